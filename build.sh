@@ -0,0 +1,13 @@
+#!/bin/sh
+# Linux counterpart of build.bat: needs the Vulkan headers and loader, glslc, and the X11 or Wayland
+# development packages GLFW builds against. The shaders are compiled as part of the build.
+
+set -e
+
+PROJ_PATH=$(cd "$(dirname "$0")" && pwd)
+BUILD_TYPE=${1:-Debug}
+
+git -C "$PROJ_PATH" submodule update --init external/glfw external/glm external/stb external/tinyobjloader
+
+cmake -S "$PROJ_PATH" -B "$PROJ_PATH/build" -D CMAKE_BUILD_TYPE="$BUILD_TYPE"
+cmake --build "$PROJ_PATH/build" --parallel
@@ -1,4 +1,18 @@
 if not exist "%cd%/shader" mkdir "%cd%/shader"
 
 %VULKAN_SDK%/Bin/glslc sandbox/shader/shader.vert -o shader/vert.spv
-%VULKAN_SDK%/Bin/glslc sandbox/shader/shader.frag -o shader/frag.spv
\ No newline at end of file
+%VULKAN_SDK%/Bin/glslc sandbox/shader/shader.frag -o shader/frag.spv
+%VULKAN_SDK%/Bin/glslc sandbox/shader/depth_pyramid.comp -o shader/depth_pyramid.spv
+%VULKAN_SDK%/Bin/glslc -DMULTISAMPLED sandbox/shader/depth_pyramid.comp -o shader/depth_pyramid_ms.spv
+%VULKAN_SDK%/Bin/glslc sandbox/shader/occlusion_cull.comp -o shader/cull_early.spv
+%VULKAN_SDK%/Bin/glslc -DLATE sandbox/shader/occlusion_cull.comp -o shader/cull_late.spv
+%VULKAN_SDK%/Bin/glslc sandbox/shader/cluster_cull.comp -o shader/cluster_cull.spv
+%VULKAN_SDK%/Bin/glslc sandbox/shader/particles.comp -o shader/particle_sim.spv
+%VULKAN_SDK%/Bin/glslc -DEMIT sandbox/shader/particles.comp -o shader/particle_emit.spv
+%VULKAN_SDK%/Bin/glslc sandbox/shader/particle.vert -o shader/particle_vert.spv
+%VULKAN_SDK%/Bin/glslc sandbox/shader/particle.frag -o shader/particle_frag.spv
+%VULKAN_SDK%/Bin/glslc sandbox/shader/bloom_down.comp -o shader/bloom_down.spv
+%VULKAN_SDK%/Bin/glslc -DPREFILTER sandbox/shader/bloom_down.comp -o shader/bloom_prefilter.spv
+%VULKAN_SDK%/Bin/glslc sandbox/shader/bloom_up.comp -o shader/bloom_up.spv
+%VULKAN_SDK%/Bin/glslc sandbox/shader/tonemap.comp -o shader/tonemap.spv
+%VULKAN_SDK%/Bin/glslc sandbox/shader/fxaa.comp -o shader/fxaa.spv
\ No newline at end of file
@@ -0,0 +1,35 @@
+# cmake -D SPIRV_DIR=<dir> -D NAMES=<a.spv,b.spv,...> -D OUTPUT=<file> -P embed_spirv.cmake
+#
+# Writes every SPIR-V binary as an aligned constexpr array of words, plus the embedded_shaders table that
+# embedded_shaders.cpp looks them up in, keyed by the name the asset pack would store the file under.
+
+string(REPLACE "," ";" NAMES "${NAMES}")
+
+set(_arrays "")
+set(_table "")
+
+foreach(_name IN LISTS NAMES)
+  file(READ ${SPIRV_DIR}/${_name} _hex HEX)
+  string(LENGTH "${_hex}" _length)
+  math(EXPR _remainder "${_length} % 8")
+
+  if(_length EQUAL 0 OR NOT _remainder EQUAL 0)
+    message(FATAL_ERROR "${_name} is not a whole number of SPIR-V words")
+  endif()
+
+  # glslc writes little endian words, the bytes are turned around to spell them as literals
+  string(REGEX REPLACE "([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])" "0x\\4\\3\\2\\1, " _words "${_hex}")
+
+  # eight words to a line, CMake's regular expressions have no {n}
+  set(_word "0x[0-9a-f]+, ")
+  string(REGEX REPLACE "(${_word}${_word}${_word}${_word}${_word}${_word}${_word}${_word})" "\\1\n\t" _words "${_words}")
+  string(REGEX REPLACE " \n" "\n" _words "${_words}")
+  string(REGEX REPLACE "[ \t\n]+$" "" _words "${_words}")
+
+  string(MAKE_C_IDENTIFIER "${_name}" _identifier)
+
+  string(APPEND _arrays "alignas(4) constexpr uint32_t ${_identifier}[] =\n{\n\t${_words}\n};\n\n")
+  string(APPEND _table "\t{ \"shader/${_name}\", ${_identifier}, sizeof(${_identifier}) },\n")
+endforeach()
+
+file(WRITE ${OUTPUT} "// generated from ${SPIRV_DIR} by embed_spirv.cmake, do not edit\n\n${_arrays}constexpr embedded_shader embedded_shaders[] =\n{\n${_table}};\n")
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+
+namespace sandbox
+{
+	namespace asset
+	{
+		/*
+		Pack layout, all offsets are relative to the start of the file:
+
+			pack_header | pack_entry[entry_count] | name table | payload | payload | ...
+
+		The table of contents is sorted by name hash so lookups are a binary search. Every payload
+		starts on an entry_alignment boundary, which means SPIR-V words, vertex and index data can be
+		handed to Vulkan straight out of the mapping without an intermediate copy.
+		*/
+		constexpr uint32_t pack_magic = 0x4B504253; // "SBPK"
+		constexpr uint32_t pack_version = 3;
+		constexpr uint64_t entry_alignment = 64;
+
+		enum entry_flags : uint32_t
+		{
+			ENTRY_RAW = 0,
+			ENTRY_LZ4 = 1 << 0
+		};
+
+		struct pack_header
+		{
+			uint32_t	magic;
+			uint32_t	version;
+			uint32_t	entry_count;
+			uint32_t	names_size;
+			uint64_t	toc_offset;
+			uint64_t	names_offset;
+		};
+
+		struct pack_entry
+		{
+			uint64_t	name_hash;
+			uint32_t	name_offset;
+			uint32_t	name_length;
+			uint64_t	offset;
+			uint64_t	stored_size;	// bytes in the file
+			uint64_t	size;			// bytes after decompression
+			uint32_t	flags;
+			uint32_t	reserved;
+		};
+
+		constexpr uint32_t max_mesh_lods = 8;
+
+		// a range of the index stream, and the meshlets that cover exactly that range
+		struct mesh_lod
+		{
+			uint32_t	first_index;
+			uint32_t	index_count;
+			float		error;			// how far the surface moved from the full mesh, in model units
+			uint32_t	first_meshlet;
+			uint32_t	meshlet_count;
+			uint32_t	reserved[3];
+		};
+
+		/*
+		A cluster of at most 64 vertices and 124 triangles, stored as a contiguous range of the index stream.
+		Laid out as std430 wants it, so the stream is uploaded to a storage buffer as is.
+		*/
+		struct mesh_meshlet
+		{
+			float		center[3];		// bounding sphere, model space
+			float		radius;
+			float		cone_axis[3];	// the triangles face away from any eye behind the cone, see the packer
+			float		cone_cutoff;
+			uint32_t	first_index;
+			uint32_t	index_count;
+			uint32_t	reserved[2];
+		};
+
+		/*
+		Baked meshes are stored as a mesh_header followed by the vertex, index and meshlet streams, each
+		aligned to entry_alignment within the entry. The vertex stream uses the vulkan::vertex layout.
+		The index stream holds every LOD back to back, finest first, all indexing the one vertex stream.
+		Meshlets are optional, meshlet_count is zero when the packer was told not to build them.
+		*/
+		struct mesh_header
+		{
+			uint32_t	vertex_count;
+			uint32_t	index_count;		// all LODs together
+			uint32_t	vertex_stride;
+			uint32_t	index_size;
+			uint64_t	vertex_offset;
+			uint64_t	index_offset;
+			uint64_t	meshlet_offset;
+			uint32_t	meshlet_count;		// all LODs together
+			uint32_t	lod_count;
+			mesh_lod	lods[max_mesh_lods];
+		};
+
+		struct view
+		{
+			const uint8_t*	data{ nullptr };
+			size_t			size{ 0 };
+
+			explicit operator bool() const { return nullptr != data; }
+
+			template<typename T>
+			const T* as(size_t offset = 0) const { return reinterpret_cast<const T*>(data + offset); }
+		};
+
+		uint64_t hash_name(std::string_view name);
+
+		class pack
+		{
+		public:
+
+			pack() = default;
+			~pack();
+
+			pack(const pack&) = delete;
+			pack& operator=(const pack&) = delete;
+
+			void open(const std::string& path);
+			void close();
+
+			bool is_open() const { return nullptr != base; }
+
+			const pack_entry* find(std::string_view name) const;
+
+			// Returns a view into the mapping, or into a decompressed copy for LZ4 entries.
+			view read(std::string_view name);
+
+			std::string_view name_of(const pack_entry& entry) const;
+
+		private:
+
+			const uint8_t*		base{ nullptr };
+			size_t				mapped_size{ 0 };
+
+			const pack_header*	header{ nullptr };
+			const pack_entry*	entries{ nullptr };
+
+			std::unordered_map<const pack_entry*, std::vector<uint8_t>> decompressed;
+		};
+
+		class pack_writer
+		{
+		public:
+
+			// Compression is only kept when LZ4 support is compiled in and it actually saves space.
+			void add(const std::string& name, std::vector<uint8_t> data, bool compress);
+
+			void write(const std::string& path) const;
+
+		private:
+
+			struct pending
+			{
+				std::string				name;
+				std::vector<uint8_t>	stored;
+				uint64_t				size;
+				uint32_t				flags;
+			};
+
+			std::vector<pending> items;
+		};
+	}
+}
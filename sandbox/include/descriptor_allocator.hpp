@@ -0,0 +1,147 @@
+#pragma once
+
+#include "vk_sandbox.hpp"
+
+#include <cstddef>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+namespace sandbox
+{
+	namespace vulkan
+	{
+		/*
+		Descriptor sets come from two places. Sets that only live for one frame come from a frame slot's
+		allocator, which grows by another pool whenever the current one runs out and is reset wholesale with
+		vkResetDescriptorPool once the slot's submission has retired: no set is ever freed on its own. Sets whose
+		contents repeat from frame to frame go through the cache, which hands back the set it wrote the first
+		time those exact contents were asked for.
+		*/
+		namespace descriptors
+		{
+			// the most bindings one set may have, write() builds its VkWriteDescriptorSets on the stack
+			constexpr uint32_t max_bindings = 16;
+
+			/*
+			Writes every descriptor of a set from one packed struct in a single vkUpdateDescriptorSetWithTemplate call,
+			instead of a VkWriteDescriptorSet per binding. The template is generated from the same
+			VkDescriptorSetLayoutBinding array the layout was created from, and the struct it reads mirrors that
+			array: in binding order, descriptorCount infos per binding, a VkDescriptorBufferInfo for buffer types, a
+			VkDescriptorImageInfo for image and sampler types and a VkBufferView for texel buffers. All three are
+			a multiple of 8 bytes, so a plain struct of them has no padding between members and create() checks
+			that the struct's size is the one the bindings work out to.
+			*/
+			class update_template
+			{
+			public:
+
+				void create(VkDescriptorSetLayout layout, const VkDescriptorSetLayoutBinding* bindings, uint32_t count,
+					size_t packed_size);
+
+				void destroy();
+
+				// every descriptor of the set in one call
+				void update(VkDescriptorSet set, const void* packed) const;
+
+				// the same through one VkWriteDescriptorSet per binding, what the template replaces
+				void write(VkDescriptorSet set, const void* packed) const;
+
+				// over the info fields only, the padding at the end of a VkDescriptorImageInfo is never read
+				size_t hash(const void* packed) const;
+				bool equal(const void* a, const void* b) const;
+
+				// what one set of the layout needs from a pool
+				std::vector<VkDescriptorPoolSize> pool_sizes() const;
+
+				VkDescriptorSetLayout layout() const { return set_layout; }
+
+				size_t size() const { return packed_bytes; }
+
+			private:
+
+				std::vector<VkDescriptorUpdateTemplateEntry>	entries;		// by binding, offsets into the packed struct
+				VkDescriptorUpdateTemplate						handle{ VK_NULL_HANDLE };
+				VkDescriptorSetLayout							set_layout{ VK_NULL_HANDLE };
+				size_t											packed_bytes{ 0 };
+			};
+
+			// updates per second for sets of the template's layout, written with vkUpdateDescriptorSets and with the template
+			void benchmark(std::ostream& out, const update_template& tmpl, const void* packed, uint32_t set_count = 1024);
+
+			class allocator
+			{
+			public:
+
+				/*
+				per_set is what one set of the expected layouts needs, every pool holds sets_per_pool of those to
+				begin with and each pool added after running out holds twice as many as the last.
+				*/
+				void init(const std::vector<VkDescriptorPoolSize>& per_set, uint32_t sets_per_pool);
+
+				VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+
+				// every set allocated since the last reset becomes invalid, the pools stay
+				void reset();
+
+				void destroy();
+
+				uint32_t pools() const { return static_cast<uint32_t>(pool_list.size()); }
+
+				uint64_t allocations() const { return allocated; }
+
+				// pools that had to be added because the ones before were full
+				uint64_t growths() const { return grown; }
+
+			private:
+
+				VkDescriptorPool create_pool(uint32_t sets);
+
+				std::vector<VkDescriptorPoolSize>	ratios;
+				uint32_t							next_sets{ 0 };
+
+				std::vector<VkDescriptorPool>		pool_list;
+				size_t								current{ 0 };
+
+				uint64_t							allocated{ 0 };
+				uint64_t							grown{ 0 };
+			};
+
+			class cache
+			{
+			public:
+
+				void init(const std::vector<VkDescriptorPoolSize>& per_set, uint32_t sets_per_pool);
+
+				// a set of the template's layout with exactly these contents, written on the first request and reused after that
+				VkDescriptorSet get(const update_template& tmpl, const void* packed);
+
+				/*
+				Every cached set dies with the pools. Sets hold raw handles, so once anything they reference is
+				destroyed the cache has to go too, the same way as the resources, once no frame uses it any more.
+				*/
+				void destroy();
+
+				uint64_t hits() const { return hit_count; }
+				uint64_t misses() const { return miss_count; }
+
+				const allocator& pools() const { return sets; }
+
+			private:
+
+				struct entry
+				{
+					VkDescriptorSetLayout	layout;
+					std::vector<std::byte>	contents;		// the packed struct it was written from
+					VkDescriptorSet			set;
+				};
+
+				allocator								sets;
+				std::unordered_multimap<size_t, entry>	entries;	// by hash of layout and contents
+
+				uint64_t								hit_count{ 0 };
+				uint64_t								miss_count{ 0 };
+			};
+		}
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory_resource>
+#include <ostream>
+
+namespace sandbox
+{
+	namespace vulkan
+	{
+		/*
+		Draws are ordered by one 64 bit key per draw. The fields are packed most significant first in the order
+		state changes cost: the pass, then the pipeline, the descriptor set (the material) and the mesh, with the
+		view depth in the low bits so draws that share all of their state go front to back.
+
+			63   60 59        48 47        36 35        24 23                 0
+			| pass | pipeline   | material   | mesh       | depth              |
+		*/
+		namespace sort
+		{
+			constexpr uint32_t pass_shift = 60;
+			constexpr uint32_t pipeline_shift = 48;
+			constexpr uint32_t material_shift = 36;
+			constexpr uint32_t mesh_shift = 24;
+
+			constexpr uint32_t depth_bits = 24;
+
+			// depth is normalized to [0, 1] between the near and far plane, anything outside is clamped
+			inline uint64_t make_key(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth)
+			{
+				const float clamped = depth > 0.f ? (depth < 1.f ? depth : 1.f) : 0.f;
+				const uint64_t d = static_cast<uint64_t>(clamped * static_cast<float>((1u << depth_bits) - 1));
+
+				return (uint64_t(pass & 0xF) << pass_shift) | (uint64_t(pipeline & 0xFFF) << pipeline_shift) |
+					(uint64_t(material & 0xFFF) << material_shift) | (uint64_t(mesh & 0xFFF) << mesh_shift) | d;
+			}
+
+			inline uint32_t key_pass(uint64_t key) { return static_cast<uint32_t>(key >> pass_shift) & 0xF; }
+			inline uint32_t key_pipeline(uint64_t key) { return static_cast<uint32_t>(key >> pipeline_shift) & 0xFFF; }
+			inline uint32_t key_material(uint64_t key) { return static_cast<uint32_t>(key >> material_shift) & 0xFFF; }
+			inline uint32_t key_mesh(uint64_t key) { return static_cast<uint32_t>(key >> mesh_shift) & 0xFFF; }
+
+			/*
+			Stable LSD radix sort, a byte per pass, keys ascending with values moved along. Bytes that are the same
+			in every key are skipped, which with a handful of passes and pipelines is most of the upper half. Large
+			lists are split across worker threads: every thread counts its slice, the counts are turned into
+			per thread offsets, and every thread scatters its slice, which keeps the sort stable.
+
+			The ping pong buffers come from scratch. threads = 0 picks the hardware's count.
+			*/
+			void radix_sort(uint64_t* keys, uint32_t* values, size_t count, std::pmr::memory_resource* scratch,
+				unsigned threads = 0);
+
+			// sorting count random draws with std::stable_sort and with the radix sort on one thread and on all of them
+			void benchmark(std::ostream& out, size_t count = 100000);
+		}
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "asset_pack.hpp"
+
+#include <cstdint>
+#include <string_view>
+
+namespace sandbox
+{
+	namespace vulkan
+	{
+		/*
+		SPIR-V compiled into the executable at build time, under the same names the asset pack stores it under.
+		The arrays are constexpr words, so loading a shader is a table lookup: no file to open, map or
+		decompress, and nothing that can be missing at runtime. Builds without SANDBOX_EMBED_SHADERS, and runs
+		that turn embedding off to compare, read the pack as before.
+		*/
+		namespace spirv
+		{
+			struct load_stats
+			{
+				uint32_t	embedded{ 0 };
+				uint32_t	packed{ 0 };
+				double		ms{ 0.0 };		// spent looking up, reading and decompressing
+			};
+
+			bool has_embedded();
+
+			void use_embedded(bool enabled);
+
+			// the embedded copy when there is one and it is in use, otherwise the pack's, which throws when missing
+			asset::view load(asset::pack& pack, std::string_view name);
+
+			const load_stats& stats();
+		}
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+namespace sandbox
+{
+	namespace memory
+	{
+		/*
+		Bump allocator for data that lives exactly one frame: draw lists, sort keys, barrier arrays. Allocating
+		is a pointer increment, deallocating does nothing, and reset() hands everything back at once by rewinding
+		to the first block. Blocks are kept across resets, so once the arena has grown to a frame's high water it
+		never touches the heap again.
+
+		It is a std::pmr::memory_resource, so std::pmr containers use it unchanged. The containers must not
+		outlive the next reset, which for the per frame arenas is when the frame slot's submission retires.
+		*/
+		class frame_arena : public std::pmr::memory_resource
+		{
+		public:
+
+			explicit frame_arena(size_t block_size = 64 * 1024,
+				std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+			~frame_arena() override;
+
+			frame_arena(const frame_arena&) = delete;
+			frame_arena& operator=(const frame_arena&) = delete;
+
+			// O(1), nothing allocated since the last reset may be used afterwards
+			void reset();
+
+			size_t used() const { return bytes_used; }
+			size_t high_water() const { return peak_bytes; }
+			size_t capacity() const { return capacity_bytes; }
+
+			// blocks taken from upstream, flat once the arena has warmed up
+			uint64_t upstream_allocations() const { return block_allocations; }
+
+		private:
+
+			void* do_allocate(size_t bytes, size_t alignment) override;
+			void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+			bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+			struct block
+			{
+				std::byte*	data;
+				size_t		size;
+			};
+
+			std::pmr::memory_resource*	upstream;
+			size_t						block_size;
+
+			std::vector<block>			blocks;
+			size_t						current{ 0 };		// block being bumped through
+			size_t						offset{ 0 };		// into blocks[current]
+
+			size_t						bytes_used{ 0 };
+			size_t						peak_bytes{ 0 };
+			size_t						capacity_bytes{ 0 };
+			uint64_t					block_allocations{ 0 };
+		};
+
+		/*
+		Every global operator new since startup. The replacement operators only count, so the number covers
+		everything the C++ side allocates, including the standard library, but not what drivers allocate.
+		*/
+		uint64_t heap_allocations();
+	}
+}
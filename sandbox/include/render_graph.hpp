@@ -0,0 +1,231 @@
+#pragma once
+
+#include "vk_sandbox.hpp"
+
+#include <functional>
+#include <memory_resource>
+#include <ostream>
+#include <string>
+
+namespace sandbox
+{
+	namespace vulkan
+	{
+		/*
+		Passes declare which images and buffers they read and write and how. From that the graph works out
+		the layout transitions and the smallest set of pipeline barriers between passes, merges all barriers
+		a pass needs into a single vkCmdPipelineBarrier, drops passes whose results nobody consumes, and lets
+		transient images whose lifetimes do not overlap share one memory allocation.
+		*/
+		namespace rg
+		{
+			using resource_id = uint32_t;
+
+			constexpr resource_id invalid_resource = ~0u;
+
+			enum class usage
+			{
+				color_attachment,
+				depth_attachment,			// depth test and write
+				depth_read_only,			// depth test without write
+				resolve_attachment,
+				fragment_sampled,
+				compute_sampled,
+				compute_storage_read,
+				compute_storage_write,
+				compute_storage_read_write,
+				transfer_src,
+				transfer_dst,
+				indirect_read,
+				vertex_read,
+				vertex_storage_read,		// a storage buffer the vertex shader reads
+				index_read,
+				uniform_read,
+				host_read,
+				present
+			};
+
+			struct resource_state
+			{
+				VkImageLayout			layout{ VK_IMAGE_LAYOUT_UNDEFINED };
+				VkPipelineStageFlags	stages{ VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT };
+				VkAccessFlags			access{ 0 };
+				bool					write{ false };
+			};
+
+			resource_state state_for(usage u);
+
+			// the canonical stages and accesses an image in this layout is used with
+			resource_state state_for_layout(VkImageLayout layout);
+
+			struct image_desc
+			{
+				VkFormat				format{ VK_FORMAT_UNDEFINED };
+				VkExtent2D				extent{ 0, 0 };
+				uint32_t				mip_levels{ 1 };
+				VkSampleCountFlagBits	samples{ VK_SAMPLE_COUNT_1_BIT };
+				VkImageUsageFlags		usage{ 0 };
+				VkImageAspectFlags		aspect{ VK_IMAGE_ASPECT_COLOR_BIT };
+			};
+
+			class render_graph;
+
+			using execute_fn = std::function<void(VkCommandBuffer cmd, uint32_t image_index)>;
+
+			class pass_builder
+			{
+			public:
+
+				pass_builder& read(resource_id id, usage u);
+				pass_builder& write(resource_id id, usage u);
+
+				// keep the pass even if nothing reads what it writes (readbacks, queries)
+				pass_builder& side_effects();
+
+			private:
+
+				friend class render_graph;
+
+				pass_builder(render_graph& g, uint32_t pass) : graph(g), index(pass) {}
+
+				render_graph&	graph;
+				uint32_t		index;
+			};
+
+			class render_graph
+			{
+			public:
+
+				// externally owned, bound with bind_image before every execute
+				resource_id import_image(const std::string& name, VkImageAspectFlags aspect, resource_state initial);
+				resource_id import_buffer(const std::string& name, resource_state initial = {});
+
+				// graph owned, allocated at compile time and possibly aliased with other transients
+				resource_id create_image(const std::string& name, const image_desc& desc);
+
+				pass_builder add_pass(const std::string& name, execute_fn execute);
+
+				// state the resource is left in once the graph has executed, e.g. present for the swap chain
+				void set_final_usage(resource_id id, usage u);
+
+				void compile();
+
+				void bind_image(resource_id id, VkImage image, VkImageView view);
+				void bind_buffer(resource_id id, VkBuffer buffer);
+
+				/*
+				frame_slot selects the timestamp queries, it must cycle through max_frames_in_flight values. The
+				barrier arrays and timestamp readback are built in scratch, which only has to last the call.
+				*/
+				void execute(VkCommandBuffer cmd, uint32_t frame_slot, uint32_t image_index, std::pmr::memory_resource* scratch);
+
+				VkImage image(resource_id id) const;
+				VkImageView view(resource_id id) const;
+				VkBuffer buffer(resource_id id) const;
+
+				void dump_timings(std::ostream& out) const;
+
+				// average GPU time of the named pass, 0 when it was culled or never timed
+				double average_ms(const std::string& pass) const;
+
+				// starts the averages over, once a benchmark has warmed up for instance
+				void reset_timings();
+
+				// false when the graphics queue has no timestamps
+				bool timed() const { return VK_NULL_HANDLE != query_pool; }
+
+				VkDeviceSize transient_memory() const { return transient_bytes; }
+
+				void destroy();
+
+			private:
+
+				friend class pass_builder;
+
+				struct resource
+				{
+					std::string				name;
+					bool					is_image{ true };
+					bool					imported{ true };
+					image_desc				desc;
+					resource_state			initial;
+					std::optional<usage>	final_usage;
+
+					VkImage					img{ VK_NULL_HANDLE };
+					VkImageView				img_view{ VK_NULL_HANDLE };
+					VkBuffer				buf{ VK_NULL_HANDLE };
+
+					// lifetime in compiled pass order, used for aliasing
+					uint32_t				first_use{ ~0u };
+					uint32_t				last_use{ 0 };
+					uint32_t				memory_slot{ ~0u };
+				};
+
+				struct access
+				{
+					resource_id				id;
+					usage					u;
+				};
+
+				struct pass
+				{
+					std::string				name;
+					execute_fn				execute;
+					std::vector<access>		reads;
+					std::vector<access>		writes;
+					bool					has_side_effects{ false };
+					bool					culled{ false };
+				};
+
+				struct barrier
+				{
+					resource_id				id;
+					resource_state			src;
+					resource_state			dst;
+				};
+
+				struct batch
+				{
+					std::vector<barrier>	barriers;
+				};
+
+				struct memory_slot
+				{
+					VkDeviceMemory			memory{ VK_NULL_HANDLE };
+					VkDeviceSize			size{ 0 };
+					uint32_t				type_bits{ ~0u };
+					std::vector<resource_id> occupants;
+				};
+
+				struct timing
+				{
+					double					total_ms{ 0.0 };
+					uint64_t				samples{ 0 };
+				};
+
+				void cull();
+				void schedule_barriers();
+				void allocate_transients();
+				void create_queries();
+				void collect_timings(uint32_t frame_slot, std::pmr::memory_resource* scratch);
+				void record_batch(VkCommandBuffer cmd, const batch& b, std::pmr::memory_resource* scratch) const;
+
+				std::vector<resource>		resources;
+				std::vector<pass>			passes;
+				std::vector<uint32_t>		order;			// live passes
+				std::vector<batch>			pass_barriers;	// one per live pass
+				batch						final_barriers;
+				std::vector<memory_slot>	slots;
+				VkDeviceSize				transient_bytes{ 0 };
+
+				VkQueryPool					query_pool{ VK_NULL_HANDLE };
+				float						timestamp_period{ 0.f };
+				std::vector<bool>			queries_written;
+				std::vector<timing>			timings;
+			};
+		}
+
+		// the renderer's frame, rebuilt with the swap chain
+		extern rg::render_graph frame_graph;
+	}
+}
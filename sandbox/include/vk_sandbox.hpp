@@ -1,8 +1,8 @@
-#define VK_USE_PLATFORM_WIN32_KHR
+#pragma once
+
+// the surface comes from glfwCreateWindowSurface, no platform specific Vulkan or GLFW headers needed
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
-#define GLFW_EXPOSE_NATIVE_WIN32
-#include <GLFW/glfw3native.h>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -16,10 +16,51 @@
 #include <iostream>
 #include <vector>
 #include <optional>
+#include <string>
 #include <array>
+#include <mutex>
+#include <functional>
+#include <memory_resource>
+
+// parenthesised so that !OP_SUCCESS(x) negates the comparison and not VK_SUCCESS
+#define OP_SUCCESS(X) (VK_SUCCESS == (X))
 
 namespace sandbox
 {
+	// command line options, parsed once before the app starts
+	struct options
+	{
+		uint32_t	msaa_samples{ 1 };		// clamped to what the device supports
+		uint32_t	object_count{ 1 };		// copies of the model, laid out on a grid
+		bool		depth_prepass{ false };
+		bool		sort_front_to_back{ true };
+		bool		occlusion_culling{ false };		// two phase Hi-Z culling, needs a sampleable depth buffer
+		bool		compact_vertices{ false };		// quantized 20 byte vertices instead of full precision floats
+		bool		lod{ true };					// pick a LOD per object by projected error, otherwise always LOD0
+		float		lod_pixel_error{ 1.f };			// largest error a LOD may show on screen, in pixels
+		bool		cluster_culling{ false };		// per meshlet frustum and backface culling in compute
+		VkPresentModeKHR	present_mode{ VK_PRESENT_MODE_MAILBOX_KHR };	// what is asked for, FIFO when the surface lacks it
+		float		target_fps{ 0.f };				// paced frame rate, 0 leaves the pacing to the present mode
+		bool		descriptor_cache{ true };		// reuse sets with identical contents, otherwise write one every frame
+		bool		sort_benchmark{ false };		// time the draw sort on 100k draws and exit
+		bool		descriptor_benchmark{ false };	// time descriptor writes against update templates and exit
+		bool		async_compute{ true };			// compute that does not depend on the frame's rendering on its own queue
+		uint32_t	particle_count{ 0 };			// GPU simulated particles, 0 leaves the particle system out
+		bool		particle_benchmark{ false };	// time the particle simulation and exit
+		std::string	device;							// index or part of the name, empty picks the best scoring device
+		bool		packed_shaders{ false };		// read SPIR-V from the asset pack even when it is embedded
+		bool		post_processing{ true };		// HDR target, bloom, tonemap and FXAA, otherwise straight to the swap chain
+		bool		post_benchmark{ false };		// time the post chain at 1080p and 4K and exit
+		float		post_budget_ms{ 2.f };			// what the whole post chain may cost on the GPU
+		uint32_t	capture_frame{ 0 };				// frame written to capture_path and exit, counted from 1, 0 captures nothing
+		std::string	capture_path{ "capture.png" };
+		bool		fixed_step{ false };			// animation advances a fixed step per frame instead of with the clock
+	};
+
+	extern options settings;
+
+	void parse_options(int argc, char** argv);
+
 	class app
 	{
 	public:
@@ -33,6 +74,8 @@ namespace sandbox
 		static constexpr unsigned RES_WIDTH = 1280;
 		static constexpr unsigned RES_HEIGHT = 720;
 
+		static constexpr const char* ASSET_PACK = "assets.pak";
+
 		void initialize();
 		void app_loop();
 		void cleanup();
@@ -40,8 +83,22 @@ namespace sandbox
 
 	namespace vulkan
 	{
+		constexpr unsigned max_frames_in_flight = 2;
+
+		namespace rg
+		{
+			class render_graph;
+
+			using resource_id = uint32_t;
+		}
+
+		struct post_chain;
+
 		extern bool fb_resized;
 
+		extern VkPhysicalDevice pd;
+		extern VkDevice dev;
+
 		namespace debug
 		{
 			bool check_validation_layer_support();
@@ -78,6 +135,8 @@ namespace sandbox
 
 			VkSurfaceFormatKHR choose_swap_surface_fmt(const std::vector<VkSurfaceFormatKHR>& available_fmts);
 
+			const char* present_mode_name(VkPresentModeKHR mode);
+
 			VkPresentModeKHR choose_swap_present_mode(const std::vector<VkPresentModeKHR>& available_modes);
 
 			VkExtent2D choose_swap_extent(const VkSurfaceCapabilitiesKHR& capabilities);
@@ -92,13 +151,145 @@ namespace sandbox
 
 			void update_ubo(uint32_t curr_img);
 
+			// sleeps until the next frame should start, called before input is polled
+			void pace_frame();
+
 			void draw_frame();
 		}
 
+		enum shading_mode : uint32_t
+		{
+			SHADING_TEXTURED = 0,
+			SHADING_TEXCOORDS,
+			SHADING_VERTEX_COLOR,
+			SHADING_NORMALS,
+			SHADING_MODE_COUNT
+		};
+
+		enum vertex_format : uint32_t
+		{
+			VERTEX_FULL = 0,				// vulkan::vertex, as baked in the pack
+			VERTEX_COMPACT,					// vulkan::compact_vertex, quantized at load time
+			VERTEX_FORMAT_COUNT
+		};
+
+		// mirrors the constant_id layout in shader.vert
+		struct vertex_constants
+		{
+			uint32_t vertex_format{ VERTEX_FULL };
+		};
+
+		// mirrors the constant_id layout in shader.frag
+		struct fragment_constants
+		{
+			uint32_t shading_mode{ SHADING_TEXTURED };
+		};
+
+		/*
+		Mirrors ObjectData in shader.vert and occlusion_cull.comp, std430 pads it to 96 bytes. Objects are
+		uploaded in draw order and each draw's firstInstance indexes this array, which is what lets indirect
+		draws written by the GPU find their transform without a push constant per draw.
+		*/
+		struct object_data
+		{
+			glm::mat4	model;
+			glm::vec4	sphere;			// world space bounds, xyz center and w radius
+			uint32_t	id;				// index into the scene, stable while the draw order changes
+			uint32_t	first_index;	// this frame's LOD, a range of the shared index buffer
+			uint32_t	index_count;
+			uint32_t	lod;
+		};
+
+		static_assert(sizeof(object_data) == 96, "object_data no longer matches the std430 layout");
+
+		/*
+		Everything descriptor_set_layout's bindings point at, in binding order, which is the packed form its update
+		template reads: a whole set is written from one of these in one call.
+		*/
+		struct scene_descriptors
+		{
+			VkDescriptorBufferInfo	ubo;			// binding 0
+			VkDescriptorImageInfo	texture;		// binding 1
+			VkDescriptorBufferInfo	objects;		// binding 2
+		};
+
+		// the same for the particle pipeline's set
+		struct particle_descriptors
+		{
+			VkDescriptorBufferInfo	ubo;			// binding 0
+			VkDescriptorBufferInfo	draws;			// binding 1, the frame slot's draw list
+		};
+
+		/*
+		Which part of the depth setup a pipeline is built for. With a prepass, subpass 0 lays down depth with a
+		vertex only pipeline and subpass 1 shades with an EQUAL test, so every pixel runs the fragment shader once.
+		*/
+		enum geometry_pass : uint32_t
+		{
+			GEOMETRY_FORWARD = 0,			// single subpass, LESS test and depth writes
+			GEOMETRY_DEPTH_ONLY,			// prepass, no fragment shader and no color attachments
+			GEOMETRY_AFTER_PREPASS			// EQUAL test, depth read only
+		};
+
+		/*
+		Everything that selects a distinct graphics pipeline. Shader options are specialization constants,
+		so the driver compiles the untaken branches away instead of the fragment shader branching per pixel.
+		*/
+		struct pipeline_variant
+		{
+			vertex_constants		vert;
+			fragment_constants		frag;
+			VkSampleCountFlagBits	samples{ VK_SAMPLE_COUNT_1_BIT };
+			geometry_pass			pass{ GEOMETRY_FORWARD };
+
+			bool operator==(const pipeline_variant& o) const
+			{
+				return vert.vertex_format == o.vert.vertex_format && frag.shading_mode == o.frag.shading_mode &&
+					samples == o.samples && pass == o.pass;
+			}
+		};
+
+		struct pipeline_variant_hash
+		{
+			size_t operator()(const pipeline_variant& v) const
+			{
+				return (static_cast<size_t>(v.vert.vertex_format) << 24) ^ (static_cast<size_t>(v.pass) << 16) ^
+					(static_cast<size_t>(v.frag.shading_mode) << 8) ^ static_cast<size_t>(v.samples);
+			}
+		};
+
+		extern pipeline_variant active_variant;
+
+		/*
+		Watches the GLSL sources, recompiles edited stages to SPIR-V with shaderc on a worker thread and
+		builds a replacement graphics pipeline there as well. The render loop only picks the finished
+		pipeline up at a frame boundary, so an edit never stalls a frame.
+		*/
+		namespace hot_reload
+		{
+			// held while a pipeline is built against, or while the swap chain replaces, the render pass
+			extern std::mutex pipeline_mutex;
+
+			void start(const char* shader_dir);
+
+			void stop();
+
+			bool current_spirv(VkShaderStageFlagBits stage, std::vector<uint32_t>& code);
+
+			// the variant the worker rebuilds when a shader changes
+			void track_variant(const pipeline_variant& variant);
+
+			VkPipeline take_pipeline(pipeline_variant& variant);
+
+			void invalidate();
+		}
+
 		struct queue_family_indices
 		{
 			std::optional<unsigned> graphics_family;
 			std::optional<unsigned> present_family;
+			std::optional<unsigned> compute_family;
+			std::optional<unsigned> async_compute_family;		// compute without graphics, runs beside the graphics queue
 
 			bool is_complete()
 			{
@@ -106,11 +297,37 @@ namespace sandbox
 			}
 		};
 
-		struct vertex
+		/*
+		A vertex layout is described once, as the list of its attributes in shader location order, and the stride,
+		the offsets and the Vulkan input descriptions are all derived from that list at compile time. Attributes are
+		tightly packed; the static_asserts after each layout check that the C++ struct agrees with its description.
+		*/
+		template<typename T, VkFormat Format>
+		struct attribute
 		{
-			glm::vec3 position;
-			glm::vec3 color;
-			glm::vec2 tex_coord;
+			using type = T;
+			static constexpr VkFormat format = Format;
+		};
+
+		template<typename... Attributes>
+		struct vertex_layout
+		{
+			static constexpr uint32_t attribute_count = sizeof...(Attributes);
+			static constexpr uint32_t stride = (0u + ... + static_cast<uint32_t>(sizeof(typename Attributes::type)));
+
+			static constexpr uint32_t offset(uint32_t location)
+			{
+				constexpr uint32_t sizes[] = { static_cast<uint32_t>(sizeof(typename Attributes::type))... };
+
+				uint32_t result = 0;
+
+				for (uint32_t i = 0; i < location; i++)
+				{
+					result += sizes[i];
+				}
+
+				return result;
+			}
 
 			static VkVertexInputBindingDescription get_binding_desc()
 			{
@@ -132,53 +349,107 @@ namespace sandbox
 				We're not going to use instanced rendering, so we'll stick to per-vertex data.
 				*/
 				bind_desc.binding = 0;
-				bind_desc.stride = sizeof(vertex);
+				bind_desc.stride = stride;
 				bind_desc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
 				return bind_desc;
 			}
 
-			static std::array<VkVertexInputAttributeDescription, 3>
+			static std::array<VkVertexInputAttributeDescription, attribute_count>
 				get_attr_desc()
 			{
-				std::array<VkVertexInputAttributeDescription, 3> attr_desc{};
-
-				attr_desc[0].binding = 0;
-				attr_desc[0].location = 0;
-				attr_desc[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-				attr_desc[0].offset = offsetof(vertex, position);
+				constexpr VkFormat formats[] = { Attributes::format... };
 
-				attr_desc[1].binding = 0;
-				attr_desc[1].location = 1;
-				attr_desc[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-				attr_desc[1].offset = offsetof(vertex, color);
+				std::array<VkVertexInputAttributeDescription, attribute_count> attr_desc{};
 
-				attr_desc[2].binding = 0;
-				attr_desc[2].location = 2;
-				attr_desc[2].format = VK_FORMAT_R32G32_SFLOAT;
-				attr_desc[2].offset = offsetof(vertex, tex_coord);
+				for (uint32_t i = 0; i < attribute_count; i++)
+				{
+					attr_desc[i].binding = 0;
+					attr_desc[i].location = i;
+					attr_desc[i].format = formats[i];
+					attr_desc[i].offset = offset(i);
+				}
 
 				return attr_desc;
 			}
 		};
 
+		// full precision, the layout the packer bakes
+		struct vertex
+		{
+			glm::vec3 position;
+			glm::vec3 color;
+			glm::vec2 tex_coord;
+			glm::vec3 normal;
+
+			using layout = vertex_layout<
+				attribute<glm::vec3, VK_FORMAT_R32G32B32_SFLOAT>,
+				attribute<glm::vec3, VK_FORMAT_R32G32B32_SFLOAT>,
+				attribute<glm::vec2, VK_FORMAT_R32G32_SFLOAT>,
+				attribute<glm::vec3, VK_FORMAT_R32G32B32_SFLOAT>>;
+		};
+
+		static_assert(sizeof(vertex) == vertex::layout::stride, "vertex does not match its layout");
+		static_assert(offsetof(vertex, normal) == vertex::layout::offset(3), "vertex does not match its layout");
+
+		/*
+		Positions are 16 bit unorm within the mesh's bounding box, the model matrix carries the per mesh scale and
+		offset back, so dequantizing costs the shader nothing. The fourth position component only pads to a format
+		every device can fetch. Normals are octahedral, two snorm components decoded in shader.vert.
+		*/
+		struct compact_vertex
+		{
+			uint16_t position[4];
+			uint8_t color[4];
+			uint16_t tex_coord[2];			// half floats
+			int16_t normal[2];
+
+			using layout = vertex_layout<
+				attribute<uint16_t[4], VK_FORMAT_R16G16B16A16_UNORM>,
+				attribute<uint8_t[4], VK_FORMAT_R8G8B8A8_UNORM>,
+				attribute<uint16_t[2], VK_FORMAT_R16G16_SFLOAT>,
+				attribute<int16_t[2], VK_FORMAT_R16G16_SNORM>>;
+		};
+
+		static_assert(sizeof(compact_vertex) == compact_vertex::layout::stride, "compact_vertex does not match its layout");
+		static_assert(offsetof(compact_vertex, normal) == compact_vertex::layout::offset(3),
+			"compact_vertex does not match its layout");
+
+		// both layouts feed the same shader inputs
+		static_assert(vertex::layout::attribute_count == compact_vertex::layout::attribute_count,
+			"vertex layouts disagree on the shader inputs");
+
+		void load_assets(const char* pack_path);
+
 		void create_instance();
 
 		bool check_dev_extension_support(VkPhysicalDevice dev);
 
 		queue_family_indices find_queue_families(VkPhysicalDevice dev);
 
-		bool is_device_suitable(VkPhysicalDevice dev);
+		// what the device lacks goes to missing when it is not
+		bool is_device_suitable(VkPhysicalDevice dev, std::string* missing = nullptr);
+
+		const char* device_type_name(VkPhysicalDeviceType type);
+
+		// the largest device local heap
+		VkDeviceSize device_local_memory(VkPhysicalDevice dev);
+
+		// type first, then memory, features and limits; 0 when the device is not suitable
+		uint64_t score_device(VkPhysicalDevice dev);
+
+		void log_device_capabilities(VkPhysicalDevice dev);
 
 		void pick_physical_device();
 
 		void create_logical_device();
 
-		VkImageView create_img_view(VkImage img, VkFormat fmt, VkImageAspectFlags aspectFlags);
+		VkImageView create_img_view(VkImage img, VkFormat fmt, VkImageAspectFlags aspectFlags,
+			uint32_t base_mip = 0, uint32_t mip_count = 1);
 
 		void create_image_views();
 
-		VkShaderModule create_shader_module(const std::vector<char>& spv);
+		VkShaderModule create_shader_module(const uint32_t* code, size_t size);
 
 		void create_render_pass();
 
@@ -186,10 +457,33 @@ namespace sandbox
 
 		void create_graphics_pipeline();
 
+		VkPipeline build_graphics_pipeline(const uint32_t* vert_code, size_t vert_size,
+			const uint32_t* frag_code, size_t frag_size, const pipeline_variant& variant);
+
+		VkPipeline get_pipeline_variant(const pipeline_variant& variant);
+
+		void destroy_pipeline_variants();
+
 		void create_framebuffers();
 
 		void create_cmd_pool();
 
+		// command pool, semaphore and timestamps for the async compute queue, nothing when it falls back to graphics
+		void create_compute_resources();
+
+		void destroy_compute_resources();
+
+		/*
+		Records and submits this frame's async compute work, returns the compute timeline value the graphics
+		submission has to wait on or 0 if there was none.
+		*/
+		uint64_t submit_async_compute(uint32_t image_index);
+
+		// reads back the frame slot's compute and graphics timestamps once its submissions have retired
+		void collect_async_timings();
+
+		void report_async_compute_stats();
+
 		VkFormat find_supported_format(const std::vector<VkFormat>& candidates,
 			VkImageTiling tiling, VkFormatFeatureFlags feats);
 
@@ -199,21 +493,182 @@ namespace sandbox
 
 		uint32_t find_mem_type(uint32_t type_filter, VkMemoryPropertyFlags props);
 
-		void create_image(uint32_t tex_w, uint32_t tex_h, VkFormat fmt, VkImageTiling tiling,
-			VkImageUsageFlags usage, VkMemoryPropertyFlags props, VkImage& img, VkDeviceMemory& img_mem);
+		// returns the memory properties that were honoured, LAZILY_ALLOCATED is dropped when no type offers it
+		VkMemoryPropertyFlags create_image(uint32_t tex_w, uint32_t tex_h, VkFormat fmt, VkImageTiling tiling,
+			VkImageUsageFlags usage, VkMemoryPropertyFlags props, VkImage& img, VkDeviceMemory& img_mem,
+			VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT);
 
 		VkCommandBuffer begin_single_time_cmds();
 
 		void end_single_time_cmds(VkCommandBuffer cmd_buffer);
 
+		VkSampleCountFlagBits choose_sample_count(uint32_t requested);
+
+		// the most samples up to requested that dev renders color and depth with
+		VkSampleCountFlagBits choose_sample_count_for(VkPhysicalDevice dev, uint32_t requested);
+
+		void create_color_resources();
+
 		void create_depth_resources();
 
+		void report_msaa_stats();
+
+		void build_scene();
+
+		void update_scene(float time);
+
+		void report_depth_stats();
+
+		void create_occlusion_pipelines();
+
+		void create_occlusion_buffers();
+
+		void create_occlusion_descriptors();
+
+		void destroy_occlusion_descriptors();
+
+		void destroy_occlusion_resources();
+
+		void record_cull_pass(VkCommandBuffer cmd, uint32_t image_index, bool late);
+
+		void record_depth_pyramid(VkCommandBuffer cmd, uint32_t image_index);
+
+		void report_occlusion_stats();
+
+		// bindings 0..n-1 of a compute only set layout, one descriptor each
+		VkDescriptorSetLayout create_compute_set_layout(const std::vector<VkDescriptorType>& types);
+
+		VkPipelineLayout create_compute_pipeline_layout(VkDescriptorSetLayout set_layout, uint32_t push_size);
+
+		VkPipeline create_compute_pipeline(const char* path, VkPipelineLayout layout);
+
+		void create_cluster_pipeline();
+
+		void create_cluster_buffers();
+
+		void create_cluster_descriptors();
+
+		void destroy_cluster_descriptors();
+
+		void destroy_cluster_resources();
+
+		void record_cluster_cull(VkCommandBuffer cmd, uint32_t image_index);
+
+		void report_cluster_stats();
+
+		// the simulation's pipelines and the particle pipeline's layouts, nothing without settings.particle_count
+		void create_particle_pipelines();
+
+		// against the current render pass, recreated with the swap chain
+		void create_particle_render_pipeline();
+
+		void create_particle_buffers();
+
+		void create_particle_descriptors();
+
+		void destroy_particle_resources();
+
+		// one step of dt seconds, rebuilds the current frame slot's draw list
+		void record_particle_step(VkCommandBuffer cmd, float dt);
+
+		// a step by the time since the last one
+		void record_particle_sim(VkCommandBuffer cmd, uint32_t image_index);
+
+		// inside the scene's last subpass, additively over what the scene drew
+		void record_particles(VkCommandBuffer cmd, uint32_t image_index);
+
+		// particles simulated per millisecond once births and deaths balance, on whatever device was picked
+		void benchmark_particles();
+
+		void report_particle_stats();
+
+		// the bloom, tonemap and FXAA kernels, created once whether post processing is on or not
+		void create_post_pipelines();
+
+		// the scene's HDR color target, nothing when the frame renders straight into the swap chain
+		void create_hdr_resources();
+
+		// what the geometry passes render into
+		VkFormat scene_color_format();
+
+		/*
+		Appends the post chain to a graph: hdr is sampled, the result goes through an image of the graph's own and
+		is blitted into target, whose format says whether it encodes to sRGB by itself.
+		*/
+		void add_post_passes(rg::render_graph& graph, post_chain& chain, rg::resource_id hdr, rg::resource_id target,
+			VkFormat target_fmt, VkExtent2D extent);
+
+		// after the graph is compiled, the chain's images are graph owned
+		void create_post_descriptors(post_chain& chain, VkImageView hdr_view);
+
+		void destroy_post_descriptors(post_chain& chain);
+
+		void destroy_post_resources();
+
+		// waits for writes to one mip level before the next dispatch samples it, the rest of the image is left alone
+		void record_level_barrier(VkCommandBuffer cmd, VkImage img, uint32_t level);
+
+		void record_bloom_down(VkCommandBuffer cmd, const post_chain& chain);
+
+		void record_bloom_up(VkCommandBuffer cmd, const post_chain& chain);
+
+		void record_tonemap(VkCommandBuffer cmd, const post_chain& chain);
+
+		void record_fxaa(VkCommandBuffer cmd, const post_chain& chain);
+
+		void record_post_blit(VkCommandBuffer cmd, const post_chain& chain);
+
+		// each pass of the chain at 1080p and 4K against settings.post_budget_ms
+		void benchmark_post_processing();
+
+		void report_post_stats();
+
+		// the swap chain formats a capture converts to 8 bit RGB, all of them 4 bytes per pixel
+		bool capture_supports(VkFormat fmt);
+
+		// the host visible buffer the final image is copied into, nothing unless a capture was asked for
+		void create_capture_resources();
+
+		// collects a copy still in flight first, it would be lost with the buffer
+		void destroy_capture_resources();
+
+		// copies a swap chain image the graph has left ready to present, and leaves it that way again
+		void record_capture(VkCommandBuffer cmd, VkImage img);
+
+		/*
+		Maps the buffer once the frame holding the copy has retired and hands the pixels to a thread that writes
+		the PNG. Without wait it returns straight away while the copy is still in flight.
+		*/
+		void collect_capture(bool wait);
+
+		// waits for the PNG, throws when it could not be written or the capture frame was never drawn
+		void finish_capture();
+
+		void report_pacing_stats();
+
+		// the current frame slot's arena, std::pmr containers built from it are valid until the slot comes round again
+		std::pmr::memory_resource* frame_scratch();
+
+		void report_memory_stats();
+
+		// initialization time, and how long loading the shaders took out of it
+		void report_startup_stats();
+
+		void report_draw_stats();
+
 		void create_texture_image();
 
 		void create_tex_img_view();
 
 		void create_tex_sampler();
 
+		void load_model();
+
+		// the coarsest LOD whose error projects to at most settings.lod_pixel_error at this distance
+		uint32_t select_lod(float distance);
+
+		void report_lod_stats();
+
 		void transition_image_layout(VkImage img, VkFormat fmt, VkImageLayout old_layout, VkImageLayout new_layout);
 
 		void copy_buffer_to_img(VkBuffer buffer, VkImage img, uint32_t w, uint32_t h);
@@ -224,18 +679,55 @@ namespace sandbox
 
 		void copy_buffer(VkBuffer src, VkBuffer dst, VkDeviceSize size);
 
+		// fills out with the compact layout and returns the matrix that maps its positions back to model space
+		glm::mat4 quantize_vertices(std::vector<compact_vertex>& out);
+
 		void create_vertex_buffer();
 
+		void report_vertex_stats();
+
 		void create_index_buffer();
 
 		void create_uniform_buffers();
 
 		void create_descriptor_pool();
 
+		scene_descriptors scene_descriptor_contents(uint32_t image_index);
+
+		// the forward pass's set for this frame, cached or written into the frame slot's pools
+		VkDescriptorSet scene_descriptor_set(uint32_t image_index);
+
+		// scene sets per second through vkUpdateDescriptorSets and through the update template
+		void benchmark_descriptor_updates();
+
 		void create_descriptor_sets();
 
+		void report_descriptor_stats();
+
 		void create_cmd_buffers();
 
+		void record_cmd_buffer(VkCommandBuffer cmd, uint32_t image_index);
+
+		void record_forward_pass(VkCommandBuffer cmd, uint32_t image_index);
+
+		// indirect is VK_NULL_HANDLE for CPU driven draws, otherwise a list of one command per object
+		void record_scene(VkCommandBuffer cmd, uint32_t image_index, VkRenderPass rp, VkBuffer indirect);
+
+		void build_frame_graph();
+
+		void create_timeline();
+
+		// the last value the GPU has signalled on the timeline, everything submitted up to it has retired
+		uint64_t completed_timeline_value();
+
+		void wait_timeline(uint64_t value);
+
+		// destroy runs once the GPU has finished everything submitted so far, nothing waits for it
+		void defer_delete(std::function<void()> destroy);
+
+		// runs every deferred destroy whose submissions the timeline has passed
+		void run_deletions(uint64_t completed);
+
 		void create_syncs();
 
 		void wait_for_device_completion();
@@ -247,6 +739,7 @@ namespace sandbox
 	{
 		extern GLFWwindow* window;
 		void framebuffer_resize_callback(GLFWwindow* win, int w, int h);
+		void key_callback(GLFWwindow* win, int key, int scancode, int action, int mods);
 		void glfw_initialization(const unsigned res_width, const unsigned res_height);
 		void destroy_resources();
 	}
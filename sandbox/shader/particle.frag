@@ -0,0 +1,18 @@
+#version 450
+
+layout(location = 0) in vec2 frag_offset;
+layout(location = 1) in vec3 frag_color;
+
+layout(location = 0) out vec4 out_color;
+
+void main()
+{
+    // a soft disc, the corners of the quad add nothing
+    float falloff = 1.0 - dot(frag_offset, frag_offset);
+
+    if (falloff <= 0.0)
+        discard;
+
+    // blended additively, alpha is ignored
+    out_color = vec4(frag_color * falloff * falloff, 1.0);
+}
@@ -0,0 +1,42 @@
+#version 450
+
+/*
+Camera facing quads for the particles, six vertices per instance and no vertex buffer: the corner comes from
+gl_VertexIndex and the particle from the draw list the simulation compacted, indexed by gl_InstanceIndex.
+*/
+
+layout(set = 0, binding = 0) uniform UniformBufferObject {
+    mat4 view;
+    mat4 proj;
+} ubo;
+
+// see particles.comp
+struct DrawParticle {
+    vec4 position_size;
+    vec4 color;
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer Draws {
+    DrawParticle draws[];
+};
+
+layout(location = 0) out vec2 frag_offset;
+layout(location = 1) out vec3 frag_color;
+
+const vec2 corners[6] = vec2[](
+    vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0),
+    vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0));
+
+void main()
+{
+    DrawParticle particle = draws[gl_InstanceIndex];
+    vec2 corner = corners[gl_VertexIndex];
+
+    // expanded in view space, so the quad always faces the camera
+    vec4 center = ubo.view * vec4(particle.position_size.xyz, 1.0);
+    center.xy += corner * particle.position_size.w;
+
+    gl_Position = ubo.proj * center;
+    frag_offset = corner;
+    frag_color = particle.color.rgb;
+}
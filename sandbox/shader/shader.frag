@@ -1,8 +1,12 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+// specialization constants, see vulkan::fragment_constants
+layout (constant_id = 0) const uint SHADING_MODE = 0; // 0 textured, 1 texture coordinates, 2 vertex color, 3 normals
+
 layout (location = 0) in vec3 frag_color;
 layout (location = 1) in vec2 frag_texcoord;
+layout (location = 2) in vec3 frag_normal;
 
 layout (binding = 1) uniform sampler2D tex_sampler;
 
@@ -10,6 +14,21 @@ layout (location = 0) out vec4 out_color;
 
 void main()
 {
-    // out_color = vec4(frag_texcoord, 0.0, 1.0);
-    out_color = texture(tex_sampler, frag_texcoord);
-}
\ No newline at end of file
+    // resolved at pipeline creation, only one of these survives in each variant
+    if (SHADING_MODE == 1)
+    {
+        out_color = vec4(frag_texcoord, 0.0, 1.0);
+    }
+    else if (SHADING_MODE == 2)
+    {
+        out_color = vec4(frag_color, 1.0);
+    }
+    else if (SHADING_MODE == 3)
+    {
+        out_color = vec4(normalize(frag_normal) * 0.5 + 0.5, 1.0);
+    }
+    else
+    {
+        out_color = texture(tex_sampler, frag_texcoord);
+    }
+}
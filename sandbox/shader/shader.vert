@@ -1,22 +1,52 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+// specialization constants, see vulkan::vertex_constants
+layout (constant_id = 0) const uint VERTEX_FORMAT = 0; // 0 full precision, 1 compact
+
 layout(set = 0, binding = 0) uniform UniformBufferObject {
-    mat4 model;
     mat4 view;
     mat4 proj;
 } ubo;
 
+// see vulkan::object_data, uploaded in draw order and indexed by the draw's firstInstance
+struct ObjectData {
+    mat4 model;
+    vec4 sphere;
+    uint id;
+    uint first_index;
+    uint index_count;
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer ObjectBuffer {
+    ObjectData objects[];
+};
+
 layout (location = 0) in vec3 in_pos;
 layout (location = 1) in vec3 in_color;
 layout (location = 2) in vec2 in_tex;
+layout (location = 3) in vec3 in_normal; // compact vertices only fill xy, the octahedral encoding
 
 layout (location = 0) out vec3 frag_color;
 layout (location = 1) out vec2 frag_texcoord;
+layout (location = 2) out vec3 frag_normal;
+
+// the depth prepass and the EQUAL tested main pass must produce bit identical depth
+invariant gl_Position;
+
+vec3 oct_decode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
 
 void main()
 {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(in_pos, 1.0);
+    gl_Position = ubo.proj * ubo.view * objects[gl_InstanceIndex].model * vec4(in_pos, 1.0);
     frag_color = in_color;
     frag_texcoord = in_tex;
-}
\ No newline at end of file
+    // compact positions are dequantized by the model matrix, only the normal needs decoding
+    frag_normal = VERTEX_FORMAT == 1 ? oct_decode(in_normal.xy) : in_normal;
+}
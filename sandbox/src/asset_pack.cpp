@@ -0,0 +1,348 @@
+#include "asset_pack.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef SANDBOX_WITH_LZ4
+#include <lz4.h>
+#endif
+
+namespace sandbox
+{
+	namespace asset
+	{
+		uint64_t hash_name(std::string_view name)
+		{
+			// FNV-1a, stable across platforms so packs can be built on one machine and read on another
+			uint64_t h = 0xcbf29ce484222325ull;
+
+			for (char c : name)
+			{
+				h ^= static_cast<uint8_t>(c);
+				h *= 0x100000001b3ull;
+			}
+
+			return h;
+		}
+
+		static uint64_t align_up(uint64_t v, uint64_t a)
+		{
+			return (v + a - 1) & ~(a - 1);
+		}
+
+		pack::~pack()
+		{
+			close();
+		}
+
+		/*
+		The whole file is mapped read-only once. After that every asset access is pointer arithmetic
+		into the mapping and the OS pages data in on first touch, so startup no longer pays one
+		open/read/close round trip per loose file.
+		*/
+		void pack::open(const std::string& path)
+		{
+			close();
+
+#ifdef _WIN32
+			HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+				FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+
+			if (INVALID_HANDLE_VALUE == file)
+			{
+				throw std::runtime_error("Failed to open asset pack " + path + "!");
+			}
+
+			LARGE_INTEGER file_size{};
+			GetFileSizeEx(file, &file_size);
+
+			HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			void* mapped = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+
+			// the view keeps the mapping alive, the handles are no longer needed
+			if (mapping)
+				CloseHandle(mapping);
+			CloseHandle(file);
+
+			if (nullptr == mapped)
+			{
+				throw std::runtime_error("Failed to map asset pack " + path + "!");
+			}
+
+			mapped_size = static_cast<size_t>(file_size.QuadPart);
+#else
+			int fd = ::open(path.c_str(), O_RDONLY);
+
+			if (fd < 0)
+			{
+				throw std::runtime_error("Failed to open asset pack " + path + "!");
+			}
+
+			struct stat st {};
+
+			if (0 != fstat(fd, &st))
+			{
+				::close(fd);
+				throw std::runtime_error("Failed to stat asset pack " + path + "!");
+			}
+
+			void* mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+			::close(fd);
+
+			if (MAP_FAILED == mapped)
+			{
+				throw std::runtime_error("Failed to map asset pack " + path + "!");
+			}
+
+			mapped_size = static_cast<size_t>(st.st_size);
+#endif
+			base = static_cast<const uint8_t*>(mapped);
+
+			header = reinterpret_cast<const pack_header*>(base);
+
+			if (mapped_size < sizeof(pack_header) || pack_magic != header->magic || pack_version != header->version ||
+				header->toc_offset + uint64_t(header->entry_count) * sizeof(pack_entry) > mapped_size ||
+				header->names_offset + header->names_size > mapped_size)
+			{
+				close();
+				throw std::runtime_error("Asset pack " + path + " is corrupt or has an unsupported version!");
+			}
+
+			entries = reinterpret_cast<const pack_entry*>(base + header->toc_offset);
+
+#ifndef _WIN32
+			// the table of contents is touched on every lookup, fault it in up front
+			madvise(const_cast<uint8_t*>(base), static_cast<size_t>(header->names_offset + header->names_size), MADV_WILLNEED);
+#endif
+		}
+
+		void pack::close()
+		{
+			decompressed.clear();
+
+			if (nullptr != base)
+			{
+#ifdef _WIN32
+				UnmapViewOfFile(base);
+#else
+				munmap(const_cast<uint8_t*>(base), mapped_size);
+#endif
+			}
+
+			base = nullptr;
+			mapped_size = 0;
+			header = nullptr;
+			entries = nullptr;
+		}
+
+		std::string_view pack::name_of(const pack_entry& entry) const
+		{
+			return std::string_view(reinterpret_cast<const char*>(base + header->names_offset + entry.name_offset),
+				entry.name_length);
+		}
+
+		const pack_entry* pack::find(std::string_view name) const
+		{
+			if (!is_open())
+				return nullptr;
+
+			const uint64_t h = hash_name(name);
+			const pack_entry* end = entries + header->entry_count;
+
+			auto it = std::lower_bound(entries, end, h,
+				[](const pack_entry& e, uint64_t v) { return e.name_hash < v; });
+
+			// walk the (almost always single) run of equal hashes to rule out collisions
+			for (; it != end && h == it->name_hash; ++it)
+			{
+				if (name_of(*it) == name)
+					return it;
+			}
+
+			return nullptr;
+		}
+
+		view pack::read(std::string_view name)
+		{
+			const pack_entry* entry = find(name);
+
+			if (nullptr == entry)
+			{
+				throw std::runtime_error("Asset " + std::string(name) + " not found in pack!");
+			}
+
+			if (entry->offset + entry->stored_size > mapped_size)
+			{
+				throw std::runtime_error("Asset " + std::string(name) + " lies outside of the pack!");
+			}
+
+			if (!(entry->flags & ENTRY_LZ4))
+			{
+				return { base + entry->offset, static_cast<size_t>(entry->size) };
+			}
+
+			auto cached = decompressed.find(entry);
+
+			if (decompressed.end() != cached)
+			{
+				return { cached->second.data(), cached->second.size() };
+			}
+
+#ifdef SANDBOX_WITH_LZ4
+			std::vector<uint8_t> out(static_cast<size_t>(entry->size));
+
+			int written = LZ4_decompress_safe(reinterpret_cast<const char*>(base + entry->offset),
+				reinterpret_cast<char*>(out.data()), static_cast<int>(entry->stored_size), static_cast<int>(out.size()));
+
+			if (written != static_cast<int>(out.size()))
+			{
+				throw std::runtime_error("Asset " + std::string(name) + " failed to decompress!");
+			}
+
+			auto& stored = decompressed.emplace(entry, std::move(out)).first->second;
+
+			return { stored.data(), stored.size() };
+#else
+			throw std::runtime_error("Asset " + std::string(name) + " is LZ4 compressed but LZ4 support is not compiled in!");
+#endif
+		}
+
+		void pack_writer::add(const std::string& name, std::vector<uint8_t> data, bool compress)
+		{
+			pending p{ name, {}, data.size(), ENTRY_RAW };
+
+#ifdef SANDBOX_WITH_LZ4
+			if (compress && !data.empty())
+			{
+				std::vector<uint8_t> packed(static_cast<size_t>(LZ4_compressBound(static_cast<int>(data.size()))));
+
+				int packed_size = LZ4_compress_default(reinterpret_cast<const char*>(data.data()),
+					reinterpret_cast<char*>(packed.data()), static_cast<int>(data.size()), static_cast<int>(packed.size()));
+
+				// already compressed formats (jpg, png) gain nothing, keep those zero-copy
+				if (packed_size > 0 && static_cast<size_t>(packed_size) < data.size() - data.size() / 10)
+				{
+					packed.resize(static_cast<size_t>(packed_size));
+					p.stored = std::move(packed);
+					p.flags = ENTRY_LZ4;
+				}
+			}
+#else
+			(void)compress;
+#endif
+			if (ENTRY_RAW == p.flags)
+			{
+				p.stored = std::move(data);
+			}
+
+			items.emplace_back(std::move(p));
+		}
+
+		void pack_writer::write(const std::string& path) const
+		{
+			std::vector<const pending*> sorted;
+			sorted.reserve(items.size());
+
+			for (const auto& p : items)
+			{
+				sorted.push_back(&p);
+			}
+
+			std::sort(sorted.begin(), sorted.end(), [](const pending* a, const pending* b)
+				{
+					return hash_name(a->name) < hash_name(b->name);
+				});
+
+			for (size_t i = 1; i < sorted.size(); i++)
+			{
+				if (sorted[i - 1]->name == sorted[i]->name)
+				{
+					throw std::runtime_error("Duplicate asset " + sorted[i]->name + " in pack!");
+				}
+			}
+
+			pack_header header{};
+			header.magic = pack_magic;
+			header.version = pack_version;
+			header.entry_count = static_cast<uint32_t>(sorted.size());
+			header.toc_offset = align_up(sizeof(pack_header), alignof(pack_entry));
+
+			std::vector<pack_entry> toc(sorted.size());
+			std::string names;
+
+			for (size_t i = 0; i < sorted.size(); i++)
+			{
+				toc[i].name_hash = hash_name(sorted[i]->name);
+				toc[i].name_offset = static_cast<uint32_t>(names.size());
+				toc[i].name_length = static_cast<uint32_t>(sorted[i]->name.size());
+				toc[i].stored_size = sorted[i]->stored.size();
+				toc[i].size = sorted[i]->size;
+				toc[i].flags = sorted[i]->flags;
+
+				names += sorted[i]->name;
+			}
+
+			header.names_offset = header.toc_offset + toc.size() * sizeof(pack_entry);
+			header.names_size = static_cast<uint32_t>(names.size());
+
+			uint64_t cursor = align_up(header.names_offset + names.size(), entry_alignment);
+
+			for (auto& e : toc)
+			{
+				e.offset = cursor;
+				cursor = align_up(cursor + e.stored_size, entry_alignment);
+			}
+
+			std::ofstream out(path, std::ios::binary | std::ios::trunc);
+
+			if (!out.is_open())
+			{
+				throw std::runtime_error("Failed to create asset pack " + path + "!");
+			}
+
+			auto pad_to = [&out](uint64_t offset)
+			{
+				static const char zeros[entry_alignment] = {};
+				uint64_t pos = static_cast<uint64_t>(out.tellp());
+				out.write(zeros, static_cast<std::streamsize>(offset - pos));
+			};
+
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			pad_to(header.toc_offset);
+			out.write(reinterpret_cast<const char*>(toc.data()), static_cast<std::streamsize>(toc.size() * sizeof(pack_entry)));
+			out.write(names.data(), static_cast<std::streamsize>(names.size()));
+
+			for (size_t i = 0; i < sorted.size(); i++)
+			{
+				pad_to(toc[i].offset);
+				out.write(reinterpret_cast<const char*>(sorted[i]->stored.data()),
+					static_cast<std::streamsize>(sorted[i]->stored.size()));
+			}
+
+			pad_to(cursor);
+
+			if (!out.good())
+			{
+				throw std::runtime_error("Failed to write asset pack " + path + "!");
+			}
+		}
+	}
+}
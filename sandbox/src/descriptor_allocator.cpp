@@ -0,0 +1,514 @@
+#include "descriptor_allocator.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <limits>
+
+namespace sandbox
+{
+	namespace vulkan
+	{
+		namespace descriptors
+		{
+			namespace
+			{
+				// past this a pool is large enough that a few more of them are cheaper than one huge one
+				constexpr uint32_t max_sets_per_pool = 4096;
+
+				void combine(size_t& seed, uint64_t value)
+				{
+					seed ^= std::hash<uint64_t>()(value) + 0x9E3779B97F4A7C15ull + (seed << 6) + (seed >> 2);
+				}
+
+				bool is_image(VkDescriptorType type)
+				{
+					return VK_DESCRIPTOR_TYPE_SAMPLER == type || VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER == type ||
+						VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE == type || VK_DESCRIPTOR_TYPE_STORAGE_IMAGE == type ||
+						VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT == type;
+				}
+
+				bool is_texel_buffer(VkDescriptorType type)
+				{
+					return VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER == type || VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER == type;
+				}
+
+				bool is_buffer(VkDescriptorType type)
+				{
+					return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER == type || VK_DESCRIPTOR_TYPE_STORAGE_BUFFER == type ||
+						VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC == type || VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC == type;
+				}
+
+				// how far apart a binding's descriptors are in a packed struct, 0 for types a template cannot write this way
+				size_t info_size(VkDescriptorType type)
+				{
+					if (is_image(type))
+						return sizeof(VkDescriptorImageInfo);
+
+					if (is_texel_buffer(type))
+						return sizeof(VkBufferView);
+
+					if (is_buffer(type))
+						return sizeof(VkDescriptorBufferInfo);
+
+					return 0;
+				}
+			}
+
+			void update_template::create(VkDescriptorSetLayout layout, const VkDescriptorSetLayoutBinding* bindings,
+				uint32_t count, size_t packed_size)
+			{
+				std::vector<VkDescriptorSetLayoutBinding> sorted(bindings, bindings + count);
+				std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.binding < b.binding; });
+
+				entries.clear();
+				size_t offset = 0;
+
+				for (const auto& b : sorted)
+				{
+					if (0 == b.descriptorCount)
+						continue;
+
+					/*
+					Every entry says where in the struct its descriptors start and how far apart they are, which is
+					where vkUpdateDescriptorSetWithTemplate reads them from: the same infos a VkWriteDescriptorSet
+					points at, just at fixed offsets instead of through pointers.
+					*/
+					VkDescriptorUpdateTemplateEntry e{};
+					e.dstBinding = b.binding;
+					e.dstArrayElement = 0;
+					e.descriptorCount = b.descriptorCount;
+					e.descriptorType = b.descriptorType;
+					e.offset = offset;
+					e.stride = info_size(b.descriptorType);
+
+					if (0 == e.stride)
+					{
+						throw std::runtime_error("Descriptor type has no update template entry!");
+					}
+
+					entries.push_back(e);
+					offset += e.stride * e.descriptorCount;
+				}
+
+				if (offset != packed_size)
+				{
+					throw std::runtime_error("Packed descriptor struct does not match its set layout!");
+				}
+
+				VkDescriptorUpdateTemplateCreateInfo ut_info{};
+				ut_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+				ut_info.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+				ut_info.pDescriptorUpdateEntries = entries.data();
+				ut_info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+				ut_info.descriptorSetLayout = layout;
+
+				if (!OP_SUCCESS(vkCreateDescriptorUpdateTemplate(dev, &ut_info, nullptr, &handle)))
+				{
+					throw std::runtime_error("Descriptor update template creation failed!");
+				}
+
+				set_layout = layout;
+				packed_bytes = packed_size;
+			}
+
+			void update_template::destroy()
+			{
+				vkDestroyDescriptorUpdateTemplate(dev, handle, nullptr);
+
+				handle = VK_NULL_HANDLE;
+				entries.clear();
+			}
+
+			void update_template::update(VkDescriptorSet set, const void* packed) const
+			{
+				vkUpdateDescriptorSetWithTemplate(dev, set, handle, packed);
+			}
+
+			void update_template::write(VkDescriptorSet set, const void* packed) const
+			{
+				if (entries.size() > max_bindings)
+				{
+					throw std::runtime_error("Too many bindings for one descriptor set!");
+				}
+
+				const auto* base = static_cast<const std::byte*>(packed);
+
+				/*
+				configuration of descriptors is updated using the vkUpdateDescriptorSets function, which takes an array of
+				VkWriteDescriptorSet structs as parameter.
+				*/
+				std::array<VkWriteDescriptorSet, max_bindings> ds_writes{};
+
+				for (size_t i = 0; i < entries.size(); i++)
+				{
+					const auto& e = entries[i];
+					auto& w = ds_writes[i];
+
+					w.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+					/*
+					The first two fields specify the descriptor set to update and the binding. Remember that descriptors can be
+					arrays, so we also need to specify the first index in the array that we want to update.
+					*/
+					w.dstSet = set;
+					w.dstBinding = e.dstBinding;
+					w.dstArrayElement = e.dstArrayElement;
+					/*
+					need to specify the type of descriptor again. It's possible to update multiple descriptors at once in an array, starting at
+					index dstArrayElement. The descriptorCount field specifies how many array elements you want to update.
+					*/
+					w.descriptorType = e.descriptorType;
+					w.descriptorCount = e.descriptorCount;
+					/*
+					The last field references an array with descriptorCount structs that actually configure the descriptors. It depends on the type
+					of descriptor which one of the three you actually need to use. The pBufferInfo field is used for descriptors that refer to buffer
+					data, pImageInfo is used for descriptors that refer to image data, and pTexelBufferView is used for descriptors that refer to
+					buffer views.
+					*/
+					if (is_image(e.descriptorType))
+					{
+						w.pImageInfo = reinterpret_cast<const VkDescriptorImageInfo*>(base + e.offset);
+					}
+					else if (is_texel_buffer(e.descriptorType))
+					{
+						w.pTexelBufferView = reinterpret_cast<const VkBufferView*>(base + e.offset);
+					}
+					else
+					{
+						w.pBufferInfo = reinterpret_cast<const VkDescriptorBufferInfo*>(base + e.offset);
+					}
+				}
+
+				/*
+				The updates are applied using vkUpdateDescriptorSets. It accepts two kinds of arrays as parameters: an array of VkWriteDescriptorSet
+				and an array of VkCopyDescriptorSet. The latter can be used to copy descriptors to each other, as its name implies.
+				*/
+				vkUpdateDescriptorSets(dev, static_cast<uint32_t>(entries.size()), ds_writes.data(), 0, nullptr);
+			}
+
+			size_t update_template::hash(const void* packed) const
+			{
+				const auto* base = static_cast<const std::byte*>(packed);
+
+				size_t seed = 0;
+
+				for (const auto& e : entries)
+				{
+					for (uint32_t i = 0; i < e.descriptorCount; i++)
+					{
+						const std::byte* p = base + e.offset + i * e.stride;
+
+						if (is_image(e.descriptorType))
+						{
+							const auto& info = *reinterpret_cast<const VkDescriptorImageInfo*>(p);
+
+							combine(seed, reinterpret_cast<uint64_t>(info.sampler));
+							combine(seed, reinterpret_cast<uint64_t>(info.imageView));
+							combine(seed, info.imageLayout);
+						}
+						else if (is_texel_buffer(e.descriptorType))
+						{
+							combine(seed, reinterpret_cast<uint64_t>(*reinterpret_cast<const VkBufferView*>(p)));
+						}
+						else
+						{
+							const auto& info = *reinterpret_cast<const VkDescriptorBufferInfo*>(p);
+
+							combine(seed, reinterpret_cast<uint64_t>(info.buffer));
+							combine(seed, info.offset);
+							combine(seed, info.range);
+						}
+					}
+				}
+
+				return seed;
+			}
+
+			bool update_template::equal(const void* a, const void* b) const
+			{
+				const auto* base_a = static_cast<const std::byte*>(a);
+				const auto* base_b = static_cast<const std::byte*>(b);
+
+				for (const auto& e : entries)
+				{
+					for (uint32_t i = 0; i < e.descriptorCount; i++)
+					{
+						const size_t at = e.offset + i * e.stride;
+
+						if (is_image(e.descriptorType))
+						{
+							const auto& x = *reinterpret_cast<const VkDescriptorImageInfo*>(base_a + at);
+							const auto& y = *reinterpret_cast<const VkDescriptorImageInfo*>(base_b + at);
+
+							if (x.sampler != y.sampler || x.imageView != y.imageView || x.imageLayout != y.imageLayout)
+								return false;
+						}
+						else if (is_texel_buffer(e.descriptorType))
+						{
+							if (*reinterpret_cast<const VkBufferView*>(base_a + at) != *reinterpret_cast<const VkBufferView*>(base_b + at))
+								return false;
+						}
+						else
+						{
+							const auto& x = *reinterpret_cast<const VkDescriptorBufferInfo*>(base_a + at);
+							const auto& y = *reinterpret_cast<const VkDescriptorBufferInfo*>(base_b + at);
+
+							if (x.buffer != y.buffer || x.offset != y.offset || x.range != y.range)
+								return false;
+						}
+					}
+				}
+
+				return true;
+			}
+
+			std::vector<VkDescriptorPoolSize> update_template::pool_sizes() const
+			{
+				std::vector<VkDescriptorPoolSize> sizes;
+
+				for (const auto& e : entries)
+				{
+					auto it = std::find_if(sizes.begin(), sizes.end(), [&](const auto& s) { return s.type == e.descriptorType; });
+
+					if (sizes.end() == it)
+					{
+						sizes.push_back({ e.descriptorType, e.descriptorCount });
+					}
+					else
+					{
+						it->descriptorCount += e.descriptorCount;
+					}
+				}
+
+				return sizes;
+			}
+
+			void benchmark(std::ostream& out, const update_template& tmpl, const void* packed, uint32_t set_count)
+			{
+				allocator sets;
+				sets.init(tmpl.pool_sizes(), set_count);
+
+				std::vector<VkDescriptorSet> targets(set_count);
+
+				for (auto& set : targets)
+				{
+					set = sets.allocate(tmpl.layout());
+				}
+
+				constexpr int rounds = 20;
+
+				// best round of writing every set once, after one untimed round to warm up the driver
+				auto time = [&](auto&& update)
+				{
+					double best = std::numeric_limits<double>::max();
+
+					for (int r = -1; r < rounds; r++)
+					{
+						const auto start = std::chrono::steady_clock::now();
+
+						for (auto set : targets)
+						{
+							update(set);
+						}
+
+						const double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+						if (r >= 0)
+						{
+							best = std::min(best, s);
+						}
+					}
+
+					return best;
+				};
+
+				const double writes = time([&](VkDescriptorSet set) { tmpl.write(set, packed); });
+				const double templated = time([&](VkDescriptorSet set) { tmpl.update(set, packed); });
+
+				auto report = [&](const char* name, double s)
+				{
+					out << '\t' << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(2)
+						<< static_cast<double>(set_count) / s * 1e-6 << " M sets/s, " << std::setprecision(1)
+						<< s / set_count * 1e9 << " ns per set\n";
+				};
+
+				out << "Updating " << set_count << " sets of " << tmpl.pool_sizes().size() << " descriptor types, best of "
+					<< rounds << " rounds:\n";
+
+				report("vkUpdateDescriptorSets", writes);
+				report("update template", templated);
+
+				out << "\ttemplate speedup " << std::setprecision(2) << writes / templated << "x\n" << std::defaultfloat << std::flush;
+
+				sets.destroy();
+			}
+
+			void allocator::init(const std::vector<VkDescriptorPoolSize>& per_set, uint32_t sets_per_pool)
+			{
+				ratios = per_set;
+				next_sets = std::max(1u, sets_per_pool);
+			}
+
+			VkDescriptorPool allocator::create_pool(uint32_t set_count)
+			{
+				/*
+				describe which descriptor types our descriptor sets are going to contain and how many of them,
+				using VkDescriptorPoolSize structures, scaled up to the number of sets the pool is for.
+				*/
+				std::array<VkDescriptorPoolSize, max_bindings> pool_sizes{};
+				const uint32_t size_count = std::min(static_cast<uint32_t>(ratios.size()), max_bindings);
+
+				for (uint32_t i = 0; i < size_count; i++)
+				{
+					pool_sizes[i].type = ratios[i].type;
+					pool_sizes[i].descriptorCount = ratios[i].descriptorCount * set_count;
+				}
+
+				/*
+				structure has an optional flag similar to command pools that determines if individual descriptor
+				sets can be freed or not: VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT. Sets from these pools are
+				only ever released all at once by vkResetDescriptorPool, so it stays off and the driver can allocate linearly.
+				*/
+				VkDescriptorPoolCreateInfo pool_info{};
+				pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+				pool_info.poolSizeCount = size_count;
+				pool_info.pPoolSizes = pool_sizes.data();
+				/*
+				Aside from the maximum number of individual descriptors that are available, we also need to specify
+				the maximum number of descriptor sets that may be allocated:
+				*/
+				pool_info.maxSets = set_count;
+
+				VkDescriptorPool pool;
+
+				if (!OP_SUCCESS(vkCreateDescriptorPool(dev, &pool_info, nullptr, &pool)))
+				{
+					throw std::runtime_error("Descriptor pool creation failed!");
+				}
+
+				return pool;
+			}
+
+			VkDescriptorSet allocator::allocate(VkDescriptorSetLayout layout)
+			{
+				/*
+				A descriptor set allocation is described with a VkDescriptorSetAllocateInfo struct. You need to specify
+				the descriptor pool to allocate from, the number of descriptor sets to allocate, and the descriptor layout
+				to base them on:
+				*/
+				VkDescriptorSetAllocateInfo dsa_info{};
+				dsa_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+				dsa_info.descriptorSetCount = 1;
+				dsa_info.pSetLayouts = &layout;
+
+				/*
+				Since Vulkan 1.1 a pool that cannot fit the set says VK_ERROR_OUT_OF_POOL_MEMORY, or FRAGMENTED_POOL. Drivers
+				may also quietly allocate past a pool's sizes, which is why the validation layers cannot catch an undersized
+				pool: either way running out only means moving on to the next pool, or making one twice the size.
+				*/
+				bool fresh = false;
+
+				while (true)
+				{
+					if (current == pool_list.size())
+					{
+						if (!pool_list.empty())
+						{
+							grown++;
+							next_sets = std::min(next_sets * 2, max_sets_per_pool);
+						}
+
+						pool_list.push_back(create_pool(next_sets));
+						fresh = true;
+					}
+
+					dsa_info.descriptorPool = pool_list[current];
+
+					VkDescriptorSet set;
+					const VkResult result = vkAllocateDescriptorSets(dev, &dsa_info, &set);
+
+					if (VK_SUCCESS == result)
+					{
+						allocated++;
+						return set;
+					}
+
+					if (VK_ERROR_OUT_OF_POOL_MEMORY != result && VK_ERROR_FRAGMENTED_POOL != result)
+					{
+						throw std::runtime_error("Descriptor sets allocation failure!");
+					}
+
+					// an empty pool that cannot fit the set means the ratios lack its types, more pools would not help
+					if (fresh)
+					{
+						throw std::runtime_error("Descriptor set layout does not fit the pool ratios!");
+					}
+
+					current++;
+				}
+			}
+
+			void allocator::reset()
+			{
+				// only the pools handed out from, the ones after current have nothing allocated
+				for (size_t i = 0; i <= current && i < pool_list.size(); i++)
+				{
+					vkResetDescriptorPool(dev, pool_list[i], 0);
+				}
+
+				current = 0;
+			}
+
+			void allocator::destroy()
+			{
+				for (auto pool : pool_list)
+				{
+					vkDestroyDescriptorPool(dev, pool, nullptr);
+				}
+
+				pool_list.clear();
+				current = 0;
+			}
+
+			void cache::init(const std::vector<VkDescriptorPoolSize>& per_set, uint32_t sets_per_pool)
+			{
+				sets.init(per_set, sets_per_pool);
+			}
+
+			VkDescriptorSet cache::get(const update_template& tmpl, const void* packed)
+			{
+				size_t hash = tmpl.hash(packed);
+				combine(hash, reinterpret_cast<uint64_t>(tmpl.layout()));
+
+				auto range = entries.equal_range(hash);
+
+				for (auto it = range.first; it != range.second; ++it)
+				{
+					const auto& e = it->second;
+
+					if (e.layout == tmpl.layout() && tmpl.equal(e.contents.data(), packed))
+					{
+						hit_count++;
+						return e.set;
+					}
+				}
+
+				miss_count++;
+
+				VkDescriptorSet set = sets.allocate(tmpl.layout());
+				tmpl.update(set, packed);
+
+				const auto* bytes = static_cast<const std::byte*>(packed);
+				entries.emplace(hash, entry{ tmpl.layout(), std::vector<std::byte>(bytes, bytes + tmpl.size()), set });
+
+				return set;
+			}
+
+			void cache::destroy()
+			{
+				sets.destroy();
+				entries.clear();
+			}
+		}
+	}
+}
@@ -0,0 +1,383 @@
+#include "draw_sort.hpp"
+#include "frame_arena.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sandbox
+{
+	namespace vulkan
+	{
+		namespace sort
+		{
+			namespace
+			{
+				// below this the threads cost more to wake than the slices take to sort
+				constexpr size_t parallel_threshold = 32 * 1024;
+
+				constexpr unsigned max_threads = 8;
+
+				using job_fn = void(*)(void* context, unsigned thread, unsigned threads);
+
+				/*
+				Threads that live as long as the program, so a sort neither creates threads nor allocates. run()
+				hands the job to the first n - 1 workers, runs slice 0 itself and returns once every slice is done.
+				*/
+				class workers
+				{
+				public:
+
+					explicit workers(unsigned count)
+					{
+						for (unsigned t = 1; t < count; t++)
+						{
+							threads.emplace_back([this, t]() { loop(t); });
+						}
+					}
+
+					~workers()
+					{
+						{
+							std::lock_guard<std::mutex> lock(mutex);
+							stopping = true;
+						}
+
+						wake.notify_all();
+
+						for (auto& t : threads)
+						{
+							t.join();
+						}
+					}
+
+					unsigned size() const { return static_cast<unsigned>(threads.size()) + 1; }
+
+					void run(job_fn fn, void* context, unsigned n)
+					{
+						n = std::min(n, size());
+
+						if (n <= 1)
+						{
+							fn(context, 0, 1);
+							return;
+						}
+
+						{
+							std::lock_guard<std::mutex> lock(mutex);
+
+							job = fn;
+							job_context = context;
+							active = n;
+							pending = n - 1;
+							generation++;
+						}
+
+						wake.notify_all();
+
+						fn(context, 0, n);
+
+						std::unique_lock<std::mutex> lock(mutex);
+						done.wait(lock, [this]() { return 0 == pending; });
+					}
+
+				private:
+
+					void loop(unsigned t)
+					{
+						uint64_t seen = 0;
+
+						std::unique_lock<std::mutex> lock(mutex);
+
+						while (true)
+						{
+							wake.wait(lock, [this, &seen]() { return stopping || generation != seen; });
+
+							if (stopping)
+								return;
+
+							seen = generation;
+
+							// not needed for this one, run() does not wait for it either
+							if (t >= active)
+								continue;
+
+							const job_fn fn = job;
+							void* const context = job_context;
+							const unsigned n = active;
+
+							lock.unlock();
+							fn(context, t, n);
+							lock.lock();
+
+							if (0 == --pending)
+								done.notify_one();
+						}
+					}
+
+					std::vector<std::thread>	threads;
+					std::mutex					mutex;
+					std::condition_variable		wake;
+					std::condition_variable		done;
+
+					job_fn						job{ nullptr };
+					void*						job_context{ nullptr };
+					unsigned					active{ 0 };
+					unsigned					pending{ 0 };
+					uint64_t					generation{ 0 };
+					bool						stopping{ false };
+				};
+
+				workers& pool()
+				{
+					static workers instance(std::max(1u, std::min(std::thread::hardware_concurrency(), max_threads)));
+
+					return instance;
+				}
+
+				struct pass_job
+				{
+					uint64_t*			keys_in;
+					uint32_t*			values_in;
+					uint64_t*			keys_out;
+					uint32_t*			values_out;
+					size_t				count;
+					uint32_t			shift;
+
+					std::array<uint32_t, 256>*	counts;		// one histogram per thread, then its scatter offsets
+					uint64_t*			key_or;				// one per thread, for the bytes that vary
+					uint64_t*			key_and;
+				};
+
+				void slice(const pass_job& job, unsigned t, unsigned n, size_t& begin, size_t& end)
+				{
+					begin = job.count * t / n;
+					end = job.count * (t + 1) / n;
+				}
+
+				void varying_bits(void* context, unsigned t, unsigned n)
+				{
+					auto& job = *static_cast<pass_job*>(context);
+
+					size_t begin, end;
+					slice(job, t, n, begin, end);
+
+					uint64_t any = 0, all = ~uint64_t(0);
+
+					for (size_t i = begin; i < end; i++)
+					{
+						any |= job.keys_in[i];
+						all &= job.keys_in[i];
+					}
+
+					job.key_or[t] = any;
+					job.key_and[t] = all;
+				}
+
+				void histogram(void* context, unsigned t, unsigned n)
+				{
+					auto& job = *static_cast<pass_job*>(context);
+
+					size_t begin, end;
+					slice(job, t, n, begin, end);
+
+					auto& counts = job.counts[t];
+					counts.fill(0);
+
+					for (size_t i = begin; i < end; i++)
+					{
+						counts[(job.keys_in[i] >> job.shift) & 0xFF]++;
+					}
+				}
+
+				void scatter(void* context, unsigned t, unsigned n)
+				{
+					auto& job = *static_cast<pass_job*>(context);
+
+					size_t begin, end;
+					slice(job, t, n, begin, end);
+
+					auto& offsets = job.counts[t];
+
+					for (size_t i = begin; i < end; i++)
+					{
+						const uint32_t dst = offsets[(job.keys_in[i] >> job.shift) & 0xFF]++;
+
+						job.keys_out[dst] = job.keys_in[i];
+						job.values_out[dst] = job.values_in[i];
+					}
+				}
+			}
+
+			void radix_sort(uint64_t* keys, uint32_t* values, size_t count, std::pmr::memory_resource* scratch,
+				unsigned threads)
+			{
+				if (count < 2)
+					return;
+
+				auto& workers = pool();
+
+				unsigned n = 0 == threads ? workers.size() : std::min(threads, workers.size());
+
+				if (count < parallel_threshold)
+				{
+					n = 1;
+				}
+
+				// every element is written before it is read, so these are left uninitialized
+				auto key_buffer = static_cast<uint64_t*>(scratch->allocate(count * sizeof(uint64_t), alignof(uint64_t)));
+				auto value_buffer = static_cast<uint32_t*>(scratch->allocate(count * sizeof(uint32_t), alignof(uint32_t)));
+
+				std::pmr::vector<std::array<uint32_t, 256>> counts(n, scratch);
+				std::pmr::vector<uint64_t> key_or(n, scratch);
+				std::pmr::vector<uint64_t> key_and(n, scratch);
+
+				pass_job job{};
+				job.keys_in = keys;
+				job.values_in = values;
+				job.keys_out = key_buffer;
+				job.values_out = value_buffer;
+				job.count = count;
+				job.counts = counts.data();
+				job.key_or = key_or.data();
+				job.key_and = key_and.data();
+
+				workers.run(varying_bits, &job, n);
+
+				uint64_t any = 0, all = ~uint64_t(0);
+
+				for (unsigned t = 0; t < n; t++)
+				{
+					any |= key_or[t];
+					all &= key_and[t];
+				}
+
+				const uint64_t varying = any ^ all;
+
+				for (uint32_t shift = 0; shift < 64; shift += 8)
+				{
+					if (0 == ((varying >> shift) & 0xFF))
+						continue;
+
+					job.shift = shift;
+
+					workers.run(histogram, &job, n);
+
+					// exclusive prefix over digits first and threads second, so equal digits keep their order
+					uint32_t sum = 0;
+
+					for (uint32_t d = 0; d < 256; d++)
+					{
+						for (unsigned t = 0; t < n; t++)
+						{
+							const uint32_t c = counts[t][d];
+							counts[t][d] = sum;
+							sum += c;
+						}
+					}
+
+					workers.run(scatter, &job, n);
+
+					std::swap(job.keys_in, job.keys_out);
+					std::swap(job.values_in, job.values_out);
+				}
+
+				if (job.keys_in != keys)
+				{
+					memcpy(keys, job.keys_in, count * sizeof(uint64_t));
+					memcpy(values, job.values_in, count * sizeof(uint32_t));
+				}
+
+				scratch->deallocate(value_buffer, count * sizeof(uint32_t), alignof(uint32_t));
+				scratch->deallocate(key_buffer, count * sizeof(uint64_t), alignof(uint64_t));
+			}
+
+			void benchmark(std::ostream& out, size_t count)
+			{
+				std::mt19937_64 rng(1234);
+
+				// a spread a real frame could have, two passes, a few pipelines, materials and meshes
+				std::vector<uint64_t> source_keys(count);
+
+				for (auto& k : source_keys)
+				{
+					k = make_key(static_cast<uint32_t>(rng() % 2), static_cast<uint32_t>(rng() % 4),
+						static_cast<uint32_t>(rng() % 16), static_cast<uint32_t>(rng() % 8),
+						std::uniform_real_distribution<float>(0.f, 1.f)(rng));
+				}
+
+				std::vector<uint64_t> keys(count);
+				std::vector<uint32_t> values(count);
+				std::vector<std::pair<uint64_t, uint32_t>> pairs(count);
+
+				memory::frame_arena arena;
+
+				constexpr int iterations = 50;
+
+				auto time = [&](auto&& sort)
+				{
+					double best = std::numeric_limits<double>::max(), total = 0.0;
+
+					// one untimed round, so the arena has grown and the workers are up
+					for (int i = -1; i < iterations; i++)
+					{
+						std::copy(source_keys.begin(), source_keys.end(), keys.begin());
+
+						for (size_t v = 0; v < count; v++)
+						{
+							values[v] = static_cast<uint32_t>(v);
+							pairs[v] = { source_keys[v], static_cast<uint32_t>(v) };
+						}
+
+						arena.reset();
+
+						const auto start = std::chrono::steady_clock::now();
+						sort();
+						const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+						if (i >= 0)
+						{
+							best = std::min(best, ms);
+							total += ms;
+						}
+					}
+
+					return std::make_pair(total / iterations, best);
+				};
+
+				auto report = [&](const char* name, std::pair<double, double> ms)
+				{
+					out << '\t' << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(3)
+						<< ms.first << " ms average, " << ms.second << " ms best, "
+						<< std::setprecision(1) << static_cast<double>(count) / ms.first * 1e-3 << " M draws/s\n";
+				};
+
+				out << "Sorting " << count << " draws, " << iterations << " runs each:\n";
+
+				report("std::stable_sort", time([&]()
+					{
+						std::stable_sort(pairs.begin(), pairs.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+					}));
+
+				report("radix, 1 thread", time([&]() { radix_sort(keys.data(), values.data(), count, &arena, 1); }));
+
+				const std::string parallel = "radix, " + std::to_string(pool().size()) + (1 == pool().size() ? " thread" : " threads");
+
+				report(parallel.c_str(), time([&]() { radix_sort(keys.data(), values.data(), count, &arena); }));
+
+				const bool sorted = std::is_sorted(keys.begin(), keys.end());
+
+				out << "\tradix result " << (sorted ? "sorted" : "NOT sorted") << '\n' << std::defaultfloat << std::flush;
+			}
+		}
+	}
+}
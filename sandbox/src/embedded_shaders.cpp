@@ -0,0 +1,81 @@
+#include "embedded_shaders.hpp"
+
+#include <chrono>
+
+namespace sandbox
+{
+	namespace vulkan
+	{
+		namespace spirv
+		{
+			namespace
+			{
+				struct embedded_shader
+				{
+					const char*		name;
+					const uint32_t*	code;
+					size_t			size;		// in bytes
+				};
+
+#ifdef SANDBOX_EMBED_SHADERS
+				// generated by cmake/embed_spirv.cmake, the arrays and the embedded_shaders table
+#include "embedded_shaders.inl"
+#else
+				constexpr embedded_shader embedded_shaders[] = { { nullptr, nullptr, 0 } };
+#endif
+
+				bool		enabled{ true };
+				load_stats	counters;
+
+				const embedded_shader* find(std::string_view name)
+				{
+					for (const auto& shader : embedded_shaders)
+					{
+						if (nullptr != shader.name && name == shader.name)
+							return &shader;
+					}
+
+					return nullptr;
+				}
+			}
+
+			bool has_embedded()
+			{
+				return nullptr != embedded_shaders[0].name;
+			}
+
+			void use_embedded(bool use)
+			{
+				enabled = use;
+			}
+
+			asset::view load(asset::pack& pack, std::string_view name)
+			{
+				const auto start = std::chrono::steady_clock::now();
+
+				asset::view spv;
+				const embedded_shader* shader = enabled ? find(name) : nullptr;
+
+				if (nullptr != shader)
+				{
+					spv = { reinterpret_cast<const uint8_t*>(shader->code), shader->size };
+					counters.embedded++;
+				}
+				else
+				{
+					spv = pack.read(name);
+					counters.packed++;
+				}
+
+				counters.ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+				return spv;
+			}
+
+			const load_stats& stats()
+			{
+				return counters;
+			}
+		}
+	}
+}
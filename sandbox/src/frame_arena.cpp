@@ -0,0 +1,129 @@
+#include "frame_arena.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+	std::atomic<uint64_t> allocation_count{ 0 };
+}
+
+/*
+The replaceable global allocation functions. The array and nothrow forms call these by default, so the
+count covers them too; the over-aligned forms go straight to the runtime's aligned allocator and are missed,
+nothing in the frame loop uses them.
+*/
+void* operator new(size_t size)
+{
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+
+	if (0 == size)
+		size = 1;
+
+	while (true)
+	{
+		if (void* p = std::malloc(size))
+			return p;
+
+		std::new_handler handler = std::get_new_handler();
+
+		if (nullptr == handler)
+			throw std::bad_alloc();
+
+		handler();
+	}
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+namespace sandbox
+{
+	namespace memory
+	{
+		uint64_t heap_allocations()
+		{
+			return allocation_count.load(std::memory_order_relaxed);
+		}
+
+		frame_arena::frame_arena(size_t block_size, std::pmr::memory_resource* upstream) :
+			upstream(upstream), block_size(block_size)
+		{
+		}
+
+		frame_arena::~frame_arena()
+		{
+			for (const auto& b : blocks)
+			{
+				upstream->deallocate(b.data, b.size, alignof(std::max_align_t));
+			}
+		}
+
+		void frame_arena::reset()
+		{
+			peak_bytes = std::max(peak_bytes, bytes_used);
+
+			bytes_used = 0;
+			current = 0;
+			offset = 0;
+		}
+
+		void* frame_arena::do_allocate(size_t bytes, size_t alignment)
+		{
+			// the rest of this block first, then any block a previous frame grew the arena by
+			for (; current < blocks.size(); current++, offset = 0)
+			{
+				const auto& b = blocks[current];
+
+				const uintptr_t base = reinterpret_cast<uintptr_t>(b.data);
+				const uintptr_t aligned = (base + offset + alignment - 1) & ~(uintptr_t(alignment) - 1);
+
+				if (aligned + bytes <= base + b.size)
+				{
+					offset = aligned + bytes - base;
+					bytes_used += bytes;
+
+					return reinterpret_cast<void*>(aligned);
+				}
+			}
+
+			// doubling keeps the number of blocks logarithmic in the high water mark
+			const size_t size = std::max({ block_size, capacity_bytes, bytes + alignment });
+
+			block b{ static_cast<std::byte*>(upstream->allocate(size, alignof(std::max_align_t))), size };
+
+			blocks.push_back(b);
+			capacity_bytes += size;
+			block_allocations++;
+
+			current = blocks.size() - 1;
+
+			const uintptr_t base = reinterpret_cast<uintptr_t>(b.data);
+			const uintptr_t aligned = (base + alignment - 1) & ~(uintptr_t(alignment) - 1);
+
+			offset = aligned + bytes - base;
+			bytes_used += bytes;
+
+			return reinterpret_cast<void*>(aligned);
+		}
+
+		void frame_arena::do_deallocate(void*, size_t, size_t)
+		{
+			// released wholesale by reset
+		}
+
+		bool frame_arena::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+		{
+			return this == &other;
+		}
+	}
+}
@@ -1,11 +1,13 @@
 #include "vk_sandbox.hpp"
 
-auto main() -> int
+auto main(int argc, char** argv) -> int
 {
 	sandbox::app app;
 
 	try
 	{
+		sandbox::parse_options(argc, argv);
+
 		app.run();
 	}
 	catch (const std::exception& e)
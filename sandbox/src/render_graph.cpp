@@ -0,0 +1,764 @@
+#include "render_graph.hpp"
+
+#include <algorithm>
+#include <iomanip>
+
+namespace sandbox
+{
+	namespace vulkan
+	{
+		namespace rg
+		{
+			constexpr VkAccessFlags write_accesses =
+				VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+				VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT |
+				VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+			constexpr VkPipelineStageFlags depth_stages =
+				VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+
+			resource_state state_for(usage u)
+			{
+				switch (u)
+				{
+				case usage::color_attachment:
+				case usage::resolve_attachment:
+					return { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+						VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, true };
+				case usage::depth_attachment:
+					return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, depth_stages,
+						VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, true };
+				case usage::depth_read_only:
+					return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, depth_stages,
+						VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, false };
+				case usage::fragment_sampled:
+					return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+						VK_ACCESS_SHADER_READ_BIT, false };
+				case usage::compute_sampled:
+					return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+						VK_ACCESS_SHADER_READ_BIT, false };
+				case usage::compute_storage_read:
+					return { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, false };
+				case usage::compute_storage_write:
+					return { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, true };
+				case usage::compute_storage_read_write:
+					return { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+						VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, true };
+				case usage::transfer_src:
+					return { VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, false };
+				case usage::transfer_dst:
+					return { VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, true };
+				case usage::indirect_read:
+					return { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, false };
+				case usage::vertex_read:
+					return { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, false };
+				case usage::vertex_storage_read:
+					return { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, false };
+				case usage::index_read:
+					return { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT, false };
+				case usage::uniform_read:
+					return { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+						VK_ACCESS_UNIFORM_READ_BIT, false };
+				case usage::host_read:
+					return { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT, false };
+				case usage::present:
+					// the present semaphore does the waiting, the barrier only has to change the layout
+					return { VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, false };
+				}
+
+				throw std::runtime_error("Unknown resource usage!");
+			}
+
+			resource_state state_for_layout(VkImageLayout layout)
+			{
+				switch (layout)
+				{
+				case VK_IMAGE_LAYOUT_UNDEFINED:
+				case VK_IMAGE_LAYOUT_PREINITIALIZED:
+					return { layout, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, false };
+				case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+					return state_for(usage::color_attachment);
+				case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+					return state_for(usage::depth_attachment);
+				case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:
+					return state_for(usage::depth_read_only);
+				case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+					return { layout, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+						VK_ACCESS_SHADER_READ_BIT, false };
+				case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+					return state_for(usage::transfer_src);
+				case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+					return state_for(usage::transfer_dst);
+				case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
+					return state_for(usage::present);
+				default:
+					// GENERAL and anything exotic, correct but as coarse as it gets
+					return { layout, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+						VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT, true };
+				}
+			}
+
+			pass_builder& pass_builder::read(resource_id id, usage u)
+			{
+				graph.passes[index].reads.push_back({ id, u });
+				return *this;
+			}
+
+			pass_builder& pass_builder::write(resource_id id, usage u)
+			{
+				graph.passes[index].writes.push_back({ id, u });
+				return *this;
+			}
+
+			pass_builder& pass_builder::side_effects()
+			{
+				graph.passes[index].has_side_effects = true;
+				return *this;
+			}
+
+			resource_id render_graph::import_image(const std::string& name, VkImageAspectFlags aspect, resource_state initial)
+			{
+				resource r;
+				r.name = name;
+				r.desc.aspect = aspect;
+				r.initial = initial;
+
+				resources.push_back(r);
+
+				return static_cast<resource_id>(resources.size() - 1);
+			}
+
+			resource_id render_graph::import_buffer(const std::string& name, resource_state initial)
+			{
+				resource r;
+				r.name = name;
+				r.is_image = false;
+				r.initial = initial;
+
+				resources.push_back(r);
+
+				return static_cast<resource_id>(resources.size() - 1);
+			}
+
+			resource_id render_graph::create_image(const std::string& name, const image_desc& desc)
+			{
+				resource r;
+				r.name = name;
+				r.imported = false;
+				r.desc = desc;
+
+				resources.push_back(r);
+
+				return static_cast<resource_id>(resources.size() - 1);
+			}
+
+			pass_builder render_graph::add_pass(const std::string& name, execute_fn execute)
+			{
+				pass p;
+				p.name = name;
+				p.execute = std::move(execute);
+
+				passes.push_back(std::move(p));
+
+				return pass_builder(*this, static_cast<uint32_t>(passes.size() - 1));
+			}
+
+			void render_graph::set_final_usage(resource_id id, usage u)
+			{
+				resources[id].final_usage = u;
+			}
+
+			void render_graph::compile()
+			{
+				cull();
+				schedule_barriers();
+				allocate_transients();
+				create_queries();
+			}
+
+			/*
+			Walk the passes backwards keeping a set of resources somebody still needs. A pass survives if it
+			writes one of them or was flagged as having side effects, and then whatever it reads is needed too.
+			Everything else would only produce results that are thrown away.
+			*/
+			void render_graph::cull()
+			{
+				std::vector<bool> needed(resources.size(), false);
+
+				for (size_t i = 0; i < resources.size(); i++)
+				{
+					needed[i] = resources[i].final_usage.has_value();
+				}
+
+				for (size_t i = passes.size(); i-- > 0;)
+				{
+					auto& p = passes[i];
+
+					bool live = p.has_side_effects;
+
+					for (const auto& w : p.writes)
+					{
+						live = live || needed[w.id];
+					}
+
+					p.culled = !live;
+
+					if (p.culled)
+						continue;
+
+					for (const auto& r : p.reads)
+					{
+						needed[r.id] = true;
+					}
+				}
+
+				order.clear();
+
+				for (uint32_t i = 0; i < passes.size(); i++)
+				{
+					// culled passes are listed by dump_timings
+					if (!passes[i].culled)
+					{
+						order.push_back(i);
+					}
+				}
+			}
+
+			/*
+			Every resource remembers its last writer and who has read it since. A barrier is only emitted when the
+			layout has to change, when somebody reads what was written (make the write visible), or when somebody
+			writes over what was read (wait for the readers, no cache flush needed). Reads of the same data in the
+			same layout are free once the write has been made visible to them.
+			*/
+			void render_graph::schedule_barriers()
+			{
+				struct tracked
+				{
+					VkImageLayout			layout;
+					VkPipelineStageFlags	write_stages;
+					VkAccessFlags			write_access;
+					VkPipelineStageFlags	read_stages;
+					VkPipelineStageFlags	visible_stages;
+					VkAccessFlags			visible_access;
+				};
+
+				std::vector<tracked> state(resources.size());
+
+				for (size_t i = 0; i < resources.size(); i++)
+				{
+					const auto& init = resources[i].initial;
+
+					// graph owned images are rewritten every frame, their old contents are never needed
+					state[i] = { resources[i].imported ? init.layout : VK_IMAGE_LAYOUT_UNDEFINED,
+						init.stages, init.access & write_accesses, 0, 0, 0 };
+
+					resources[i].first_use = ~0u;
+					resources[i].last_use = 0;
+				}
+
+				auto transition = [&](resource_id id, const resource_state& next, batch& out)
+				{
+					auto& s = state[id];
+					const bool is_image = resources[id].is_image;
+					const bool layout_change = is_image && s.layout != next.layout;
+
+					resource_state src{ s.layout, 0, 0, false };
+					resource_state dst = next;
+
+					if (next.write || layout_change)
+					{
+						// wait for everybody who touched the previous contents
+						src.stages = s.write_stages | s.read_stages;
+						src.access = s.write_access;
+
+						if (0 == src.stages && !layout_change)
+						{
+							src.stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+						}
+
+						if (!is_image)
+						{
+							dst.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+						}
+
+						out.barriers.push_back({ id, src, dst });
+
+						if (next.write)
+						{
+							s.write_stages = next.stages;
+							s.write_access = next.access & write_accesses;
+							s.read_stages = 0;
+							s.visible_stages = 0;
+							s.visible_access = 0;
+						}
+						else
+						{
+							s.read_stages = next.stages;
+							s.visible_stages = next.stages;
+							s.visible_access = next.access;
+						}
+
+						s.layout = is_image ? next.layout : s.layout;
+						return;
+					}
+
+					if (0 != s.write_stages && ((next.stages & ~s.visible_stages) || (next.access & ~s.visible_access)))
+					{
+						src.stages = s.write_stages;
+						src.access = s.write_access;
+						dst.layout = s.layout;
+
+						out.barriers.push_back({ id, src, dst });
+
+						s.visible_stages |= next.stages;
+						s.visible_access |= next.access;
+					}
+
+					s.read_stages |= next.stages;
+				};
+
+				pass_barriers.assign(order.size(), {});
+				final_barriers.barriers.clear();
+
+				for (uint32_t slot = 0; slot < order.size(); slot++)
+				{
+					const auto& p = passes[order[slot]];
+
+					for (const auto* list : { &p.reads, &p.writes })
+					{
+						for (const auto& a : *list)
+						{
+							auto& r = resources[a.id];
+							r.first_use = std::min(r.first_use, slot);
+							r.last_use = std::max(r.last_use, slot);
+
+							transition(a.id, state_for(a.u), pass_barriers[slot]);
+						}
+					}
+				}
+
+				for (resource_id id = 0; id < resources.size(); id++)
+				{
+					auto& r = resources[id];
+
+					if (r.final_usage)
+					{
+						transition(id, state_for(*r.final_usage), final_barriers);
+					}
+
+					// next frame starts from wherever this one left off
+					if (!r.imported)
+					{
+						r.initial = { VK_IMAGE_LAYOUT_UNDEFINED, state[id].write_stages | state[id].read_stages,
+							state[id].write_access, false };
+					}
+				}
+			}
+
+			/*
+			Transient images that are never alive at the same time can live in the same memory. Biggest images go
+			first, each one joins the first slot whose occupants' lifetimes it does not overlap and whose memory
+			types it can use, otherwise it opens a new slot.
+			*/
+			void render_graph::allocate_transients()
+			{
+				std::vector<resource_id> transients;
+				std::vector<VkMemoryRequirements> reqs(resources.size());
+
+				for (resource_id id = 0; id < resources.size(); id++)
+				{
+					auto& r = resources[id];
+
+					if (r.imported || ~0u == r.first_use)
+						continue;
+
+					VkImageCreateInfo img_info{};
+					img_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+					img_info.imageType = VK_IMAGE_TYPE_2D;
+					img_info.extent = { r.desc.extent.width, r.desc.extent.height, 1 };
+					img_info.mipLevels = r.desc.mip_levels;
+					img_info.arrayLayers = 1;
+					img_info.format = r.desc.format;
+					img_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+					img_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+					img_info.usage = r.desc.usage;
+					img_info.samples = r.desc.samples;
+					img_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+					if (!OP_SUCCESS(vkCreateImage(dev, &img_info, nullptr, &r.img)))
+					{
+						throw std::runtime_error("Failed to create render graph image " + r.name + "!");
+					}
+
+					vkGetImageMemoryRequirements(dev, r.img, &reqs[id]);
+					transients.push_back(id);
+				}
+
+				std::sort(transients.begin(), transients.end(), [&reqs](resource_id a, resource_id b)
+					{
+						return reqs[a].size > reqs[b].size;
+					});
+
+				slots.clear();
+
+				for (auto id : transients)
+				{
+					auto& r = resources[id];
+
+					auto fits = [&](const memory_slot& s)
+					{
+						if (0 == (s.type_bits & reqs[id].memoryTypeBits))
+							return false;
+
+						for (auto o : s.occupants)
+						{
+							if (r.first_use <= resources[o].last_use && resources[o].first_use <= r.last_use)
+								return false;
+						}
+
+						return true;
+					};
+
+					auto slot = std::find_if(slots.begin(), slots.end(), fits);
+
+					if (slots.end() == slot)
+					{
+						slots.emplace_back();
+						slot = slots.end() - 1;
+					}
+
+					// sizes are sorted descending, so only the alignment can still grow the slot
+					VkDeviceSize aligned = (reqs[id].size + reqs[id].alignment - 1) & ~(reqs[id].alignment - 1);
+
+					slot->size = std::max(slot->size, aligned);
+					slot->type_bits &= reqs[id].memoryTypeBits;
+					slot->occupants.push_back(id);
+
+					r.memory_slot = static_cast<uint32_t>(slot - slots.begin());
+				}
+
+				/*
+				An image's first use has to wait for whatever used its memory last: the previous occupant of the slot
+				in this frame, or the last one of the frame before, which may still be in flight.
+				*/
+				for (const auto& s : slots)
+				{
+					std::vector<resource_id> by_lifetime = s.occupants;
+
+					std::sort(by_lifetime.begin(), by_lifetime.end(), [this](resource_id a, resource_id b)
+						{
+							return resources[a].first_use < resources[b].first_use;
+						});
+
+					for (size_t i = 0; i < by_lifetime.size(); i++)
+					{
+						const auto& r = resources[by_lifetime[i]];
+						const auto& before = resources[by_lifetime[(i + by_lifetime.size() - 1) % by_lifetime.size()]];
+
+						for (auto& b : pass_barriers[r.first_use].barriers)
+						{
+							if (by_lifetime[i] != b.id)
+								continue;
+
+							b.src.stages |= r.initial.stages | before.initial.stages;
+							b.src.access |= r.initial.access | before.initial.access;
+							break;
+						}
+					}
+				}
+
+				transient_bytes = 0;
+
+				for (auto& s : slots)
+				{
+					VkMemoryAllocateInfo alloc_info{};
+					alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+					alloc_info.allocationSize = s.size;
+					alloc_info.memoryTypeIndex = find_mem_type(s.type_bits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+					if (!OP_SUCCESS(vkAllocateMemory(dev, &alloc_info, nullptr, &s.memory)))
+					{
+						throw std::runtime_error("Failed to allocate render graph memory!");
+					}
+
+					transient_bytes += s.size;
+
+					for (auto id : s.occupants)
+					{
+						auto& r = resources[id];
+
+						vkBindImageMemory(dev, r.img, s.memory, 0);
+						r.img_view = create_img_view(r.img, r.desc.format, r.desc.aspect);
+					}
+				}
+
+				if (!slots.empty())
+				{
+					std::cout << "Render graph: " << transients.size() << " transient images in " << slots.size()
+						<< " allocations, " << transient_bytes / 1024 << " KiB" << std::endl;
+				}
+			}
+
+			void render_graph::create_queries()
+			{
+				VkPhysicalDeviceProperties props{};
+				vkGetPhysicalDeviceProperties(pd, &props);
+
+				uint32_t family_count = 0;
+				vkGetPhysicalDeviceQueueFamilyProperties(pd, &family_count, nullptr);
+
+				std::vector<VkQueueFamilyProperties> families(family_count);
+				vkGetPhysicalDeviceQueueFamilyProperties(pd, &family_count, families.data());
+
+				auto graphics = find_queue_families(pd).graphics_family;
+
+				timings.assign(passes.size(), {});
+
+				if (!graphics || 0 == families[*graphics].timestampValidBits || order.empty())
+				{
+					return;
+				}
+
+				timestamp_period = props.limits.timestampPeriod;
+
+				// a begin and an end stamp per live pass, one set per frame in flight
+				VkQueryPoolCreateInfo qp_info{};
+				qp_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+				qp_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+				qp_info.queryCount = static_cast<uint32_t>(2 * order.size() * max_frames_in_flight);
+
+				if (!OP_SUCCESS(vkCreateQueryPool(dev, &qp_info, nullptr, &query_pool)))
+				{
+					throw std::runtime_error("Failed to create render graph query pool!");
+				}
+
+				queries_written.assign(max_frames_in_flight, false);
+			}
+
+			void render_graph::bind_image(resource_id id, VkImage image, VkImageView view)
+			{
+				resources[id].img = image;
+				resources[id].img_view = view;
+			}
+
+			void render_graph::bind_buffer(resource_id id, VkBuffer buffer)
+			{
+				resources[id].buf = buffer;
+			}
+
+			VkImage render_graph::image(resource_id id) const
+			{
+				return resources[id].img;
+			}
+
+			VkImageView render_graph::view(resource_id id) const
+			{
+				return resources[id].img_view;
+			}
+
+			VkBuffer render_graph::buffer(resource_id id) const
+			{
+				return resources[id].buf;
+			}
+
+			void render_graph::record_batch(VkCommandBuffer cmd, const batch& b, std::pmr::memory_resource* scratch) const
+			{
+				if (b.barriers.empty())
+					return;
+
+				std::pmr::vector<VkImageMemoryBarrier> img_barriers(scratch);
+				std::pmr::vector<VkBufferMemoryBarrier> buf_barriers(scratch);
+
+				img_barriers.reserve(b.barriers.size());
+				buf_barriers.reserve(b.barriers.size());
+				VkPipelineStageFlags src_stages = 0;
+				VkPipelineStageFlags dst_stages = 0;
+
+				for (const auto& br : b.barriers)
+				{
+					const auto& r = resources[br.id];
+
+					src_stages |= br.src.stages;
+					dst_stages |= br.dst.stages;
+
+					if (r.is_image)
+					{
+						VkImageMemoryBarrier ib{};
+						ib.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+						ib.srcAccessMask = br.src.access;
+						ib.dstAccessMask = br.dst.access;
+						ib.oldLayout = br.src.layout;
+						ib.newLayout = br.dst.layout;
+						ib.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+						ib.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+						ib.image = r.img;
+						ib.subresourceRange = { r.desc.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+
+						img_barriers.push_back(ib);
+					}
+					else
+					{
+						VkBufferMemoryBarrier bb{};
+						bb.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+						bb.srcAccessMask = br.src.access;
+						bb.dstAccessMask = br.dst.access;
+						bb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+						bb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+						bb.buffer = r.buf;
+						bb.offset = 0;
+						bb.size = VK_WHOLE_SIZE;
+
+						buf_barriers.push_back(bb);
+					}
+				}
+
+				if (0 == src_stages)
+				{
+					src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+				}
+
+				// everything the pass needs goes out in one call so the driver can batch the cache operations
+				vkCmdPipelineBarrier(cmd, src_stages, dst_stages, 0,
+					0, nullptr,
+					static_cast<uint32_t>(buf_barriers.size()), buf_barriers.data(),
+					static_cast<uint32_t>(img_barriers.size()), img_barriers.data());
+			}
+
+			void render_graph::collect_timings(uint32_t frame_slot, std::pmr::memory_resource* scratch)
+			{
+				if (VK_NULL_HANDLE == query_pool || !queries_written[frame_slot])
+					return;
+
+				const uint32_t count = static_cast<uint32_t>(2 * order.size());
+				std::pmr::vector<uint64_t> stamps(count, scratch);
+
+				// the caller waited for this slot's last submission, so the results are available without stalling
+				if (VK_SUCCESS != vkGetQueryPoolResults(dev, query_pool, frame_slot * count, count,
+					stamps.size() * sizeof(uint64_t), stamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT))
+				{
+					return;
+				}
+
+				for (size_t i = 0; i < order.size(); i++)
+				{
+					auto& t = timings[order[i]];
+
+					t.total_ms += static_cast<double>(stamps[2 * i + 1] - stamps[2 * i]) * timestamp_period * 1e-6;
+					t.samples++;
+				}
+			}
+
+			void render_graph::execute(VkCommandBuffer cmd, uint32_t frame_slot, uint32_t image_index,
+				std::pmr::memory_resource* scratch)
+			{
+				const uint32_t count = static_cast<uint32_t>(2 * order.size());
+
+				if (VK_NULL_HANDLE != query_pool)
+				{
+					collect_timings(frame_slot, scratch);
+
+					vkCmdResetQueryPool(cmd, query_pool, frame_slot * count, count);
+					queries_written[frame_slot] = true;
+				}
+
+				for (size_t i = 0; i < order.size(); i++)
+				{
+					record_batch(cmd, pass_barriers[i], scratch);
+
+					if (VK_NULL_HANDLE != query_pool)
+						vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool, frame_slot * count + 2 * uint32_t(i));
+
+					passes[order[i]].execute(cmd, image_index);
+
+					if (VK_NULL_HANDLE != query_pool)
+						vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, frame_slot * count + 2 * uint32_t(i) + 1);
+				}
+
+				record_batch(cmd, final_barriers, scratch);
+			}
+
+			void render_graph::dump_timings(std::ostream& out) const
+			{
+				if (VK_NULL_HANDLE == query_pool)
+				{
+					out << "Render graph: timestamps not supported on the graphics queue\n";
+					return;
+				}
+
+				out << "Render graph pass timings (GPU, average):\n";
+
+				for (auto i : order)
+				{
+					const auto& t = timings[i];
+
+					out << '\t' << std::left << std::setw(24) << passes[i].name << std::right << std::fixed << std::setprecision(3)
+						<< (t.samples ? t.total_ms / static_cast<double>(t.samples) : 0.0) << " ms over " << t.samples << " frames\n";
+				}
+
+				for (const auto& p : passes)
+				{
+					if (p.culled)
+						out << '\t' << std::left << std::setw(24) << p.name << std::right << "culled\n";
+				}
+
+				out << std::defaultfloat;
+			}
+
+			double render_graph::average_ms(const std::string& pass) const
+			{
+				for (auto i : order)
+				{
+					if (pass != passes[i].name || timings.size() <= i)
+						continue;
+
+					const auto& t = timings[i];
+
+					return t.samples ? t.total_ms / static_cast<double>(t.samples) : 0.0;
+				}
+
+				return 0.0;
+			}
+
+			void render_graph::reset_timings()
+			{
+				timings.assign(passes.size(), {});
+			}
+
+			void render_graph::destroy()
+			{
+				for (auto& r : resources)
+				{
+					if (!r.imported)
+					{
+						if (VK_NULL_HANDLE != r.img_view)
+							vkDestroyImageView(dev, r.img_view, nullptr);
+
+						if (VK_NULL_HANDLE != r.img)
+							vkDestroyImage(dev, r.img, nullptr);
+					}
+				}
+
+				for (auto& s : slots)
+				{
+					vkFreeMemory(dev, s.memory, nullptr);
+				}
+
+				if (VK_NULL_HANDLE != query_pool)
+				{
+					vkDestroyQueryPool(dev, query_pool, nullptr);
+				}
+
+				resources.clear();
+				passes.clear();
+				order.clear();
+				pass_barriers.clear();
+				final_barriers.barriers.clear();
+				slots.clear();
+				transient_bytes = 0;
+				query_pool = VK_NULL_HANDLE;
+				queries_written.clear();
+				timings.clear();
+			}
+		}
+	}
+}
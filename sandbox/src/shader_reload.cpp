@@ -0,0 +1,316 @@
+#include "vk_sandbox.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#ifdef SANDBOX_HOT_RELOAD
+#include <shaderc/shaderc.hpp>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace sandbox
+{
+	namespace vulkan
+	{
+		namespace hot_reload
+		{
+			std::mutex							pipeline_mutex;
+
+			struct watched_shader
+			{
+				fs::path						path;
+				fs::file_time_type				stamp;
+				VkShaderStageFlagBits			stage;
+			};
+
+			std::thread							worker;
+			std::mutex							state_mutex;
+			std::condition_variable				wake;
+			bool								running{ false };
+
+			// last successful compile of every stage, guarded by state_mutex
+			std::unordered_map<uint32_t, std::vector<uint32_t>> spirv;
+			VkPipeline							pending{ VK_NULL_HANDLE };
+			pipeline_variant					pending_variant;
+			uint64_t							pending_generation{ 0 };
+
+			pipeline_variant					target_variant;
+
+			// bumped whenever the render pass a pipeline was built against goes away
+			std::atomic<uint64_t>				generation{ 0 };
+
+			constexpr auto						poll_interval = std::chrono::milliseconds(250);
+
+			std::optional<VkShaderStageFlagBits> stage_from_extension(const fs::path& p)
+			{
+				const auto ext = p.extension();
+
+				if (".vert" == ext) return VK_SHADER_STAGE_VERTEX_BIT;
+				if (".frag" == ext) return VK_SHADER_STAGE_FRAGMENT_BIT;
+				if (".comp" == ext) return VK_SHADER_STAGE_COMPUTE_BIT;
+				if (".geom" == ext) return VK_SHADER_STAGE_GEOMETRY_BIT;
+				if (".tesc" == ext) return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+				if (".tese" == ext) return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+
+				return std::nullopt;
+			}
+
+#ifdef SANDBOX_HOT_RELOAD
+			bool compile(const watched_shader& shader, std::vector<uint32_t>& code)
+			{
+				std::ifstream source(shader.path);
+
+				if (!source.is_open())
+				{
+					return false;
+				}
+
+				std::stringstream text;
+				text << source.rdbuf();
+
+				shaderc_shader_kind kind = shaderc_glsl_infer_from_source;
+
+				switch (shader.stage)
+				{
+				case VK_SHADER_STAGE_VERTEX_BIT:					kind = shaderc_vertex_shader; break;
+				case VK_SHADER_STAGE_FRAGMENT_BIT:					kind = shaderc_fragment_shader; break;
+				case VK_SHADER_STAGE_COMPUTE_BIT:					kind = shaderc_compute_shader; break;
+				case VK_SHADER_STAGE_GEOMETRY_BIT:					kind = shaderc_geometry_shader; break;
+				case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT:		kind = shaderc_tess_control_shader; break;
+				case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT:	kind = shaderc_tess_evaluation_shader; break;
+				default: break;
+				}
+
+				shaderc::Compiler compiler;
+				shaderc::CompileOptions options;
+				options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_2);
+				options.SetOptimizationLevel(shaderc_optimization_level_performance);
+
+				auto result = compiler.CompileGlslToSpv(text.str(), kind, shader.path.string().c_str(), options);
+
+				if (shaderc_compilation_status_success != result.GetCompilationStatus())
+				{
+					std::cerr << "Shader hot reload: " << result.GetErrorMessage() << std::endl;
+					return false;
+				}
+
+				code.assign(result.cbegin(), result.cend());
+
+				return true;
+			}
+
+			void rebuild_pipeline()
+			{
+				std::vector<uint32_t> vert, frag;
+
+				if (!current_spirv(VK_SHADER_STAGE_VERTEX_BIT, vert) || !current_spirv(VK_SHADER_STAGE_FRAGMENT_BIT, frag))
+				{
+					return;
+				}
+
+				VkPipeline pipeline = VK_NULL_HANDLE;
+				uint64_t built_for = 0;
+				pipeline_variant variant;
+
+				{
+					std::lock_guard<std::mutex> lock(state_mutex);
+					variant = target_variant;
+				}
+
+				try
+				{
+					// the render pass cannot be replaced underneath us while we build against it
+					std::lock_guard<std::mutex> lock(pipeline_mutex);
+
+					built_for = generation.load();
+					pipeline = build_graphics_pipeline(vert.data(), vert.size() * sizeof(uint32_t),
+						frag.data(), frag.size() * sizeof(uint32_t), variant);
+				}
+				catch (const std::exception& e)
+				{
+					std::cerr << "Shader hot reload: " << e.what() << std::endl;
+					return;
+				}
+
+				std::lock_guard<std::mutex> lock(state_mutex);
+
+				// a pipeline nobody picked up yet was never submitted, it can go right away
+				if (VK_NULL_HANDLE != pending)
+				{
+					vkDestroyPipeline(dev, pending, nullptr);
+				}
+
+				pending = pipeline;
+				pending_variant = variant;
+				pending_generation = built_for;
+
+				std::cout << "Shader hot reload: pipeline rebuilt" << std::endl;
+			}
+
+			void watch(std::vector<watched_shader> shaders)
+			{
+				std::unique_lock<std::mutex> lock(state_mutex);
+
+				while (running)
+				{
+					wake.wait_for(lock, poll_interval);
+
+					if (!running)
+						break;
+
+					lock.unlock();
+
+					bool changed = false;
+
+					for (auto& shader : shaders)
+					{
+						std::error_code ec;
+						auto stamp = fs::last_write_time(shader.path, ec);
+
+						// editors often replace the file, skip the window where it does not exist
+						if (ec || stamp == shader.stamp)
+							continue;
+
+						shader.stamp = stamp;
+						changed = true;
+
+						std::vector<uint32_t> code;
+
+						if (compile(shader, code))
+						{
+							std::lock_guard<std::mutex> state(state_mutex);
+							spirv[shader.stage] = std::move(code);
+						}
+					}
+
+					if (changed)
+					{
+						// the pipeline needs every stage, compile the ones that were never edited as well
+						for (const auto& shader : shaders)
+						{
+							std::vector<uint32_t> code;
+
+							if (!current_spirv(shader.stage, code) && compile(shader, code))
+							{
+								std::lock_guard<std::mutex> state(state_mutex);
+								spirv[shader.stage] = std::move(code);
+							}
+						}
+
+						rebuild_pipeline();
+					}
+
+					lock.lock();
+				}
+			}
+#endif
+
+			void start(const char* shader_dir)
+			{
+#ifdef SANDBOX_HOT_RELOAD
+				std::vector<watched_shader> shaders;
+				std::error_code ec;
+
+				for (const auto& e : fs::directory_iterator(shader_dir, ec))
+				{
+					auto stage = stage_from_extension(e.path());
+
+					// only the scene pipeline's sources, any other shader in the directory must not replace its stages
+					if (e.is_regular_file() && stage && "shader" == e.path().stem())
+					{
+						auto stamp = fs::last_write_time(e.path(), ec);
+
+						if (!ec)
+							shaders.push_back({ e.path(), stamp, *stage });
+					}
+				}
+
+				if (shaders.empty())
+				{
+					std::cerr << "Shader hot reload: no shaders found in " << shader_dir << std::endl;
+					return;
+				}
+
+				running = true;
+				worker = std::thread(watch, std::move(shaders));
+#else
+				(void)shader_dir;
+#endif
+			}
+
+			void stop()
+			{
+				{
+					std::lock_guard<std::mutex> lock(state_mutex);
+					running = false;
+				}
+
+				wake.notify_all();
+
+				if (worker.joinable())
+				{
+					worker.join();
+				}
+
+				invalidate();
+			}
+
+			bool current_spirv(VkShaderStageFlagBits stage, std::vector<uint32_t>& code)
+			{
+				std::lock_guard<std::mutex> lock(state_mutex);
+
+				auto it = spirv.find(stage);
+
+				if (spirv.end() == it)
+					return false;
+
+				code = it->second;
+
+				return true;
+			}
+
+			void track_variant(const pipeline_variant& variant)
+			{
+				std::lock_guard<std::mutex> lock(state_mutex);
+
+				target_variant = variant;
+			}
+
+			VkPipeline take_pipeline(pipeline_variant& variant)
+			{
+				std::lock_guard<std::mutex> lock(state_mutex);
+
+				variant = pending_variant;
+
+				if (VK_NULL_HANDLE != pending && generation.load() != pending_generation)
+				{
+					// built against a render pass that has since been recreated
+					vkDestroyPipeline(dev, pending, nullptr);
+					pending = VK_NULL_HANDLE;
+				}
+
+				return std::exchange(pending, VK_NULL_HANDLE);
+			}
+
+			void invalidate()
+			{
+				++generation;
+
+				std::lock_guard<std::mutex> lock(state_mutex);
+
+				if (VK_NULL_HANDLE != pending)
+				{
+					vkDestroyPipeline(dev, pending, nullptr);
+					pending = VK_NULL_HANDLE;
+				}
+			}
+		}
+	}
+}
@@ -1,18 +1,165 @@
 #include "vk_sandbox.hpp"
+#include "asset_pack.hpp"
+#include "render_graph.hpp"
+#include "frame_arena.hpp"
+#include "draw_sort.hpp"
+#include "descriptor_allocator.hpp"
+#include "embedded_shaders.hpp"
 
 #include <memory>
 #include <set>
 #include <cstring>
+#include <cmath>
+#include <cctype>
 #include <algorithm> 
 #include <fstream>
+#include <iomanip>
+#include <map>
+#include <unordered_map>
+#include <thread>
+#include <deque>
+#include <future>
+
+#include <gtc/packing.hpp>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
-#define OP_SUCCESS(X) VK_SUCCESS == X
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
 
 namespace sandbox
 {
+	options settings;
+
+	void parse_options(int argc, char** argv)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			std::string arg = argv[i];
+
+			if ("--msaa" == arg && i + 1 < argc)
+			{
+				settings.msaa_samples = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+			}
+			else if ("--objects" == arg && i + 1 < argc)
+			{
+				settings.object_count = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+			}
+			else if ("--prepass" == arg)
+			{
+				settings.depth_prepass = true;
+			}
+			else if ("--unsorted" == arg)
+			{
+				settings.sort_front_to_back = false;
+			}
+			else if ("--occlusion" == arg)
+			{
+				settings.occlusion_culling = true;
+			}
+			else if ("--compact-vertices" == arg)
+			{
+				settings.compact_vertices = true;
+			}
+			else if ("--no-lod" == arg)
+			{
+				settings.lod = false;
+			}
+			else if ("--lod-error" == arg && i + 1 < argc)
+			{
+				settings.lod_pixel_error = std::max(0.f, static_cast<float>(std::atof(argv[++i])));
+			}
+			else if ("--clusters" == arg)
+			{
+				settings.cluster_culling = true;
+			}
+			else if ("--present" == arg && i + 1 < argc)
+			{
+				std::string mode = argv[++i];
+
+				if ("immediate" == mode)
+					settings.present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+				else if ("mailbox" == mode)
+					settings.present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+				else if ("fifo" == mode)
+					settings.present_mode = VK_PRESENT_MODE_FIFO_KHR;
+				else
+					throw std::runtime_error("Unknown present mode " + mode + "!");
+			}
+			else if ("--fps" == arg && i + 1 < argc)
+			{
+				settings.target_fps = std::max(0.f, static_cast<float>(std::atof(argv[++i])));
+			}
+			else if ("--no-descriptor-cache" == arg)
+			{
+				settings.descriptor_cache = false;
+			}
+			else if ("--sort-bench" == arg)
+			{
+				settings.sort_benchmark = true;
+			}
+			else if ("--descriptor-bench" == arg)
+			{
+				settings.descriptor_benchmark = true;
+			}
+			else if ("--no-async-compute" == arg)
+			{
+				settings.async_compute = false;
+			}
+			else if ("--particles" == arg && i + 1 < argc)
+			{
+				settings.particle_count = static_cast<uint32_t>(std::max(0, std::atoi(argv[++i])));
+			}
+			else if ("--particle-bench" == arg)
+			{
+				settings.particle_benchmark = true;
+			}
+			else if ("--device" == arg && i + 1 < argc)
+			{
+				settings.device = argv[++i];
+			}
+			else if ("--packed-shaders" == arg)
+			{
+				settings.packed_shaders = true;
+			}
+			else if ("--no-post" == arg)
+			{
+				settings.post_processing = false;
+			}
+			else if ("--post-bench" == arg)
+			{
+				settings.post_benchmark = true;
+			}
+			else if ("--post-budget" == arg && i + 1 < argc)
+			{
+				settings.post_budget_ms = std::max(0.f, static_cast<float>(std::atof(argv[++i])));
+			}
+			else if ("--capture" == arg && i + 1 < argc)
+			{
+				settings.capture_frame = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+			}
+			else if ("--capture-out" == arg && i + 1 < argc)
+			{
+				settings.capture_path = argv[++i];
+			}
+			else if ("--fixed-step" == arg)
+			{
+				settings.fixed_step = true;
+			}
+			else
+			{
+				std::cerr << "usage: sandbox [--msaa 1|2|4|8] [--objects N] [--prepass] [--unsorted] [--occlusion]"
+					" [--compact-vertices] [--no-lod] [--lod-error PX] [--clusters]"
+					" [--present immediate|mailbox|fifo] [--fps N] [--no-descriptor-cache] [--sort-bench]"
+					" [--descriptor-bench] [--no-async-compute] [--particles N] [--particle-bench]"
+					" [--device NAME|INDEX] [--packed-shaders] [--no-post] [--post-bench] [--post-budget MS]"
+					" [--capture FRAME] [--capture-out PATH] [--fixed-step]\n";
+				throw std::runtime_error("Unknown option " + arg + "!");
+			}
+		}
+	}
+
 	namespace glfw
 	{
 		GLFWwindow* window;
@@ -22,6 +169,112 @@ namespace sandbox
 			vulkan::fb_resized = true;
 		}
 
+		void key_callback(GLFWwindow* win, int key, int scancode, int action, int mods)
+		{
+			if (GLFW_PRESS != action)
+				return;
+
+			if (GLFW_KEY_T == key)
+			{
+				static const char* names[] = { "textured", "texture coordinates", "vertex color", "normals" };
+
+				auto& mode = vulkan::active_variant.frag.shading_mode;
+				mode = (mode + 1) % vulkan::SHADING_MODE_COUNT;
+
+				// picked up at the next frame boundary, built on first use
+				vulkan::hot_reload::track_variant(vulkan::active_variant);
+
+				std::cout << "Shading: " << names[mode] << std::endl;
+			}
+			else if (GLFW_KEY_P == key)
+			{
+				vulkan::frame_graph.dump_timings(std::cout);
+			}
+			else if (GLFW_KEY_M == key)
+			{
+				// numbers for the count we are leaving, while its attachments still exist
+				vulkan::report_msaa_stats();
+
+				settings.msaa_samples = settings.msaa_samples >= 8 ? 1 : settings.msaa_samples * 2;
+
+				// render pass, attachments and pipelines all depend on it, same path as a resize
+				vulkan::fb_resized = true;
+			}
+			else if (GLFW_KEY_Z == key)
+			{
+				vulkan::report_depth_stats();
+
+				// adds or removes a subpass, so the render pass is rebuilt
+				settings.depth_prepass = !settings.depth_prepass;
+				vulkan::fb_resized = true;
+
+				std::cout << "Depth prepass: " << (settings.depth_prepass ? "on" : "off") << std::endl;
+			}
+			else if (GLFW_KEY_F == key)
+			{
+				vulkan::report_depth_stats();
+
+				settings.sort_front_to_back = !settings.sort_front_to_back;
+
+				std::cout << "Front to back sorting: " << (settings.sort_front_to_back ? "on" : "off") << std::endl;
+			}
+			else if (GLFW_KEY_O == key)
+			{
+				vulkan::report_occlusion_stats();
+
+				// depth becomes sampleable and the frame splits into two geometry passes
+				settings.occlusion_culling = !settings.occlusion_culling;
+				vulkan::fb_resized = true;
+
+				std::cout << "Occlusion culling: " << (settings.occlusion_culling ? "on" : "off") << std::endl;
+			}
+			else if (GLFW_KEY_V == key)
+			{
+				vulkan::report_vertex_stats();
+
+				// the vertex buffer is rebuilt in the new layout together with the pipelines
+				settings.compact_vertices = !settings.compact_vertices;
+				vulkan::fb_resized = true;
+
+				std::cout << "Vertices: " << (settings.compact_vertices ? "compact" : "full precision") << std::endl;
+			}
+			else if (GLFW_KEY_L == key)
+			{
+				vulkan::report_lod_stats();
+
+				// only changes what update_ubo writes, nothing to rebuild
+				settings.lod = !settings.lod;
+
+				std::cout << "LOD selection: " << (settings.lod ? "on" : "off") << std::endl;
+			}
+			else if (GLFW_KEY_C == key)
+			{
+				vulkan::report_cluster_stats();
+
+				// adds or removes the cull pass, and the forward pass draws from different buffers
+				settings.cluster_culling = !settings.cluster_culling;
+				vulkan::fb_resized = true;
+
+				std::cout << "Cluster culling: " << (settings.cluster_culling ? "on" : "off") << std::endl;
+			}
+			else if (GLFW_KEY_I == key)
+			{
+				vulkan::report_pacing_stats();
+
+				// the present mode is fixed at swap chain creation
+				switch (settings.present_mode)
+				{
+				case VK_PRESENT_MODE_IMMEDIATE_KHR: settings.present_mode = VK_PRESENT_MODE_MAILBOX_KHR; break;
+				case VK_PRESENT_MODE_MAILBOX_KHR: settings.present_mode = VK_PRESENT_MODE_FIFO_KHR; break;
+				default: settings.present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR; break;
+				}
+
+				vulkan::fb_resized = true;
+
+				std::cout << "Present mode: " << vulkan::KHR::present_mode_name(settings.present_mode) << std::endl;
+			}
+		}
+
 		void glfw_initialization(const unsigned res_width, const unsigned res_height)
 		{
 			glfwInit();
@@ -32,6 +285,7 @@ namespace sandbox
 			window = glfwCreateWindow(res_width, res_height, "sandbox", nullptr, nullptr);
 			
 			glfwSetFramebufferSizeCallback(window, framebuffer_resize_callback);
+			glfwSetKeyCallback(window, key_callback);
 		}
 
 		void destroy_resources()
@@ -47,51 +301,224 @@ namespace sandbox
 	
 	namespace vulkan
 	{
-		constexpr unsigned max_frames_in_flight = 2;
-
 		const std::vector<const char*> dev_extensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 
-		const std::vector<vertex> vertices =
+		const char* const model_path = "resource/model/viking_room.obj";
+		const char* const texture_path = "resource/image/viking_room.png";
+
+		// the pack stores vertices in exactly this layout so they can be copied out of the mapping as-is
+		static_assert(sizeof(vertex) == 11 * sizeof(float), "vertex layout no longer matches the baked mesh format");
+
+		struct UniformBufferObject
+		{
+			alignas(16) glm::mat4 view;
+			alignas(16) glm::mat4 proj;
+		};
+
+		// see the Cull block in occlusion_cull.comp
+		struct cull_constants
 		{
-			{{-0.5f, -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}, {1.0f, 0.0f}},
-			{{ 0.5f, -0.5f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}},
-			{{ 0.5f,  0.5f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}},
-			{{-0.5f,  0.5f, 0.0f}, {1.0f, 1.0f, 1.0f}, {1.0f, 1.0f}},
+			glm::mat4					view;
+			float						p00;
+			float						p11;
+			float						znear;
+			float						zfar;
+			glm::vec2					pyramid_size;
+			uint32_t					object_count;
+		};
 
-			{{-0.5f, -0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
-			{{ 0.5f, -0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
-			{{ 0.5f,  0.5f, -0.5f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f}},
-			{{-0.5f,  0.5f, -0.5f}, {1.0f, 1.0f, 1.0f}, {0.0f, 1.0f}}
+		// see the Reduce block in depth_pyramid.comp
+		struct pyramid_constants
+		{
+			int32_t						src_size[2];
+			int32_t						dst_size[2];
+			int32_t						samples;
 		};
 
-		const std::vector<uint16_t> indices =
+		// mirrors the Stats block in occlusion_cull.comp
+		struct cull_counters
 		{
-			0, 1, 2, 2, 3, 0,
-			4, 5, 6, 6, 7, 4
+			uint32_t					early_drawn;
+			uint32_t					late_drawn;
+			uint32_t					frustum_culled;
+			uint32_t					occluded;
 		};
 
-		struct UniformBufferObject
+		// see the Cluster block in cluster_cull.comp
+		struct cluster_constants
 		{
-			alignas(16) glm::mat4 model;
-			alignas(16) glm::mat4 view;
-			alignas(16) glm::mat4 proj;
+			glm::mat4					quantize;
+			float						znear;
+			float						zfar;
+			uint32_t					object_count;
+			uint32_t					index_stride;
+		};
+
+		// mirrors the Stats block in cluster_cull.comp
+		struct cluster_counters
+		{
+			uint32_t					meshlets_tested;
+			uint32_t					frustum_culled;
+			uint32_t					backface_culled;
+			uint32_t					triangles_in;
+			uint32_t					triangles_out;
+		};
+
+		// see the Simulation block in particles.comp
+		struct particle_constants
+		{
+			glm::vec4					emitter;		// xyz position, w launch speed
+			float						dt;
+			float						lifetime;
+			float						gravity;
+			float						size;
+			uint32_t					capacity;
+			uint32_t					emit_count;
+			uint32_t					seed;
 		};
 
+		// see the Post block in bloom_down.comp, bloom_up.comp, tonemap.comp and fxaa.comp
+		struct post_constants
+		{
+			int32_t						src_size[2];
+			int32_t						dst_size[2];
+			float						threshold;
+			float						knee;
+			float						bloom_strength;
+			float						exposure;
+			uint32_t					srgb_target;
+		};
+
+		// Particle in particles.comp
+		struct gpu_particle
+		{
+			glm::vec4					position_life;
+			glm::vec4					velocity_size;
+			glm::vec4					color;
+		};
+
+		// DrawParticle in particles.comp and particle.vert
+		struct particle_draw
+		{
+			glm::vec4					position_size;
+			glm::vec4					color;
+		};
+
+		struct scene_object
+		{
+			glm::vec3					position;
+			glm::mat4					model;
+			float						view_depth;
+			glm::vec3					center;			// of the world space bounds
+			uint32_t					lod;			// this frame's, picked by projected error
+		};
+
+		asset::pack						assets;
+
+		// point straight into the asset pack mapping
+		const vertex*					model_vertices{ nullptr };
+		const uint32_t*					model_indices{ nullptr };
+		uint32_t						vertex_count{ 0 };
+		uint32_t						index_count{ 0 };		// every LOD, the size of the index buffer
+
+		// copied out of the mesh header, finest first
+		std::vector<asset::mesh_lod>	model_lods;
+
+		// every LOD's meshlets back to back, also straight from the pack
+		const asset::mesh_meshlet*		model_meshlets{ nullptr };
+		uint32_t						meshlet_count{ 0 };
+
+		std::vector<scene_object>		scene;
+		std::vector<uint32_t>			draw_order;
+
+		// the render pass's subpasses, and the pipeline numbers draw keys use
+		enum draw_pass : uint32_t
+		{
+			DRAW_PASS_DEPTH = 0,			// the prepass, when there is one
+			DRAW_PASS_SHADE
+		};
+
+		// this frame's draws in key order, both arrays come from the frame's arena
+		struct draw_list
+		{
+			uint64_t*					keys{ nullptr };
+			uint32_t*					objects{ nullptr };		// index into scene
+			uint32_t					count{ 0 };
+		};
+
+		draw_list						frame_draws;
+
+		enum bind_kind : uint32_t
+		{
+			BIND_PIPELINE = 0,
+			BIND_DESCRIPTOR_SET,
+			BIND_VERTEX_BUFFER,
+			BIND_INDEX_BUFFER,
+			BIND_KIND_COUNT
+		};
+
+		// what the command buffer has bound, so a draw only binds what differs from the draw before it
+		struct bind_state
+		{
+			VkPipeline					pipeline{ VK_NULL_HANDLE };
+			VkDescriptorSet				set{ VK_NULL_HANDLE };
+			VkBuffer					vertex_buffer{ VK_NULL_HANDLE };
+			VkBuffer					index_buffer{ VK_NULL_HANDLE };
+		};
+
+		struct draw_stats
+		{
+			uint64_t					sorts{ 0 };
+			uint64_t					draws{ 0 };
+			double						sort_ms{ 0.0 };
+			std::array<uint64_t, BIND_KIND_COUNT> issued{};
+			std::array<uint64_t, BIND_KIND_COUNT> skipped{};		// the ones a bind per draw would have repeated
+		};
+
+		draw_stats						draw_counters;
+
+		glm::vec3						camera_eye{ 2.f, 2.f, 2.f };
+		float							camera_near{ 0.1f };
+		float							camera_far{ 10.f };
+
+		// this frame's camera, the cull passes need it as well as the UBO
+		glm::mat4						camera_view{ 1.f };
+		glm::mat4						camera_proj{ 1.f };
+
+		// model space bounding sphere of the mesh
+		glm::vec4						mesh_bounds{ 0.f };
+
 		VkInstance						instance;
 		VkPhysicalDevice				pd;
 		VkDevice						dev;
 		VkSurfaceKHR					surface;
 
 		VkRenderPass					render_pass;
+
+		// same attachments as render_pass but loads them, for the late occlusion pass; compatible so pipelines are shared
+		VkRenderPass					render_pass_late{ VK_NULL_HANDLE };
 		VkPipelineLayout				pipeline_layout;
 
 		VkDescriptorSetLayout			descriptor_set_layout;
 
 		VkQueue							graphics_queue;
 		VkQueue							present_queue;
+		VkQueue							compute_queue;
 
+		bool							multi_draw_indirect{ false };
+		bool							draw_indirect_first_instance{ false };
+		bool							sampler_anisotropy{ false };
+
+		// the active variant's pipeline, owned by pipeline_variants
 		VkPipeline						graphics_pipeline;
 
+		// depth only pipeline for subpass 0 when the prepass is on, also owned by pipeline_variants
+		VkPipeline						depth_pipeline{ VK_NULL_HANDLE };
+
+		pipeline_variant				active_variant;
+
+		std::unordered_map<pipeline_variant, VkPipeline, pipeline_variant_hash> pipeline_variants;
+
 		VkFormat						sc_img_fmt;
 		VkExtent2D						sc_extent;
 
@@ -100,6 +527,10 @@ namespace sandbox
 		VkBuffer						vertex_buffer;
 		VkDeviceMemory					vtx_buffer_mem;
 
+		// layout the vertex buffer currently holds, and what takes its positions back to model space
+		uint32_t						vertex_buffer_format{ VERTEX_FULL };
+		glm::mat4						position_dequantize{ 1.f };
+
 		VkBuffer						index_buffer;
 		VkDeviceMemory					idx_buffer_mem;
 
@@ -108,99 +539,527 @@ namespace sandbox
 		VkImageView						tex_img_view;
 		VkSampler						tex_sampler;
 
+		VkSampleCountFlagBits			msaa_samples{ VK_SAMPLE_COUNT_1_BIT };
+
+		// multisampled color target, resolved into the swap chain image at the end of the subpass
+		VkImage							color_msaa;
+		VkDeviceMemory					color_msaa_mem;
+		VkImageView						color_msaa_view;
+		bool							color_msaa_lazy{ false };
+
 		VkImage							depth_buffer;
 		VkDeviceMemory					depth_img_mem;
 		VkImageView						depth_img_view;
+		bool							depth_lazy{ false };
 
-		VkDescriptorPool				descriptor_pool;
+		struct msaa_stats
+		{
+			VkDeviceSize				attachment_bytes{ 0 };
+			VkDeviceSize				committed_bytes{ 0 };
+			bool						lazy{ false };
+			double						frame_ms{ 0.0 };
+			uint64_t					frames{ 0 };
+		};
 
-		size_t							curr_frame{ 0 };
+		std::map<uint32_t, msaa_stats>	msaa_history;
 
-		std::vector<VkBuffer>			uniform_buffers;
-		std::vector<VkDeviceMemory>		ubo_mems;
+		struct depth_stats
+		{
+			double						frame_ms{ 0.0 };
+			uint64_t					frames{ 0 };
+		};
 
-		std::vector<VkImage>			sc_images;
-		std::vector<VkImageView>		sc_image_views;
+		// keyed by (prepass, sorted)
+		std::map<std::pair<bool, bool>, depth_stats> depth_history;
 
-		std::vector<VkFramebuffer>		sc_framebuffers;
+		/*
+		Occlusion culling. The visibility and draw buffers persist across frames and are only ever touched by the
+		GPU, the frame graph orders the accesses. The depth pyramid is a graph owned image rebuilt every frame.
+		*/
+		bool							occlusion_enabled{ false };
+
+		VkBuffer						visibility_buffer;
+		VkDeviceMemory					visibility_mem;
+		VkBuffer						early_draw_buffer;
+		VkDeviceMemory					early_draw_mem;
+		VkBuffer						late_draw_buffer;
+		VkDeviceMemory					late_draw_mem;
+
+		VkDescriptorSetLayout			pyramid_set_layout;
+		VkDescriptorSetLayout			cull_set_layout;
+		VkPipelineLayout				pyramid_layout;
+		VkPipelineLayout				cull_layout;
+		VkPipeline						pyramid_pipeline;
+		VkPipeline						pyramid_ms_pipeline;
+		VkPipeline						cull_early_pipeline;
+		VkPipeline						cull_late_pipeline;
+		VkSampler						pyramid_sampler;
+
+		VkDescriptorPool				occlusion_pool{ VK_NULL_HANDLE };
+		VkExtent2D						pyramid_extent{ 0, 0 };
+		uint32_t						pyramid_levels{ 0 };
+		VkImageView						pyramid_view{ VK_NULL_HANDLE };
+		std::vector<VkImageView>		pyramid_mip_views;
+		std::vector<VkDescriptorSet>	pyramid_sets;		// one per level
+		std::vector<VkDescriptorSet>	cull_sets;			// one per swap chain image
+
+		struct occlusion_stats
+		{
+			double						frame_ms{ 0.0 };
+			uint64_t					frames{ 0 };
+			uint64_t					objects{ 0 };
+			uint64_t					early_drawn{ 0 };
+			uint64_t					late_drawn{ 0 };
+			uint64_t					frustum_culled{ 0 };
+			uint64_t					occluded{ 0 };
+		};
 
-		std::vector<VkCommandBuffer>	cmd_buffers;
+		// keyed by whether culling was on
+		std::map<bool, occlusion_stats>	occlusion_history;
 
-		std::vector<VkDescriptorSet>	descriptor_sets;
+		struct vertex_stats
+		{
+			uint32_t					stride{ 0 };
+			VkDeviceSize				buffer_bytes{ 0 };
+			double						frame_ms{ 0.0 };
+			uint64_t					frames{ 0 };
+		};
 
-		std::vector<VkSemaphore>		image_semaphores;
-		std::vector<VkSemaphore>		rp_semaphores;
+		// keyed by vertex_format
+		std::map<uint32_t, vertex_stats> vertex_history;
 
-		std::vector<VkFence>			in_flight_fences;
-		std::vector<VkFence>			images_in_flight;
+		struct lod_stats
+		{
+			double						frame_ms{ 0.0 };
+			uint64_t					frames{ 0 };
+			uint64_t					triangles{ 0 };			// submitted, before any culling
+			uint64_t					full_triangles{ 0 };	// what LOD0 everywhere would have submitted
+			uint64_t					objects[asset::max_mesh_lods]{};
+		};
 
-		bool							fb_resized{ false };
+		// keyed by whether selection was on
+		std::map<bool, lod_stats>		lod_history;
 
-		namespace debug
-		{
-			const std::vector<const char*> validation_layers =
-			{
-				"VK_LAYER_KHRONOS_validation"
-			};
+		/*
+		Cluster culling. The meshlet buffer is uploaded once; the compacted index buffer gives every object a slice
+		the size of its full LOD0 index list, so objects never have to agree on where their indices go.
+		*/
+		bool							cluster_enabled{ false };
 
-			VkDebugUtilsMessengerEXT	debug_messenger;
+		VkBuffer						meshlet_buffer{ VK_NULL_HANDLE };
+		VkDeviceMemory					meshlet_mem{ VK_NULL_HANDLE };
 
-#ifdef _DEBUG
-			const bool enable_validation_layers = true;
-#else
-			const bool enable_validation_layers = false;
-#endif
+		/*
+		The cull's output, one set per frame slot: the cull of the next frame can run while the previous frame still
+		draws from its own, which is what lets it go ahead on the async compute queue.
+		*/
+		std::array<VkBuffer, max_frames_in_flight>			cluster_index_buffers{};
+		std::array<VkDeviceMemory, max_frames_in_flight>	cluster_index_mems{};
+		std::array<VkBuffer, max_frames_in_flight>			cluster_draw_buffers{};
+		std::array<VkDeviceMemory, max_frames_in_flight>	cluster_draw_mems{};
 
-			bool check_validation_layer_support()
-			{
-				unsigned layer_count;
-				vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
+		VkDescriptorSetLayout			cluster_set_layout;
+		VkPipelineLayout				cluster_layout;
+		VkPipeline						cluster_pipeline;
 
-				std::vector<VkLayerProperties> available_layers(layer_count);
-				vkEnumerateInstanceLayerProperties(&layer_count, available_layers.data());
+		VkDescriptorPool				cluster_pool{ VK_NULL_HANDLE };
+		std::vector<VkDescriptorSet>	cluster_sets;		// one per swap chain image
 
-				for (auto l : validation_layers)
-				{
-					bool found = false;
+		struct cluster_stats
+		{
+			double						frame_ms{ 0.0 };
+			uint64_t					frames{ 0 };
+			uint64_t					meshlets{ 0 };
+			uint64_t					frustum_culled{ 0 };
+			uint64_t					backface_culled{ 0 };
+			uint64_t					triangles_in{ 0 };
+			uint64_t					triangles_out{ 0 };
+		};
 
-					for (const auto& p : available_layers)
-					{
-						if (0 == strcmp(l, p.layerName))
-						{
-							found = true;
-							break;
-						}
-					}
+		// keyed by whether culling was on
+		std::map<bool, cluster_stats>	cluster_history;
 
-					if (!found)
-					{
-						return false;
-					}
-				}
+		/*
+		Particles. The state and the free list are the simulation's alone and persist, every frame slot has its own
+		draw list and indirect command, so a frame's simulation can write them while the previous frame still
+		draws from its own. The capacity is fixed at startup.
+		*/
+		bool							particles_enabled{ false };
+		uint32_t						particle_capacity{ 0 };
 
-				return true;
-			}
+		VkBuffer						particle_buffer{ VK_NULL_HANDLE };
+		VkDeviceMemory					particle_mem{ VK_NULL_HANDLE };
+		VkBuffer						particle_free_buffer{ VK_NULL_HANDLE };
+		VkDeviceMemory					particle_free_mem{ VK_NULL_HANDLE };
 
-			VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
-				VkDebugUtilsMessageSeverityFlagBitsEXT msg_severity,
-				VkDebugUtilsMessageTypeFlagsEXT msg_type,
-				const VkDebugUtilsMessengerCallbackDataEXT* callback_data,
-				void* user_data)
-			{
-				if (msg_severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)
-					std::cerr << "Validation Layer: " << callback_data->pMessage << std::endl;
+		std::array<VkBuffer, max_frames_in_flight>			particle_draw_buffers{};
+		std::array<VkDeviceMemory, max_frames_in_flight>	particle_draw_mems{};
+		std::array<VkBuffer, max_frames_in_flight>			particle_args_buffers{};		// host visible, reset before every frame
+		std::array<VkDeviceMemory, max_frames_in_flight>	particle_args_mems{};
+		std::array<bool, max_frames_in_flight>				particle_args_pending{};
 
-				return VK_FALSE;
-			}
+		VkDescriptorSetLayout			particle_sim_set_layout{ VK_NULL_HANDLE };
+		VkPipelineLayout				particle_sim_layout{ VK_NULL_HANDLE };
+		VkPipeline						particle_sim_pipeline{ VK_NULL_HANDLE };
+		VkPipeline						particle_emit_pipeline{ VK_NULL_HANDLE };
 
-			VkResult CreateDebugUtilsMessengerEXT(VkInstance inst, const VkDebugUtilsMessengerCreateInfoEXT*
-				create_info, const VkAllocationCallbacks* allocator, VkDebugUtilsMessengerEXT* debug_messenger)
-			{
-				auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(inst,
-					"vkCreateDebugUtilsMessengerEXT");
+		VkDescriptorPool				particle_pool{ VK_NULL_HANDLE };
+		std::array<VkDescriptorSet, max_frames_in_flight>	particle_sim_sets{};
 
-				if (nullptr != func)
-				{
+		VkDescriptorSetLayout			particle_set_layout{ VK_NULL_HANDLE };
+		VkPipelineLayout				particle_layout{ VK_NULL_HANDLE };
+		VkPipeline						particle_pipeline{ VK_NULL_HANDLE };
+
+		// writes a particle set from a particle_descriptors, its sets go through the scene's cache
+		descriptors::update_template	particle_template;
+
+		std::chrono::steady_clock::time_point particle_last_step;
+		float							particle_emit_carry{ 0.f };		// fractions of a particle owed to the next frame
+		uint32_t						particle_seed{ 0 };
+
+		struct particle_stats
+		{
+			uint64_t					frames{ 0 };
+			uint64_t					drawn{ 0 };
+			uint32_t					max_drawn{ 0 };
+		};
+
+		particle_stats					particle_counters;
+
+		/*
+		Post processing. The geometry passes render into an HDR target instead of the swap chain image, and a chain
+		of compute passes takes it from there: a bloom pyramid down and back up, a tonemap, FXAA, and a blit into the
+		swap chain image. Every intermediate image is a graph transient, so they only hold memory for as long as
+		the chain needs them and alias whatever else fits. The kernels are created once, their sets follow the graph.
+		*/
+		bool							post_enabled{ false };
+
+		constexpr VkFormat				hdr_format{ VK_FORMAT_R16G16B16A16_SFLOAT };
+
+		// the scene is lit in [0, 1], so only what gets close to white blooms
+		constexpr float					bloom_threshold{ 0.8f };
+		constexpr float					bloom_knee{ 0.2f };
+		constexpr float					bloom_strength{ 0.1f };
+		constexpr float					post_exposure{ 1.f };
+		constexpr uint32_t				max_bloom_levels{ 6 };
+
+		// in the order add_post_passes adds them
+		constexpr std::array<const char*, 5> post_passes = { "bloom down", "bloom up", "tonemap", "fxaa", "post blit" };
+
+		VkImage							hdr_color{ VK_NULL_HANDLE };
+		VkDeviceMemory					hdr_color_mem{ VK_NULL_HANDLE };
+		VkImageView						hdr_color_view{ VK_NULL_HANDLE };
+
+		VkDescriptorSetLayout			post_set_layout{ VK_NULL_HANDLE };		// a source and a destination
+		VkDescriptorSetLayout			tonemap_set_layout{ VK_NULL_HANDLE };	// the scene, the bloom and the destination
+		VkPipelineLayout				post_layout{ VK_NULL_HANDLE };
+		VkPipelineLayout				tonemap_layout{ VK_NULL_HANDLE };
+		VkPipeline						bloom_prefilter_pipeline{ VK_NULL_HANDLE };
+		VkPipeline						bloom_down_pipeline{ VK_NULL_HANDLE };
+		VkPipeline						bloom_up_pipeline{ VK_NULL_HANDLE };
+		VkPipeline						tonemap_pipeline{ VK_NULL_HANDLE };
+		VkPipeline						fxaa_pipeline{ VK_NULL_HANDLE };
+		VkSampler						post_sampler{ VK_NULL_HANDLE };
+
+		// one graph's post chain, the frame's or one the benchmark builds on its own
+		struct post_chain
+		{
+			const rg::render_graph*		graph{ nullptr };
+			VkExtent2D					extent{ 0, 0 };
+			VkExtent2D					bloom_extent{ 0, 0 };		// of level 0, half the scene
+			uint32_t					bloom_levels{ 0 };
+			bool						srgb_target{ false };
+
+			rg::resource_id				hdr{ rg::invalid_resource };
+			rg::resource_id				bloom{ rg::invalid_resource };
+			rg::resource_id				ldr{ rg::invalid_resource };
+			rg::resource_id				output{ rg::invalid_resource };
+			rg::resource_id				target{ rg::invalid_resource };
+
+			std::vector<VkImageView>	bloom_views;				// one per level
+			VkDescriptorPool			pool{ VK_NULL_HANDLE };
+			std::vector<VkDescriptorSet> down_sets;					// one per level
+			std::vector<VkDescriptorSet> up_sets;					// one per level but the smallest
+			VkDescriptorSet				tonemap_set{ VK_NULL_HANDLE };
+			VkDescriptorSet				fxaa_set{ VK_NULL_HANDLE };
+
+			VkExtent2D level_extent(uint32_t level) const
+			{
+				return { std::max(1u, bloom_extent.width >> level), std::max(1u, bloom_extent.height >> level) };
+			}
+
+			post_constants constants(VkExtent2D src, VkExtent2D dst) const
+			{
+				post_constants c{};
+				c.src_size[0] = static_cast<int32_t>(src.width);
+				c.src_size[1] = static_cast<int32_t>(src.height);
+				c.dst_size[0] = static_cast<int32_t>(dst.width);
+				c.dst_size[1] = static_cast<int32_t>(dst.height);
+				c.threshold = bloom_threshold;
+				c.knee = bloom_knee;
+				c.bloom_strength = bloom_strength;
+				c.exposure = post_exposure;
+				c.srgb_target = srgb_target ? 1 : 0;
+
+				return c;
+			}
+		};
+
+		post_chain						post_frame;
+
+		/*
+		Readback for --capture. The capture frame copies the swap chain image into a host visible buffer after
+		the graph has run, which is mapped a few frames later once the timeline has passed the copy, so the frame
+		loop never waits for it. The PNG is encoded on a thread of its own for the same reason.
+		*/
+		bool							capture_enabled{ false };
+		VkBuffer						capture_buffer{ VK_NULL_HANDLE };
+		VkDeviceMemory					capture_mem{ VK_NULL_HANDLE };
+		VkExtent2D						capture_extent{ 0, 0 };		// of the copy, the swap chain may have moved on
+		VkFormat						capture_format{ VK_FORMAT_UNDEFINED };
+		uint64_t						capture_value{ 0 };			// what the frame holding the copy signals, 0 while none is in flight
+		bool							capture_recorded{ false };
+		std::future<bool>				capture_written;
+
+		// with --fixed-step the scene and the particles advance by this much per frame, so captures are repeatable
+		constexpr float					fixed_step_dt{ 1.f / 60.f };
+		uint64_t						frame_number{ 0 };			// frames submitted so far
+
+		std::chrono::steady_clock::time_point last_frame_start;
+
+		VkPresentModeKHR				sc_present_mode{ VK_PRESENT_MODE_FIFO_KHR };	// what the swap chain actually got
+
+		/*
+		Frame pacing. With a target rate every frame has a deadline one period after the previous one, and the
+		pacer wakes up the expected cost of a frame ahead of it: input is sampled as late as possible and the frame
+		still makes its deadline. The cost is measured from waking up to the frame's timeline value signalling.
+		*/
+		std::chrono::steady_clock::time_point pace_deadline;
+		std::chrono::steady_clock::time_point frame_wake;
+		std::chrono::steady_clock::time_point last_present;
+		double							frame_work_ms{ 0.0 };
+
+		struct pacing_stats
+		{
+			uint64_t					presents{ 0 };
+			uint64_t					intervals{ 0 };
+			double						interval_ms{ 0.0 };
+			double						interval_sq{ 0.0 };		// for the jitter, as a standard deviation
+			double						min_ms{ std::numeric_limits<double>::max() };
+			double						max_ms{ 0.0 };
+			double						latency_ms{ 0.0 };		// wake up, and so input, to present
+			double						sleep_ms{ 0.0 };
+			uint64_t					missed{ 0 };			// frames that woke up after their deadline
+		};
+
+		// keyed by the present mode the swap chain got
+		std::map<VkPresentModeKHR, pacing_stats> pacing_history;
+
+		// writes a scene set from a scene_descriptors in one call, generated with descriptor_set_layout
+		descriptors::update_template	scene_template;
+
+		// the forward pass's sets, one per swap chain image and the same every frame, so they are cached
+		descriptors::cache				scene_sets;
+
+		// sets that live for one frame, reset with the frame slot
+		std::array<descriptors::allocator, max_frames_in_flight> frame_descriptors;
+
+		// this frame's forward pass set, from one of the two above
+		VkDescriptorSet					scene_set{ VK_NULL_HANDLE };
+
+		struct descriptor_stats
+		{
+			uint64_t					frames{ 0 };
+			uint64_t					cache_hits{ 0 };		// of caches retired with their swap chain
+			uint64_t					cache_misses{ 0 };
+			uint64_t					cache_pools{ 0 };
+		};
+
+		descriptor_stats				descriptor_counters;
+
+		size_t							curr_frame{ 0 };
+
+		// objects replaced while frames that still reference them may be in flight
+		struct deferred_delete
+		{
+			uint64_t					retire_after;	// timeline value of the last submission that may use it
+			std::function<void()>		destroy;
+		};
+
+		// in submission order, so the front is always the first to become ready
+		std::deque<deferred_delete>		deletion_queue;
+
+		rg::render_graph				frame_graph;
+		rg::resource_id					rg_swap_chain{ rg::invalid_resource };
+		rg::resource_id					rg_depth{ rg::invalid_resource };
+		rg::resource_id					rg_color_msaa{ rg::invalid_resource };
+		rg::resource_id					rg_hdr{ rg::invalid_resource };
+		rg::resource_id					rg_pyramid{ rg::invalid_resource };
+		rg::resource_id					rg_visibility{ rg::invalid_resource };
+		rg::resource_id					rg_early_draws{ rg::invalid_resource };
+		rg::resource_id					rg_late_draws{ rg::invalid_resource };
+		rg::resource_id					rg_cull_stats{ rg::invalid_resource };
+		rg::resource_id					rg_cluster_indices{ rg::invalid_resource };
+		rg::resource_id					rg_cluster_draws{ rg::invalid_resource };
+		rg::resource_id					rg_cluster_stats{ rg::invalid_resource };
+		rg::resource_id					rg_particle_draws{ rg::invalid_resource };
+		rg::resource_id					rg_particle_args{ rg::invalid_resource };
+
+		std::vector<VkBuffer>			uniform_buffers;
+		std::vector<VkDeviceMemory>		ubo_mems;
+
+		// per swap chain image like the UBOs, objects in this frame's draw order
+		std::vector<VkBuffer>			object_buffers;
+		std::vector<VkDeviceMemory>		object_mems;
+
+		// cull_counters, read back once the image's previous frame has retired
+		std::vector<VkBuffer>			cull_stats_buffers;
+		std::vector<VkDeviceMemory>		cull_stats_mems;
+		std::vector<bool>				cull_stats_pending;
+
+		// cluster_counters, the same way
+		std::vector<VkBuffer>			cluster_stats_buffers;
+		std::vector<VkDeviceMemory>		cluster_stats_mems;
+		std::vector<bool>				cluster_stats_pending;
+
+		std::vector<VkImage>			sc_images;
+		std::vector<VkImageView>		sc_image_views;
+
+		std::vector<VkFramebuffer>		sc_framebuffers;
+
+		std::vector<VkCommandBuffer>	cmd_buffers;
+
+		std::vector<VkSemaphore>		image_semaphores;
+		std::vector<VkSemaphore>		rp_semaphores;
+
+		/*
+		One timeline semaphore orders everything submitted to the GPU. Every submission signals the next value, and
+		whatever has to outlive a submission remembers the value that submission signals. Acquire and present
+		still need the binary semaphores above, swap chains do not take timeline ones.
+		*/
+		VkSemaphore						timeline{ VK_NULL_HANDLE };
+		uint64_t						timeline_value{ 0 };		// the last value handed to a submission
+
+		std::array<uint64_t, max_frames_in_flight> frame_timeline{};	// what each frame slot's last submission signals
+		std::vector<uint64_t>			image_timeline;				// what the last frame rendering to each image signals
+
+		/*
+		Async compute. With a queue family that does compute but not graphics, work that only depends on the frame's
+		uploads is submitted there first and the graphics submission waits for it at the stage that consumes it, so
+		it overlaps whatever the graphics queue is still busy with. The compute queue signals a timeline of its own:
+		both queues signalling one semaphore could not keep its values increasing. Buffers are shared between the
+		two families concurrently, so no ownership transfers are needed. Without such a family, or with
+		--no-async-compute, everything stays in the frame graph on the graphics queue.
+		*/
+		bool							async_compute{ false };
+		std::array<unsigned, 2>			async_families{};			// graphics and compute, for concurrent sharing
+
+		VkCommandPool					compute_cmd_pool{ VK_NULL_HANDLE };
+		std::array<VkCommandBuffer, max_frames_in_flight> compute_cmd_buffers{};
+
+		VkSemaphore						compute_timeline{ VK_NULL_HANDLE };
+		uint64_t						compute_timeline_value{ 0 };
+
+		// per frame slot: compute begin and end, then graphics begin and end
+		VkQueryPool						async_queries{ VK_NULL_HANDLE };
+		std::array<bool, max_frames_in_flight> async_queries_written{};
+		double							async_timestamp_ns{ 0.0 };	// one tick
+		uint64_t						async_timestamp_mask{ 0 };
+
+		struct async_compute_stats
+		{
+			uint64_t					frames{ 0 };
+			double						compute_ms{ 0.0 };
+			double						overlap_ms{ 0.0 };		// of compute_ms, while graphics work was running too
+
+			// the last retired frame's graphics work, the next frame's compute may overlap its tail
+			uint64_t					graphics_begin{ 0 };
+			uint64_t					graphics_end{ 0 };
+		};
+
+		async_compute_stats				async_counters;
+
+		// scratch for whatever a frame builds on the CPU, rewound once the slot's last submission has retired
+		std::array<memory::frame_arena, max_frames_in_flight> frame_arenas;
+
+		struct memory_stats
+		{
+			uint64_t					frames{ 0 };
+			uint64_t					allocations{ 0 };		// global operator new calls between frame starts
+			uint64_t					max_allocations{ 0 };
+			uint64_t					clean_frames{ 0 };		// frames that made none at all
+		};
+
+		memory_stats					frame_memory;
+		uint64_t						last_heap_allocations{ 0 };
+
+		bool							fb_resized{ false };
+
+		namespace debug
+		{
+			const std::vector<const char*> validation_layers =
+			{
+				"VK_LAYER_KHRONOS_validation"
+			};
+
+			VkDebugUtilsMessengerEXT	debug_messenger;
+
+#ifdef _DEBUG
+			const bool enable_validation_layers = true;
+#else
+			const bool enable_validation_layers = false;
+#endif
+
+			bool check_validation_layer_support()
+			{
+				unsigned layer_count;
+				vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
+
+				std::vector<VkLayerProperties> available_layers(layer_count);
+				vkEnumerateInstanceLayerProperties(&layer_count, available_layers.data());
+
+				for (auto l : validation_layers)
+				{
+					bool found = false;
+
+					for (const auto& p : available_layers)
+					{
+						if (0 == strcmp(l, p.layerName))
+						{
+							found = true;
+							break;
+						}
+					}
+
+					if (!found)
+					{
+						return false;
+					}
+				}
+
+				return true;
+			}
+
+			VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
+				VkDebugUtilsMessageSeverityFlagBitsEXT msg_severity,
+				VkDebugUtilsMessageTypeFlagsEXT msg_type,
+				const VkDebugUtilsMessengerCallbackDataEXT* callback_data,
+				void* user_data)
+			{
+				if (msg_severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)
+					std::cerr << "Validation Layer: " << callback_data->pMessage << std::endl;
+
+				return VK_FALSE;
+			}
+
+			VkResult CreateDebugUtilsMessengerEXT(VkInstance inst, const VkDebugUtilsMessengerCreateInfoEXT*
+				create_info, const VkAllocationCallbacks* allocator, VkDebugUtilsMessengerEXT* debug_messenger)
+			{
+				auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(inst,
+					"vkCreateDebugUtilsMessengerEXT");
+
+				if (nullptr != func)
+				{
 					return func(inst, create_info, allocator, debug_messenger);
 				}
 				else
@@ -260,6 +1119,7 @@ namespace sandbox
 			std::chrono::steady_clock::time_point start_time;
 
 			VkSwapchainKHR swap_chain;
+			VkSwapchainKHR old_swap_chain{ VK_NULL_HANDLE };	// between clean_swap_chain and its replacement
 
 			/*
 				See: https://vulkan-tutorial.com/en/Drawing_a_triangle/Presentation/Window_surface
@@ -287,15 +1147,42 @@ namespace sandbox
 				return available_fmts[0];
 			}
 
-			VkPresentModeKHR choose_swap_present_mode(const std::vector<VkPresentModeKHR>& available_modes)
+			const char* present_mode_name(VkPresentModeKHR mode)
 			{
-				for (const auto& mode : available_modes)
+				switch (mode)
 				{
-					if (VK_PRESENT_MODE_MAILBOX_KHR == mode) // triple buffering
-						return mode;
+				case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+				case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+				case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+				case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo relaxed";
+				default: return "other";
 				}
+			}
+
+			/*
+			IMMEDIATE has the lowest latency and tears, MAILBOX (triple buffering) does not tear and never blocks,
+			FIFO waits for vblank and is the only mode every surface has to support. A missing IMMEDIATE falls back
+			to MAILBOX, the next lowest latency, and everything ends at FIFO.
+			*/
+			VkPresentModeKHR choose_swap_present_mode(const std::vector<VkPresentModeKHR>& available_modes)
+			{
+				auto available = [&available_modes](VkPresentModeKHR mode)
+				{
+					return available_modes.end() != std::find(available_modes.begin(), available_modes.end(), mode);
+				};
+
+				if (available(settings.present_mode))
+					return settings.present_mode;
+
+				VkPresentModeKHR fallback = VK_PRESENT_MODE_FIFO_KHR;
+
+				if (VK_PRESENT_MODE_IMMEDIATE_KHR == settings.present_mode && available(VK_PRESENT_MODE_MAILBOX_KHR))
+					fallback = VK_PRESENT_MODE_MAILBOX_KHR;
 
-				return VK_PRESENT_MODE_FIFO_KHR;
+				std::cout << "Present mode: " << present_mode_name(settings.present_mode) << " is not supported, using "
+					<< present_mode_name(fallback) << std::endl;
+
+				return fallback;
 			}
 
 			VkExtent2D choose_swap_extent(const VkSurfaceCapabilitiesKHR& capabilities)
@@ -377,8 +1264,38 @@ namespace sandbox
 				/*
 				* In that case you may use a value like VK_IMAGE_USAGE_TRANSFER_DST_BIT instead and
 					use a memory operation to transfer the rendered image to a swap chain image.
+
+				Which is what post processing does: the chain ends in an image of its own and blits it over, since
+				surfaces rarely offer storage usage for their formats. The blit also converts to the surface's format.
 				*/
-				create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+				VkFormatProperties fmt_props{};
+				vkGetPhysicalDeviceFormatProperties(pd, surface_fmt.format, &fmt_props);
+
+				post_enabled = settings.post_processing &&
+					(support.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) &&
+					(fmt_props.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT);
+
+				if (settings.post_processing && !post_enabled)
+				{
+					std::cout << "Post processing: the swap chain cannot be blitted to, rendering straight into it" << std::endl;
+				}
+
+				capture_enabled = 0 != settings.capture_frame;
+
+				// a capture run that silently never captures would pass in CI
+				if (capture_enabled && !(support.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT))
+				{
+					throw std::runtime_error("The swap chain cannot be read back for --capture!");
+				}
+
+				if (capture_enabled && !capture_supports(surface_fmt.format))
+				{
+					throw std::runtime_error("The swap chain format " + std::to_string(surface_fmt.format) +
+						" cannot be written out by --capture!");
+				}
+
+				create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | (post_enabled ? VK_IMAGE_USAGE_TRANSFER_DST_BIT : 0) |
+					(capture_enabled ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : 0);
 
 				queue_family_indices indices = find_queue_families(pd);
 				unsigned q_fam_indices[] = { indices.graphics_family.value(), indices.present_family.value() };
@@ -407,13 +1324,19 @@ namespace sandbox
 				create_info.presentMode = present_mode;
 				create_info.clipped = VK_TRUE;
 
-				create_info.oldSwapchain = VK_NULL_HANDLE;
+				// lets the presentation engine hand the old images over instead of tearing down first
+				create_info.oldSwapchain = old_swap_chain;
 
 				if (!OP_SUCCESS(vkCreateSwapchainKHR(dev, &create_info, nullptr, &swap_chain)))
 				{
 					throw std::runtime_error("Failed to create swap chain!");
 				}
 
+				sc_present_mode = present_mode;
+
+				// its destruction is already queued by clean_swap_chain
+				old_swap_chain = VK_NULL_HANDLE;
+
 				vkGetSwapchainImagesKHR(dev, swap_chain, &image_count, nullptr);
 				sc_images.resize(image_count);
 				vkGetSwapchainImagesKHR(dev, swap_chain, &image_count, sc_images.data());
@@ -426,40 +1349,128 @@ namespace sandbox
 			* We could recreate the command pool from scratch, but that is rather wasteful.
 			Instead I've opted to clean up the existing command buffers with the vkFreeCommandBuffers
 			function. This way we can reuse the existing pool to allocate the new command buffers.
+
+			Nothing here waits for the GPU: every object goes to the deletion queue with the last submitted timeline
+			value, and the frames still in flight keep using it until they retire. The globals are left free for
+			the replacements.
 			*/
 			void clean_swap_chain()
 			{
-				vkDestroyImageView(dev, depth_img_view, nullptr);
-				vkDestroyImage(dev, depth_buffer, nullptr);
-				vkFreeMemory(dev, depth_img_mem, nullptr);
+				// the pyramid and bloom views belong to graph images
+				destroy_occlusion_descriptors();
+				destroy_cluster_descriptors();
+				destroy_post_descriptors(post_frame);
+
+				destroy_capture_resources();
+
+				auto graph = std::make_shared<rg::render_graph>(std::move(frame_graph));
+				frame_graph = rg::render_graph();
+
+				defer_delete([graph]() { graph->destroy(); });
+
+				defer_delete([view = depth_img_view, img = depth_buffer, mem = depth_img_mem]()
+					{
+						vkDestroyImageView(dev, view, nullptr);
+						vkDestroyImage(dev, img, nullptr);
+						vkFreeMemory(dev, mem, nullptr);
+					});
+
+				if (VK_NULL_HANDLE != color_msaa)
+				{
+					defer_delete([view = color_msaa_view, img = color_msaa, mem = color_msaa_mem]()
+						{
+							vkDestroyImageView(dev, view, nullptr);
+							vkDestroyImage(dev, img, nullptr);
+							vkFreeMemory(dev, mem, nullptr);
+						});
+
+					color_msaa = VK_NULL_HANDLE;
+				}
 
-				for (auto fb : sc_framebuffers)
+				if (VK_NULL_HANDLE != hdr_color)
 				{
-					vkDestroyFramebuffer(dev, fb, nullptr);
+					defer_delete([view = hdr_color_view, img = hdr_color, mem = hdr_color_mem]()
+						{
+							vkDestroyImageView(dev, view, nullptr);
+							vkDestroyImage(dev, img, nullptr);
+							vkFreeMemory(dev, mem, nullptr);
+						});
+
+					hdr_color = VK_NULL_HANDLE;
 				}
 
+				std::vector<std::pair<VkBuffer, VkDeviceMemory>> buffers;
+
 				for (size_t i = 0; i < sc_images.size(); i++)
 				{
-					vkDestroyBuffer(dev, uniform_buffers[i], nullptr);
-					vkFreeMemory(dev, ubo_mems[i], nullptr);
+					buffers.emplace_back(uniform_buffers[i], ubo_mems[i]);
+					buffers.emplace_back(object_buffers[i], object_mems[i]);
+					buffers.emplace_back(cull_stats_buffers[i], cull_stats_mems[i]);
+					buffers.emplace_back(cluster_stats_buffers[i], cluster_stats_mems[i]);
 				}
 
-				vkDestroyDescriptorPool(dev, descriptor_pool, nullptr);
+				defer_delete([buffers]()
+					{
+						for (const auto& [buffer, mem] : buffers)
+						{
+							vkDestroyBuffer(dev, buffer, nullptr);
+							vkFreeMemory(dev, mem, nullptr);
+						}
+					});
+
+				// the cached sets point at the buffers above
+				descriptor_counters.cache_hits += scene_sets.hits();
+				descriptor_counters.cache_misses += scene_sets.misses();
+				descriptor_counters.cache_pools += scene_sets.pools().pools();
 
-				vkFreeCommandBuffers(dev, cmd_pool, static_cast<uint32_t>(cmd_buffers.size()), cmd_buffers.data());
+				auto sets = std::make_shared<descriptors::cache>(std::move(scene_sets));
+				scene_sets = descriptors::cache();
 
-				vkDestroyRenderPass(dev, render_pass, nullptr);
+				defer_delete([sets]() { sets->destroy(); });
 
-				vkDestroyPipeline(dev, graphics_pipeline, nullptr);
+				defer_delete([cmds = cmd_buffers]()
+					{
+						vkFreeCommandBuffers(dev, cmd_pool, static_cast<uint32_t>(cmds.size()), cmds.data());
+					});
 
-				vkDestroyPipelineLayout(dev, pipeline_layout, nullptr);
+				destroy_pipeline_variants();
 
-				for (auto iv : sc_image_views)
+				if (VK_NULL_HANDLE != particle_pipeline)
 				{
-					vkDestroyImageView(dev, iv, nullptr);
+					defer_delete([pipeline = particle_pipeline]() { vkDestroyPipeline(dev, pipeline, nullptr); });
+					particle_pipeline = VK_NULL_HANDLE;
 				}
 
-				vkDestroySwapchainKHR(dev, swap_chain, nullptr);
+				defer_delete([framebuffers = sc_framebuffers, rp = render_pass, rp_late = render_pass_late,
+					layout = pipeline_layout, views = sc_image_views, sc = swap_chain]()
+					{
+						for (auto fb : framebuffers)
+						{
+							vkDestroyFramebuffer(dev, fb, nullptr);
+						}
+
+						vkDestroyRenderPass(dev, rp, nullptr);
+
+						if (VK_NULL_HANDLE != rp_late)
+						{
+							vkDestroyRenderPass(dev, rp_late, nullptr);
+						}
+
+						vkDestroyPipelineLayout(dev, layout, nullptr);
+
+						for (auto iv : views)
+						{
+							vkDestroyImageView(dev, iv, nullptr);
+						}
+
+						vkDestroySwapchainKHR(dev, sc, nullptr);
+					});
+
+				render_pass_late = VK_NULL_HANDLE;
+
+				// handed to the replacement, which takes over its images once they are presented
+				old_swap_chain = swap_chain;
+				swap_chain = VK_NULL_HANDLE;
 			}
 
 			void recreate_swap_chain()
@@ -474,20 +1485,118 @@ namespace sandbox
 					glfwWaitEvents();
 				}
 
-				vkDeviceWaitIdle(dev);
+				// keep the hot reload worker from building against the render pass we are about to retire
+				std::lock_guard<std::mutex> lock(hot_reload::pipeline_mutex);
 
 				clean_swap_chain();
 
 				create_swap_chain();
 				create_image_views();
 				create_render_pass();
+
+				// new images with new per image buffers, nothing rendered to them yet
+				image_timeline.assign(sc_images.size(), 0);
+
+				// the V key switches vertex layouts through here
+				if (vertex_buffer_format != active_variant.vert.vertex_format)
+				{
+					defer_delete([buffer = vertex_buffer, mem = vtx_buffer_mem]()
+						{
+							vkDestroyBuffer(dev, buffer, nullptr);
+							vkFreeMemory(dev, mem, nullptr);
+						});
+
+					create_vertex_buffer();
+				}
+
 				create_graphics_pipeline();
+				create_particle_render_pipeline();
+				create_color_resources();
+				create_hdr_resources();
+				create_capture_resources();
 				create_depth_resources();
 				create_framebuffers();
+				build_frame_graph();
 				create_uniform_buffers();
 				create_descriptor_pool();
 				create_descriptor_sets();
+				create_occlusion_descriptors();
+				create_cluster_descriptors();
+				create_post_descriptors(post_frame, hdr_color_view);
 				create_cmd_buffers();
+
+				hot_reload::invalidate();
+
+				// the frame that waited for all of this is not representative
+				last_frame_start = {};
+				last_present = {};
+				pace_deadline = {};
+			}
+
+			void pace_frame()
+			{
+				using clock = std::chrono::steady_clock;
+
+				if (0.f == settings.target_fps)
+				{
+					frame_wake = clock::now();
+					return;
+				}
+
+				auto& pacing = pacing_history[sc_present_mode];
+
+				// once the last submission has signalled nothing of ours is queued ahead of the next frame
+				wait_timeline(timeline_value);
+
+				auto now = clock::now();
+
+				if (clock::time_point{} != frame_wake)
+				{
+					const double work = std::chrono::duration<double, std::milli>(now - frame_wake).count();
+
+					// smoothed, one slow frame should not make every following one wake up early
+					frame_work_ms = 0.0 == frame_work_ms ? work : 0.9 * frame_work_ms + 0.1 * work;
+				}
+
+				const auto period = std::chrono::duration_cast<clock::duration>(
+					std::chrono::duration<double>(1.0 / settings.target_fps));
+				const auto work = std::chrono::duration_cast<clock::duration>(
+					std::chrono::duration<double, std::milli>(frame_work_ms));
+
+				if (clock::time_point{} == pace_deadline)
+				{
+					pace_deadline = now + work;
+				}
+				else
+				{
+					pace_deadline += period;
+
+					// late already, pick up from now instead of rushing the next frames out to catch up
+					if (pace_deadline - work < now)
+					{
+						pacing.missed++;
+						pace_deadline = now + work;
+					}
+				}
+
+				const auto wake = pace_deadline - work;
+
+				// sleep_for overshoots by up to a scheduler tick, so it stops short and the rest is spun out
+				const auto spin = std::chrono::milliseconds(2);
+
+				if (wake - now > spin)
+				{
+					std::this_thread::sleep_for(wake - now - spin);
+				}
+
+				while (clock::now() < wake)
+				{
+					std::this_thread::yield();
+				}
+
+				frame_wake = clock::now();
+
+				pacing.sleep_ms += std::chrono::duration<double, std::milli>(frame_wake - now).count();
 			}
 
 			/*
@@ -497,14 +1606,19 @@ namespace sandbox
 			*/
 			void update_ubo(uint32_t curr_img)
 			{
-				auto curr_time = std::chrono::high_resolution_clock::now();
+				auto curr_time = std::chrono::steady_clock::now();
 				float time = std::chrono::duration<float, std::chrono::seconds::period>(curr_time - start_time).count();
 
+				// the same frame number shows the same scene, whatever the machine's frame rate
+				if (settings.fixed_step)
+				{
+					time = static_cast<float>(frame_number) * fixed_step_dt;
+				}
+
 				UniformBufferObject ubo{};
-				ubo.model = glm::rotate(glm::mat4(1.f), time * glm::radians(90.f), glm::vec3(0.f, 0.f, 1.f));
-				ubo.view  = glm::lookAt(glm::vec3(2.f, 2.f, 2.f), glm::vec3(0.f, 0.f, 0.f), glm::vec3(0.f, 0.f, 1.f));
+				ubo.view  = glm::lookAt(camera_eye, glm::vec3(0.f, 0.f, 0.f), glm::vec3(0.f, 0.f, 1.f));
 				ubo.proj = glm::perspective(glm::radians(70.f), 
-					static_cast<float>(sc_extent.width) / static_cast<float>(sc_extent.height), 0.1f, 10.f);
+					static_cast<float>(sc_extent.width) / static_cast<float>(sc_extent.height), camera_near, camera_far);
 				/*
 				GLM was originally designed for OpenGL, where the Y coordinate of the clip coordinates is inverted. The easiest way 
 				to compensate for that is to flip the sign on the scaling factor of the Y axis in the projection matrix. If you don't 
@@ -516,11 +1630,108 @@ namespace sandbox
 				vkMapMemory(dev, ubo_mems[curr_img], 0, sizeof(ubo), 0, &data);
 				memcpy(data, &ubo, sizeof(ubo));
 				vkUnmapMemory(dev, ubo_mems[curr_img]);
-			}
+
+				camera_view = ubo.view;
+				camera_proj = ubo.proj;
+
+				// LOD selection projects with this frame's camera
+				update_scene(time);
+
+				// in draw order, so draw i, CPU or GPU recorded, uses firstInstance i
+				const VkDeviceSize objects_size = sizeof(object_data) * draw_order.size();
+
+				vkMapMemory(dev, object_mems[curr_img], 0, objects_size, 0, &data);
+
+				auto objects = static_cast<object_data*>(data);
+				auto& lods = lod_history[settings.lod];
+
+				for (size_t i = 0; i < draw_order.size(); i++)
+				{
+					const auto& obj = scene[draw_order[i]];
+					const uint32_t lod = obj.lod;
+
+					objects[i].model = obj.model * position_dequantize;
+					objects[i].sphere = glm::vec4(obj.center, mesh_bounds.w);
+					objects[i].id = draw_order[i];
+					objects[i].first_index = model_lods[lod].first_index;
+					objects[i].index_count = model_lods[lod].index_count;
+					objects[i].lod = lod;
+
+					lods.triangles += model_lods[lod].index_count / 3;
+					lods.full_triangles += model_lods[0].index_count / 3;
+					lods.objects[lod]++;
+				}
+
+				vkUnmapMemory(dev, object_mems[curr_img]);
+			}
 
 			void draw_frame()
 			{
-				vkWaitForFences(dev, 1, &in_flight_fences[curr_frame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+				auto frame_start = std::chrono::steady_clock::now();
+
+				if (std::chrono::steady_clock::time_point{} != last_frame_start)
+				{
+					double ms = std::chrono::duration<double, std::milli>(frame_start - last_frame_start).count();
+
+					auto& stats = msaa_history[msaa_samples];
+					stats.frame_ms += ms;
+					stats.frames++;
+
+					auto& depth = depth_history[{ settings.depth_prepass, settings.sort_front_to_back }];
+					depth.frame_ms += ms;
+					depth.frames++;
+
+					auto& occlusion = occlusion_history[occlusion_enabled];
+					occlusion.frame_ms += ms;
+					occlusion.frames++;
+
+					auto& vertices = vertex_history[vertex_buffer_format];
+					vertices.frame_ms += ms;
+					vertices.frames++;
+
+					auto& lods = lod_history[settings.lod];
+					lods.frame_ms += ms;
+					lods.frames++;
+
+					auto& clusters = cluster_history[cluster_enabled];
+					clusters.frame_ms += ms;
+					clusters.frames++;
+				}
+
+				/*
+				Counted from one frame start to the next, so input handling, pacing and presentation are included.
+				A frame that toggles a mode rebuilds the swap chain and allocates plenty, the steady state is the
+				number to drive to zero.
+				*/
+				const uint64_t heap_allocations = memory::heap_allocations();
+
+				if (std::chrono::steady_clock::time_point{} != last_frame_start)
+				{
+					const uint64_t allocations = heap_allocations - last_heap_allocations;
+
+					frame_memory.frames++;
+					frame_memory.allocations += allocations;
+					frame_memory.max_allocations = std::max(frame_memory.max_allocations, allocations);
+
+					if (0 == allocations)
+						frame_memory.clean_frames++;
+				}
+
+				last_heap_allocations = heap_allocations;
+				last_frame_start = frame_start;
+
+				// this slot's command buffer and semaphores are free again once its last submission has retired
+				wait_timeline(frame_timeline[curr_frame]);
+
+				// which covers the slot's compute submission too, the graphics one waited for it
+				collect_async_timings();
+
+				// the copy went out with an earlier frame, usually the previous time round this slot
+				collect_capture(false);
+
+				// and so is everything its recording allocated
+				frame_arenas[curr_frame].reset();
+				frame_descriptors[curr_frame].reset();
 
 				/*
 				The first thing we need to do in the drawFrame function is acquire an image from the swap chain.
@@ -566,40 +1777,140 @@ namespace sandbox
 					}
 				}
 
-				// check if previous frame is using this image -> there is a fence to wait on it
-				if (VK_NULL_HANDLE != images_in_flight[image_index])
+				// the previous frame that rendered to this image may still be using its per image buffers
+				wait_timeline(image_timeline[image_index]);
+
+				// the last frame that used this image has retired, its counters are final
+				if (cull_stats_pending[image_index])
+				{
+					void* data;
+					vkMapMemory(dev, cull_stats_mems[image_index], 0, sizeof(cull_counters), 0, &data);
+
+					auto counters = static_cast<cull_counters*>(data);
+					auto& stats = occlusion_history[true];
+
+					stats.objects += scene.size();
+					stats.early_drawn += counters->early_drawn;
+					stats.late_drawn += counters->late_drawn;
+					stats.frustum_culled += counters->frustum_culled;
+					stats.occluded += counters->occluded;
+
+					// host writes are visible to the next submission without a barrier
+					memset(data, 0, sizeof(cull_counters));
+
+					vkUnmapMemory(dev, cull_stats_mems[image_index]);
+
+					cull_stats_pending[image_index] = false;
+				}
+
+				cull_stats_pending[image_index] = occlusion_enabled;
+
+				if (cluster_stats_pending[image_index])
+				{
+					void* data;
+					vkMapMemory(dev, cluster_stats_mems[image_index], 0, sizeof(cluster_counters), 0, &data);
+
+					auto counters = static_cast<cluster_counters*>(data);
+					auto& stats = cluster_history[true];
+
+					stats.meshlets += counters->meshlets_tested;
+					stats.frustum_culled += counters->frustum_culled;
+					stats.backface_culled += counters->backface_culled;
+					stats.triangles_in += counters->triangles_in;
+					stats.triangles_out += counters->triangles_out;
+
+					memset(data, 0, sizeof(cluster_counters));
+
+					vkUnmapMemory(dev, cluster_stats_mems[image_index]);
+				}
+
+				cluster_stats_pending[image_index] = cluster_enabled;
+
+				/*
+				Frame boundary: whatever was retired before the submissions the timeline has since passed can be
+				destroyed, and a freshly hot reloaded pipeline can be swapped in. The swap is just a handle exchange
+				because the command buffer is recorded from scratch below.
+				*/
+				run_deletions(completed_timeline_value());
+
+				pipeline_variant reloaded_variant;
+
+				if (VkPipeline reloaded = hot_reload::take_pipeline(reloaded_variant); VK_NULL_HANDLE != reloaded)
 				{
-					vkWaitForFences(dev, 1, &images_in_flight[image_index], VK_TRUE,
-						std::numeric_limits<uint64_t>::max());
+					// every cached variant was built from the old SPIR-V, they get rebuilt lazily on next use
+					destroy_pipeline_variants();
+
+					pipeline_variants.emplace(reloaded_variant, reloaded);
 				}
 
-				// mark the image as now being in use by this frame
-				images_in_flight[image_index] = in_flight_fences[curr_frame];
+				graphics_pipeline = get_pipeline_variant(active_variant);
+
+				if (GEOMETRY_AFTER_PREPASS == active_variant.pass)
+				{
+					// shading options do not affect depth, all of them share the one prepass pipeline
+					pipeline_variant prepass;
+					prepass.vert = active_variant.vert;
+					prepass.samples = active_variant.samples;
+					prepass.pass = GEOMETRY_DEPTH_ONLY;
+
+					depth_pipeline = get_pipeline_variant(prepass);
+				}
+				else
+				{
+					depth_pipeline = VK_NULL_HANDLE;
+				}
 
 				update_ubo(image_index);
 
+				scene_set = scene_descriptor_set(image_index);
+				descriptor_counters.frames++;
+
+				// goes ahead of the graphics submission, which only waits for it where it consumes the results
+				const uint64_t compute_value = submit_async_compute(image_index);
+
+				record_cmd_buffer(cmd_buffers[curr_frame], image_index);
+
 				VkSubmitInfo submit{};
 				submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-				VkSemaphore wait_sems[] = { image_semaphores[curr_frame] };
-				VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-				submit.waitSemaphoreCount = 1;
+				VkSemaphore wait_sems[] = { image_semaphores[curr_frame], compute_timeline };
+				// indirect commands and indices from the cluster cull, the draw list particle.vert reads
+				VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+					VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT };
+				submit.waitSemaphoreCount = 0 != compute_value ? 2 : 1;
 				submit.pWaitSemaphores = wait_sems;
 				submit.pWaitDstStageMask = wait_stages;
 				submit.commandBufferCount = 1;
-				submit.pCommandBuffers = &cmd_buffers[image_index];
+				submit.pCommandBuffers = &cmd_buffers[curr_frame];
+
+				// present waits on the binary semaphore, everything on the CPU side on the timeline value
+				const uint64_t signal_value = timeline_value + 1;
 
-				VkSemaphore sig_sems[] = { rp_semaphores[curr_frame] };
-				submit.signalSemaphoreCount = 1;
+				VkSemaphore sig_sems[] = { rp_semaphores[curr_frame], timeline };
+				uint64_t sig_values[] = { 0, signal_value };	// binary semaphores ignore theirs
+				uint64_t wait_values[] = { 0, compute_value };
+				submit.signalSemaphoreCount = 2;
 				submit.pSignalSemaphores = sig_sems;
 
-				vkResetFences(dev, 1, &in_flight_fences[curr_frame]);
+				VkTimelineSemaphoreSubmitInfo timeline_info{};
+				timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+				timeline_info.waitSemaphoreValueCount = submit.waitSemaphoreCount;
+				timeline_info.pWaitSemaphoreValues = wait_values;
+				timeline_info.signalSemaphoreValueCount = 2;
+				timeline_info.pSignalSemaphoreValues = sig_values;
+				submit.pNext = &timeline_info;
 
-				if (!OP_SUCCESS(vkQueueSubmit(graphics_queue, 1, &submit, in_flight_fences[curr_frame])))
+				if (!OP_SUCCESS(vkQueueSubmit(graphics_queue, 1, &submit, VK_NULL_HANDLE)))
 				{
 					throw std::runtime_error("Failed to submit draw command buffer!");
 				}
 
+				timeline_value = signal_value;
+				frame_timeline[curr_frame] = signal_value;
+				image_timeline[image_index] = signal_value;
+
+				frame_number++;
+
 				VkPresentInfoKHR present_info{};
 				present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 				/*
@@ -616,6 +1927,32 @@ namespace sandbox
 
 				result = vkQueuePresentKHR(present_queue, &present_info);
 
+				/*
+				When the present call returns, not when the image reaches the display; exact timing needs
+				VK_GOOGLE_display_timing or VK_KHR_present_wait, which not every driver has. Under FIFO the call
+				blocks for vblank once the queue is full, so the intervals still show the display's rhythm.
+				*/
+				{
+					auto presented = std::chrono::steady_clock::now();
+					auto& pacing = pacing_history[sc_present_mode];
+
+					if (std::chrono::steady_clock::time_point{} != last_present)
+					{
+						const double interval = std::chrono::duration<double, std::milli>(presented - last_present).count();
+
+						pacing.intervals++;
+						pacing.interval_ms += interval;
+						pacing.interval_sq += interval * interval;
+						pacing.min_ms = std::min(pacing.min_ms, interval);
+						pacing.max_ms = std::max(pacing.max_ms, interval);
+					}
+
+					pacing.presents++;
+					pacing.latency_ms += std::chrono::duration<double, std::milli>(presented - frame_wake).count();
+
+					last_present = presented;
+				}
+
 				if (VK_ERROR_OUT_OF_DATE_KHR == result || VK_SUBOPTIMAL_KHR == result || fb_resized)
 				{
 					fb_resized = false;
@@ -626,12 +1963,17 @@ namespace sandbox
 					std::runtime_error("Swap chain image acquisition failed!");
 				}
 
-				vkQueueWaitIdle(present_queue);
-
 				curr_frame = (curr_frame + 1) % max_frames_in_flight;
 			}
 		}
 
+		void load_assets(const char* pack_path)
+		{
+			assets.open(pack_path);
+
+			spirv::use_embedded(!settings.packed_shaders);
+		}
+
 		void create_instance()
 		{
 			if (debug::enable_validation_layers && !debug::check_validation_layer_support())
@@ -775,19 +2117,37 @@ namespace sandbox
 			int i = 0;
 			for (const auto& qf : queue_fams)
 			{
-				if (qf.queueFamilyProperties.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+				if (!indices.graphics_family && (qf.queueFamilyProperties.queueFlags & VK_QUEUE_GRAPHICS_BIT))
 				{
 					indices.graphics_family = i;
 				}
 
+				/*
+				Compute work that sits between two graphics passes of the same frame is best recorded on the graphics
+				queue itself, no ownership transfers or semaphores needed. A family with both is guaranteed to exist,
+				prefer it and settle for a compute only one otherwise.
+				*/
+				const auto flags = qf.queueFamilyProperties.queueFlags;
+
+				if ((flags & VK_QUEUE_COMPUTE_BIT) && (!indices.compute_family || (flags & VK_QUEUE_GRAPHICS_BIT)))
+				{
+					indices.compute_family = i;
+				}
+
+				// work that does not sit between graphics passes is better off on a queue the graphics work cannot block
+				if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT) && !indices.async_compute_family)
+				{
+					indices.async_compute_family = i;
+				}
+
 				VkBool32 present_support = false;
 				vkGetPhysicalDeviceSurfaceSupportKHR(dev, i, surface, &present_support);
 
-				if (present_support)
+				if (present_support && !indices.present_family)
 					indices.present_family = i;
 
 
-				if (indices.is_complete())
+				if (indices.is_complete() && indices.async_compute_family)
 					break;
 
 				i++;
@@ -797,44 +2157,198 @@ namespace sandbox
 		}
 
 		/*
-			Instead of just checking if a device is suitable or not and going with the first one,
-			you could also give each device a score and pick the highest one. That way you could
-			favor a dedicated graphics card by giving it a higher score, but fall back to an
-			integrated GPU if that's the only available one.
+		Only what the sandbox cannot run without is required: Vulkan 1.2 for render pass 2 and the timeline
+		semaphore, graphics and present queues, and a swap chain for the surface. Everything else is used when the
+		device has it, so integrated GPUs and CPU implementations like lavapipe or SwiftShader qualify too.
 
-			See: https://vulkan-tutorial.com/en/Drawing_a_triangle/Setup/Physical_devices_and_queue_families
-			For device suitability test
+		See: https://vulkan-tutorial.com/en/Drawing_a_triangle/Setup/Physical_devices_and_queue_families
+		For device suitability test
 		*/
-		bool is_device_suitable(VkPhysicalDevice dev)
+		bool is_device_suitable(VkPhysicalDevice dev, std::string* missing)
 		{
 			VkPhysicalDeviceProperties2 dev_props{};
 			dev_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+			VkPhysicalDeviceVulkan12Features vk12_feats{};
+			vk12_feats.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
 			VkPhysicalDeviceFeatures2 dev_feats{};
 			dev_feats.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			dev_feats.pNext = &vk12_feats;
 
 			vkGetPhysicalDeviceProperties2(dev, &dev_props);
+
+			auto fail = [missing](const char* requirement)
+			{
+				if (nullptr != missing)
+					*missing = requirement;
+
+				return false;
+			};
+
+			// the features query below is a 1.1 entry point, and the chained 1.2 struct needs a 1.2 device
+			if (dev_props.properties.apiVersion < VK_MAKE_VERSION(1, 2, 0))
+				return fail("Vulkan 1.2");
+
 			vkGetPhysicalDeviceFeatures2(dev, &dev_feats);
 
-			queue_family_indices indices = find_queue_families(dev);
+			if (!vk12_feats.timelineSemaphore)
+				return fail("timeline semaphores");
+
+			if (!find_queue_families(dev).is_complete())
+				return fail("graphics and present queues");
 
-			bool extensions_supported = check_dev_extension_support(dev);
+			if (!check_dev_extension_support(dev))
+				return fail(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
-			bool sw_adequate = false;
+			KHR::swap_chain_support sw_support = KHR::query_sc_support(dev);
 
-			if(extensions_supported)
+			if (sw_support.formats.empty() || sw_support.present_modes.empty())
+				return fail("a surface format and present mode");
+
+			return true;
+		}
+
+		const char* device_type_name(VkPhysicalDeviceType type)
+		{
+			switch (type)
 			{
-				KHR::swap_chain_support sw_support = KHR::query_sc_support(dev);
-				sw_adequate = !sw_support.formats.empty() && !sw_support.present_modes.empty();
+			case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return "discrete";
+			case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return "integrated";
+			case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return "virtual";
+			case VK_PHYSICAL_DEVICE_TYPE_CPU: return "cpu";
+			default: return "other";
 			}
+		}
 
-			return  dev_props.properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
-					dev_feats.features.tessellationShader && 
-					indices.is_complete() && 
-					extensions_supported && 
-					dev_feats.features.samplerAnisotropy &&
-					sw_adequate;
-		};
+		VkDeviceSize device_local_memory(VkPhysicalDevice dev)
+		{
+			VkPhysicalDeviceMemoryProperties mem_props{};
+			vkGetPhysicalDeviceMemoryProperties(dev, &mem_props);
+
+			VkDeviceSize largest = 0;
+
+			for (uint32_t i = 0; i < mem_props.memoryHeapCount; i++)
+			{
+				if (mem_props.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+				{
+					largest = std::max(largest, mem_props.memoryHeaps[i].size);
+				}
+			}
+
+			return largest;
+		}
+
+		/*
+		Instead of just checking if a device is suitable or not and going with the first one, each device gets a
+		score and the highest one wins. The device type dominates, so a dedicated graphics card is favoured and an
+		integrated GPU, then a CPU implementation, is only the fallback. Within a type the largest device local heap
+		wins, and the optional features and limits settle what is left. 0 is an unsuitable device.
+		*/
+		uint64_t score_device(VkPhysicalDevice dev)
+		{
+			if (!is_device_suitable(dev))
+				return 0;
+
+			VkPhysicalDeviceProperties props{};
+			vkGetPhysicalDeviceProperties(dev, &props);
+
+			VkPhysicalDeviceFeatures feats{};
+			vkGetPhysicalDeviceFeatures(dev, &feats);
+
+			uint64_t score = 1;
+
+			switch (props.deviceType)
+			{
+			case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: score += 1000000; break;
+			case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: score += 100000; break;
+			case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: score += 50000; break;
+			default: break;
+			}
+
+			// 10 per 256 MiB, a terabyte still stays below the gap between two types
+			score += 10 * (device_local_memory(dev) >> 28);
+
+			const queue_family_indices indices = find_queue_families(dev);
+
+			if (indices.async_compute_family)
+				score += 100;
 
+			if (feats.multiDrawIndirect)
+				score += 50;
+
+			if (feats.drawIndirectFirstInstance)
+				score += 50;
+
+			if (feats.samplerAnisotropy)
+				score += 20;
+
+			uint32_t family_count = 0;
+			vkGetPhysicalDeviceQueueFamilyProperties(dev, &family_count, nullptr);
+
+			std::vector<VkQueueFamilyProperties> families(family_count);
+			vkGetPhysicalDeviceQueueFamilyProperties(dev, &family_count, families.data());
+
+			if (families[indices.graphics_family.value()].timestampValidBits)
+				score += 20;
+
+			const VkSampleCountFlags samples = props.limits.framebufferColorSampleCounts &
+				props.limits.framebufferDepthSampleCounts;
+
+			for (uint32_t count = VK_SAMPLE_COUNT_64_BIT; count > VK_SAMPLE_COUNT_1_BIT; count >>= 1)
+			{
+				if (samples & count)
+				{
+					score += 5 * count;
+					break;
+				}
+			}
+
+			score += props.limits.maxImageDimension2D / 1024;
+
+			return score;
+		}
+
+		// what the sandbox uses of the device, and what it will do without
+		void log_device_capabilities(VkPhysicalDevice dev)
+		{
+			VkPhysicalDeviceProperties props{};
+			vkGetPhysicalDeviceProperties(dev, &props);
+
+			VkPhysicalDeviceFeatures feats{};
+			vkGetPhysicalDeviceFeatures(dev, &feats);
+
+			const queue_family_indices indices = find_queue_families(dev);
+
+			uint32_t family_count = 0;
+			vkGetPhysicalDeviceQueueFamilyProperties(dev, &family_count, nullptr);
+
+			std::vector<VkQueueFamilyProperties> families(family_count);
+			vkGetPhysicalDeviceQueueFamilyProperties(dev, &family_count, families.data());
+
+			const uint32_t timestamp_bits = families[indices.graphics_family.value()].timestampValidBits;
+
+			auto yes_no = [](bool b) { return b ? "yes" : "no"; };
+
+			std::cout << "Device: " << props.deviceName << " (" << device_type_name(props.deviceType) << "), Vulkan "
+				<< VK_VERSION_MAJOR(props.apiVersion) << '.' << VK_VERSION_MINOR(props.apiVersion) << '.'
+				<< VK_VERSION_PATCH(props.apiVersion) << ", driver " << props.driverVersion << '\n'
+				<< "\tmemory: " << device_local_memory(dev) / (1024 * 1024) << " MiB device local\n"
+				<< "\tqueues: graphics family " << indices.graphics_family.value() << ", present family "
+				<< indices.present_family.value() << ", async compute "
+				<< (indices.async_compute_family ? "family " + std::to_string(*indices.async_compute_family) : std::string("none"))
+				<< '\n'
+				<< "\tfeatures: anisotropic filtering " << yes_no(feats.samplerAnisotropy) << ", multi draw indirect "
+				<< yes_no(feats.multiDrawIndirect) << ", indirect first instance " << yes_no(feats.drawIndirectFirstInstance)
+				<< ", timestamps " << yes_no(0 != timestamp_bits) << '\n'
+				<< "\tlimits: " << props.limits.maxImageDimension2D << " px images, "
+				<< choose_sample_count_for(dev, 64) << "x MSAA, " << props.limits.maxComputeWorkGroupInvocations
+				<< " invocations per workgroup, " << props.limits.maxStorageBufferRange / (1024 * 1024)
+				<< " MiB storage buffer range\n" << std::flush;
+		}
+
+		/*
+		Every device is listed with its score or what it lacks. --device picks one by its index in that list or by
+		a case insensitive part of its name, and fails rather than fall back when that one cannot run the sandbox.
+		*/
 		void pick_physical_device()
 		{
 			unsigned dev_count = 0;
@@ -848,31 +2362,76 @@ namespace sandbox
 			std::vector<VkPhysicalDevice> devices(dev_count);
 			vkEnumeratePhysicalDevices(instance, &dev_count, devices.data());
 
-#ifdef _DEBUG
+			std::vector<uint64_t> scores(dev_count);
+			std::vector<std::string> names(dev_count);
+
 			std::cout << "Available Devices" << std::endl;
 
-			for (const auto& d : devices)
+			for (uint32_t i = 0; i < dev_count; i++)
 			{
-				VkPhysicalDeviceProperties2 dev_props{};
-				dev_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
-				vkGetPhysicalDeviceProperties2(d, &dev_props);
-				std::cout << '\t' << dev_props.properties.deviceName << '\n';
+				VkPhysicalDeviceProperties props{};
+				vkGetPhysicalDeviceProperties(devices[i], &props);
+
+				std::string missing;
+				const bool suitable = is_device_suitable(devices[i], &missing);
+
+				scores[i] = suitable ? score_device(devices[i]) : 0;
+				names[i] = props.deviceName;
+
+				std::cout << '\t' << i << ": " << names[i] << " (" << device_type_name(props.deviceType) << "), "
+					<< (suitable ? "score " + std::to_string(scores[i]) : "unsuitable, needs " + missing) << '\n';
 			}
-#endif
-			for (const auto& d : devices)
+
+			size_t chosen = dev_count;
+
+			if (!settings.device.empty())
 			{
-				if (is_device_suitable(d))
+				auto lower = [](std::string str)
 				{
-					pd = d;
+					std::transform(str.begin(), str.end(), str.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+					return str;
+				};
 
-					break;
+				const bool is_index = std::all_of(settings.device.begin(), settings.device.end(),
+					[](unsigned char c) { return 0 != std::isdigit(c); });
+
+				for (size_t i = 0; i < dev_count && dev_count == chosen; i++)
+				{
+					if (is_index ? std::to_string(i) == settings.device :
+						std::string::npos != lower(names[i]).find(lower(settings.device)))
+					{
+						chosen = i;
+					}
+				}
+
+				if (dev_count == chosen)
+				{
+					throw std::runtime_error("No device matches " + settings.device + "!");
+				}
+
+				if (0 == scores[chosen])
+				{
+					throw std::runtime_error(names[chosen] + " cannot run the sandbox!");
+				}
+			}
+			else
+			{
+				const auto best = std::max_element(scores.begin(), scores.end());
+
+				if (0 != *best)
+				{
+					chosen = static_cast<size_t>(best - scores.begin());
 				}
 			}
 
-			if (VK_NULL_HANDLE == pd)
+			if (dev_count == chosen)
 			{
 				throw std::runtime_error("Failed to find a suitable GPU!");
 			}
+
+			pd = devices[chosen];
+
+			log_device_capabilities(pd);
 		}
 
 		void create_logical_device()
@@ -882,6 +2441,20 @@ namespace sandbox
 			std::vector<VkDeviceQueueCreateInfo> q_create_infos;
 			std::set<unsigned> unique_q_fams = { indices.graphics_family.value(), indices.present_family.value() };
 
+			if (indices.compute_family)
+			{
+				unique_q_fams.insert(*indices.compute_family);
+			}
+
+			async_compute = settings.async_compute && indices.async_compute_family.has_value();
+
+			if (async_compute)
+			{
+				unique_q_fams.insert(*indices.async_compute_family);
+
+				async_families = { indices.graphics_family.value(), *indices.async_compute_family };
+			}
+
 			float queue_priority = 1.f;
 
 			for (const auto q_fam : unique_q_fams)
@@ -894,14 +2467,25 @@ namespace sandbox
 				q_create_infos.emplace_back(create_info);
 			}
 
+			VkPhysicalDeviceFeatures2 supported{};
+			supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			vkGetPhysicalDeviceFeatures2(pd, &supported);
+
+			// frame, upload and recycling synchronization all run on one timeline semaphore
+			VkPhysicalDeviceVulkan12Features vk12_feats{};
+			vk12_feats.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+			vk12_feats.timelineSemaphore = VK_TRUE;
+
 			VkPhysicalDeviceFeatures2 dev_feats{};
 			dev_feats.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			dev_feats.pNext = &vk12_feats;
 
 			VkDeviceCreateInfo dev_info{};
 			dev_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+			dev_info.pNext = &dev_feats;
 			dev_info.pQueueCreateInfos = q_create_infos.data();
 			dev_info.queueCreateInfoCount = static_cast<unsigned>(q_create_infos.size());
-			dev_info.pEnabledFeatures = &dev_feats.features;
+			dev_info.pEnabledFeatures = nullptr;		// chained through pNext instead
 
 			dev_info.enabledExtensionCount = static_cast<unsigned>(dev_extensions.size());
 			dev_info.ppEnabledExtensionNames = dev_extensions.data();
@@ -916,7 +2500,17 @@ namespace sandbox
 				dev_info.enabledLayerCount = 0;
 			}
 
-			dev_feats.features.samplerAnisotropy = VK_TRUE;
+			// optional, the texture sampler goes without
+			sampler_anisotropy = supported.features.samplerAnisotropy;
+			dev_feats.features.samplerAnisotropy = supported.features.samplerAnisotropy;
+
+			// one vkCmdDrawIndexedIndirect for the whole GPU written draw list, otherwise one call per object
+			multi_draw_indirect = supported.features.multiDrawIndirect;
+			dev_feats.features.multiDrawIndirect = supported.features.multiDrawIndirect;
+
+			// the culling shaders pass the object index in firstInstance, GPU written draws need it to be non zero
+			draw_indirect_first_instance = supported.features.drawIndirectFirstInstance;
+			dev_feats.features.drawIndirectFirstInstance = supported.features.drawIndirectFirstInstance;
 
 			if (!OP_SUCCESS(vkCreateDevice(pd, &dev_info, nullptr, &dev)))
 			{
@@ -933,6 +2527,19 @@ namespace sandbox
 			devq_info.queueFamilyIndex = indices.present_family.value();
 			vkGetDeviceQueue2(dev, &devq_info, &present_queue);
 
+			// the graphics queue itself when there is no async compute, submitting there just serializes
+			devq_info.queueFamilyIndex = async_compute ? *indices.async_compute_family : indices.graphics_family.value();
+			vkGetDeviceQueue2(dev, &devq_info, &compute_queue);
+
+			if (!settings.async_compute)
+			{
+				std::cout << "Async compute: off, compute runs on the graphics queue" << std::endl;
+			}
+			else if (!async_compute)
+			{
+				std::cout << "Async compute: no compute only queue family, compute runs on the graphics queue" << std::endl;
+			}
+
 			/*
 			Note:
 
@@ -964,7 +2571,8 @@ namespace sandbox
 			*/
 		}
 
-		VkImageView create_img_view(VkImage img, VkFormat fmt, VkImageAspectFlags aspectFlags)
+		VkImageView create_img_view(VkImage img, VkFormat fmt, VkImageAspectFlags aspectFlags,
+			uint32_t base_mip, uint32_t mip_count)
 		{
 			VkImageViewCreateInfo iv_info{};
 			iv_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -998,8 +2606,8 @@ namespace sandbox
 				representing the views for the left and right eyes by accessing different layers.
 			*/
 			iv_info.subresourceRange.aspectMask = aspectFlags;
-			iv_info.subresourceRange.baseMipLevel = 0;
-			iv_info.subresourceRange.levelCount = 1;
+			iv_info.subresourceRange.baseMipLevel = base_mip;
+			iv_info.subresourceRange.levelCount = mip_count;
 			iv_info.subresourceRange.baseArrayLayer = 0;
 			iv_info.subresourceRange.layerCount = 1;
 
@@ -1030,12 +2638,12 @@ namespace sandbox
 			}
 		}
 
-		VkShaderModule create_shader_module(const std::vector<char>& spv)
+		VkShaderModule create_shader_module(const uint32_t* code, size_t size)
 		{
 			VkShaderModuleCreateInfo create_info{};
 			create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-			create_info.codeSize = spv.size();
-			create_info.pCode = reinterpret_cast<const unsigned*>(spv.data());
+			create_info.codeSize = size;
+			create_info.pCode = code;
 
 			VkShaderModule shader_module;
 
@@ -1049,10 +2657,85 @@ namespace sandbox
 
 		void create_render_pass()
 		{
+			msaa_samples = choose_sample_count(settings.msaa_samples);
+
+			const bool multisampled = VK_SAMPLE_COUNT_1_BIT != msaa_samples;
+
+			/*
+			Occlusion culling reduces the depth buffer in a compute shader, so depth has to be sampleable at the
+			sample count in use. Its draws carry the object index in firstInstance. When either is missing we
+			render without culling rather than fail.
+			*/
+			occlusion_enabled = false;
+
+			if (settings.occlusion_culling && !draw_indirect_first_instance)
+			{
+				std::cout << "Occlusion culling: no drawIndirectFirstInstance, culling stays off" << std::endl;
+			}
+			else if (settings.occlusion_culling)
+			{
+				VkPhysicalDeviceProperties props{};
+				vkGetPhysicalDeviceProperties(pd, &props);
+
+				VkFormatProperties fmt_props{};
+				vkGetPhysicalDeviceFormatProperties(pd, find_depth_format(), &fmt_props);
+
+				occlusion_enabled = (props.limits.sampledImageDepthSampleCounts & msaa_samples) &&
+					(fmt_props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+
+				if (!occlusion_enabled)
+				{
+					std::cout << "Occlusion culling: depth is not sampleable with " << msaa_samples
+						<< " samples, culling stays off" << std::endl;
+				}
+			}
+
+			/*
+			Cluster culling owns the indirect draws when it runs, so it only does when occlusion culling does not.
+			Every object gets a full LOD0 sized slice of the compacted index buffer, which has to fit one binding.
+			*/
+			cluster_enabled = false;
+
+			if (settings.cluster_culling)
+			{
+				VkPhysicalDeviceProperties props{};
+				vkGetPhysicalDeviceProperties(pd, &props);
+
+				const uint64_t slice_bytes = uint64_t(settings.object_count) * model_lods[0].index_count * sizeof(uint32_t);
+
+				if (occlusion_enabled)
+				{
+					std::cout << "Cluster culling: occlusion culling is on, clusters stay off" << std::endl;
+				}
+				else if (!draw_indirect_first_instance)
+				{
+					std::cout << "Cluster culling: no drawIndirectFirstInstance, clusters stay off" << std::endl;
+				}
+				else if (0 == meshlet_count)
+				{
+					std::cout << "Cluster culling: the asset pack has no meshlets, clusters stay off" << std::endl;
+				}
+				else if (slice_bytes > props.limits.maxStorageBufferRange)
+				{
+					std::cout << "Cluster culling: " << slice_bytes << " bytes of indices exceed the storage buffer range, "
+						"clusters stay off" << std::endl;
+				}
+				else
+				{
+					cluster_enabled = true;
+				}
+			}
+
+			// pipelines have to match the render pass sample count and subpass layout, and the vertex buffer's layout
+			active_variant.vert.vertex_format = settings.compact_vertices ? VERTEX_COMPACT : VERTEX_FULL;
+			active_variant.samples = msaa_samples;
+			active_variant.pass = settings.depth_prepass ? GEOMETRY_AFTER_PREPASS : GEOMETRY_FORWARD;
+			hot_reload::track_variant(active_variant);
+
 			VkAttachmentDescription2 color_attachment{};
 			color_attachment.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
-			color_attachment.format = sc_img_fmt;
-			color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+			color_attachment.format = scene_color_format();
+			color_attachment.samples = msaa_samples;
 
 			/*
 			The loadOp and storeOp determine what to do with the data in the attachment before rendering and 
@@ -1069,7 +2752,17 @@ namespace sandbox
 				- VK_ATTACHMENT_STORE_OP_DONT_CARE: Contents of the framebuffer will be undefined after the rendering operation
 			*/
 			color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-			color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			/*
+			With MSAA only the resolved image is ever looked at. Not storing the samples is what lets a tiler keep
+			them in tile memory for the whole pass, and together with the transient usage never back them with memory.
+			*/
+			color_attachment.storeOp = multisampled ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+
+			// the late occlusion pass carries on drawing into the samples the early one left behind
+			if (occlusion_enabled)
+			{
+				color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			}
 
 			/*
 			The loadOp and storeOp apply to color and depth data, and stencilLoadOp / stencilStoreOp apply to stencil data. 
@@ -1098,21 +2791,38 @@ namespace sandbox
 
 			 We want the image to be ready for presentation using the swap chain after rendering, which is why we use
 			 VK_IMAGE_LAYOUT_PRESENT_SRC_KHR as finalLayout.
+
+			That was the single pass story. The frame graph now owns every layout transition between passes, including
+			the one to PRESENT_SRC, so the render pass expects and leaves its attachments in their attachment layouts
+			and does no transitions of its own.
 			*/
-			color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+			color_attachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			color_attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 			
 			VkAttachmentDescription2 depth_attachment{};
 			depth_attachment.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
 			depth_attachment.format = find_depth_format();
-			depth_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+			depth_attachment.samples = msaa_samples;
 			depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-			depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			// the depth pyramid is built from what the early occlusion pass stored
+			depth_attachment.storeOp = occlusion_enabled ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
 			depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 			depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-			depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			depth_attachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 			depth_attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
+			// the swap chain image or the HDR target, written only by the resolve so its previous contents are irrelevant
+			VkAttachmentDescription2 resolve_attachment{};
+			resolve_attachment.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
+			resolve_attachment.format = scene_color_format();
+			resolve_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+			resolve_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			resolve_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			resolve_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			resolve_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			resolve_attachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			resolve_attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
 			VkAttachmentReference2 ca_ref{}; // color
 			ca_ref.sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
 			/*
@@ -1130,6 +2840,16 @@ namespace sandbox
 			da_ref.attachment = 1;
 			da_ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
+			VkAttachmentReference2 ra_ref{}; // resolve
+			ra_ref.sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
+			ra_ref.attachment = 2;
+			ra_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+			VkAttachmentReference2 da_ro_ref{}; // depth, tested but never written after the prepass
+			da_ro_ref.sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
+			da_ro_ref.attachment = 1;
+			da_ro_ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
 			/*
 			Vulkan may also support compute subpasses in the future, so we have to be explicit about this being a graphics subpass.
 			*/
@@ -1151,46 +2871,63 @@ namespace sandbox
 			sp.colorAttachmentCount = 1;
 			sp.pColorAttachments = &ca_ref;
 			sp.pDepthStencilAttachment = &da_ref;
+			sp.pResolveAttachments = multisampled ? &ra_ref : nullptr;
+
+			/*
+			The prepass is a subpass of the same render pass rather than a render pass of its own. Depth then never
+			has to be stored and loaded in between, which keeps it a transient attachment, and on a tiler both
+			subpasses run over each tile while it is still on chip.
+			*/
+			std::vector<VkSubpassDescription2> subpasses;
+			std::vector<VkSubpassDependency2> dependencies;
+
+			if (settings.depth_prepass)
+			{
+				VkSubpassDescription2 prepass{};
+				prepass.sType = VK_STRUCTURE_TYPE_SUBPASS_DESCRIPTION_2;
+				prepass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+				prepass.colorAttachmentCount = 0;
+				prepass.pDepthStencilAttachment = &da_ref;
+
+				sp.pDepthStencilAttachment = &da_ro_ref;
+
+				subpasses = { prepass, sp };
+
+				// shading may only test against depth once the prepass has finished writing it, per pixel is enough
+				VkSubpassDependency2 spd{};
+				spd.sType = VK_STRUCTURE_TYPE_SUBPASS_DEPENDENCY_2;
+				spd.srcSubpass = 0;
+				spd.dstSubpass = 1;
+				spd.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+				spd.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+				spd.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+				spd.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+				spd.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+				dependencies.push_back(spd);
+			}
+			else
+			{
+				subpasses = { sp };
+			}
 
 			/*
 			* There are two built-in dependencies that take care of the transition at the start of the
 			render pass and at the end of the render pass, but the former does not occur at the right time.
 			It assumes that the transition occurs at the start of the pipeline, but we haven't acquired the
-			image yet at that point! There are two ways to deal with this problem. We could change the waitStages
-			for the imageAvailableSemaphore to VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT to ensure that the render passes
-			don't begin until the image is available, or we can make the render pass wait for the
-			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT stage.
+			image yet at that point!
 
-			The first two fields specify the indices of the dependency and the dependent subpass. The special value 
-			VK_SUBPASS_EXTERNAL refers to the implicit subpass before or after the render pass depending on whether 
-			it is specified in srcSubpass or dstSubpass.
-
-			The index 0 refers to our subpass, which is the first and only one. The dstSubpass must always be higher 
-			than srcSubpass to prevent cycles in the dependency graph (unless one of the subpasses is VK_SUBPASS_EXTERNAL).
-			*/
-			VkSubpassDependency2 spd{};
-			spd.sType = VK_STRUCTURE_TYPE_SUBPASS_DEPENDENCY_2;
-			spd.srcSubpass = VK_SUBPASS_EXTERNAL;
-			spd.dstSubpass = 0;
-			/*
-			* The next two fields specify the operations to wait on and the stages in which these operations occur. We need 
-			to wait for the swap chain to finish reading from the image before we can access it. This can be accomplished by 
-			waiting on the color attachment output stage itself.
-			*/
-			spd.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
-				VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-			spd.srcAccessMask = 0;
-			/*
-			* The operations that should wait on this are in the color attachment stage and involve the writing of the color 
-			attachment. These settings will prevent the transition from happening until it's actually necessary (and allowed): 
-			when we want to start writing colors to it.
+			No subpass dependency on VK_SUBPASS_EXTERNAL is needed any more: the frame graph records a barrier
+			right before the render pass that waits on the acquire semaphore's stage and on the previous frame's
+			depth writes, and another after it for the transition to PRESENT_SRC. The only explicit dependency
+			left is the one between the prepass and the shading subpass.
 			*/
-			spd.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
-				VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-			spd.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | 
-				VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			std::vector<VkAttachmentDescription2> attachments = { color_attachment, depth_attachment };
 
-			std::array<VkAttachmentDescription2, 2> attachments = { color_attachment,depth_attachment };
+			if (multisampled)
+			{
+				attachments.push_back(resolve_attachment);
+			}
 			/*
 			The render pass object can then be created by filling in the VkRenderPassCreateInfo structure with an array of attachments 
 			and subpasses. The VkAttachmentReference objects reference attachments using the indices of this array.
@@ -1199,16 +2936,35 @@ namespace sandbox
 			rp_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO_2;
 			rp_info.attachmentCount = static_cast<uint32_t>(attachments.size());
 			rp_info.pAttachments = attachments.data();
-			rp_info.subpassCount = 1;
-			rp_info.pSubpasses = &sp;
-			rp_info.dependencyCount = 1;
-			rp_info.pDependencies = &spd;
+			rp_info.subpassCount = static_cast<uint32_t>(subpasses.size());
+			rp_info.pSubpasses = subpasses.data();
+			rp_info.dependencyCount = static_cast<uint32_t>(dependencies.size());
+			rp_info.pDependencies = dependencies.data();
 
 			if (!OP_SUCCESS(vkCreateRenderPass2(dev, &rp_info, nullptr, &render_pass)))
 			{
 				throw std::runtime_error("Failed to create render pass!");
 			}
-		}
+
+			/*
+			The late occlusion pass continues the image the early pass started. Render passes that only differ in
+			load and store ops are compatible, so the same pipelines and framebuffers work with both.
+			*/
+			render_pass_late = VK_NULL_HANDLE;
+
+			if (occlusion_enabled)
+			{
+				attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+				attachments[0].storeOp = multisampled ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+				attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+				attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+				if (!OP_SUCCESS(vkCreateRenderPass2(dev, &rp_info, nullptr, &render_pass_late)))
+				{
+					throw std::runtime_error("Failed to create render pass!");
+				}
+			}
+		}
 
 		void create_descriptor_set_layout()
 		{
@@ -1237,7 +2993,15 @@ namespace sandbox
 			sam_layout_bind.pImmutableSamplers = nullptr;
 			sam_layout_bind.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-			std::array<VkDescriptorSetLayoutBinding, 2> bindings = { ubo_layout_bind, sam_layout_bind };
+			// per object transforms, indexed by the draw's firstInstance
+			VkDescriptorSetLayoutBinding obj_layout_bind{};
+			obj_layout_bind.binding = 2;
+			obj_layout_bind.descriptorCount = 1;
+			obj_layout_bind.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			obj_layout_bind.pImmutableSamplers = nullptr;
+			obj_layout_bind.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+			std::array<VkDescriptorSetLayoutBinding, 3> bindings = { ubo_layout_bind, sam_layout_bind, obj_layout_bind };
 
 			// Note: All of the descriptor bindings are combined into a single VkDescriptorSetLayout object.
 			VkDescriptorSetLayoutCreateInfo dsl_info{};
@@ -1249,6 +3013,10 @@ namespace sandbox
 			{
 				throw std::runtime_error("Descriptor set layout creation failed!");
 			}
+
+			// from the same bindings so the two cannot drift apart, it throws if scene_descriptors no longer matches them
+			scene_template.create(descriptor_set_layout, bindings.data(), static_cast<uint32_t>(bindings.size()),
+				sizeof(scene_descriptors));
 		}
 
 		/*
@@ -1258,33 +3026,93 @@ namespace sandbox
 		*/
 		void create_graphics_pipeline()
 		{
-			// shader stuff
-			// serialize spir-v
-			auto read_spv = [](const std::string& wp) 
+			// pipeline layout
+			VkPipelineLayoutCreateInfo pll_info{};
+			pll_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+			/*
+			need to specify the descriptor set layout during pipeline creation to tell Vulkan which descriptors
+			the shaders will be using. Descriptor set layouts are specified in the pipeline layout object.
+			*/
+			pll_info.setLayoutCount = 1;
+			pll_info.pSetLayouts = &descriptor_set_layout;
+			
+			if (!OP_SUCCESS(vkCreatePipelineLayout(dev, &pll_info, nullptr, &pipeline_layout)))
 			{
-				std::ifstream source(wp, std::ios::ate | std::ios::binary);
+				throw std::runtime_error("Failed to create pipeline layout!");
+			}
 
-				if (!source.is_open())
-				{
-					throw std::runtime_error("Failed to open .spv file!");
-				}
+			graphics_pipeline = get_pipeline_variant(active_variant);
+		}
+
+		/*
+		Variants are built on first use and cached for the lifetime of the render pass. Switching an option
+		back and forth is then just a hash lookup.
+		*/
+		VkPipeline get_pipeline_variant(const pipeline_variant& variant)
+		{
+			auto cached = pipeline_variants.find(variant);
+
+			if (pipeline_variants.end() != cached)
+			{
+				return cached->second;
+			}
 
-				size_t src_size = static_cast<size_t>(source.tellg());
-				std::vector<char> buffer(src_size);
+			// shader stuff
+			// embedded arrays and pack entries are both aligned, so the SPIR-V words are consumed in place
+			auto vert_spv = spirv::load(assets, "shader/vert.spv");
+			auto frag_spv = spirv::load(assets, "shader/frag.spv");
 
-				source.seekg(0);
-				source.read(buffer.data(), src_size);
+			// shaders that were edited and recompiled at runtime win over the packed ones
+			std::vector<uint32_t> vert_reloaded, frag_reloaded;
 
-				source.close();
+			if (hot_reload::current_spirv(VK_SHADER_STAGE_VERTEX_BIT, vert_reloaded))
+				vert_spv = { reinterpret_cast<const uint8_t*>(vert_reloaded.data()), vert_reloaded.size() * sizeof(uint32_t) };
 
-				return buffer;
-			};
+			if (hot_reload::current_spirv(VK_SHADER_STAGE_FRAGMENT_BIT, frag_reloaded))
+				frag_spv = { reinterpret_cast<const uint8_t*>(frag_reloaded.data()), frag_reloaded.size() * sizeof(uint32_t) };
+
+			VkPipeline pipeline = build_graphics_pipeline(vert_spv.as<uint32_t>(), vert_spv.size,
+				frag_spv.as<uint32_t>(), frag_spv.size, variant);
+
+			pipeline_variants.emplace(variant, pipeline);
+
+			return pipeline;
+		}
+
+		void destroy_pipeline_variants()
+		{
+			std::vector<VkPipeline> pipelines;
+
+			for (const auto& v : pipeline_variants)
+			{
+				pipelines.push_back(v.second);
+			}
+
+			// frames in flight may still be drawing with any of them
+			defer_delete([pipelines]()
+				{
+					for (auto pipeline : pipelines)
+					{
+						vkDestroyPipeline(dev, pipeline, nullptr);
+					}
+				});
+
+			pipeline_variants.clear();
+			graphics_pipeline = VK_NULL_HANDLE;
+		}
 
-			auto vert_spv = read_spv("shader/vert.spv");
-			auto frag_spv = read_spv("shader/frag.spv");
+		/*
+		Builds a pipeline against the current render pass, pipeline layout and extent. Only creates objects and
+		never touches the queues, so the hot reload worker can call it off the main thread.
+		*/
+		VkPipeline build_graphics_pipeline(const uint32_t* vert_code, size_t vert_size,
+			const uint32_t* frag_code, size_t frag_size, const pipeline_variant& variant)
+		{
+			// the prepass only needs positions, without a fragment shader the rasterizer just writes depth
+			const bool depth_only = GEOMETRY_DEPTH_ONLY == variant.pass;
 
-			VkShaderModule vert_mod = create_shader_module(vert_spv);
-			VkShaderModule frag_mod = create_shader_module(frag_spv);
+			VkShaderModule vert_mod = create_shader_module(vert_code, vert_size);
+			VkShaderModule frag_mod = depth_only ? VK_NULL_HANDLE : create_shader_module(frag_code, frag_size);
 
 			VkPipelineShaderStageCreateInfo vert_ssinfo{};
 			vert_ssinfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -1292,8 +3120,8 @@ namespace sandbox
 			vert_ssinfo.module = vert_mod;
 			vert_ssinfo.pName = "main";
 			/*
-				There is one more (optional) member, pSpecializationInfo, which we won't be using here, 
-				but is worth discussing. It allows you to specify values for shader constants. You can 
+				There is one more (optional) member, pSpecializationInfo. 
+				It allows you to specify values for shader constants. You can 
 				use a single shader module where its behavior can be configured at pipeline creation by 
 				specifying different values for the constants used in it. This is more efficient than 
 				configuring the shader using variables at render time, because the compiler can do 
@@ -1303,6 +3131,20 @@ namespace sandbox
 
 				vert_ssinfo.pSpecializationInfo = nullptr;
 			*/
+
+			// constant_id = 0 in shader.vert
+			VkSpecializationMapEntry vert_spec_entry{};
+			vert_spec_entry.constantID = 0;
+			vert_spec_entry.offset = offsetof(vertex_constants, vertex_format);
+			vert_spec_entry.size = sizeof(uint32_t);
+
+			VkSpecializationInfo vert_spec{};
+			vert_spec.mapEntryCount = 1;
+			vert_spec.pMapEntries = &vert_spec_entry;
+			vert_spec.dataSize = sizeof(vertex_constants);
+			vert_spec.pData = &variant.vert;
+
+			vert_ssinfo.pSpecializationInfo = &vert_spec;
 			
 			VkPipelineShaderStageCreateInfo frag_ssinfo{};
 			frag_ssinfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -1310,11 +3152,27 @@ namespace sandbox
 			frag_ssinfo.module = frag_mod;
 			frag_ssinfo.pName = "main";
 
+			// constant_id = 0 in shader.frag
+			VkSpecializationMapEntry frag_spec_entry{};
+			frag_spec_entry.constantID = 0;
+			frag_spec_entry.offset = offsetof(fragment_constants, shading_mode);
+			frag_spec_entry.size = sizeof(uint32_t);
+
+			VkSpecializationInfo frag_spec{};
+			frag_spec.mapEntryCount = 1;
+			frag_spec.pMapEntries = &frag_spec_entry;
+			frag_spec.dataSize = sizeof(fragment_constants);
+			frag_spec.pData = &variant.frag;
+
+			frag_ssinfo.pSpecializationInfo = &frag_spec;
+
 			VkPipelineShaderStageCreateInfo stages[] = { vert_ssinfo, frag_ssinfo };
 
-			// vertex input stuff
-			auto binding_description = vertex::get_binding_desc();
-			auto attr_descriptions = vertex::get_attr_desc();
+			// vertex input stuff, both layouts describe the same locations
+			const bool compact = VERTEX_COMPACT == variant.vert.vertex_format;
+
+			auto binding_description = compact ? compact_vertex::layout::get_binding_desc() : vertex::layout::get_binding_desc();
+			auto attr_descriptions = compact ? compact_vertex::layout::get_attr_desc() : vertex::layout::get_attr_desc();
 
 			VkPipelineVertexInputStateCreateInfo vtx_input_info{};
 			vtx_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
@@ -1410,7 +3268,7 @@ namespace sandbox
 			VkPipelineMultisampleStateCreateInfo ms_info{};
 			ms_info.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
 			ms_info.sampleShadingEnable = VK_FALSE;
-			ms_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+			ms_info.rasterizationSamples = variant.samples;
 			ms_info.minSampleShading = 1.f;
 			ms_info.pSampleMask = nullptr;
 			ms_info.alphaToCoverageEnable = VK_FALSE;
@@ -1421,8 +3279,21 @@ namespace sandbox
 			VkPipelineDepthStencilStateCreateInfo ds_info{};
 			ds_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
 			ds_info.depthTestEnable = VK_TRUE;
-			ds_info.depthWriteEnable = VK_TRUE;
-			ds_info.depthCompareOp = VK_COMPARE_OP_LESS;
+			/*
+			After a prepass the depth buffer already holds the nearest surface, so only fragments that match it
+			exactly pass, and nothing needs writing. Early tests stay enabled as the shader neither writes depth
+			nor discards.
+			*/
+			if (GEOMETRY_AFTER_PREPASS == variant.pass)
+			{
+				ds_info.depthWriteEnable = VK_FALSE;
+				ds_info.depthCompareOp = VK_COMPARE_OP_EQUAL;
+			}
+			else
+			{
+				ds_info.depthWriteEnable = VK_TRUE;
+				ds_info.depthCompareOp = VK_COMPARE_OP_LESS;
+			}
 			ds_info.depthBoundsTestEnable = VK_FALSE;
 			ds_info.minDepthBounds = 0.f;
 			ds_info.maxDepthBounds = 1.f;
@@ -1506,8 +3377,8 @@ namespace sandbox
 			color_blend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
 			color_blend.logicOpEnable = VK_FALSE;
 			color_blend.logicOp = VK_LOGIC_OP_COPY;
-			color_blend.attachmentCount = 1;
-			color_blend.pAttachments = &cb_attachment;
+			color_blend.attachmentCount = depth_only ? 0 : 1;
+			color_blend.pAttachments = depth_only ? nullptr : &cb_attachment;
 			color_blend.blendConstants[0] = 0.f;
 			color_blend.blendConstants[1] = 0.f;
 			color_blend.blendConstants[2] = 0.f;
@@ -1527,27 +3398,10 @@ namespace sandbox
 				dynamicState.pDynamicStates = dynamicStates;
 			*/
 
-			// pipeline layout
-			VkPipelineLayoutCreateInfo pll_info{};
-			pll_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-			/*
-			need to specify the descriptor set layout during pipeline creation to tell Vulkan which descriptors
-			the shaders will be using. Descriptor set layouts are specified in the pipeline layout object.
-			*/
-			pll_info.setLayoutCount = 1;
-			pll_info.pSetLayouts = &descriptor_set_layout;
-			pll_info.pushConstantRangeCount = 0;
-			pll_info.pPushConstantRanges = nullptr;
-			
-			if (!OP_SUCCESS(vkCreatePipelineLayout(dev, &pll_info, nullptr, &pipeline_layout)))
-			{
-				throw std::runtime_error("Failed to create pipeline layout!");
-			}
-
 			VkGraphicsPipelineCreateInfo pl_info{};
 			pl_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
 			// shader stages
-			pl_info.stageCount = 2;
+			pl_info.stageCount = depth_only ? 1 : 2;
 			pl_info.pStages = stages;
 			// fixed functions
 			pl_info.pVertexInputState = &vtx_input_info;
@@ -1562,7 +3416,7 @@ namespace sandbox
 			pl_info.layout = pipeline_layout;
 			// render pass
 			pl_info.renderPass = render_pass;
-			pl_info.subpass = 0;
+			pl_info.subpass = GEOMETRY_AFTER_PREPASS == variant.pass ? 1 : 0;
 			/*
 			Vulkan allows you to create a new graphics pipeline by deriving from an existing pipeline. The idea 
 			of pipeline derivatives is that it is less expensive to set up pipelines when they have much functionality 
@@ -1578,13 +3432,18 @@ namespace sandbox
 			pl_info.basePipelineHandle = VK_NULL_HANDLE;
 			pl_info.basePipelineIndex = 0;
 
-			if (!OP_SUCCESS(vkCreateGraphicsPipelines(dev, VK_NULL_HANDLE, 1, &pl_info, nullptr, &graphics_pipeline)))
+			VkPipeline pipeline;
+			VkResult result = vkCreateGraphicsPipelines(dev, VK_NULL_HANDLE, 1, &pl_info, nullptr, &pipeline);
+
+			vkDestroyShaderModule(dev, frag_mod, nullptr);
+			vkDestroyShaderModule(dev, vert_mod, nullptr);
+
+			if (!OP_SUCCESS(result))
 			{
 				throw std::runtime_error("Failed to create graphics pipeline!");
 			}
 
-			vkDestroyShaderModule(dev, frag_mod, nullptr);
-			vkDestroyShaderModule(dev, vert_mod, nullptr);
+			return pipeline;
 		}
 
 		void create_framebuffers()
@@ -1593,11 +3452,16 @@ namespace sandbox
 
 			for (size_t i = 0; i < sc_image_views.size(); i++)
 			{
-				std::array<VkImageView, 2> attachments =
+				// with post processing every image's framebuffer renders into the one HDR target
+				VkImageView scene_view = post_enabled ? hdr_color_view : sc_image_views[i];
+
+				// same order as the attachment descriptions in create_render_pass
+				std::vector<VkImageView> attachments = { scene_view, depth_img_view };
+
+				if (VK_SAMPLE_COUNT_1_BIT != msaa_samples)
 				{
-					sc_image_views[i],
-					depth_img_view
-				};
+					attachments = { color_msaa_view, depth_img_view, scene_view };
+				}
 
 				VkFramebufferCreateInfo fb_info{};
 				fb_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
@@ -1647,7 +3511,7 @@ namespace sandbox
 			VkCommandPoolCreateInfo pool_info{};
 			pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 			pool_info.queueFamilyIndex = qfi.graphics_family.value();
-			pool_info.flags = 0;
+			pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
 			if (!OP_SUCCESS(vkCreateCommandPool(dev, &pool_info, nullptr, &cmd_pool)))
 			{
@@ -1693,18 +3557,90 @@ namespace sandbox
 			return (fmt == VK_FORMAT_D32_SFLOAT_S8_UINT) || (fmt == VK_FORMAT_D24_UNORM_S8_UINT);
 		}
 
+		/*
+		The largest count both color and depth attachments support that does not exceed the request. Counts are
+		powers of two, so the bits of the supported mask can be walked downwards.
+		*/
+		VkSampleCountFlagBits choose_sample_count(uint32_t requested)
+		{
+			return choose_sample_count_for(pd, requested);
+		}
+
+		VkSampleCountFlagBits choose_sample_count_for(VkPhysicalDevice dev, uint32_t requested)
+		{
+			VkPhysicalDeviceProperties props{};
+			vkGetPhysicalDeviceProperties(dev, &props);
+
+			VkSampleCountFlags supported = props.limits.framebufferColorSampleCounts &
+				props.limits.framebufferDepthSampleCounts;
+
+			for (uint32_t count = VK_SAMPLE_COUNT_64_BIT; count > VK_SAMPLE_COUNT_1_BIT; count >>= 1)
+			{
+				if (count <= requested && (supported & count))
+					return static_cast<VkSampleCountFlagBits>(count);
+			}
+
+			return VK_SAMPLE_COUNT_1_BIT;
+		}
+
+		/*
+		Depth and the multisampled color target only live for the duration of the render pass: both are cleared on
+		load and not stored. TRANSIENT_ATTACHMENT lets the driver keep them on chip, and lazily allocated memory means
+		a tiler never commits physical pages for them. Desktop GPUs have no such memory type and we fall back to
+		plain device local memory.
+		*/
+		void create_color_resources()
+		{
+			if (VK_SAMPLE_COUNT_1_BIT == msaa_samples)
+				return;
+
+			// stored between the two occlusion passes, so no longer transient
+			auto props = create_image(sc_extent.width, sc_extent.height, scene_color_format(), VK_IMAGE_TILING_OPTIMAL,
+				VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | (occlusion_enabled ? 0 : VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT),
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | (occlusion_enabled ? 0 : VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT),
+				color_msaa, color_msaa_mem, msaa_samples);
+
+			color_msaa_lazy = props & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+			color_msaa_view = create_img_view(color_msaa, scene_color_format(), VK_IMAGE_ASPECT_COLOR_BIT);
+		}
+
+		/*
+		Rendered to, or resolved into, by the geometry passes and sampled by the post chain. Like the depth buffer
+		one is shared by the frames in flight: the graph has every frame's writes wait for the last frame's reads.
+		*/
+		void create_hdr_resources()
+		{
+			if (!post_enabled)
+				return;
+
+			create_image(sc_extent.width, sc_extent.height, hdr_format, VK_IMAGE_TILING_OPTIMAL,
+				VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				hdr_color, hdr_color_mem);
+
+			hdr_color_view = create_img_view(hdr_color, hdr_format, VK_IMAGE_ASPECT_COLOR_BIT);
+		}
+
+		VkFormat scene_color_format()
+		{
+			return post_enabled ? hdr_format : sc_img_fmt;
+		}
+
 		void create_depth_resources()
 		{
 			VkFormat depth_fmt = find_depth_format();
 
-			create_image(sc_extent.width, sc_extent.height, depth_fmt, VK_IMAGE_TILING_OPTIMAL,
-				VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-				depth_buffer, depth_img_mem);
+			// with occlusion culling the depth pyramid is reduced from it, which needs real memory and sampling
+			auto props = create_image(sc_extent.width, sc_extent.height, depth_fmt, VK_IMAGE_TILING_OPTIMAL,
+				VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+				(occlusion_enabled ? VK_IMAGE_USAGE_SAMPLED_BIT : VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT),
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | (occlusion_enabled ? 0 : VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT),
+				depth_buffer, depth_img_mem, msaa_samples);
+
+			depth_lazy = props & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
 
 			depth_img_view = create_img_view(depth_buffer, depth_fmt, VK_IMAGE_ASPECT_DEPTH_BIT);
 
-			transition_image_layout(depth_buffer, depth_fmt, VK_IMAGE_LAYOUT_UNDEFINED, 
-				VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+			// cleared every frame, the frame graph transitions it from UNDEFINED before first use
 		}
 		
 		/*
@@ -1747,8 +3683,9 @@ namespace sandbox
 			throw std::runtime_error("Suitable memory type not found!");
 		};
 
-		void create_image(uint32_t w, uint32_t h, VkFormat fmt, VkImageTiling tiling,
-			VkImageUsageFlags usage, VkMemoryPropertyFlags props, VkImage& img, VkDeviceMemory& img_mem)
+		VkMemoryPropertyFlags create_image(uint32_t w, uint32_t h, VkFormat fmt, VkImageTiling tiling,
+			VkImageUsageFlags usage, VkMemoryPropertyFlags props, VkImage& img, VkDeviceMemory& img_mem,
+			VkSampleCountFlagBits samples)
 		{
 			VkImageCreateInfo img_info{};
 			img_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -1762,7 +3699,7 @@ namespace sandbox
 			img_info.tiling = tiling;
 			img_info.usage = usage;
 			img_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-			img_info.samples = VK_SAMPLE_COUNT_1_BIT;
+			img_info.samples = samples;
 			img_info.flags = 0;
 
 			if (!OP_SUCCESS(vkCreateImage(dev, &img_info, nullptr, &img)))
@@ -1782,7 +3719,20 @@ namespace sandbox
 			VkMemoryAllocateInfo ma_info{};
 			ma_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
 			ma_info.allocationSize = mem_reqs.memoryRequirements.size;
-			ma_info.memoryTypeIndex = find_mem_type(mem_reqs.memoryRequirements.memoryTypeBits, props);
+
+			try
+			{
+				ma_info.memoryTypeIndex = find_mem_type(mem_reqs.memoryRequirements.memoryTypeBits, props);
+			}
+			catch (const std::runtime_error&)
+			{
+				// lazily allocated memory is a nice to have, only tilers offer it
+				if (!(props & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT))
+					throw;
+
+				props &= ~VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+				ma_info.memoryTypeIndex = find_mem_type(mem_reqs.memoryRequirements.memoryTypeBits, props);
+			}
 
 			if (!OP_SUCCESS(vkAllocateMemory(dev, &ma_info, nullptr, &img_mem)))
 			{
@@ -1796,13 +3746,16 @@ namespace sandbox
 			bim_info.memoryOffset = 0;
 
 			vkBindImageMemory2(dev, 1, &bim_info);
+
+			return props;
 		}
 
 		void create_texture_image()
 		{
 			int tex_w, tex_h, tex_channel;
-			stbi_uc* pixels = stbi_load("resource/image/statue.jpg", &tex_w, &tex_h, &tex_channel,
-				STBI_rgb_alpha);
+			auto encoded = assets.read(texture_path);
+			stbi_uc* pixels = stbi_load_from_memory(encoded.data, static_cast<int>(encoded.size), &tex_w, &tex_h, 
+				&tex_channel, STBI_rgb_alpha);
 			VkDeviceSize image_size = tex_w * tex_h * 4;
 
 			if (!pixels)
@@ -1916,8 +3869,9 @@ namespace sandbox
 				sam_info.anisotropyEnable = VK_FALSE;
 				sam_info.maxAnisotropy = 1.f;
 			*/
-			sam_info.anisotropyEnable = VK_TRUE;
-			sam_info.maxAnisotropy = pd_props.properties.limits.maxSamplerAnisotropy;
+			// the feature is optional, devices without it sample without anisotropy
+			sam_info.anisotropyEnable = sampler_anisotropy ? VK_TRUE : VK_FALSE;
+			sam_info.maxAnisotropy = sampler_anisotropy ? pd_props.properties.limits.maxSamplerAnisotropy : 1.f;
 			sam_info.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
 			sam_info.unnormalizedCoordinates = VK_FALSE;
 			sam_info.compareEnable = VK_FALSE;
@@ -1933,6 +3887,128 @@ namespace sandbox
 			}
 		}
 
+		/*
+		The packer bakes .obj files into a mesh_header followed by deduplicated vertex and 32-bit index streams,
+		so loading a model is just resolving pointers into the mapped pack. The index stream carries the whole
+		LOD chain, the header says where each level starts.
+		*/
+		void load_model()
+		{
+			auto blob = assets.read(model_path);
+			auto header = blob.as<asset::mesh_header>();
+
+			if (blob.size < sizeof(asset::mesh_header) || sizeof(vertex) != header->vertex_stride ||
+				sizeof(uint32_t) != header->index_size ||
+				header->vertex_offset + uint64_t(header->vertex_count) * header->vertex_stride > blob.size ||
+				header->index_offset + uint64_t(header->index_count) * header->index_size > blob.size ||
+				0 == header->lod_count || header->lod_count > asset::max_mesh_lods)
+			{
+				throw std::runtime_error("Baked mesh has an unexpected layout!");
+			}
+
+			if (header->meshlet_offset + uint64_t(header->meshlet_count) * sizeof(asset::mesh_meshlet) > blob.size)
+			{
+				throw std::runtime_error("Baked mesh meshlets are out of range!");
+			}
+
+			model_lods.assign(header->lods, header->lods + header->lod_count);
+
+			for (const auto& lod : model_lods)
+			{
+				if (uint64_t(lod.first_index) + lod.index_count > header->index_count ||
+					uint64_t(lod.first_meshlet) + lod.meshlet_count > header->meshlet_count)
+					throw std::runtime_error("Baked mesh LOD is out of range!");
+			}
+
+			model_meshlets = blob.as<asset::mesh_meshlet>(static_cast<size_t>(header->meshlet_offset));
+			meshlet_count = header->meshlet_count;
+
+			model_vertices = blob.as<vertex>(static_cast<size_t>(header->vertex_offset));
+			model_indices = blob.as<uint32_t>(static_cast<size_t>(header->index_offset));
+			vertex_count = header->vertex_count;
+			index_count = header->index_count;
+
+			// every draw path fetches through these, one bad index would read past the vertex buffer on the GPU
+			for (uint32_t i = 0; i < index_count; i++)
+			{
+				if (model_indices[i] >= vertex_count)
+					throw std::runtime_error("Baked mesh index is out of range!");
+			}
+
+			// a sphere around the box is loose but cheap, and the cull shader only ever needs it conservative
+			glm::vec3 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+
+			for (uint32_t i = 0; i < vertex_count; i++)
+			{
+				lo = glm::min(lo, model_vertices[i].position);
+				hi = glm::max(hi, model_vertices[i].position);
+			}
+
+			const glm::vec3 center = 0.5f * (lo + hi);
+			float radius = 0.f;
+
+			for (uint32_t i = 0; i < vertex_count; i++)
+			{
+				radius = std::max(radius, glm::length(model_vertices[i].position - center));
+			}
+
+			mesh_bounds = glm::vec4(center, radius);
+		}
+
+		/*
+		An error of e model units at distance d covers e / d * P11 of the half height of the viewport, so LODs
+		are picked in pixels and the same threshold holds at any resolution or field of view. The chain is
+		ordered finest first with growing error, the first level from the coarse end that fits is the cheapest.
+		*/
+		uint32_t select_lod(float distance)
+		{
+			if (!settings.lod)
+				return 0;
+
+			const float pixels_per_unit = 0.5f * static_cast<float>(sc_extent.height) * std::abs(camera_proj[1][1]) / distance;
+
+			for (uint32_t lod = static_cast<uint32_t>(model_lods.size()) - 1; lod > 0; lod--)
+			{
+				if (model_lods[lod].error * pixels_per_unit <= settings.lod_pixel_error)
+					return lod;
+			}
+
+			return 0;
+		}
+
+		void report_lod_stats()
+		{
+			std::cout << "LOD  triangles  error\n";
+
+			for (size_t i = 0; i < model_lods.size(); i++)
+			{
+				std::cout << std::setw(3) << i << "  " << std::setw(9) << model_lods[i].index_count / 3 << "  "
+					<< model_lods[i].error << "\n";
+			}
+
+			std::cout << "Selection  triangles/frame  of LOD0  frame time\n";
+
+			for (const auto& [enabled, stats] : lod_history)
+			{
+				const double frames = static_cast<double>(std::max<uint64_t>(stats.frames, 1));
+
+				std::cout << std::setw(9) << (enabled ? "on" : "off") << "  " << std::setw(15)
+					<< static_cast<uint64_t>(static_cast<double>(stats.triangles) / frames) << "  " << std::fixed
+					<< std::setprecision(1) << std::setw(6)
+					<< (stats.full_triangles ? 100.0 * stats.triangles / stats.full_triangles : 100.0) << "%  "
+					<< std::setprecision(3) << stats.frame_ms / frames << " ms over " << stats.frames << " frames, objects per LOD";
+
+				for (size_t i = 0; i < model_lods.size(); i++)
+				{
+					std::cout << " " << stats.objects[i];
+				}
+
+				std::cout << "\n" << std::defaultfloat;
+			}
+
+			std::cout << std::flush;
+		}
+
 		/*
 		If we were still using buffers, then we could now write a function to record and execute vkCmdCopyBufferToImage
 		to finish the job, but this command requires the image to be in the right layout first.
@@ -1959,7 +4035,8 @@ namespace sandbox
 
 			img_barrier.image = img;
 
-			if (VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL == new_layout)
+			if (VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL == new_layout ||
+				VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL == new_layout)
 			{
 				img_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
 
@@ -1980,41 +4057,20 @@ namespace sandbox
 			/*
 			Barriers are primarily used for synchronization purposes, so you must specify which types of operations that involve the
 			resource must happen before the barrier, and which operations that involve the resource must wait on the barrier. We need
-			to do that despite already using vkQueueWaitIdle to manually synchronize. The right values depend on the old and new layout
+			to do that despite already using vkQueueWaitIdle to manually synchronize. The right values depend on the old and new layout.
+
+			The same layout -> stage/access table the frame graph uses answers that for any pair, instead of a
+			list of hand written special cases.
 			*/
-			VkPipelineStageFlags src_stage;
-			VkPipelineStageFlags dst_stage;
+			auto src = rg::state_for_layout(old_layout);
+			auto dst = rg::state_for_layout(new_layout);
 
-			if (VK_IMAGE_LAYOUT_UNDEFINED == old_layout &&
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL == new_layout)
-			{
-				img_barrier.srcAccessMask = 0;
-				img_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				src_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-				dst_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-			}
-			else if (VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL == old_layout &&
-				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL == new_layout)
-			{
-				img_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				img_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-				src_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-				dst_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-			}
-			else if (VK_IMAGE_LAYOUT_UNDEFINED == old_layout && 
-				VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL == new_layout)
-			{
-				img_barrier.srcAccessMask = 0;
-				img_barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
-					VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			// only writes have anything to flush, reads just need the execution dependency
+			img_barrier.srcAccessMask = src.write ? src.access : 0;
+			img_barrier.dstAccessMask = dst.access;
 
-				src_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-				dst_stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-			}
-			else
-			{
-				throw std::runtime_error("Layout transition not supported!");
-			}			
+			VkPipelineStageFlags src_stage = src.stages;
+			VkPipelineStageFlags dst_stage = dst.stages;
 
 			/*
 			All types of pipeline barriers are submitted using the same function. The first parameter after the command buffer specifies 
@@ -2132,8 +4188,20 @@ namespace sandbox
 			submit.commandBufferCount = 1;
 			submit.pCommandBuffers = &cmd_buffer;
 
+			// the upload takes the next timeline value, so waiting for it leaves frames in flight alone
+			const uint64_t signal_value = ++timeline_value;
+
+			VkTimelineSemaphoreSubmitInfo timeline_info{};
+			timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+			timeline_info.signalSemaphoreValueCount = 1;
+			timeline_info.pSignalSemaphoreValues = &signal_value;
+
+			submit.pNext = &timeline_info;
+			submit.signalSemaphoreCount = 1;
+			submit.pSignalSemaphores = &timeline;
+
 			vkQueueSubmit(graphics_queue, 1, &submit, VK_NULL_HANDLE);
-			vkQueueWaitIdle(graphics_queue);
+			wait_timeline(signal_value);
 
 			vkFreeCommandBuffers(dev, cmd_pool, 1, &cmd_buffer);
 		}
@@ -2152,14 +4220,23 @@ namespace sandbox
 			b_info.usage = usage;
 			/*
 			* Just like the images in the swap chain, buffers can also be owned by a specific
-			queue family or be shared between multiple at the same time. The buffer will only
-			be used from the graphics queue, so we can stick to exclusive access.
+			queue family or be shared between multiple at the same time. Without async compute a buffer
+			is only used from the graphics queue, so we can stick to exclusive access. With it any buffer
+			may be read or written from both families, sharing it concurrently spares us the ownership
+			transfers.
 
 			The flags parameter is used to configure sparse buffer memory, which is not relevant
 			right now. We'll leave it at the default value of 0.
 			*/
 			b_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
+			if (async_compute)
+			{
+				b_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+				b_info.queueFamilyIndexCount = static_cast<uint32_t>(async_families.size());
+				b_info.pQueueFamilyIndices = async_families.data();
+			}
+
 			if (!OP_SUCCESS(vkCreateBuffer(dev,  &b_info, nullptr, &buffer)))
 			{
 				throw std::runtime_error("Buffer creation failed!");
@@ -2239,9 +4316,116 @@ namespace sandbox
 			end_single_time_cmds(cmd_buffer);
 		}
 
+		/*
+		Quantizes the baked full precision vertices. Positions are normalized to the mesh's bounding box, so the 16 bits
+		are spent where the mesh is; the returned matrix is the box, applied through the model matrix.
+		*/
+		glm::mat4 quantize_vertices(std::vector<compact_vertex>& out)
+		{
+			glm::vec3 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+
+			for (uint32_t i = 0; i < vertex_count; i++)
+			{
+				lo = glm::min(lo, model_vertices[i].position);
+				hi = glm::max(hi, model_vertices[i].position);
+			}
+
+			// a flat mesh still needs a non zero scale on its flat axis
+			const glm::vec3 extent = glm::max(hi - lo, glm::vec3(std::numeric_limits<float>::min()));
+
+			auto unorm = [](float v, float max) { return static_cast<uint32_t>(std::round(glm::clamp(v, 0.f, 1.f) * max)); };
+			auto snorm16 = [](float v) { return static_cast<int16_t>(std::round(glm::clamp(v, -1.f, 1.f) * 32767.f)); };
+
+			// octahedral mapping, the upper hemisphere is the diamond and the lower one folds over its corners
+			auto oct_encode = [](glm::vec3 n)
+			{
+				const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+
+				if (0.f == l1)
+					return glm::vec2(0.f);
+
+				n /= l1;
+
+				glm::vec2 p(n.x, n.y);
+
+				if (n.z < 0.f)
+				{
+					p = (1.f - glm::abs(glm::vec2(n.y, n.x))) * glm::vec2(n.x >= 0.f ? 1.f : -1.f, n.y >= 0.f ? 1.f : -1.f);
+				}
+
+				return p;
+			};
+
+			out.resize(vertex_count);
+
+			double max_position_error = 0.0;
+
+			for (uint32_t i = 0; i < vertex_count; i++)
+			{
+				const vertex& v = model_vertices[i];
+				compact_vertex& c = out[i];
+
+				const glm::vec3 p = (v.position - lo) / extent;
+
+				for (int k = 0; k < 3; k++)
+				{
+					c.position[k] = static_cast<uint16_t>(unorm(p[k], 65535.f));
+				}
+
+				c.position[3] = 0;
+
+				for (int k = 0; k < 3; k++)
+				{
+					c.color[k] = static_cast<uint8_t>(unorm(v.color[k], 255.f));
+				}
+
+				c.color[3] = 255;
+
+				c.tex_coord[0] = static_cast<uint16_t>(glm::packHalf1x16(v.tex_coord.x));
+				c.tex_coord[1] = static_cast<uint16_t>(glm::packHalf1x16(v.tex_coord.y));
+
+				const glm::vec2 oct = oct_encode(v.normal);
+
+				c.normal[0] = snorm16(oct.x);
+				c.normal[1] = snorm16(oct.y);
+
+				const glm::vec3 decoded = lo + extent * glm::vec3(c.position[0], c.position[1], c.position[2]) / 65535.f;
+
+				max_position_error = std::max(max_position_error, static_cast<double>(glm::length(decoded - v.position)));
+			}
+
+			std::cout << "Vertex quantization: max position error " << max_position_error << " over a "
+				<< glm::length(extent) << " diagonal" << std::endl;
+
+			return glm::scale(glm::translate(glm::mat4(1.f), lo), extent);
+		}
+
 		void create_vertex_buffer()
 		{
-			VkDeviceSize buffer_size = sizeof(vertex) * vertices.size();
+			vertex_buffer_format = active_variant.vert.vertex_format;
+
+			std::vector<compact_vertex> compact;
+
+			const void* source = model_vertices;
+			uint32_t stride = vertex::layout::stride;
+
+			if (VERTEX_COMPACT == vertex_buffer_format)
+			{
+				position_dequantize = quantize_vertices(compact);
+
+				source = compact.data();
+				stride = compact_vertex::layout::stride;
+			}
+			else
+			{
+				position_dequantize = glm::mat4(1.f);
+			}
+
+			VkDeviceSize buffer_size = VkDeviceSize(stride) * vertex_count;
+
+			auto& stats = vertex_history[vertex_buffer_format];
+			stats.stride = stride;
+			stats.buffer_bytes = buffer_size;
 			
 			/*
 				using a new stagingBuffer with stagingBufferMemory for mapping and copying the vertex data.
@@ -2280,347 +4464,3319 @@ namespace sandbox
 				vertexBuffer is now allocated from a memory type that is device local, which generally means that we're
 				not able to use vkMapMemory.
 
-				we can copy data from the stagingBuffer to the vertexBuffer.
+				we can copy data from the stagingBuffer to the vertexBuffer.
+
+				We have to indicate that we intend to do that by specifying the transfer source flag for the stagingBuffer
+				and the transfer destination flag for the vertexBuffer, along with the vertex buffer usage flag.
+			*/
+			void* data{ nullptr };
+			if (!OP_SUCCESS(vkMapMemory(dev, staging_buffer_memory, 0, buffer_size, 0, &data)))
+			{
+				throw std::runtime_error("Memory mapping failed!");
+			}
+
+			memcpy(data, source, static_cast<size_t>(buffer_size));
+			vkUnmapMemory(dev, staging_buffer_memory);
+
+			create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertex_buffer, vtx_buffer_mem);
+
+			copy_buffer(staging_buffer, vertex_buffer, buffer_size);
+
+			vkDestroyBuffer(dev, staging_buffer, nullptr);
+			vkFreeMemory(dev, staging_buffer_memory, nullptr);
+		}
+		
+		void create_index_buffer()
+		{
+			VkDeviceSize buffer_size = sizeof(uint32_t) * index_count;
+
+			VkBuffer		staging_buffer;
+			VkDeviceMemory	staging_buffer_mem;
+
+			create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				staging_buffer, staging_buffer_mem);
+
+			void* data = nullptr;
+			vkMapMemory(dev, staging_buffer_mem, 0, buffer_size , 0, &data);
+			memcpy(data, model_indices, static_cast<size_t>(buffer_size));
+			vkUnmapMemory(dev, staging_buffer_mem);
+
+			// the cluster cull reads it as storage to copy out the visible meshlets
+			create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, index_buffer, idx_buffer_mem);
+
+			copy_buffer(staging_buffer, index_buffer, buffer_size);
+
+			vkDestroyBuffer(dev, staging_buffer, nullptr);
+			vkFreeMemory(dev, staging_buffer_mem, nullptr);
+		}
+
+		void create_uniform_buffers()
+		{
+			VkDeviceSize buffer_size = sizeof(UniformBufferObject);
+
+			uniform_buffers.resize(sc_images.size());
+			ubo_mems.resize(sc_images.size());
+
+			for (size_t i = 0; i < sc_images.size(); i++)
+			{
+				create_buffer(buffer_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					uniform_buffers[i], ubo_mems[i]);
+			}
+
+			object_buffers.resize(sc_images.size());
+			object_mems.resize(sc_images.size());
+			cull_stats_buffers.resize(sc_images.size());
+			cull_stats_mems.resize(sc_images.size());
+			cull_stats_pending.assign(sc_images.size(), false);
+			cluster_stats_buffers.resize(sc_images.size());
+			cluster_stats_mems.resize(sc_images.size());
+			cluster_stats_pending.assign(sc_images.size(), false);
+
+			for (size_t i = 0; i < sc_images.size(); i++)
+			{
+				create_buffer(sizeof(object_data) * scene.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					object_buffers[i], object_mems[i]);
+
+				create_buffer(sizeof(cull_counters), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					cull_stats_buffers[i], cull_stats_mems[i]);
+
+				void* data;
+				vkMapMemory(dev, cull_stats_mems[i], 0, sizeof(cull_counters), 0, &data);
+				memset(data, 0, sizeof(cull_counters));
+				vkUnmapMemory(dev, cull_stats_mems[i]);
+
+				create_buffer(sizeof(cluster_counters), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					cluster_stats_buffers[i], cluster_stats_mems[i]);
+
+				vkMapMemory(dev, cluster_stats_mems[i], 0, sizeof(cluster_counters), 0, &data);
+				memset(data, 0, sizeof(cluster_counters));
+				vkUnmapMemory(dev, cluster_stats_mems[i]);
+			}
+		}
+
+		void create_descriptor_pool()
+		{
+			/*
+			What one set of descriptor_set_layout needs. The cache starts with room for a set per swap chain image,
+			which is all it should ever hold; the frame allocators with as many, and both grow if that turns out short.
+			*/
+			const std::vector<VkDescriptorPoolSize> per_set = scene_template.pool_sizes();
+
+			const uint32_t sets = static_cast<uint32_t>(sc_images.size());
+
+			scene_sets.init(per_set, sets);
+
+			// not tied to the swap chain, they outlive its recreation
+			for (auto& frame : frame_descriptors)
+			{
+				if (0 == frame.pools())
+				{
+					frame.init(per_set, sets);
+				}
+			}
+		}
+
+		scene_descriptors scene_descriptor_contents(uint32_t image_index)
+		{
+			/*
+			Descriptors that refer to buffers, like our uniform buffer descriptor, are configured with a VkDescriptorBufferInfo
+			struct. This structure specifies the buffer and the region within it that contains the data for the descriptor.
+			*/
+			scene_descriptors contents{};
+			contents.ubo = { uniform_buffers[image_index], 0, sizeof(UniformBufferObject) };	// can use VK_WHOLE_SIZE
+			contents.texture = { tex_sampler, tex_img_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+			contents.objects = { object_buffers[image_index], 0, VK_WHOLE_SIZE };
+
+			return contents;
+		}
+
+		VkDescriptorSet scene_descriptor_set(uint32_t image_index)
+		{
+			const scene_descriptors contents = scene_descriptor_contents(image_index);
+
+			if (settings.descriptor_cache)
+			{
+				return scene_sets.get(scene_template, &contents);
+			}
+
+			// allocated and written again every frame, what content that really changes per frame costs
+			VkDescriptorSet set = frame_descriptors[curr_frame].allocate(descriptor_set_layout);
+			scene_template.update(set, &contents);
+
+			return set;
+		}
+
+		void benchmark_descriptor_updates()
+		{
+			const scene_descriptors contents = scene_descriptor_contents(0);
+
+			descriptors::benchmark(std::cout, scene_template, &contents);
+		}
+
+		void create_descriptor_sets()
+		{
+			// fill the cache now, so the first frames after a resize do not write descriptors
+			if (!settings.descriptor_cache)
+				return;
+
+			for (uint32_t i = 0; i < sc_images.size(); i++)
+			{
+				scene_descriptor_set(i);
+			}
+		}
+
+		/*
+		With the cache every frame after the first few should be a hit and allocate nothing. Without it every
+		frame allocates and writes its set from the frame slot's pools, which are reset rather than freed.
+		*/
+		void report_descriptor_stats()
+		{
+			const double frames = static_cast<double>(std::max<uint64_t>(descriptor_counters.frames, 1));
+
+			uint64_t frame_sets = 0, frame_pools = 0, frame_growths = 0;
+
+			for (const auto& frame : frame_descriptors)
+			{
+				frame_sets += frame.allocations();
+				frame_pools += frame.pools();
+				frame_growths += frame.growths();
+			}
+
+			const uint64_t hits = descriptor_counters.cache_hits + scene_sets.hits();
+			const uint64_t misses = descriptor_counters.cache_misses + scene_sets.misses();
+
+			std::cout << "Descriptor sets: cache " << (settings.descriptor_cache ? "on" : "off") << ", " << hits << " hits, "
+				<< misses << " misses, " << descriptor_counters.cache_pools + scene_sets.pools().pools() << " cache pools\n"
+				<< "\tper frame pools: " << std::fixed << std::setprecision(2) << static_cast<double>(frame_sets) / frames
+				<< " sets allocated per frame, " << frame_pools << " pools, " << frame_growths << " grown on running out\n"
+				<< std::defaultfloat << std::flush;
+		}
+
+		void create_cmd_buffers()
+		{
+			/*
+			One command buffer per frame in flight. They are re-recorded every frame in draw_frame, which is
+			what lets the pipeline be swapped (hot reload) or the draw list change without touching buffers
+			the GPU may still be executing.
+			*/
+			cmd_buffers.resize(max_frames_in_flight);
+
+			VkCommandBufferAllocateInfo alloc_info{};
+			alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			alloc_info.commandPool = cmd_pool;
+			/*
+			The level parameter specifies if the allocated command buffers are primary or secondary command buffers.
+
+				- VK_COMMAND_BUFFER_LEVEL_PRIMARY: Can be submitted to a queue for execution, but cannot be called from other command buffers.
+				- VK_COMMAND_BUFFER_LEVEL_SECONDARY: Cannot be submitted directly, but can be called from primary command buffers.
+			*/
+			alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			alloc_info.commandBufferCount = static_cast<unsigned>(cmd_buffers.size());
+
+			if (!OP_SUCCESS(vkAllocateCommandBuffers(dev,&alloc_info, cmd_buffers.data())))
+			{
+				throw std::runtime_error("Failed to allocate command buffers!");
+			}
+		}
+
+		void record_cmd_buffer(VkCommandBuffer cmd, uint32_t image_index)
+		{
+			VkCommandBufferBeginInfo begin_info{};
+			begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			/*
+			The flags parameter specifies how we're going to use the command buffer. The following values are available:
+
+				- VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT: The command buffer will be rerecorded right after executing it once.
+				- VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT: This is a secondary command buffer that will be entirely within a single render pass.
+				- VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT: The command buffer can be resubmitted while it is also already pending execution.
+			
+			The buffer is re-recorded every frame, so each recording is submitted exactly once.
+			*/
+			begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			/*
+			The pInheritanceInfo parameter is only relevant for secondary command buffers. It specifies which state to 
+			inherit from the calling primary command buffers.
+			*/
+			begin_info.pInheritanceInfo = nullptr;
+
+			if (!OP_SUCCESS(vkBeginCommandBuffer(cmd, &begin_info)))
+			{
+				throw std::runtime_error("Command buffer recording failed!");
+			}
+
+			frame_graph.bind_image(rg_swap_chain, sc_images[image_index], sc_image_views[image_index]);
+			frame_graph.bind_image(rg_depth, depth_buffer, depth_img_view);
+
+			if (rg::invalid_resource != rg_color_msaa)
+			{
+				frame_graph.bind_image(rg_color_msaa, color_msaa, color_msaa_view);
+			}
+
+			if (post_enabled)
+			{
+				frame_graph.bind_image(rg_hdr, hdr_color, hdr_color_view);
+			}
+
+			if (occlusion_enabled)
+			{
+				frame_graph.bind_buffer(rg_visibility, visibility_buffer);
+				frame_graph.bind_buffer(rg_early_draws, early_draw_buffer);
+				frame_graph.bind_buffer(rg_late_draws, late_draw_buffer);
+				frame_graph.bind_buffer(rg_cull_stats, cull_stats_buffers[image_index]);
+			}
+
+			if (cluster_enabled)
+			{
+				frame_graph.bind_buffer(rg_cluster_indices, cluster_index_buffers[curr_frame]);
+				frame_graph.bind_buffer(rg_cluster_draws, cluster_draw_buffers[curr_frame]);
+
+				// the cull and its counters are on the compute queue otherwise
+				if (!async_compute)
+				{
+					frame_graph.bind_buffer(rg_cluster_stats, cluster_stats_buffers[image_index]);
+				}
+			}
+
+			if (particles_enabled)
+			{
+				frame_graph.bind_buffer(rg_particle_draws, particle_draw_buffers[curr_frame]);
+				frame_graph.bind_buffer(rg_particle_args, particle_args_buffers[curr_frame]);
+			}
+
+			// what the compute queue's work is measured against
+			const bool stamp = VK_NULL_HANDLE != async_queries;
+			const uint32_t first_query = static_cast<uint32_t>(4 * curr_frame);
+
+			if (stamp)
+			{
+				vkCmdResetQueryPool(cmd, async_queries, first_query + 2, 2);
+				vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, async_queries, first_query + 2);
+			}
+
+			// barriers, layout transitions and the passes themselves
+			frame_graph.execute(cmd, static_cast<uint32_t>(curr_frame), image_index, frame_scratch());
+
+			if (stamp)
+			{
+				vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, async_queries, first_query + 3);
+			}
+
+			// outside the graph, so only the capture frame pays for it; frame_number + 1 is the frame being recorded
+			if (capture_enabled && frame_number + 1 == settings.capture_frame)
+			{
+				record_capture(cmd, sc_images[image_index]);
+			}
+
+			if (!OP_SUCCESS(vkEndCommandBuffer(cmd)))
+			{
+				throw std::runtime_error("Command buffer recording failed!");
+			}
+		}
+
+		void record_forward_pass(VkCommandBuffer cmd, uint32_t image_index)
+		{
+			record_scene(cmd, image_index, render_pass, cluster_enabled ? cluster_draw_buffers[curr_frame] : VK_NULL_HANDLE);
+		}
+
+		void record_scene(VkCommandBuffer cmd, uint32_t image_index, VkRenderPass rp, VkBuffer indirect)
+		{
+			// ignored by the late occlusion pass, which loads instead
+			std::array<VkClearValue, 2> clear_values{};
+			clear_values[0].color = { 0.f, 0.f, 0.f, 1.f };
+			clear_values[1].depthStencil = { 1.f, 0 };
+
+			/* Note: If the command buffer was already recorded once, then a call to vkBeginCommandBuffer will implicitly reset it. 
+			 It's not possible to append commands to a buffer at a later time. */
+
+			VkRenderPassBeginInfo rpi{};
+			rpi.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			/*
+			The first parameters are the render pass itself and the attachments to bind. We created a framebuffer for each swap chain 
+			image that specifies it as color attachment.
+			*/
+			rpi.renderPass = rp;
+			rpi.framebuffer = sc_framebuffers[image_index];
+			/*
+			* The next two parameters define the size of the render area. The render area defines where shader loads and stores will 
+			take place. The pixels outside this region will have undefined values. It should match the size of the attachments for 
+			best performance.
+			*/
+			rpi.renderArea.offset = { 0,0 };
+			rpi.renderArea.extent = sc_extent;
+			/*
+			The last two parameters define the clear values to use for VK_ATTACHMENT_LOAD_OP_CLEAR, which we used as load operation 
+			for the color attachment.
+			*/
+			
+			rpi.clearValueCount = static_cast<uint32_t>(clear_values.size());
+			rpi.pClearValues = clear_values.data();
+
+			VkSubpassBeginInfo spi{};
+			spi.sType = VK_STRUCTURE_TYPE_SUBPASS_BEGIN_INFO;
+			spi.contents = VK_SUBPASS_CONTENTS_INLINE;
+			
+			/*
+			The render pass can now begin. All of the functions that record commands can be recognized by their vkCmd prefix. 
+			They all return void, so there will be no error handling until we've finished recording.
+
+			The final parameter controls how the drawing commands within the render pass will be provided. It can have one of two values:
+
+				- VK_SUBPASS_CONTENTS_INLINE: The render pass commands will be embedded in the primary command buffer itself and no 
+				secondary command buffers will be executed.
+				
+				- VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS: The render pass commands will be executed from secondary command buffers.
+			*/
+			vkCmdBeginRenderPass2(cmd, &rpi, &spi);
+
+			// the cluster draws address the compacted copy, everything else the baked indices
+			const VkBuffer indices = cluster_enabled ? cluster_index_buffers[curr_frame] : index_buffer;
+
+			// nothing recorded into this render pass yet as far as the cache knows
+			bind_state bound{};
+
+			auto changed = [](bind_kind kind, auto& current, auto wanted)
+			{
+				if (current == wanted)
+				{
+					draw_counters.skipped[kind]++;
+					return false;
+				}
+
+				current = wanted;
+				draw_counters.issued[kind]++;
+
+				return true;
+			};
+
+			/*
+			bind the right descriptor set for each swap chain image to the descriptors in the shader with vkCmdBindDescriptorSets. 
+			This needs to be done before the vkCmdDrawIndexed call:
+
+			Unlike vertex and index buffers, descriptor sets are not unique to graphics pipelines. Therefore we need to specify if 
+			we want to bind descriptor sets to the graphics or compute pipeline. The next parameter is the layout that the descriptors 
+			are based on. The next three parameters specify the index of the first descriptor set, the number of sets to bind, and the 
+			array of sets to bind.
+
+			The last two parameters specify an array of offsets that are used for dynamic descriptors.
+
+			Every draw asks for its whole state and only what differs from the previous draw is recorded. Buffers and
+			descriptor sets stay bound across subpasses, so after the first draw only pipeline changes get through.
+			*/
+			auto bind = [cmd, indices, &bound, &changed](VkPipeline pipeline)
+			{
+				if (changed(BIND_PIPELINE, bound.pipeline, pipeline))
+				{
+					vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+				}
+
+				if (changed(BIND_DESCRIPTOR_SET, bound.set, scene_set))
+				{
+					vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1,
+						&scene_set, 0, nullptr);
+				}
+
+				if (changed(BIND_VERTEX_BUFFER, bound.vertex_buffer, vertex_buffer))
+				{
+					VkBuffer vtx_buffers[] = { vertex_buffer };
+					VkDeviceSize offsets[] = { 0 };
+
+					vkCmdBindVertexBuffers(cmd, 0, 1, vtx_buffers, offsets);
+				}
+
+				if (changed(BIND_INDEX_BUFFER, bound.index_buffer, indices))
+				{
+					vkCmdBindIndexBuffer(cmd, indices, 0, VK_INDEX_TYPE_UINT32);
+				}
+			};
+
+			VkSubpassEndInfo spe{};
+			spe.sType = VK_STRUCTURE_TYPE_SUBPASS_END_INFO;
+
+			if (VK_NULL_HANDLE == indirect)
+			{
+				// numbered like the passes, see update_scene
+				const VkPipeline pipelines[] = { depth_pipeline, graphics_pipeline };
+
+				uint32_t pass = frame_draws.count ? sort::key_pass(frame_draws.keys[0]) : DRAW_PASS_SHADE;
+				uint32_t first = 0;
+
+				for (uint32_t k = 0; k < frame_draws.count; k++)
+				{
+					const uint64_t key = frame_draws.keys[k];
+
+					if (sort::key_pass(key) != pass)
+					{
+						vkCmdNextSubpass2(cmd, &spi, &spe);
+
+						pass = sort::key_pass(key);
+						first = k;
+					}
+
+					bind(pipelines[sort::key_pipeline(key)]);
+
+					// every pass lists the objects in upload order, so firstInstance is the draw's place in its pass
+					const auto& lod = model_lods[scene[frame_draws.objects[k]].lod];
+
+					//vkCmdDraw(cmd, vertex_count, 1, 0, 0);
+					vkCmdDrawIndexed(cmd, lod.index_count, 1, lod.first_index, 0, k - first);
+				}
+			}
+			else
+			{
+				auto draw_indirect = [cmd, indirect]()
+				{
+					const uint32_t count = static_cast<uint32_t>(draw_order.size());
+					const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+					if (multi_draw_indirect)
+					{
+						vkCmdDrawIndexedIndirect(cmd, indirect, 0, count, stride);
+					}
+					else
+					{
+						for (uint32_t i = 0; i < count; i++)
+						{
+							vkCmdDrawIndexedIndirect(cmd, indirect, i * stride, 1, stride);
+						}
+					}
+				};
+
+				if (VK_NULL_HANDLE != depth_pipeline)
+				{
+					bind(depth_pipeline);
+					draw_indirect();
+
+					vkCmdNextSubpass2(cmd, &spi, &spe);
+				}
+
+				bind(graphics_pipeline);
+				draw_indirect();
+			}
+
+			// over the finished scene, in the last geometry pass of the frame
+			if (particles_enabled && (occlusion_enabled ? render_pass_late : render_pass) == rp)
+			{
+				record_particles(cmd, image_index);
+			}
+
+			vkCmdEndRenderPass2(cmd, &spe);
+		}
+
+		/*
+		Copies of the model on a square grid. Seen from the camera's diagonal the rooms overlap heavily on
+		screen, which is the overdraw a depth prepass and front to back ordering are meant to remove.
+		*/
+		void build_scene()
+		{
+			const uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(settings.object_count))));
+			const float spacing = 2.5f;
+			const float offset = 0.5f * spacing * static_cast<float>(side - 1);
+
+			scene.clear();
+
+			for (uint32_t i = 0; i < settings.object_count; i++)
+			{
+				scene_object obj{};
+				obj.position = glm::vec3(spacing * static_cast<float>(i % side) - offset,
+					spacing * static_cast<float>(i / side) - offset, 0.f);
+				obj.model = glm::mat4(1.f);
+
+				scene.push_back(obj);
+			}
+
+			// pull the camera back far enough to see the whole grid
+			const float scale = std::max(1.f, 0.9f * static_cast<float>(side));
+
+			camera_eye = glm::vec3(2.f, 2.f, 2.f) * scale;
+			camera_far = 10.f * scale;
+
+			draw_order.resize(scene.size());
+
+			for (uint32_t i = 0; i < draw_order.size(); i++)
+			{
+				draw_order[i] = i;
+			}
+		}
+
+		/*
+		Every draw of the frame gets a sort key and one radix sort orders them. With a prepass every object is
+		drawn twice and the depth only draws carry the lower pass, so they come first. The sort is stable and both
+		copies of an object share everything below the pass and pipeline, so both passes list the objects in the
+		same order, and that order is the one the objects are uploaded in.
+
+		Nearest first means the depth test rejects as many hidden fragments as possible before they are shaded.
+		Without a prepass this is all the early-Z help we get, with one it makes the prepass itself cheaper.
+		The mesh, here the LOD, sorts above depth, but LODs follow distance, so the order stays close to front to back.
+		There is one pipeline per pass and one material for now, those fields only start to matter with more.
+		*/
+		void update_scene(float time)
+		{
+			const glm::vec3 forward = glm::normalize(-camera_eye);
+
+			for (auto& obj : scene)
+			{
+				obj.model = glm::rotate(glm::translate(glm::mat4(1.f), obj.position), time * glm::radians(90.f),
+					glm::vec3(0.f, 0.f, 1.f));
+				obj.view_depth = glm::dot(obj.position - camera_eye, forward);
+				obj.center = glm::vec3(obj.model * glm::vec4(glm::vec3(mesh_bounds), 1.f));
+
+				// nearest point of the bounds, so no part of the object shows more error than allowed
+				const float distance = std::max(glm::length(obj.center - camera_eye) - mesh_bounds.w, camera_near);
+				obj.lod = select_lod(distance);
+			}
+
+			const uint32_t objects = static_cast<uint32_t>(scene.size());
+			const uint32_t first_pass = VK_NULL_HANDLE != depth_pipeline ? DRAW_PASS_DEPTH : DRAW_PASS_SHADE;
+			const uint32_t count = (DRAW_PASS_SHADE - first_pass + 1) * objects;
+
+			auto scratch = frame_scratch();
+
+			frame_draws.keys = static_cast<uint64_t*>(scratch->allocate(count * sizeof(uint64_t), alignof(uint64_t)));
+			frame_draws.objects = static_cast<uint32_t*>(scratch->allocate(count * sizeof(uint32_t), alignof(uint32_t)));
+			frame_draws.count = count;
+
+			const bool sorted = settings.sort_front_to_back;
+			const float depth_range = camera_far - camera_near;
+
+			uint32_t k = 0;
+
+			for (uint32_t pass = first_pass; pass <= DRAW_PASS_SHADE; pass++)
+			{
+				for (uint32_t i = 0; i < objects; i++, k++)
+				{
+					const auto& obj = scene[i];
+
+					// unsorted keeps only pass and pipeline, the stable sort leaves everything else in submission order
+					frame_draws.keys[k] = sort::make_key(pass, pass, 0, sorted ? obj.lod : 0,
+						sorted ? (obj.view_depth - camera_near) / depth_range : 0.f);
+					frame_draws.objects[k] = i;
+				}
+			}
+
+			const auto start = std::chrono::steady_clock::now();
+
+			sort::radix_sort(frame_draws.keys, frame_draws.objects, count, scratch);
+
+			draw_counters.sort_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			draw_counters.sorts++;
+			draw_counters.draws += count;
+
+			// the last pass's list is the upload order
+			std::copy(frame_draws.objects + count - objects, frame_draws.objects + count, draw_order.begin());
+		}
+
+		/*
+		Binds per frame against draws per frame. Issued is what reached the command buffer, skipped what a bind
+		before every draw would have recorded on top. The sort decides how long the runs of equal state are.
+		*/
+		void report_draw_stats()
+		{
+			static const char* names[] = { "pipeline", "descriptor set", "vertex buffer", "index buffer" };
+
+			const double frames = static_cast<double>(std::max<uint64_t>(draw_counters.sorts, 1));
+
+			std::cout << "Draw sorting: " << std::fixed << std::setprecision(0) << static_cast<double>(draw_counters.draws) / frames
+				<< " draws per frame, radix sorted in " << std::setprecision(3) << draw_counters.sort_ms / frames << " ms\n";
+
+			std::cout << "Binds           issued/frame  skipped/frame\n";
+
+			for (uint32_t kind = 0; kind < BIND_KIND_COUNT; kind++)
+			{
+				std::cout << std::left << std::setw(14) << names[kind] << std::right << std::setprecision(1) << "  "
+					<< std::setw(12) << static_cast<double>(draw_counters.issued[kind]) / frames << "  "
+					<< std::setw(13) << static_cast<double>(draw_counters.skipped[kind]) / frames << "\n";
+			}
+
+			std::cout << std::defaultfloat << std::flush;
+		}
+
+		/*
+		Vertex fetch is bandwidth, so the byte counts are the first half of the comparison. Whether they move the frame
+		time depends on how vertex bound the scene is, more objects make it more so.
+		*/
+		void report_vertex_stats()
+		{
+			static const char* names[] = { "full", "compact" };
+
+			std::cout << "Vertices  bytes/vertex  buffer  frame time\n";
+
+			for (const auto& [format, stats] : vertex_history)
+			{
+				std::cout << std::setw(8) << names[format] << "  " << std::setw(12) << stats.stride << "  "
+					<< std::setw(6) << stats.buffer_bytes / 1024 << " KiB  " << std::fixed << std::setprecision(3)
+					<< (stats.frames ? stats.frame_ms / static_cast<double>(stats.frames) : 0.0)
+					<< " ms over " << stats.frames << " frames\n" << std::defaultfloat;
+			}
+
+			std::cout << std::flush;
+		}
+
+		void report_depth_stats()
+		{
+			std::cout << "Prepass  Sorted  frame time\n";
+
+			for (const auto& [mode, stats] : depth_history)
+			{
+				std::cout << std::setw(7) << (mode.first ? "on" : "off") << "  " << std::setw(6) << (mode.second ? "on" : "off")
+					<< "  " << std::fixed << std::setprecision(3)
+					<< (stats.frames ? stats.frame_ms / static_cast<double>(stats.frames) : 0.0)
+					<< " ms over " << stats.frames << " frames\n" << std::defaultfloat;
+			}
+
+			std::cout << std::flush;
+		}
+
+		VkDescriptorSetLayout create_compute_set_layout(const std::vector<VkDescriptorType>& types)
+		{
+			std::vector<VkDescriptorSetLayoutBinding> bindings(types.size());
+
+			for (uint32_t i = 0; i < types.size(); i++)
+			{
+				bindings[i].binding = i;
+				bindings[i].descriptorType = types[i];
+				bindings[i].descriptorCount = 1;
+				bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+				bindings[i].pImmutableSamplers = nullptr;
+			}
+
+			VkDescriptorSetLayoutCreateInfo dsl_info{};
+			dsl_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+			dsl_info.bindingCount = static_cast<uint32_t>(bindings.size());
+			dsl_info.pBindings = bindings.data();
+
+			VkDescriptorSetLayout layout;
+
+			if (!OP_SUCCESS(vkCreateDescriptorSetLayout(dev, &dsl_info, nullptr, &layout)))
+			{
+				throw std::runtime_error("Descriptor set layout creation failed!");
+			}
+
+			return layout;
+		}
+
+		VkPipelineLayout create_compute_pipeline_layout(VkDescriptorSetLayout set_layout, uint32_t push_size)
+		{
+			VkPushConstantRange range{};
+			range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+			range.offset = 0;
+			range.size = push_size;
+
+			VkPipelineLayoutCreateInfo pll_info{};
+			pll_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+			pll_info.setLayoutCount = 1;
+			pll_info.pSetLayouts = &set_layout;
+			pll_info.pushConstantRangeCount = 1;
+			pll_info.pPushConstantRanges = &range;
+
+			VkPipelineLayout layout;
+
+			if (!OP_SUCCESS(vkCreatePipelineLayout(dev, &pll_info, nullptr, &layout)))
+			{
+				throw std::runtime_error("Failed to create pipeline layout!");
+			}
+
+			return layout;
+		}
+
+		VkPipeline create_compute_pipeline(const char* path, VkPipelineLayout layout)
+		{
+			auto spv = spirv::load(assets, path);
+
+			VkShaderModule module = create_shader_module(spv.as<uint32_t>(), spv.size);
+
+			VkComputePipelineCreateInfo cp_info{};
+			cp_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+			cp_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			cp_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+			cp_info.stage.module = module;
+			cp_info.stage.pName = "main";
+			cp_info.layout = layout;
+
+			VkPipeline pipeline;
+			VkResult result = vkCreateComputePipelines(dev, VK_NULL_HANDLE, 1, &cp_info, nullptr, &pipeline);
+
+			vkDestroyShaderModule(dev, module, nullptr);
+
+			if (!OP_SUCCESS(result))
+			{
+				throw std::runtime_error("Failed to create compute pipeline!");
+			}
+
+			return pipeline;
+		}
+
+		/*
+		Compute side of occlusion culling. None of it depends on the swap chain, so it is created once and the
+		render pass can come and go underneath it.
+		*/
+		void create_occlusion_pipelines()
+		{
+			// source level (or the depth buffer), destination level
+			pyramid_set_layout = create_compute_set_layout({ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE });
+
+			// objects, visibility, early draws, late draws, counters, pyramid
+			cull_set_layout = create_compute_set_layout({ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER });
+
+			pyramid_layout = create_compute_pipeline_layout(pyramid_set_layout, sizeof(pyramid_constants));
+			cull_layout = create_compute_pipeline_layout(cull_set_layout, sizeof(cull_constants));
+
+			pyramid_pipeline = create_compute_pipeline("shader/depth_pyramid.spv", pyramid_layout);
+			pyramid_ms_pipeline = create_compute_pipeline("shader/depth_pyramid_ms.spv", pyramid_layout);
+			cull_early_pipeline = create_compute_pipeline("shader/cull_early.spv", cull_layout);
+			cull_late_pipeline = create_compute_pipeline("shader/cull_late.spv", cull_layout);
+
+			// everything is read with texelFetch, the filter never applies
+			VkSamplerCreateInfo sam_info{};
+			sam_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+			sam_info.magFilter = VK_FILTER_NEAREST;
+			sam_info.minFilter = VK_FILTER_NEAREST;
+			sam_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+			sam_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			sam_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			sam_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			sam_info.maxLod = VK_LOD_CLAMP_NONE;
+
+			if (!OP_SUCCESS(vkCreateSampler(dev, &sam_info, nullptr, &pyramid_sampler)))
+			{
+				throw std::runtime_error("Sampler creation failed!");
+			}
+		}
+
+		void create_occlusion_buffers()
+		{
+			const VkDeviceSize count = scene.size();
+
+			create_buffer(count * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, visibility_buffer, visibility_mem);
+
+			create_buffer(count * sizeof(VkDrawIndexedIndirectCommand),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, early_draw_buffer, early_draw_mem);
+
+			create_buffer(count * sizeof(VkDrawIndexedIndirectCommand),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, late_draw_buffer, late_draw_mem);
+
+			// nothing was visible before the first frame, its late pass draws whatever survives the empty pyramid
+			VkCommandBuffer cmd = begin_single_time_cmds();
+			vkCmdFillBuffer(cmd, visibility_buffer, 0, VK_WHOLE_SIZE, 0);
+			end_single_time_cmds(cmd);
+		}
+
+		/*
+		The pyramid is a frame graph image, so its views and every set that points at it are rebuilt together
+		with the graph.
+		*/
+		void create_occlusion_descriptors()
+		{
+			if (!occlusion_enabled)
+				return;
+
+			VkImage pyramid = frame_graph.image(rg_pyramid);
+
+			pyramid_view = create_img_view(pyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 0, pyramid_levels);
+
+			pyramid_mip_views.resize(pyramid_levels);
+
+			for (uint32_t level = 0; level < pyramid_levels; level++)
+			{
+				pyramid_mip_views[level] = create_img_view(pyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, level, 1);
+			}
+
+			const uint32_t images = static_cast<uint32_t>(sc_images.size());
+
+			std::array<VkDescriptorPoolSize, 3> pool_sizes{};
+			pool_sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			pool_sizes[0].descriptorCount = pyramid_levels + images;
+			pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			pool_sizes[1].descriptorCount = pyramid_levels;
+			pool_sizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			pool_sizes[2].descriptorCount = 5 * images;
+
+			VkDescriptorPoolCreateInfo pool_info{};
+			pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+			pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+			pool_info.pPoolSizes = pool_sizes.data();
+			pool_info.maxSets = pyramid_levels + images;
+
+			if (!OP_SUCCESS(vkCreateDescriptorPool(dev, &pool_info, nullptr, &occlusion_pool)))
+			{
+				throw std::runtime_error("Descriptor pool creation failed!");
+			}
+
+			auto allocate = [](VkDescriptorSetLayout layout, uint32_t count)
+			{
+				std::vector<VkDescriptorSetLayout> layouts(count, layout);
+				std::vector<VkDescriptorSet> sets(count);
+
+				VkDescriptorSetAllocateInfo dsa_info{};
+				dsa_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+				dsa_info.descriptorPool = occlusion_pool;
+				dsa_info.descriptorSetCount = count;
+				dsa_info.pSetLayouts = layouts.data();
+
+				if (!OP_SUCCESS(vkAllocateDescriptorSets(dev, &dsa_info, sets.data())))
+				{
+					throw std::runtime_error("Descriptor sets allocation failure!");
+				}
+
+				return sets;
+			};
+
+			pyramid_sets = allocate(pyramid_set_layout, pyramid_levels);
+			cull_sets = allocate(cull_set_layout, images);
+
+			auto write = [](VkDescriptorSet set, uint32_t binding, VkDescriptorType type,
+				const VkDescriptorBufferInfo* buffer, const VkDescriptorImageInfo* image)
+			{
+				VkWriteDescriptorSet ds_write{};
+				ds_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				ds_write.dstSet = set;
+				ds_write.dstBinding = binding;
+				ds_write.dstArrayElement = 0;
+				ds_write.descriptorType = type;
+				ds_write.descriptorCount = 1;
+				ds_write.pBufferInfo = buffer;
+				ds_write.pImageInfo = image;
+
+				return ds_write;
+			};
+
+			for (uint32_t level = 0; level < pyramid_levels; level++)
+			{
+				// level 0 reduces the depth buffer, every other level the one above it, which stays in GENERAL
+				VkDescriptorImageInfo src{};
+				src.sampler = pyramid_sampler;
+				src.imageView = 0 == level ? depth_img_view : pyramid_mip_views[level - 1];
+				src.imageLayout = 0 == level ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+				VkDescriptorImageInfo dst{};
+				dst.imageView = pyramid_mip_views[level];
+				dst.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+				std::array<VkWriteDescriptorSet, 2> ds_writes = {
+					write(pyramid_sets[level], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, nullptr, &src),
+					write(pyramid_sets[level], 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, nullptr, &dst) };
+
+				vkUpdateDescriptorSets(dev, static_cast<uint32_t>(ds_writes.size()), ds_writes.data(), 0, nullptr);
+			}
+
+			for (uint32_t i = 0; i < images; i++)
+			{
+				std::array<VkDescriptorBufferInfo, 5> buffers = { {
+					{ object_buffers[i], 0, VK_WHOLE_SIZE },
+					{ visibility_buffer, 0, VK_WHOLE_SIZE },
+					{ early_draw_buffer, 0, VK_WHOLE_SIZE },
+					{ late_draw_buffer, 0, VK_WHOLE_SIZE },
+					{ cull_stats_buffers[i], 0, VK_WHOLE_SIZE } } };
+
+				VkDescriptorImageInfo pyramid_info{};
+				pyramid_info.sampler = pyramid_sampler;
+				pyramid_info.imageView = pyramid_view;
+				pyramid_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+				std::vector<VkWriteDescriptorSet> ds_writes;
+
+				for (uint32_t b = 0; b < buffers.size(); b++)
+				{
+					ds_writes.push_back(write(cull_sets[i], b, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &buffers[b], nullptr));
+				}
+
+				ds_writes.push_back(write(cull_sets[i], 5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, nullptr, &pyramid_info));
+
+				vkUpdateDescriptorSets(dev, static_cast<uint32_t>(ds_writes.size()), ds_writes.data(), 0, nullptr);
+			}
+		}
+
+		void destroy_occlusion_descriptors()
+		{
+			if (VK_NULL_HANDLE == occlusion_pool)
+				return;
+
+			// the pool frees the sets with it
+			defer_delete([pool = occlusion_pool, view = pyramid_view, mip_views = pyramid_mip_views]()
+				{
+					vkDestroyDescriptorPool(dev, pool, nullptr);
+
+					for (auto v : mip_views)
+					{
+						vkDestroyImageView(dev, v, nullptr);
+					}
+
+					vkDestroyImageView(dev, view, nullptr);
+				});
+
+			occlusion_pool = VK_NULL_HANDLE;
+
+			pyramid_view = VK_NULL_HANDLE;
+			pyramid_mip_views.clear();
+			pyramid_sets.clear();
+			cull_sets.clear();
+		}
+
+		void destroy_occlusion_resources()
+		{
+			vkDestroyPipeline(dev, cull_late_pipeline, nullptr);
+			vkDestroyPipeline(dev, cull_early_pipeline, nullptr);
+			vkDestroyPipeline(dev, pyramid_ms_pipeline, nullptr);
+			vkDestroyPipeline(dev, pyramid_pipeline, nullptr);
+
+			vkDestroyPipelineLayout(dev, cull_layout, nullptr);
+			vkDestroyPipelineLayout(dev, pyramid_layout, nullptr);
+
+			vkDestroyDescriptorSetLayout(dev, cull_set_layout, nullptr);
+			vkDestroyDescriptorSetLayout(dev, pyramid_set_layout, nullptr);
+
+			vkDestroySampler(dev, pyramid_sampler, nullptr);
+
+			vkDestroyBuffer(dev, late_draw_buffer, nullptr);
+			vkFreeMemory(dev, late_draw_mem, nullptr);
+
+			vkDestroyBuffer(dev, early_draw_buffer, nullptr);
+			vkFreeMemory(dev, early_draw_mem, nullptr);
+
+			vkDestroyBuffer(dev, visibility_buffer, nullptr);
+			vkFreeMemory(dev, visibility_mem, nullptr);
+		}
+
+		void record_cull_pass(VkCommandBuffer cmd, uint32_t image_index, bool late)
+		{
+			cull_constants constants{};
+			constants.view = camera_view;
+			constants.p00 = camera_proj[0][0];
+			// the shader wants y up, it flips on its own when going to texture space
+			constants.p11 = -camera_proj[1][1];
+			constants.znear = camera_near;
+			constants.zfar = camera_far;
+			constants.pyramid_size = glm::vec2(static_cast<float>(pyramid_extent.width), static_cast<float>(pyramid_extent.height));
+			constants.object_count = static_cast<uint32_t>(draw_order.size());
+
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, late ? cull_late_pipeline : cull_early_pipeline);
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cull_layout, 0, 1, &cull_sets[image_index], 0, nullptr);
+			vkCmdPushConstants(cmd, cull_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
+			vkCmdDispatch(cmd, (constants.object_count + 63) / 64, 1, 1);
+		}
+
+		/*
+		One dispatch per level. The graph keeps the whole pyramid in GENERAL for the pass, the barriers between
+		levels are the pass's own business.
+		*/
+		void record_depth_pyramid(VkCommandBuffer cmd, uint32_t image_index)
+		{
+			VkImage pyramid = frame_graph.image(rg_pyramid);
+
+			VkExtent2D src = sc_extent;
+
+			for (uint32_t level = 0; level < pyramid_levels; level++)
+			{
+				VkExtent2D dst = { std::max(1u, pyramid_extent.width >> level), std::max(1u, pyramid_extent.height >> level) };
+
+				pyramid_constants constants{};
+				constants.src_size[0] = static_cast<int32_t>(src.width);
+				constants.src_size[1] = static_cast<int32_t>(src.height);
+				constants.dst_size[0] = static_cast<int32_t>(dst.width);
+				constants.dst_size[1] = static_cast<int32_t>(dst.height);
+				constants.samples = static_cast<int32_t>(msaa_samples);
+
+				VkPipeline pipeline = (0 == level && VK_SAMPLE_COUNT_1_BIT != msaa_samples) ? pyramid_ms_pipeline : pyramid_pipeline;
+
+				vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pyramid_layout, 0, 1, &pyramid_sets[level], 0, nullptr);
+				vkCmdPushConstants(cmd, pyramid_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
+				vkCmdDispatch(cmd, (dst.width + 7) / 8, (dst.height + 7) / 8, 1);
+
+				if (level + 1 == pyramid_levels)
+					break;
+
+				record_level_barrier(cmd, pyramid, level);
+
+				src = dst;
+			}
+		}
+
+		/*
+		How much of the scene never reached the rasterizer, and what that did to the frame time. The per pass GPU
+		cost of the culling itself is in the frame graph timings.
+		*/
+		void report_occlusion_stats()
+		{
+			std::cout << "Occlusion culling  frame time\n";
+
+			for (const auto& [on, stats] : occlusion_history)
+			{
+				std::cout << std::setw(17) << (on ? "on" : "off") << "  " << std::fixed << std::setprecision(3)
+					<< (stats.frames ? stats.frame_ms / static_cast<double>(stats.frames) : 0.0)
+					<< " ms over " << stats.frames << " frames\n";
+
+				if (on && stats.objects)
+				{
+					const double objects = static_cast<double>(stats.objects);
+
+					std::cout << std::setprecision(1)
+						<< "\tculled " << 100.0 * static_cast<double>(stats.frustum_culled + stats.occluded) / objects << "% ("
+						<< 100.0 * static_cast<double>(stats.frustum_culled) / objects << "% frustum, "
+						<< 100.0 * static_cast<double>(stats.occluded) / objects << "% occluded), drawn "
+						<< 100.0 * static_cast<double>(stats.early_drawn) / objects << "% early and "
+						<< 100.0 * static_cast<double>(stats.late_drawn) / objects << "% late\n";
+				}
+			}
+
+			auto on = occlusion_history.find(true);
+			auto off = occlusion_history.find(false);
+
+			if (occlusion_history.end() != on && occlusion_history.end() != off && on->second.frames && off->second.frames)
+			{
+				const double saved = off->second.frame_ms / static_cast<double>(off->second.frames) -
+					on->second.frame_ms / static_cast<double>(on->second.frames);
+
+				std::cout << "\tsaved " << std::setprecision(3) << saved << " ms per frame\n";
+			}
+
+			std::cout << std::defaultfloat << std::flush;
+		}
+
+		/*
+		Cluster culling reuses the compute helpers above. The pipeline is created whether culling is on or not,
+		like the occlusion ones, so the C key only has to rebuild what hangs off the swap chain.
+		*/
+		void create_cluster_pipeline()
+		{
+			// objects, meshlets, source indices, compacted indices, draws, counters, camera
+			cluster_set_layout = create_compute_set_layout({ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER });
+
+			cluster_layout = create_compute_pipeline_layout(cluster_set_layout, sizeof(cluster_constants));
+
+			cluster_pipeline = create_compute_pipeline("shader/cluster_cull.spv", cluster_layout);
+		}
+
+		/*
+		The meshlet buffer starts with the first meshlet and meshlet count of every LOD, padded to the uvec4 the
+		shader reads them as, so an object only has to carry which LOD it picked.
+		*/
+		void create_cluster_buffers()
+		{
+			if (0 == meshlet_count)
+				return;
+
+			const VkDeviceSize prefix_size = asset::max_mesh_lods * 4 * sizeof(uint32_t);
+			const VkDeviceSize buffer_size = prefix_size + sizeof(asset::mesh_meshlet) * meshlet_count;
+
+			VkBuffer		staging_buffer;
+			VkDeviceMemory	staging_buffer_mem;
+
+			create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				staging_buffer, staging_buffer_mem);
+
+			void* data = nullptr;
+			vkMapMemory(dev, staging_buffer_mem, 0, buffer_size, 0, &data);
+
+			auto ranges = static_cast<uint32_t*>(data);
+			memset(ranges, 0, static_cast<size_t>(prefix_size));
+
+			for (size_t i = 0; i < model_lods.size(); i++)
+			{
+				ranges[4 * i + 0] = model_lods[i].first_meshlet;
+				ranges[4 * i + 1] = model_lods[i].meshlet_count;
+			}
+
+			memcpy(static_cast<uint8_t*>(data) + prefix_size, model_meshlets, sizeof(asset::mesh_meshlet) * meshlet_count);
+			vkUnmapMemory(dev, staging_buffer_mem);
+
+			create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, meshlet_buffer, meshlet_mem);
+
+			copy_buffer(staging_buffer, meshlet_buffer, buffer_size);
+
+			vkDestroyBuffer(dev, staging_buffer, nullptr);
+			vkFreeMemory(dev, staging_buffer_mem, nullptr);
+
+			// LOD0 is the longest list, so any LOD's survivors fit an object's slice
+			const VkDeviceSize count = scene.size();
+
+			for (size_t i = 0; i < max_frames_in_flight; i++)
+			{
+				create_buffer(count * model_lods[0].index_count * sizeof(uint32_t),
+					VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, cluster_index_buffers[i], cluster_index_mems[i]);
+
+				create_buffer(count * sizeof(VkDrawIndexedIndirectCommand),
+					VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, cluster_draw_buffers[i], cluster_draw_mems[i]);
+			}
+		}
+
+		/*
+		The sets point at per image object and counter buffers, so they follow the swap chain, and at the frame
+		slot's output: one set per image and slot, image major.
+		*/
+		void create_cluster_descriptors()
+		{
+			if (!cluster_enabled)
+				return;
+
+			const uint32_t sets = static_cast<uint32_t>(sc_images.size() * max_frames_in_flight);
+
+			std::array<VkDescriptorPoolSize, 2> pool_sizes{};
+			pool_sizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			pool_sizes[0].descriptorCount = 6 * sets;
+			pool_sizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			pool_sizes[1].descriptorCount = sets;
+
+			VkDescriptorPoolCreateInfo pool_info{};
+			pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+			pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+			pool_info.pPoolSizes = pool_sizes.data();
+			pool_info.maxSets = sets;
+
+			if (!OP_SUCCESS(vkCreateDescriptorPool(dev, &pool_info, nullptr, &cluster_pool)))
+			{
+				throw std::runtime_error("Descriptor pool creation failed!");
+			}
+
+			std::vector<VkDescriptorSetLayout> layouts(sets, cluster_set_layout);
+			cluster_sets.resize(sets);
+
+			VkDescriptorSetAllocateInfo dsa_info{};
+			dsa_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			dsa_info.descriptorPool = cluster_pool;
+			dsa_info.descriptorSetCount = sets;
+			dsa_info.pSetLayouts = layouts.data();
+
+			if (!OP_SUCCESS(vkAllocateDescriptorSets(dev, &dsa_info, cluster_sets.data())))
+			{
+				throw std::runtime_error("Descriptor sets allocation failure!");
+			}
+
+			for (uint32_t i = 0; i < sets; i++)
+			{
+				const uint32_t image = i / max_frames_in_flight;
+				const uint32_t slot = i % max_frames_in_flight;
+
+				std::array<VkDescriptorBufferInfo, 7> buffers = { {
+					{ object_buffers[image], 0, VK_WHOLE_SIZE },
+					{ meshlet_buffer, 0, VK_WHOLE_SIZE },
+					{ index_buffer, 0, VK_WHOLE_SIZE },
+					{ cluster_index_buffers[slot], 0, VK_WHOLE_SIZE },
+					{ cluster_draw_buffers[slot], 0, VK_WHOLE_SIZE },
+					{ cluster_stats_buffers[image], 0, VK_WHOLE_SIZE },
+					{ uniform_buffers[image], 0, sizeof(UniformBufferObject) } } };
+
+				std::array<VkWriteDescriptorSet, 7> ds_writes{};
+
+				for (uint32_t b = 0; b < buffers.size(); b++)
+				{
+					ds_writes[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+					ds_writes[b].dstSet = cluster_sets[i];
+					ds_writes[b].dstBinding = b;
+					ds_writes[b].dstArrayElement = 0;
+					ds_writes[b].descriptorType = 6 == b ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+					ds_writes[b].descriptorCount = 1;
+					ds_writes[b].pBufferInfo = &buffers[b];
+				}
+
+				vkUpdateDescriptorSets(dev, static_cast<uint32_t>(ds_writes.size()), ds_writes.data(), 0, nullptr);
+			}
+		}
+
+		void destroy_cluster_descriptors()
+		{
+			if (VK_NULL_HANDLE == cluster_pool)
+				return;
+
+			defer_delete([pool = cluster_pool]() { vkDestroyDescriptorPool(dev, pool, nullptr); });
+			cluster_pool = VK_NULL_HANDLE;
+
+			cluster_sets.clear();
+		}
+
+		void destroy_cluster_resources()
+		{
+			vkDestroyPipeline(dev, cluster_pipeline, nullptr);
+			vkDestroyPipelineLayout(dev, cluster_layout, nullptr);
+			vkDestroyDescriptorSetLayout(dev, cluster_set_layout, nullptr);
+
+			// null when the pack has no meshlets, which the destroy calls accept
+			for (size_t i = 0; i < max_frames_in_flight; i++)
+			{
+				vkDestroyBuffer(dev, cluster_draw_buffers[i], nullptr);
+				vkFreeMemory(dev, cluster_draw_mems[i], nullptr);
+
+				vkDestroyBuffer(dev, cluster_index_buffers[i], nullptr);
+				vkFreeMemory(dev, cluster_index_mems[i], nullptr);
+			}
+
+			vkDestroyBuffer(dev, meshlet_buffer, nullptr);
+			vkFreeMemory(dev, meshlet_mem, nullptr);
+		}
+
+		void record_cluster_cull(VkCommandBuffer cmd, uint32_t image_index)
+		{
+			cluster_constants constants{};
+			// the meshlet bounds are in the pack's units, the object matrices expect quantized positions
+			constants.quantize = glm::inverse(position_dequantize);
+			constants.znear = camera_near;
+			constants.zfar = camera_far;
+			constants.object_count = static_cast<uint32_t>(draw_order.size());
+			constants.index_stride = model_lods[0].index_count;
+
+			const size_t set = image_index * max_frames_in_flight + curr_frame;
+
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cluster_pipeline);
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cluster_layout, 0, 1, &cluster_sets[set], 0, nullptr);
+			vkCmdPushConstants(cmd, cluster_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
+			// one workgroup per object, its threads walk the object's meshlets
+			vkCmdDispatch(cmd, constants.object_count, 1, 1);
+		}
+
+		/*
+		What the cull kept of the meshlets and triangles the chosen LODs would have drawn. The compute cost is in
+		the frame graph timings, the frame time shows whether the rasterizer saved more than that.
+		*/
+		void report_cluster_stats()
+		{
+			std::cout << "Cluster culling  frame time\n";
+
+			for (const auto& [on, stats] : cluster_history)
+			{
+				std::cout << std::setw(15) << (on ? "on" : "off") << "  " << std::fixed << std::setprecision(3)
+					<< (stats.frames ? stats.frame_ms / static_cast<double>(stats.frames) : 0.0)
+					<< " ms over " << stats.frames << " frames\n";
+
+				if (on && stats.meshlets)
+				{
+					const double meshlets = static_cast<double>(stats.meshlets);
+
+					std::cout << std::setprecision(1)
+						<< "\tculled " << 100.0 * static_cast<double>(stats.frustum_culled) / meshlets << "% of meshlets by frustum and "
+						<< 100.0 * static_cast<double>(stats.backface_culled) / meshlets << "% by cone, drew "
+						<< 100.0 * static_cast<double>(stats.triangles_out) / static_cast<double>(std::max<uint64_t>(stats.triangles_in, 1))
+						<< "% of the triangles\n";
+				}
+			}
+
+			std::cout << std::defaultfloat << std::flush;
+		}
+
+		/*
+		The particle system's pipelines do not depend on the swap chain: two compute kernels that share a layout,
+		and the set and pipeline layouts of the billboard pipeline. Only the billboard pipeline itself follows the
+		render pass.
+		*/
+		void create_particle_pipelines()
+		{
+			particles_enabled = 0 != settings.particle_count;
+
+			if (!particles_enabled)
+				return;
+
+			// particles, free list, draw list, draw command
+			particle_sim_set_layout = create_compute_set_layout({ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER });
+
+			particle_sim_layout = create_compute_pipeline_layout(particle_sim_set_layout, sizeof(particle_constants));
+
+			particle_sim_pipeline = create_compute_pipeline("shader/particle_sim.spv", particle_sim_layout);
+			particle_emit_pipeline = create_compute_pipeline("shader/particle_emit.spv", particle_sim_layout);
+
+			// the camera and the frame slot's draw list, both read by the vertex shader
+			std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+
+			for (uint32_t b = 0; b < bindings.size(); b++)
+			{
+				bindings[b].binding = b;
+				bindings[b].descriptorType = 0 == b ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				bindings[b].descriptorCount = 1;
+				bindings[b].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+				bindings[b].pImmutableSamplers = nullptr;
+			}
+
+			VkDescriptorSetLayoutCreateInfo dsl_info{};
+			dsl_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+			dsl_info.bindingCount = static_cast<uint32_t>(bindings.size());
+			dsl_info.pBindings = bindings.data();
+
+			if (!OP_SUCCESS(vkCreateDescriptorSetLayout(dev, &dsl_info, nullptr, &particle_set_layout)))
+			{
+				throw std::runtime_error("Descriptor set layout creation failed!");
+			}
+
+			particle_template.create(particle_set_layout, bindings.data(), static_cast<uint32_t>(bindings.size()),
+				sizeof(particle_descriptors));
+
+			VkPipelineLayoutCreateInfo pll_info{};
+			pll_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+			pll_info.setLayoutCount = 1;
+			pll_info.pSetLayouts = &particle_set_layout;
+
+			if (!OP_SUCCESS(vkCreatePipelineLayout(dev, &pll_info, nullptr, &particle_layout)))
+			{
+				throw std::runtime_error("Failed to create pipeline layout!");
+			}
+		}
+
+		/*
+		The second pipeline next to graphics_pipeline. It draws into the scene's last subpass, so it follows the
+		render pass's sample count and subpass layout the same way the scene's variants do, tests against the
+		scene's depth without writing it and adds its color to what is there.
+		*/
+		void create_particle_render_pipeline()
+		{
+			if (!particles_enabled)
+				return;
+
+			auto vert_spv = spirv::load(assets, "shader/particle_vert.spv");
+			auto frag_spv = spirv::load(assets, "shader/particle_frag.spv");
+
+			VkShaderModule vert_mod = create_shader_module(vert_spv.as<uint32_t>(), vert_spv.size);
+			VkShaderModule frag_mod = create_shader_module(frag_spv.as<uint32_t>(), frag_spv.size);
+
+			std::array<VkPipelineShaderStageCreateInfo, 2> stages{};
+			stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+			stages[0].module = vert_mod;
+			stages[0].pName = "main";
+			stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+			stages[1].module = frag_mod;
+			stages[1].pName = "main";
+
+			// no vertex buffer, the corners come from gl_VertexIndex
+			VkPipelineVertexInputStateCreateInfo vtx_input_info{};
+			vtx_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+			VkPipelineInputAssemblyStateCreateInfo ia_info{};
+			ia_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+			ia_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+			ia_info.primitiveRestartEnable = VK_FALSE;
+
+			VkViewport vp{};
+			vp.width = static_cast<float>(sc_extent.width);
+			vp.height = static_cast<float>(sc_extent.height);
+			vp.minDepth = 0.f;
+			vp.maxDepth = 1.f;
+
+			VkRect2D scissor{};
+			scissor.offset = { 0, 0 };
+			scissor.extent = sc_extent;
+
+			VkPipelineViewportStateCreateInfo vp_state{};
+			vp_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+			vp_state.viewportCount = 1;
+			vp_state.pViewports = &vp;
+			vp_state.scissorCount = 1;
+			vp_state.pScissors = &scissor;
+
+			// billboards face the camera either way round
+			VkPipelineRasterizationStateCreateInfo raster_info{};
+			raster_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+			raster_info.polygonMode = VK_POLYGON_MODE_FILL;
+			raster_info.lineWidth = 1.f;
+			raster_info.cullMode = VK_CULL_MODE_NONE;
+			raster_info.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+			VkPipelineMultisampleStateCreateInfo ms_info{};
+			ms_info.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+			ms_info.rasterizationSamples = msaa_samples;
+
+			// LESS_OR_EQUAL also passes after a prepass, where the subpass reads depth without writing it
+			VkPipelineDepthStencilStateCreateInfo ds_info{};
+			ds_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+			ds_info.depthTestEnable = VK_TRUE;
+			ds_info.depthWriteEnable = VK_FALSE;
+			ds_info.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+			// additive, so the particles can be drawn in whatever order the simulation appended them
+			VkPipelineColorBlendAttachmentState cb_attachment{};
+			cb_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+				VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+			cb_attachment.blendEnable = VK_TRUE;
+			cb_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+			cb_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+			cb_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+			cb_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+			cb_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+			cb_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+			VkPipelineColorBlendStateCreateInfo color_blend{};
+			color_blend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+			color_blend.attachmentCount = 1;
+			color_blend.pAttachments = &cb_attachment;
+
+			VkGraphicsPipelineCreateInfo pl_info{};
+			pl_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+			pl_info.stageCount = static_cast<uint32_t>(stages.size());
+			pl_info.pStages = stages.data();
+			pl_info.pVertexInputState = &vtx_input_info;
+			pl_info.pInputAssemblyState = &ia_info;
+			pl_info.pViewportState = &vp_state;
+			pl_info.pRasterizationState = &raster_info;
+			pl_info.pMultisampleState = &ms_info;
+			pl_info.pDepthStencilState = &ds_info;
+			pl_info.pColorBlendState = &color_blend;
+			pl_info.layout = particle_layout;
+			// render_pass_late is compatible with it, so this one pipeline serves both
+			pl_info.renderPass = render_pass;
+			pl_info.subpass = GEOMETRY_AFTER_PREPASS == active_variant.pass ? 1 : 0;
+
+			VkResult result = vkCreateGraphicsPipelines(dev, VK_NULL_HANDLE, 1, &pl_info, nullptr, &particle_pipeline);
+
+			vkDestroyShaderModule(dev, frag_mod, nullptr);
+			vkDestroyShaderModule(dev, vert_mod, nullptr);
+
+			if (!OP_SUCCESS(result))
+			{
+				throw std::runtime_error("Failed to create graphics pipeline!");
+			}
+		}
+
+		/*
+		Every particle starts out dead with its index on the free list, so the first frames only emit. The free
+		list is a count followed by the indices, which is the std430 layout of FreeList in particles.comp.
+		*/
+		void create_particle_buffers()
+		{
+			if (!particles_enabled)
+				return;
+
+			VkPhysicalDeviceProperties props{};
+			vkGetPhysicalDeviceProperties(pd, &props);
+
+			// one thread per particle in one dimension, and the largest buffer has to fit a storage binding
+			const uint64_t by_dispatch = uint64_t(props.limits.maxComputeWorkGroupCount[0]) * 64;
+			const uint64_t by_range = props.limits.maxStorageBufferRange / sizeof(gpu_particle);
+
+			particle_capacity = static_cast<uint32_t>(std::min<uint64_t>({ settings.particle_count, by_dispatch, by_range }));
+
+			if (particle_capacity != settings.particle_count)
+			{
+				std::cout << "Particles: " << settings.particle_count << " exceed what one dispatch or binding covers, "
+					"simulating " << particle_capacity << std::endl;
+			}
+
+			const VkDeviceSize particles_size = sizeof(gpu_particle) * VkDeviceSize(particle_capacity);
+			const VkDeviceSize free_size = sizeof(int32_t) + sizeof(uint32_t) * VkDeviceSize(particle_capacity);
+
+			create_buffer(particles_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, particle_buffer, particle_mem);
+
+			create_buffer(free_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, particle_free_buffer, particle_free_mem);
+
+			VkBuffer		staging_buffer;
+			VkDeviceMemory	staging_buffer_mem;
+
+			create_buffer(free_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				staging_buffer, staging_buffer_mem);
+
+			void* data = nullptr;
+			vkMapMemory(dev, staging_buffer_mem, 0, free_size, 0, &data);
+
+			auto count = static_cast<int32_t*>(data);
+			*count = static_cast<int32_t>(particle_capacity);
+
+			auto indices = reinterpret_cast<uint32_t*>(count + 1);
+
+			// popped from the top, so the low indices go first
+			for (uint32_t i = 0; i < particle_capacity; i++)
+			{
+				indices[i] = particle_capacity - 1 - i;
+			}
+
+			vkUnmapMemory(dev, staging_buffer_mem);
+
+			VkCommandBuffer cmd = begin_single_time_cmds();
+
+			// a life of zero is dead
+			vkCmdFillBuffer(cmd, particle_buffer, 0, VK_WHOLE_SIZE, 0);
+
+			VkBufferCopy region{};
+			region.size = free_size;
+			vkCmdCopyBuffer(cmd, staging_buffer, particle_free_buffer, 1, &region);
+
+			end_single_time_cmds(cmd);
+
+			vkDestroyBuffer(dev, staging_buffer, nullptr);
+			vkFreeMemory(dev, staging_buffer_mem, nullptr);
+
+			for (size_t i = 0; i < max_frames_in_flight; i++)
+			{
+				create_buffer(sizeof(particle_draw) * VkDeviceSize(particle_capacity), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, particle_draw_buffers[i], particle_draw_mems[i]);
+
+				// small and rewritten by the host every frame, like the counters
+				create_buffer(sizeof(VkDrawIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					particle_args_buffers[i], particle_args_mems[i]);
+			}
+		}
+
+		// nothing in the simulation's sets hangs off the swap chain, one per frame slot for the program's lifetime
+		void create_particle_descriptors()
+		{
+			if (!particles_enabled)
+				return;
+
+			VkDescriptorPoolSize pool_size{};
+			pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			pool_size.descriptorCount = 4 * max_frames_in_flight;
+
+			VkDescriptorPoolCreateInfo pool_info{};
+			pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+			pool_info.poolSizeCount = 1;
+			pool_info.pPoolSizes = &pool_size;
+			pool_info.maxSets = max_frames_in_flight;
+
+			if (!OP_SUCCESS(vkCreateDescriptorPool(dev, &pool_info, nullptr, &particle_pool)))
+			{
+				throw std::runtime_error("Descriptor pool creation failed!");
+			}
+
+			std::array<VkDescriptorSetLayout, max_frames_in_flight> layouts;
+			layouts.fill(particle_sim_set_layout);
+
+			VkDescriptorSetAllocateInfo dsa_info{};
+			dsa_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			dsa_info.descriptorPool = particle_pool;
+			dsa_info.descriptorSetCount = max_frames_in_flight;
+			dsa_info.pSetLayouts = layouts.data();
+
+			if (!OP_SUCCESS(vkAllocateDescriptorSets(dev, &dsa_info, particle_sim_sets.data())))
+			{
+				throw std::runtime_error("Descriptor sets allocation failure!");
+			}
+
+			for (uint32_t slot = 0; slot < max_frames_in_flight; slot++)
+			{
+				std::array<VkDescriptorBufferInfo, 4> buffers = { {
+					{ particle_buffer, 0, VK_WHOLE_SIZE },
+					{ particle_free_buffer, 0, VK_WHOLE_SIZE },
+					{ particle_draw_buffers[slot], 0, VK_WHOLE_SIZE },
+					{ particle_args_buffers[slot], 0, VK_WHOLE_SIZE } } };
+
+				std::array<VkWriteDescriptorSet, 4> ds_writes{};
+
+				for (uint32_t b = 0; b < buffers.size(); b++)
+				{
+					ds_writes[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+					ds_writes[b].dstSet = particle_sim_sets[slot];
+					ds_writes[b].dstBinding = b;
+					ds_writes[b].dstArrayElement = 0;
+					ds_writes[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+					ds_writes[b].descriptorCount = 1;
+					ds_writes[b].pBufferInfo = &buffers[b];
+				}
+
+				vkUpdateDescriptorSets(dev, static_cast<uint32_t>(ds_writes.size()), ds_writes.data(), 0, nullptr);
+			}
+		}
+
+		void destroy_particle_resources()
+		{
+			// all null without particles, which the destroy calls accept
+			vkDestroyDescriptorPool(dev, particle_pool, nullptr);
+
+			vkDestroyPipelineLayout(dev, particle_layout, nullptr);
+			particle_template.destroy();
+			vkDestroyDescriptorSetLayout(dev, particle_set_layout, nullptr);
+
+			vkDestroyPipeline(dev, particle_emit_pipeline, nullptr);
+			vkDestroyPipeline(dev, particle_sim_pipeline, nullptr);
+			vkDestroyPipelineLayout(dev, particle_sim_layout, nullptr);
+			vkDestroyDescriptorSetLayout(dev, particle_sim_set_layout, nullptr);
+
+			for (size_t i = 0; i < max_frames_in_flight; i++)
+			{
+				vkDestroyBuffer(dev, particle_args_buffers[i], nullptr);
+				vkFreeMemory(dev, particle_args_mems[i], nullptr);
+
+				vkDestroyBuffer(dev, particle_draw_buffers[i], nullptr);
+				vkFreeMemory(dev, particle_draw_mems[i], nullptr);
+			}
+
+			vkDestroyBuffer(dev, particle_free_buffer, nullptr);
+			vkFreeMemory(dev, particle_free_mem, nullptr);
+
+			vkDestroyBuffer(dev, particle_buffer, nullptr);
+			vkFreeMemory(dev, particle_mem, nullptr);
+		}
+
+		/*
+		One step of dt seconds into the current frame slot's draw list. The slot's last frame has retired, so
+		what it drew is read back and the command reset on the host before anything is recorded.
+		*/
+		void record_particle_step(VkCommandBuffer cmd, float dt)
+		{
+			void* data;
+			vkMapMemory(dev, particle_args_mems[curr_frame], 0, sizeof(VkDrawIndirectCommand), 0, &data);
+
+			auto args = static_cast<VkDrawIndirectCommand*>(data);
+
+			if (particle_args_pending[curr_frame])
+			{
+				particle_counters.frames++;
+				particle_counters.drawn += args->instanceCount;
+				particle_counters.max_drawn = std::max(particle_counters.max_drawn, args->instanceCount);
+			}
+
+			// host writes are visible to the next submission without a barrier
+			*args = { 6, 0, 0, 0 };
+
+			vkUnmapMemory(dev, particle_args_mems[curr_frame]);
+
+			particle_args_pending[curr_frame] = true;
+
+			// an average life of three quarters of the longest keeps about that much of the capacity alive
+			constexpr float lifetime = 4.f;
+
+			const float owed = static_cast<float>(particle_capacity) * dt / lifetime + particle_emit_carry;
+			const uint32_t emit_count = static_cast<uint32_t>(std::min(owed, static_cast<float>(particle_capacity)));
+
+			particle_emit_carry = std::min(owed - static_cast<float>(emit_count), 1.f);
+
+			// a fountain in the middle of the grid, scaled with it like the camera
+			particle_constants constants{};
+			constants.emitter = glm::vec4(0.f, 0.f, 0.f, 0.1f * camera_far);
+			constants.dt = dt;
+			constants.lifetime = lifetime;
+			constants.gravity = 0.1f * camera_far;
+			constants.size = 0.002f * camera_far;
+			constants.capacity = particle_capacity;
+			constants.emit_count = emit_count;
+			constants.seed = particle_seed++;
+
+			/*
+			The state and the free list are only ever touched by these two kernels, whichever queue they run on, so
+			they order their accesses themselves: the last step's writes before this one's, and the simulation's
+			before emission, which pops what the simulation freed.
+			*/
+			VkMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+			vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+				1, &barrier, 0, nullptr, 0, nullptr);
+
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, particle_sim_layout, 0, 1,
+				&particle_sim_sets[curr_frame], 0, nullptr);
+			vkCmdPushConstants(cmd, particle_sim_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, particle_sim_pipeline);
+			vkCmdDispatch(cmd, (particle_capacity + 63) / 64, 1, 1);
+
+			if (0 == emit_count)
+				return;
+
+			vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+				1, &barrier, 0, nullptr, 0, nullptr);
+
+			// the layout is shared, the set and the constants stay bound
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, particle_emit_pipeline);
+			vkCmdDispatch(cmd, (emit_count + 63) / 64, 1, 1);
+		}
+
+		void record_particle_sim(VkCommandBuffer cmd, uint32_t image_index)
+		{
+			const auto now = std::chrono::steady_clock::now();
+
+			// a stall, a resize or the first frame should not fire a burst of particles through the scene
+			float dt = 0.f;
+
+			if (settings.fixed_step)
+			{
+				dt = fixed_step_dt;
+			}
+			else if (std::chrono::steady_clock::time_point{} != particle_last_step)
+			{
+				dt = std::min(std::chrono::duration<float>(now - particle_last_step).count(), 0.1f);
+			}
+
+			particle_last_step = now;
+
+			record_particle_step(cmd, dt);
+		}
+
+		void record_particles(VkCommandBuffer cmd, uint32_t image_index)
+		{
+			particle_descriptors contents{};
+			contents.ubo = { uniform_buffers[image_index], 0, sizeof(UniformBufferObject) };
+			contents.draws = { particle_draw_buffers[curr_frame], 0, VK_WHOLE_SIZE };
+
+			// one set per image and frame slot, the same every time they meet
+			VkDescriptorSet set;
+
+			if (settings.descriptor_cache)
+			{
+				set = scene_sets.get(particle_template, &contents);
+			}
+			else
+			{
+				set = frame_descriptors[curr_frame].allocate(particle_set_layout);
+				particle_template.update(set, &contents);
+			}
+
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, particle_pipeline);
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, particle_layout, 0, 1, &set, 0, nullptr);
+
+			// six vertices per live particle, however many the simulation counted
+			vkCmdDrawIndirect(cmd, particle_args_buffers[curr_frame], 0, 1, sizeof(VkDrawIndirectCommand));
+		}
+
+		/*
+		Simulation throughput without rendering, timed with GPU timestamps. The system first runs until births
+		and deaths balance, then every step is timed on its own and the best and average are reported as
+		particles simulated per millisecond. Run it once on the software ICD and once on the hardware driver,
+		the device name and type tell the two apart.
+		*/
+		void benchmark_particles()
+		{
+			if (!particles_enabled)
+				return;
+
+			VkPhysicalDeviceProperties props{};
+			vkGetPhysicalDeviceProperties(pd, &props);
+
+			uint32_t family_count = 0;
+			vkGetPhysicalDeviceQueueFamilyProperties(pd, &family_count, nullptr);
+
+			std::vector<VkQueueFamilyProperties> families(family_count);
+			vkGetPhysicalDeviceQueueFamilyProperties(pd, &family_count, families.data());
+
+			const uint32_t valid_bits = families[find_queue_families(pd).graphics_family.value()].timestampValidBits;
+
+			if (0 == valid_bits)
+			{
+				throw std::runtime_error("Particle benchmark needs timestamps on the graphics queue!");
+			}
+
+			const uint64_t mask = valid_bits >= 64 ? ~uint64_t(0) : (uint64_t(1) << valid_bits) - 1;
+
+			VkQueryPoolCreateInfo qp_info{};
+			qp_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			qp_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			qp_info.queryCount = 2;
+
+			VkQueryPool queries;
+
+			if (!OP_SUCCESS(vkCreateQueryPool(dev, &qp_info, nullptr, &queries)))
+			{
+				throw std::runtime_error("Query pool creation failed!");
+			}
+
+			std::cout << "Particles: " << particle_capacity << " on " << props.deviceName << " ("
+				<< device_type_name(props.deviceType) << ")\n";
+
+			// 60 steps a second, five of the longest lives to settle and two hundred timed
+			constexpr float dt = 1.f / 60.f;
+			constexpr int warmup = 300;
+			constexpr int steps = 200;
+
+			double best = std::numeric_limits<double>::max(), total = 0.0;
+
+			for (int i = -warmup; i < steps; i++)
+			{
+				VkCommandBuffer cmd = begin_single_time_cmds();
+
+				vkCmdResetQueryPool(cmd, queries, 0, 2);
+				vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queries, 0);
+
+				record_particle_step(cmd, dt);
+
+				vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queries, 1);
+
+				// waits for the queue, so the slot's draw count is final when it comes round again
+				end_single_time_cmds(cmd);
+
+				curr_frame = (curr_frame + 1) % max_frames_in_flight;
+
+				if (i < 0)
+				{
+					// only the timed steps count towards the live particles
+					particle_counters = {};
+					continue;
+				}
+
+				std::array<uint64_t, 2> stamps{};
+				vkGetQueryPoolResults(dev, queries, 0, 2, sizeof(stamps), stamps.data(), sizeof(uint64_t),
+					VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+
+				const double ms = static_cast<double>((stamps[1] - stamps[0]) & mask) * props.limits.timestampPeriod * 1e-6;
+
+				best = std::min(best, ms);
+				total += ms;
+			}
+
+			vkDestroyQueryPool(dev, queries, nullptr);
+
+			const double average = total / steps;
+			const double alive = particle_counters.frames ?
+				static_cast<double>(particle_counters.drawn) / static_cast<double>(particle_counters.frames) : 0.0;
+
+			std::cout << '\t' << std::fixed << std::setprecision(3) << average << " ms average, " << best << " ms best per step, "
+				<< std::setprecision(0) << alive << " alive on average\n"
+				<< '\t' << std::setprecision(1) << static_cast<double>(particle_capacity) / average * 1e-3
+				<< "k particles per ms average, " << static_cast<double>(particle_capacity) / best * 1e-3 << "k best\n"
+				<< std::defaultfloat << std::flush;
+		}
+
+		/*
+		How many particles the frames drew. The simulation's time is in the frame graph timings, or in the async
+		compute figures when it ran on the compute queue.
+		*/
+		void report_particle_stats()
+		{
+			if (!particles_enabled)
+				return;
+
+			std::cout << "Particles: " << particle_capacity << " capacity, " << std::fixed << std::setprecision(0)
+				<< (particle_counters.frames ?
+					static_cast<double>(particle_counters.drawn) / static_cast<double>(particle_counters.frames) : 0.0)
+				<< " drawn per frame on average, " << particle_counters.max_drawn << " at most over "
+				<< particle_counters.frames << " frames\n" << std::defaultfloat << std::flush;
+		}
+
+		void create_post_pipelines()
+		{
+			post_set_layout = create_compute_set_layout({ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE });
+			tonemap_set_layout = create_compute_set_layout({ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE });
+
+			post_layout = create_compute_pipeline_layout(post_set_layout, sizeof(post_constants));
+			tonemap_layout = create_compute_pipeline_layout(tonemap_set_layout, sizeof(post_constants));
+
+			bloom_prefilter_pipeline = create_compute_pipeline("shader/bloom_prefilter.spv", post_layout);
+			bloom_down_pipeline = create_compute_pipeline("shader/bloom_down.spv", post_layout);
+			bloom_up_pipeline = create_compute_pipeline("shader/bloom_up.spv", post_layout);
+			tonemap_pipeline = create_compute_pipeline("shader/tonemap.spv", tonemap_layout);
+			fxaa_pipeline = create_compute_pipeline("shader/fxaa.spv", post_layout);
+
+			// the bloom and FXAA sample between texels, everything else is read with texelFetch
+			VkSamplerCreateInfo sam_info{};
+			sam_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+			sam_info.magFilter = VK_FILTER_LINEAR;
+			sam_info.minFilter = VK_FILTER_LINEAR;
+			sam_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+			sam_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			sam_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			sam_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			sam_info.maxLod = 0.f;
+
+			if (!OP_SUCCESS(vkCreateSampler(dev, &sam_info, nullptr, &post_sampler)))
+			{
+				throw std::runtime_error("Sampler creation failed!");
+			}
+		}
+
+		/*
+		The bloom pyramid starts at half the scene's size and stops while its smallest level still spans a few
+		workgroups; below that the levels cost a dispatch each and add next to nothing to the glow. The tonemap
+		writes 8 bit color, which is all FXAA needs and halves what it reads. The output stays 16 bit float
+		because it is a storage image, which the swap chain's formats rarely can be.
+		*/
+		void add_post_passes(rg::render_graph& graph, post_chain& chain, rg::resource_id hdr, rg::resource_id target,
+			VkFormat target_fmt, VkExtent2D extent)
+		{
+			chain.graph = &graph;
+			chain.extent = extent;
+			chain.bloom_extent = { std::max(1u, extent.width / 2), std::max(1u, extent.height / 2) };
+			chain.hdr = hdr;
+			chain.target = target;
+
+			// the blit encodes to sRGB on its own, FXAA has to undo the tonemap's encoding for it
+			chain.srgb_target = VK_FORMAT_B8G8R8A8_SRGB == target_fmt || VK_FORMAT_R8G8B8A8_SRGB == target_fmt ||
+				VK_FORMAT_A8B8G8R8_SRGB_PACK32 == target_fmt;
+
+			const uint32_t smallest = std::min(chain.bloom_extent.width, chain.bloom_extent.height);
+
+			chain.bloom_levels = 1;
+
+			while (chain.bloom_levels < max_bloom_levels && (smallest >> chain.bloom_levels) >= 8)
+				chain.bloom_levels++;
+
+			rg::image_desc bloom{};
+			bloom.format = hdr_format;
+			bloom.extent = chain.bloom_extent;
+			bloom.mip_levels = chain.bloom_levels;
+			bloom.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+			rg::image_desc ldr{};
+			ldr.format = VK_FORMAT_R8G8B8A8_UNORM;
+			ldr.extent = extent;
+			ldr.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+			rg::image_desc output{};
+			output.format = hdr_format;
+			output.extent = extent;
+			output.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+			chain.bloom = graph.create_image("bloom", bloom);
+			chain.ldr = graph.create_image("ldr", ldr);
+			chain.output = graph.create_image("post output", output);
+
+			const post_chain* c = &chain;
+
+			// the whole pyramid stays in GENERAL for both bloom passes, like the depth pyramid
+			graph.add_pass(post_passes[0], [c](VkCommandBuffer cmd, uint32_t) { record_bloom_down(cmd, *c); })
+				.read(hdr, rg::usage::compute_sampled)
+				.write(chain.bloom, rg::usage::compute_storage_read_write);
+
+			if (chain.bloom_levels > 1)
+			{
+				graph.add_pass(post_passes[1], [c](VkCommandBuffer cmd, uint32_t) { record_bloom_up(cmd, *c); })
+					.write(chain.bloom, rg::usage::compute_storage_read_write);
+			}
+
+			graph.add_pass(post_passes[2], [c](VkCommandBuffer cmd, uint32_t) { record_tonemap(cmd, *c); })
+				.read(hdr, rg::usage::compute_sampled)
+				.read(chain.bloom, rg::usage::compute_sampled)
+				.write(chain.ldr, rg::usage::compute_storage_write);
+
+			graph.add_pass(post_passes[3], [c](VkCommandBuffer cmd, uint32_t) { record_fxaa(cmd, *c); })
+				.read(chain.ldr, rg::usage::compute_sampled)
+				.write(chain.output, rg::usage::compute_storage_write);
+
+			graph.add_pass(post_passes[4], [c](VkCommandBuffer cmd, uint32_t) { record_post_blit(cmd, *c); })
+				.read(chain.output, rg::usage::transfer_src)
+				.write(target, rg::usage::transfer_dst);
+		}
+
+		/*
+		Every level gets a view of its own, a set to write it from the level above (the HDR target for level 0) and,
+		but for the smallest, a set to add the level below back into it.
+		*/
+		void create_post_descriptors(post_chain& chain, VkImageView hdr_view)
+		{
+			if (nullptr == chain.graph)
+				return;
+
+			const uint32_t levels = chain.bloom_levels;
+			const uint32_t sets = 2 * levels - 1 + 2;
+
+			VkImage bloom = chain.graph->image(chain.bloom);
+
+			chain.bloom_views.resize(levels);
+
+			for (uint32_t level = 0; level < levels; level++)
+			{
+				chain.bloom_views[level] = create_img_view(bloom, hdr_format, VK_IMAGE_ASPECT_COLOR_BIT, level, 1);
+			}
+
+			std::array<VkDescriptorPoolSize, 2> pool_sizes{};
+			pool_sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			pool_sizes[0].descriptorCount = sets + 1;
+			pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			pool_sizes[1].descriptorCount = sets;
+
+			VkDescriptorPoolCreateInfo pool_info{};
+			pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+			pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+			pool_info.pPoolSizes = pool_sizes.data();
+			pool_info.maxSets = sets;
+
+			if (!OP_SUCCESS(vkCreateDescriptorPool(dev, &pool_info, nullptr, &chain.pool)))
+			{
+				throw std::runtime_error("Descriptor pool creation failed!");
+			}
+
+			auto allocate = [&chain](VkDescriptorSetLayout layout, uint32_t count)
+			{
+				std::vector<VkDescriptorSetLayout> layouts(count, layout);
+				std::vector<VkDescriptorSet> sets(count);
+
+				VkDescriptorSetAllocateInfo dsa_info{};
+				dsa_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+				dsa_info.descriptorPool = chain.pool;
+				dsa_info.descriptorSetCount = count;
+				dsa_info.pSetLayouts = layouts.data();
+
+				if (count && !OP_SUCCESS(vkAllocateDescriptorSets(dev, &dsa_info, sets.data())))
+				{
+					throw std::runtime_error("Descriptor sets allocation failure!");
+				}
+
+				return sets;
+			};
+
+			chain.down_sets = allocate(post_set_layout, levels);
+			chain.up_sets = allocate(post_set_layout, levels - 1);
+			chain.tonemap_set = allocate(tonemap_set_layout, 1)[0];
+			chain.fxaa_set = allocate(post_set_layout, 1)[0];
+
+			auto image = [](VkImageView view, VkImageLayout layout)
+			{
+				VkDescriptorImageInfo info{};
+				info.sampler = post_sampler;
+				info.imageView = view;
+				info.imageLayout = layout;
+
+				return info;
+			};
+
+			auto write = [](VkDescriptorSet set, uint32_t binding, VkDescriptorType type, const VkDescriptorImageInfo* info)
+			{
+				VkWriteDescriptorSet ds_write{};
+				ds_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				ds_write.dstSet = set;
+				ds_write.dstBinding = binding;
+				ds_write.dstArrayElement = 0;
+				ds_write.descriptorType = type;
+				ds_write.descriptorCount = 1;
+				ds_write.pImageInfo = info;
+
+				return ds_write;
+			};
+
+			// a source and a destination, the source sampled and the destination a storage image
+			auto write_pair = [&write](VkDescriptorSet set, const VkDescriptorImageInfo& src, const VkDescriptorImageInfo& dst)
+			{
+				std::array<VkWriteDescriptorSet, 2> ds_writes = {
+					write(set, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &src),
+					write(set, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &dst) };
+
+				vkUpdateDescriptorSets(dev, static_cast<uint32_t>(ds_writes.size()), ds_writes.data(), 0, nullptr);
+			};
+
+			const auto hdr = image(hdr_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+			for (uint32_t level = 0; level < levels; level++)
+			{
+				const auto dst = image(chain.bloom_views[level], VK_IMAGE_LAYOUT_GENERAL);
+
+				write_pair(chain.down_sets[level], 0 == level ? hdr : image(chain.bloom_views[level - 1], VK_IMAGE_LAYOUT_GENERAL), dst);
+
+				if (level + 1 < levels)
+				{
+					write_pair(chain.up_sets[level], image(chain.bloom_views[level + 1], VK_IMAGE_LAYOUT_GENERAL), dst);
+				}
+			}
+
+			// level 0 once both bloom passes are done, the graph has moved it to SHADER_READ_ONLY by then
+			const auto bloom_read = image(chain.bloom_views[0], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			const auto ldr_write = image(chain.graph->view(chain.ldr), VK_IMAGE_LAYOUT_GENERAL);
+
+			std::array<VkWriteDescriptorSet, 3> tonemap_writes = {
+				write(chain.tonemap_set, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &hdr),
+				write(chain.tonemap_set, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &bloom_read),
+				write(chain.tonemap_set, 2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &ldr_write) };
+
+			vkUpdateDescriptorSets(dev, static_cast<uint32_t>(tonemap_writes.size()), tonemap_writes.data(), 0, nullptr);
+
+			write_pair(chain.fxaa_set, image(chain.graph->view(chain.ldr), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+				image(chain.graph->view(chain.output), VK_IMAGE_LAYOUT_GENERAL));
+		}
+
+		void destroy_post_descriptors(post_chain& chain)
+		{
+			if (VK_NULL_HANDLE == chain.pool)
+				return;
+
+			// the pool frees the sets with it
+			defer_delete([pool = chain.pool, views = chain.bloom_views]()
+				{
+					vkDestroyDescriptorPool(dev, pool, nullptr);
+
+					for (auto v : views)
+					{
+						vkDestroyImageView(dev, v, nullptr);
+					}
+				});
+
+			chain = post_chain();
+		}
+
+		void destroy_post_resources()
+		{
+			vkDestroyPipeline(dev, fxaa_pipeline, nullptr);
+			vkDestroyPipeline(dev, tonemap_pipeline, nullptr);
+			vkDestroyPipeline(dev, bloom_up_pipeline, nullptr);
+			vkDestroyPipeline(dev, bloom_down_pipeline, nullptr);
+			vkDestroyPipeline(dev, bloom_prefilter_pipeline, nullptr);
+
+			vkDestroyPipelineLayout(dev, tonemap_layout, nullptr);
+			vkDestroyPipelineLayout(dev, post_layout, nullptr);
+
+			vkDestroyDescriptorSetLayout(dev, tonemap_set_layout, nullptr);
+			vkDestroyDescriptorSetLayout(dev, post_set_layout, nullptr);
+
+			vkDestroySampler(dev, post_sampler, nullptr);
+		}
+
+		void record_level_barrier(VkCommandBuffer cmd, VkImage img, uint32_t level)
+		{
+			VkImageMemoryBarrier level_barrier{};
+			level_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			level_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			level_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			level_barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+			level_barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+			level_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			level_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			level_barrier.image = img;
+			level_barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+
+			vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+				0, nullptr, 0, nullptr, 1, &level_barrier);
+		}
+
+		// level 0 thresholds the HDR target, every level after it halves the one above
+		void record_bloom_down(VkCommandBuffer cmd, const post_chain& chain)
+		{
+			VkImage bloom = chain.graph->image(chain.bloom);
+
+			VkExtent2D src = chain.extent;
+
+			for (uint32_t level = 0; level < chain.bloom_levels; level++)
+			{
+				VkExtent2D dst = chain.level_extent(level);
+
+				post_constants constants = chain.constants(src, dst);
+
+				vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, 0 == level ? bloom_prefilter_pipeline : bloom_down_pipeline);
+				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, post_layout, 0, 1, &chain.down_sets[level], 0, nullptr);
+				vkCmdPushConstants(cmd, post_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
+				vkCmdDispatch(cmd, (dst.width + 7) / 8, (dst.height + 7) / 8, 1);
+
+				if (level + 1 == chain.bloom_levels)
+					break;
+
+				record_level_barrier(cmd, bloom, level);
+
+				src = dst;
+			}
+		}
+
+		// from the smallest level up, each one added into the level above it
+		void record_bloom_up(VkCommandBuffer cmd, const post_chain& chain)
+		{
+			VkImage bloom = chain.graph->image(chain.bloom);
+
+			for (uint32_t level = chain.bloom_levels - 1; level-- > 0;)
+			{
+				VkExtent2D dst = chain.level_extent(level);
+
+				post_constants constants = chain.constants(chain.level_extent(level + 1), dst);
+
+				vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, bloom_up_pipeline);
+				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, post_layout, 0, 1, &chain.up_sets[level], 0, nullptr);
+				vkCmdPushConstants(cmd, post_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
+				vkCmdDispatch(cmd, (dst.width + 7) / 8, (dst.height + 7) / 8, 1);
+
+				// level 0 is read by the tonemap, the graph's barrier covers that one
+				if (0 != level)
+				{
+					record_level_barrier(cmd, bloom, level);
+				}
+			}
+		}
+
+		void record_tonemap(VkCommandBuffer cmd, const post_chain& chain)
+		{
+			post_constants constants = chain.constants(chain.extent, chain.extent);
+
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, tonemap_pipeline);
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, tonemap_layout, 0, 1, &chain.tonemap_set, 0, nullptr);
+			vkCmdPushConstants(cmd, tonemap_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
+			vkCmdDispatch(cmd, (chain.extent.width + 7) / 8, (chain.extent.height + 7) / 8, 1);
+		}
+
+		void record_fxaa(VkCommandBuffer cmd, const post_chain& chain)
+		{
+			post_constants constants = chain.constants(chain.extent, chain.extent);
+
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, fxaa_pipeline);
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, post_layout, 0, 1, &chain.fxaa_set, 0, nullptr);
+			vkCmdPushConstants(cmd, post_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
+			vkCmdDispatch(cmd, (chain.extent.width + 7) / 8, (chain.extent.height + 7) / 8, 1);
+		}
+
+		// the same size on both sides, so the filter never applies, only the format conversion
+		void record_post_blit(VkCommandBuffer cmd, const post_chain& chain)
+		{
+			const VkOffset3D corner = { static_cast<int32_t>(chain.extent.width), static_cast<int32_t>(chain.extent.height), 1 };
+
+			VkImageBlit region{};
+			region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+			region.srcOffsets[1] = corner;
+			region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+			region.dstOffsets[1] = corner;
+
+			vkCmdBlitImage(cmd, chain.graph->image(chain.output), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				chain.graph->image(chain.target), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_NEAREST);
+		}
+
+		/*
+		The post chain on its own at 1080p and 4K, with nothing else in its graph. The scene is a generated HDR
+		image, soft gradients with small spots far above the bloom threshold, so every pass does the work it does
+		on a real frame: the early out in FXAA is taken where the gradients are smooth and not around the spots.
+		Passes are timed by the graph's own timestamps, the total is checked against settings.post_budget_ms.
+		*/
+		void benchmark_post_processing()
+		{
+			VkPhysicalDeviceProperties props{};
+			vkGetPhysicalDeviceProperties(pd, &props);
+
+			std::cout << "Post processing on " << props.deviceName << " (" << device_type_name(props.deviceType)
+				<< "), budget " << std::fixed << std::setprecision(3) << settings.post_budget_ms << " ms\n" << std::defaultfloat;
+
+			constexpr int warmup = 20;
+			constexpr int runs = 200;
+
+			const std::array<VkExtent2D, 2> resolutions = { { { 1920, 1080 }, { 3840, 2160 } } };
+
+			bool within = true;
+
+			for (const auto extent : resolutions)
+			{
+				const VkDeviceSize texels = VkDeviceSize(extent.width) * extent.height;
+				const VkDeviceSize size = texels * sizeof(uint64_t);
+
+				VkBuffer staging;
+				VkDeviceMemory staging_mem;
+
+				create_buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging, staging_mem);
+
+				void* data;
+				vkMapMemory(dev, staging_mem, 0, size, 0, &data);
+
+				auto texel = static_cast<uint64_t*>(data);
+
+				for (uint32_t y = 0; y < extent.height; y++)
+				{
+					for (uint32_t x = 0; x < extent.width; x++)
+					{
+						const float u = static_cast<float>(x) / static_cast<float>(extent.width);
+						const float v = static_cast<float>(y) / static_cast<float>(extent.height);
+
+						glm::vec3 c = glm::vec3(u, v, 0.5f + 0.5f * std::sin(40.f * u * v)) * 0.6f;
+
+						// a spot every 64 texels, a few texels across
+						const float dx = static_cast<float>(x % 64) - 32.f;
+						const float dy = static_cast<float>(y % 64) - 32.f;
+
+						if (dx * dx + dy * dy < 16.f)
+						{
+							c = glm::vec3(8.f, 6.f, 4.f);
+						}
+
+						*texel++ = glm::packHalf4x16(glm::vec4(c, 1.f));
+					}
+				}
+
+				vkUnmapMemory(dev, staging_mem);
+
+				VkImage hdr, target;
+				VkDeviceMemory hdr_mem, target_mem;
+
+				create_image(extent.width, extent.height, hdr_format, VK_IMAGE_TILING_OPTIMAL,
+					VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, hdr, hdr_mem);
+
+				// stands in for the swap chain image, in the same format
+				create_image(extent.width, extent.height, sc_img_fmt, VK_IMAGE_TILING_OPTIMAL,
+					VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, target, target_mem);
+
+				transition_image_layout(hdr, hdr_format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+				copy_buffer_to_img(staging, hdr, extent.width, extent.height);
+				transition_image_layout(hdr, hdr_format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+				vkDestroyBuffer(dev, staging, nullptr);
+				vkFreeMemory(dev, staging_mem, nullptr);
+
+				VkImageView hdr_view = create_img_view(hdr, hdr_format, VK_IMAGE_ASPECT_COLOR_BIT);
+
+				rg::render_graph graph;
+				post_chain chain;
+
+				rg::resource_id hdr_id = graph.import_image("hdr", VK_IMAGE_ASPECT_COLOR_BIT,
+					rg::state_for_layout(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+				rg::resource_id target_id = graph.import_image("target", VK_IMAGE_ASPECT_COLOR_BIT,
+					{ VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, false });
+
+				add_post_passes(graph, chain, hdr_id, target_id, sc_img_fmt, extent);
+
+				graph.set_final_usage(target_id, rg::usage::transfer_src);
+				graph.compile();
+
+				if (!graph.timed())
+				{
+					throw std::runtime_error("Post processing benchmark needs timestamps on the graphics queue!");
+				}
+
+				create_post_descriptors(chain, hdr_view);
+
+				graph.bind_image(hdr_id, hdr, hdr_view);
+				graph.bind_image(target_id, target, VK_NULL_HANDLE);
+
+				std::pmr::monotonic_buffer_resource scratch;
+
+				/*
+				The graph reads a slot's timestamps back when the slot comes round again, so the averages start over
+				once the first timed run is about to be read and the last runs only see their predecessors read.
+				*/
+				for (int i = -warmup; i < runs + static_cast<int>(max_frames_in_flight); i++)
+				{
+					if (static_cast<int>(max_frames_in_flight) == i)
+					{
+						graph.reset_timings();
+					}
+
+					VkCommandBuffer cmd = begin_single_time_cmds();
+					graph.execute(cmd, static_cast<uint32_t>(i + warmup) % max_frames_in_flight, 0, &scratch);
+					end_single_time_cmds(cmd);
+
+					scratch.release();
+				}
+
+				std::cout << '\t' << extent.width << 'x' << extent.height << ", " << chain.bloom_levels << " bloom levels\n";
+
+				double total = 0.0;
+
+				for (const char* pass : post_passes)
+				{
+					const double ms = graph.average_ms(pass);
+					total += ms;
+
+					std::cout << "\t\t" << std::left << std::setw(12) << pass << std::right << std::fixed << std::setprecision(3)
+						<< ms << " ms\n";
+				}
+
+				const bool fits = total <= settings.post_budget_ms;
+				within = within && fits;
+
+				std::cout << "\t\t" << std::left << std::setw(12) << "total" << std::right << total << " ms, "
+					<< (fits ? "within" : "over") << " budget\n" << std::defaultfloat;
+
+				// everything has retired, end_single_time_cmds waited for it
+				destroy_post_descriptors(chain);
+				graph.destroy();
+
+				vkDestroyImageView(dev, hdr_view, nullptr);
+				vkDestroyImage(dev, target, nullptr);
+				vkFreeMemory(dev, target_mem, nullptr);
+				vkDestroyImage(dev, hdr, nullptr);
+				vkFreeMemory(dev, hdr_mem, nullptr);
+			}
+
+			run_deletions(completed_timeline_value());
+
+			std::cout << "Post processing: " << (within ? "within" : "over") << " budget" << std::endl;
+		}
+
+		/*
+		What the chain cost the frames of the current swap chain, from the frame graph's timings, against the same
+		budget the benchmark checks.
+		*/
+		void report_post_stats()
+		{
+			if (!post_enabled || nullptr == post_frame.graph)
+				return;
+
+			if (!frame_graph.timed())
+			{
+				std::cout << "Post processing: no timestamps on the graphics queue" << std::endl;
+				return;
+			}
+
+			double total = 0.0;
+
+			for (const char* pass : post_passes)
+			{
+				total += frame_graph.average_ms(pass);
+			}
+
+			std::cout << "Post processing: " << post_frame.extent.width << 'x' << post_frame.extent.height << ", "
+				<< post_frame.bloom_levels << " bloom levels, " << std::fixed << std::setprecision(3) << total
+				<< " ms per frame, " << (total <= settings.post_budget_ms ? "within" : "over") << " the "
+				<< settings.post_budget_ms << " ms budget\n" << std::defaultfloat << std::flush;
+		}
+
+		bool capture_supports(VkFormat fmt)
+		{
+			switch (fmt)
+			{
+			case VK_FORMAT_R8G8B8A8_UNORM:
+			case VK_FORMAT_R8G8B8A8_SRGB:
+			case VK_FORMAT_B8G8R8A8_UNORM:
+			case VK_FORMAT_B8G8R8A8_SRGB:
+			case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+			case VK_FORMAT_A2R10G10B10_UNORM_PACK32:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		void create_capture_resources()
+		{
+			if (!capture_enabled)
+				return;
+
+			// read once by the CPU front to back, coherent memory does for that
+			create_buffer(static_cast<VkDeviceSize>(sc_extent.width) * sc_extent.height * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, capture_buffer, capture_mem);
+		}
+
+		void destroy_capture_resources()
+		{
+			if (VK_NULL_HANDLE == capture_buffer)
+				return;
+
+			collect_capture(true);
+
+			defer_delete([buffer = capture_buffer, mem = capture_mem]()
+				{
+					vkDestroyBuffer(dev, buffer, nullptr);
+					vkFreeMemory(dev, mem, nullptr);
+				});
+
+			capture_buffer = VK_NULL_HANDLE;
+			capture_mem = VK_NULL_HANDLE;
+		}
+
+		/*
+		The graph's final barrier has put the image in the present layout, at the bottom of the pipe. Waiting on
+		that stage chains the copy after it; the image goes back to the present layout afterwards, and the copy is
+		made available to the host that maps the buffer.
+		*/
+		void record_capture(VkCommandBuffer cmd, VkImage img)
+		{
+			const rg::resource_state present = rg::state_for(rg::usage::present);
+			const rg::resource_state copy_src = rg::state_for(rg::usage::transfer_src);
+			const rg::resource_state host = rg::state_for(rg::usage::host_read);
+
+			VkImageMemoryBarrier img_barrier{};
+			img_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			img_barrier.srcAccessMask = present.access;
+			img_barrier.dstAccessMask = copy_src.access;
+			img_barrier.oldLayout = present.layout;
+			img_barrier.newLayout = copy_src.layout;
+			img_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			img_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			img_barrier.image = img;
+			img_barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+			vkCmdPipelineBarrier(cmd, present.stages, copy_src.stages, 0, 0, nullptr, 0, nullptr, 1, &img_barrier);
+
+			VkBufferImageCopy region{};
+			region.bufferOffset = 0;
+			region.bufferRowLength = 0;		// tightly packed
+			region.bufferImageHeight = 0;
+			region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+			region.imageOffset = { 0, 0, 0 };
+			region.imageExtent = { sc_extent.width, sc_extent.height, 1 };
+
+			vkCmdCopyImageToBuffer(cmd, img, copy_src.layout, capture_buffer, 1, &region);
+
+			// nothing was written to the image, the way back is only a layout change
+			img_barrier.srcAccessMask = 0;
+			img_barrier.dstAccessMask = present.access;
+			img_barrier.oldLayout = copy_src.layout;
+			img_barrier.newLayout = present.layout;
+
+			VkBufferMemoryBarrier buf_barrier{};
+			buf_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			buf_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			buf_barrier.dstAccessMask = host.access;
+			buf_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			buf_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			buf_barrier.buffer = capture_buffer;
+			buf_barrier.offset = 0;
+			buf_barrier.size = VK_WHOLE_SIZE;
+
+			vkCmdPipelineBarrier(cmd, copy_src.stages, present.stages | host.stages, 0, 0, nullptr, 1, &buf_barrier,
+				1, &img_barrier);
+
+			capture_extent = sc_extent;
+			capture_format = sc_img_fmt;
+			capture_recorded = true;
+
+			// draw_frame submits right after recording
+			capture_value = timeline_value + 1;
+		}
+
+		void collect_capture(bool wait)
+		{
+			if (0 == capture_value)
+				return;
+
+			if (wait)
+			{
+				wait_timeline(capture_value);
+			}
+			else if (completed_timeline_value() < capture_value)
+			{
+				return;
+			}
+
+			capture_value = 0;
+
+			// the swap chain was checked at creation, but the copy is what gets converted
+			if (!capture_supports(capture_format))
+			{
+				throw std::runtime_error("Cannot convert a capture of format " + std::to_string(capture_format) + "!");
+			}
+
+			const uint32_t width = capture_extent.width;
+			const uint32_t height = capture_extent.height;
+			const size_t size = static_cast<size_t>(width) * height * 4;
+
+			// one sequential pass over uncached memory, the conversion works on the copy
+			std::vector<uint8_t> pixels(size);
+
+			void* data;
+			vkMapMemory(dev, capture_mem, 0, size, 0, &data);
+			memcpy(pixels.data(), data, size);
+			vkUnmapMemory(dev, capture_mem);
+
+			capture_written = std::async(std::launch::async,
+				[pixels = std::move(pixels), width, height, fmt = capture_format, path = settings.capture_path]() mutable
+				{
+					/*
+					To RGB in place, each pixel's write ends before the next one's read starts. Alpha is dropped, the
+					surface is composited opaque whatever the post chain left in it. The values already hold what
+					the display gets, sRGB encoded by the hardware or by the shaders, which is what PNG expects, so
+					10 bit channels only lose their low bits.
+					*/
+					const size_t count = static_cast<size_t>(width) * height;
+
+					for (size_t i = 0; i < count; i++)
+					{
+						uint32_t texel;
+						memcpy(&texel, &pixels[i * 4], sizeof(texel));
+
+						uint8_t rgb[3];
+
+						switch (fmt)
+						{
+						case VK_FORMAT_B8G8R8A8_UNORM:
+						case VK_FORMAT_B8G8R8A8_SRGB:
+							rgb[0] = pixels[i * 4 + 2];
+							rgb[1] = pixels[i * 4 + 1];
+							rgb[2] = pixels[i * 4 + 0];
+							break;
+						case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+							rgb[0] = static_cast<uint8_t>((texel >> 2) & 0xff);
+							rgb[1] = static_cast<uint8_t>((texel >> 12) & 0xff);
+							rgb[2] = static_cast<uint8_t>((texel >> 22) & 0xff);
+							break;
+						case VK_FORMAT_A2R10G10B10_UNORM_PACK32:
+							rgb[0] = static_cast<uint8_t>((texel >> 22) & 0xff);
+							rgb[1] = static_cast<uint8_t>((texel >> 12) & 0xff);
+							rgb[2] = static_cast<uint8_t>((texel >> 2) & 0xff);
+							break;
+						default:	// R8G8B8A8
+							rgb[0] = pixels[i * 4 + 0];
+							rgb[1] = pixels[i * 4 + 1];
+							rgb[2] = pixels[i * 4 + 2];
+							break;
+						}
+
+						memcpy(&pixels[i * 3], rgb, sizeof(rgb));
+					}
+
+					return 0 != stbi_write_png(path.c_str(), static_cast<int>(width), static_cast<int>(height), 3,
+						pixels.data(), static_cast<int>(width * 3));
+				});
+
+			// the run was for this frame, the loop ends and the writer is waited for on the way out
+			glfwSetWindowShouldClose(glfw::window, GLFW_TRUE);
+		}
+
+		void finish_capture()
+		{
+			if (0 == settings.capture_frame)
+				return;
+
+			if (!capture_recorded)
+			{
+				throw std::runtime_error("Capture frame " + std::to_string(settings.capture_frame) + " was never drawn!");
+			}
+
+			// the device is idle, a copy from the last frames is done
+			collect_capture(true);
+
+			if (!capture_written.get())
+			{
+				throw std::runtime_error("Failed to write " + settings.capture_path + "!");
+			}
+
+			std::cout << "Capture: frame " << settings.capture_frame << ", " << capture_extent.width << 'x'
+				<< capture_extent.height << (settings.fixed_step ? " at a fixed step" : "") << " written to "
+				<< settings.capture_path << std::endl;
+		}
+
+		void create_compute_resources()
+		{
+			if (!async_compute)
+				return;
+
+			// the same as the graphics pool, for the compute family: a command pool only serves one family
+			VkCommandPoolCreateInfo pool_info{};
+			pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			pool_info.queueFamilyIndex = async_families[1];
+			pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+			if (!OP_SUCCESS(vkCreateCommandPool(dev, &pool_info, nullptr, &compute_cmd_pool)))
+			{
+				throw std::runtime_error("Failed to create command pool!");
+			}
+
+			VkCommandBufferAllocateInfo alloc_info{};
+			alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			alloc_info.commandPool = compute_cmd_pool;
+			alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			alloc_info.commandBufferCount = static_cast<uint32_t>(compute_cmd_buffers.size());
+
+			if (!OP_SUCCESS(vkAllocateCommandBuffers(dev, &alloc_info, compute_cmd_buffers.data())))
+			{
+				throw std::runtime_error("Failed to allocate command buffers!");
+			}
+
+			VkSemaphoreTypeCreateInfo type_info{};
+			type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+			type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+			type_info.initialValue = 0;
+
+			VkSemaphoreCreateInfo sem_info{};
+			sem_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+			sem_info.pNext = &type_info;
+
+			if (!OP_SUCCESS(vkCreateSemaphore(dev, &sem_info, nullptr, &compute_timeline)))
+			{
+				throw std::runtime_error("Timeline semaphore creation failed!");
+			}
+
+			// both families have to count timestamps for the two queues to be compared
+			uint32_t family_count = 0;
+			vkGetPhysicalDeviceQueueFamilyProperties(pd, &family_count, nullptr);
+
+			std::vector<VkQueueFamilyProperties> families(family_count);
+			vkGetPhysicalDeviceQueueFamilyProperties(pd, &family_count, families.data());
+
+			const uint32_t valid_bits = std::min(families[async_families[0]].timestampValidBits,
+				families[async_families[1]].timestampValidBits);
+
+			if (0 == valid_bits)
+			{
+				std::cout << "Async compute: a queue family has no timestamps, the overlap is not measured" << std::endl;
+				return;
+			}
+
+			VkPhysicalDeviceProperties props{};
+			vkGetPhysicalDeviceProperties(pd, &props);
+
+			async_timestamp_ns = props.limits.timestampPeriod;
+			async_timestamp_mask = valid_bits >= 64 ? ~uint64_t(0) : (uint64_t(1) << valid_bits) - 1;
+
+			VkQueryPoolCreateInfo qp_info{};
+			qp_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			qp_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			qp_info.queryCount = static_cast<uint32_t>(4 * max_frames_in_flight);
+
+			if (!OP_SUCCESS(vkCreateQueryPool(dev, &qp_info, nullptr, &async_queries)))
+			{
+				throw std::runtime_error("Query pool creation failed!");
+			}
+		}
+
+		void destroy_compute_resources()
+		{
+			// all null without async compute, which the destroy calls accept
+			vkDestroyQueryPool(dev, async_queries, nullptr);
+			vkDestroySemaphore(dev, compute_timeline, nullptr);
+			vkDestroyCommandPool(dev, compute_cmd_pool, nullptr);
+
+			async_queries = VK_NULL_HANDLE;
+			compute_timeline = VK_NULL_HANDLE;
+			compute_cmd_pool = VK_NULL_HANDLE;
+		}
+
+		uint64_t submit_async_compute(uint32_t image_index)
+		{
+			/*
+			The cluster cull only needs the frame's uploads and the particle simulation nothing of the frame at all,
+			which makes them the compute work that can run ahead. The occlusion culling passes sit between two
+			geometry passes of the same frame and stay in the graph.
+			*/
+			if (!async_compute || (!cluster_enabled && !particles_enabled))
+				return 0;
+
+			// free again, the frame slot's graphics submission waited for this one's last use before it retired
+			VkCommandBuffer cmd = compute_cmd_buffers[curr_frame];
+
+			VkCommandBufferBeginInfo begin_info{};
+			begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+			if (!OP_SUCCESS(vkBeginCommandBuffer(cmd, &begin_info)))
+			{
+				throw std::runtime_error("Command buffer recording failed!");
+			}
+
+			const bool stamp = VK_NULL_HANDLE != async_queries;
+			const uint32_t first_query = static_cast<uint32_t>(4 * curr_frame);
+
+			if (stamp)
+			{
+				vkCmdResetQueryPool(cmd, async_queries, first_query, 2);
+				vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, async_queries, first_query);
+			}
+
+			if (cluster_enabled)
+			{
+				record_cluster_cull(cmd, image_index);
+			}
+
+			if (particles_enabled)
+			{
+				record_particle_sim(cmd, image_index);
+			}
+
+			// the counters are read on the host once the frame has retired, what set_final_usage does in the graph
+			VkMemoryBarrier host_barrier{};
+			host_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			host_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			host_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+			vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+				1, &host_barrier, 0, nullptr, 0, nullptr);
+
+			if (stamp)
+			{
+				vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, async_queries, first_query + 1);
+			}
+
+			if (!OP_SUCCESS(vkEndCommandBuffer(cmd)))
+			{
+				throw std::runtime_error("Command buffer recording failed!");
+			}
+
+			const uint64_t signal_value = compute_timeline_value + 1;
+
+			VkTimelineSemaphoreSubmitInfo timeline_info{};
+			timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+			timeline_info.signalSemaphoreValueCount = 1;
+			timeline_info.pSignalSemaphoreValues = &signal_value;
+
+			VkSubmitInfo submit{};
+			submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			submit.pNext = &timeline_info;
+			submit.commandBufferCount = 1;
+			submit.pCommandBuffers = &cmd;
+			submit.signalSemaphoreCount = 1;
+			submit.pSignalSemaphores = &compute_timeline;
+
+			if (!OP_SUCCESS(vkQueueSubmit(compute_queue, 1, &submit, VK_NULL_HANDLE)))
+			{
+				throw std::runtime_error("Failed to submit compute command buffer!");
+			}
+
+			compute_timeline_value = signal_value;
+			async_queries_written[curr_frame] = stamp;
+
+			return signal_value;
+		}
+
+		/*
+		How much of the compute queue's work ran while the graphics queue was busy too: a frame's compute overlaps
+		the tail of the previous frame's graphics work and the start of its own, up to the stage that waits for it.
+		Both queues count the same device clock on the drivers we have seen; the spec does not promise it across
+		queues, so take the overlap as an estimate.
+		*/
+		void collect_async_timings()
+		{
+			if (VK_NULL_HANDLE == async_queries || !async_queries_written[curr_frame])
+			{
+				// nothing to line the next frame's compute up against
+				async_counters.graphics_begin = async_counters.graphics_end = 0;
+				return;
+			}
+
+			async_queries_written[curr_frame] = false;
+
+			std::array<uint64_t, 4> stamps{};
+
+			if (VK_SUCCESS != vkGetQueryPoolResults(dev, async_queries, static_cast<uint32_t>(4 * curr_frame), 4,
+				sizeof(stamps), stamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT))
+			{
+				return;
+			}
+
+			for (auto& t : stamps)
+			{
+				t &= async_timestamp_mask;
+			}
+
+			auto overlap = [](uint64_t begin_a, uint64_t end_a, uint64_t begin_b, uint64_t end_b) -> uint64_t
+			{
+				const uint64_t begin = std::max(begin_a, begin_b);
+				const uint64_t end = std::min(end_a, end_b);
+
+				return end > begin ? end - begin : 0;
+			};
+
+			const uint64_t compute = stamps[1] > stamps[0] ? stamps[1] - stamps[0] : 0;
+
+			const uint64_t overlapped = std::min(compute,
+				overlap(stamps[0], stamps[1], async_counters.graphics_begin, async_counters.graphics_end) +
+				overlap(stamps[0], stamps[1], stamps[2], stamps[3]));
+
+			const double tick_ms = async_timestamp_ns * 1e-6;
+
+			async_counters.frames++;
+			async_counters.compute_ms += static_cast<double>(compute) * tick_ms;
+			async_counters.overlap_ms += static_cast<double>(overlapped) * tick_ms;
 
-				We have to indicate that we intend to do that by specifying the transfer source flag for the stagingBuffer
-				and the transfer destination flag for the vertexBuffer, along with the vertex buffer usage flag.
-			*/
-			void* data{ nullptr };
-			if (!OP_SUCCESS(vkMapMemory(dev, staging_buffer_memory, 0, buffer_size, 0, &data)))
+			async_counters.graphics_begin = stamps[2];
+			async_counters.graphics_end = stamps[3];
+		}
+
+		void report_async_compute_stats()
+		{
+			std::cout << "Async compute: ";
+
+			if (!async_compute)
 			{
-				throw std::runtime_error("Memory mapping failed!");
+				std::cout << (settings.async_compute ? "no compute only queue family" : "off")
+					<< ", compute ran on the graphics queue\n" << std::flush;
+				return;
 			}
 
-			memcpy(data, vertices.data(), static_cast<size_t>(buffer_size));
-			vkUnmapMemory(dev, staging_buffer_memory);
+			std::cout << "queue family " << async_families[1] << ", " << async_counters.frames << " frames timed\n";
 
-			create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertex_buffer, vtx_buffer_mem);
+			if (async_counters.frames)
+			{
+				const double frames = static_cast<double>(async_counters.frames);
 
-			copy_buffer(staging_buffer, vertex_buffer, buffer_size);
+				std::cout << "\t" << std::fixed << std::setprecision(3) << async_counters.compute_ms / frames
+					<< " ms of compute per frame, " << async_counters.overlap_ms / frames << " ms ("
+					<< std::setprecision(1) << 100.0 * async_counters.overlap_ms / std::max(async_counters.compute_ms, 1e-9)
+					<< "%) overlapped with graphics work\n";
+			}
 
-			vkDestroyBuffer(dev, staging_buffer, nullptr);
-			vkFreeMemory(dev, staging_buffer_memory, nullptr);
+			std::cout << std::defaultfloat << std::flush;
 		}
-		
-		void create_index_buffer()
+
+		std::pmr::memory_resource* frame_scratch()
 		{
-			VkDeviceSize buffer_size = sizeof(uint16_t) * indices.size();
+			return &frame_arenas[curr_frame];
+		}
 
-			VkBuffer		staging_buffer;
-			VkDeviceMemory	staging_buffer_mem;
+		/*
+		Time from the start of initialization to the first frame, and the part of it spent getting SPIR-V. Run once
+		with and once without --packed-shaders to compare the embedded shaders against reading them from the pack.
+		*/
+		void report_startup_stats()
+		{
+			const auto& shaders = spirv::stats();
 
-			create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				staging_buffer, staging_buffer_mem);
+			const double startup_ms = std::chrono::duration<double, std::milli>(
+				std::chrono::steady_clock::now() - KHR::start_time).count();
 
-			void* data = nullptr;
-			vkMapMemory(dev, staging_buffer_mem, 0, buffer_size , 0, &data);
-			memcpy(data, indices.data(), static_cast<size_t>(buffer_size));
-			vkUnmapMemory(dev, staging_buffer_mem);
+			std::cout << "Startup: " << std::fixed << std::setprecision(1) << startup_ms << " ms, shaders "
+				<< std::setprecision(3) << shaders.ms << " ms for " << shaders.embedded << " embedded and "
+				<< shaders.packed << " packed" << (spirv::has_embedded() ? "" : " (built without embedded SPIR-V)")
+				<< '\n' << std::defaultfloat << std::flush;
+		}
 
-			create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, index_buffer, idx_buffer_mem);
+		/*
+		Allocations the C++ side makes per frame, and how large the frame arenas had to grow. Once the arenas have
+		warmed up they take nothing from the heap, so any allocation left is one a frame scoped container still
+		makes outside them.
+		*/
+		void report_memory_stats()
+		{
+			const double frames = static_cast<double>(std::max<uint64_t>(frame_memory.frames, 1));
 
-			copy_buffer(staging_buffer, index_buffer, buffer_size);
+			std::cout << "Heap allocations per frame: " << std::fixed << std::setprecision(2)
+				<< static_cast<double>(frame_memory.allocations) / frames << " average, " << frame_memory.max_allocations
+				<< " worst, " << frame_memory.clean_frames << " of " << frame_memory.frames << " frames allocation free\n";
 
-			vkDestroyBuffer(dev, staging_buffer, nullptr);
-			vkFreeMemory(dev, staging_buffer_mem, nullptr);
+			for (size_t i = 0; i < frame_arenas.size(); i++)
+			{
+				const auto& arena = frame_arenas[i];
+
+				std::cout << "\tframe arena " << i << ": " << std::setprecision(1)
+					<< static_cast<double>(std::max(arena.high_water(), arena.used())) / 1024.0 << " KiB high water, "
+					<< static_cast<double>(arena.capacity()) / 1024.0 << " KiB in " << arena.upstream_allocations()
+					<< " blocks\n";
+			}
+
+			std::cout << std::defaultfloat << std::flush;
 		}
 
-		void create_uniform_buffers()
+		/*
+		Present intervals per present mode. Jitter is the standard deviation of the interval, latency runs from the
+		moment the pacer let the frame start, right before input is polled, to its present.
+		*/
+		void report_pacing_stats()
 		{
-			VkDeviceSize buffer_size = sizeof(UniformBufferObject);
-
-			uniform_buffers.resize(sc_images.size());
-			ubo_mems.resize(sc_images.size());
+			std::cout << "Present mode  interval  jitter  min / max  input to present\n";
 
-			for (size_t i = 0; i < sc_images.size(); i++)
+			for (const auto& [mode, stats] : pacing_history)
 			{
-				create_buffer(buffer_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-					uniform_buffers[i], ubo_mems[i]);
+				const double n = static_cast<double>(std::max<uint64_t>(stats.intervals, 1));
+				const double mean = stats.interval_ms / n;
+				const double jitter = std::sqrt(std::max(0.0, stats.interval_sq / n - mean * mean));
+
+				std::cout << std::setw(12) << KHR::present_mode_name(mode) << "  " << std::fixed << std::setprecision(3)
+					<< mean << " ms  " << jitter << " ms  "
+					<< (stats.intervals ? stats.min_ms : 0.0) << " / " << stats.max_ms << " ms  "
+					<< (stats.presents ? stats.latency_ms / static_cast<double>(stats.presents) : 0.0)
+					<< " ms over " << stats.presents << " presents\n";
+
+				if (0.f != settings.target_fps)
+				{
+					std::cout << "\tpaced at " << std::setprecision(1) << settings.target_fps << " fps, slept "
+						<< std::setprecision(3) << (stats.presents ? stats.sleep_ms / static_cast<double>(stats.presents) : 0.0)
+						<< " ms per frame, " << stats.missed << " deadlines missed\n";
+				}
 			}
+
+			std::cout << std::defaultfloat << std::flush;
 		}
 
-		void create_descriptor_pool()
+		/*
+		Lazily allocated memory only gets physical pages once the GPU actually needs to spill the attachment,
+		vkGetDeviceMemoryCommitment tells how much that was. For regular memory the commitment is the allocation.
+		*/
+		void report_msaa_stats()
 		{
-			/*
-			describe which descriptor types our descriptor sets are going to contain and how many of them, 
-			using VkDescriptorPoolSize structures.
-			*/
-			std::array<VkDescriptorPoolSize, 2> pool_sizes{};
-			pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-			pool_sizes[0].descriptorCount = static_cast<uint32_t>(sc_images.size());
-			pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			pool_sizes[1].descriptorCount = static_cast<uint32_t>(sc_images.size());
+			auto& current = msaa_history[msaa_samples];
 
-			/*
-			allocate one of these descriptors for every frame. This pool size structure is referenced 
-			by the main VkDescriptorPoolCreateInfo:
+			auto account = [&current](VkImage img, VkDeviceMemory mem, bool lazy)
+			{
+				VkMemoryRequirements reqs{};
+				vkGetImageMemoryRequirements(dev, img, &reqs);
 
-			structure has an optional flag similar to command pools that determines if individual descriptor 
-			sets can be freed or not: VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT.
-			*/
-			VkDescriptorPoolCreateInfo pool_info{};
-			pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-			pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
-			pool_info.pPoolSizes = pool_sizes.data();
-			/*
-			Aside from the maximum number of individual descriptors that are available, we also need to specify 
-			the maximum number of descriptor sets that may be allocated:
-			*/
-			pool_info.maxSets = static_cast<uint32_t>(sc_images.size());
+				VkDeviceSize committed = reqs.size;
 
-			
-			if (!OP_SUCCESS(vkCreateDescriptorPool(dev, &pool_info, nullptr, &descriptor_pool)))
+				if (lazy)
+				{
+					vkGetDeviceMemoryCommitment(dev, mem, &committed);
+				}
+
+				current.attachment_bytes += reqs.size;
+				current.committed_bytes += committed;
+				current.lazy = current.lazy || lazy;
+			};
+
+			current.attachment_bytes = 0;
+			current.committed_bytes = 0;
+
+			account(depth_buffer, depth_img_mem, depth_lazy);
+
+			if (VK_NULL_HANDLE != color_msaa)
 			{
-				throw std::runtime_error("Descriptor pool creation failed!");
+				account(color_msaa, color_msaa_mem, color_msaa_lazy);
 			}
-			/*
-			* Note:
-			* 
-			 Inadequate descriptor pools are a good example of a problem that the validation layers will not catch: As of
-			 Vulkan 1.1, vkAllocateDescriptorSets may fail with the error code VK_ERROR_POOL_OUT_OF_MEMORY if the pool is
-			 not sufficiently large, but the driver may also try to solve the problem internally. This means that sometimes
-			 (depending on hardware, pool size and allocation size) the driver will let us get away with an allocation that
-			 exceeds the limits of our descriptor pool. Other times, vkAllocateDescriptorSets will fail and return
-			 VK_ERROR_POOL_OUT_OF_MEMORY. This can be particularly frustrating if the allocation succeeds on some machines,
-			 but fails on others.
 
-			 Since Vulkan shifts the responsiblity for the allocation to the driver, it is no longer a strict requirement to 
-			 only allocate as many descriptors of a certain type (VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, etc.) as 
-			 specified by the corresponding descriptorCount members for the creation of the descriptor pool. However, it 
-			 remains best practise to do so, and in the future, VK_LAYER_KHRONOS_validation will warn about this type of 
-			 problem if you enable Best Practice Validation.
-			*/
+			std::cout << "MSAA  attachments  committed  frame time\n";
+
+			for (const auto& [samples, stats] : msaa_history)
+			{
+				std::cout << std::setw(3) << samples << "x  "
+					<< std::setw(7) << stats.attachment_bytes / 1024 << " KiB  "
+					<< std::setw(5) << stats.committed_bytes / 1024 << " KiB"
+					<< (stats.lazy ? "*" : " ") << "  "
+					<< std::fixed << std::setprecision(3)
+					<< (stats.frames ? stats.frame_ms / static_cast<double>(stats.frames) : 0.0)
+					<< " ms over " << stats.frames << " frames\n" << std::defaultfloat;
+			}
 
+			std::cout << "(* lazily allocated)" << std::endl;
 		}
 
-		void create_descriptor_sets()
+		/*
+		The frame as a graph: the forward pass writes the swap chain image and the depth buffer, and the swap chain
+		image leaves the graph ready to present. Passes added later only declare what they touch, the graph works
+		out every barrier in between. With occlusion culling the forward pass splits into an early and a late
+		geometry pass with the culling work in between. With post processing the geometry writes the HDR target
+		instead, and the post chain's blit is the only pass that touches the swap chain image.
+		*/
+		void build_frame_graph()
 		{
-			/*
-			A descriptor set allocation is described with a VkDescriptorSetAllocateInfo struct. You need to specify 
-			the descriptor pool to allocate from, the number of descriptor sets to allocate, and the descriptor layout 
-			to base them on:
-			*/
+			VkFormat depth_fmt = find_depth_format();
 
-			/*
-			create one descriptor set for each swap chain image, all with the same layout. Unfortunately we do need all 
-			the copies of the layout because the next function expects an array matching the number of sets.
-			*/
-			std::vector<VkDescriptorSetLayout> layouts(sc_images.size(), descriptor_set_layout);
-			VkDescriptorSetAllocateInfo dsa_info{};
-			dsa_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-			dsa_info.descriptorPool = descriptor_pool;
-			dsa_info.descriptorSetCount = static_cast<uint32_t>(sc_images.size());
-			dsa_info.pSetLayouts = layouts.data();
+			// acquire signals at COLOR_ATTACHMENT_OUTPUT (the submit's wait stage), that is what the first barrier waits on
+			rg_swap_chain = frame_graph.import_image("swap chain", VK_IMAGE_ASPECT_COLOR_BIT,
+				{ VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, false });
 
-			descriptor_sets.resize(sc_images.size());
+			// a single depth buffer is shared by all frames in flight, so the last frame's depth writes must be waited on
+			rg_depth = frame_graph.import_image("depth", VK_IMAGE_ASPECT_DEPTH_BIT |
+				(has_stencil(depth_fmt) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0),
+				{ VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+				VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, false });
 
-			/*
-			 The call to vkAllocateDescriptorSets will allocate descriptor sets, each with one uniform buffer descriptor.
-			*/
-			if (!OP_SUCCESS(vkAllocateDescriptorSets(dev, &dsa_info, descriptor_sets.data())))
+			if (VK_SAMPLE_COUNT_1_BIT != msaa_samples)
 			{
-				throw std::runtime_error("Descriptor sets allocation failure!");
+				rg_color_msaa = frame_graph.import_image("color msaa", VK_IMAGE_ASPECT_COLOR_BIT,
+					{ VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+					VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, false });
+			}
+			else
+			{
+				rg_color_msaa = rg::invalid_resource;
 			}
 
-			/*
-			configure each descriptor 
-			*/
-			for (size_t i = 0; i < sc_images.size(); i++)
+			// the post chain's last reads are what the next frame's geometry has to wait for
+			if (post_enabled)
 			{
-				/*
-				Descriptors that refer to buffers, like our uniform buffer descriptor, are configured with a VkDescriptorBufferInfo 
-				struct. This structure specifies the buffer and the region within it that contains the data for the descriptor.
-				*/
-				VkDescriptorBufferInfo db_info{};
-				db_info.buffer = uniform_buffers[i];
-				db_info.offset = 0;
-				db_info.range = sizeof(UniformBufferObject); // can use VK_WHOLE_SIZE
+				rg_hdr = frame_graph.import_image("hdr", VK_IMAGE_ASPECT_COLOR_BIT,
+					{ VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, false });
+			}
+			else
+			{
+				rg_hdr = rg::invalid_resource;
+			}
 
-				VkDescriptorImageInfo di_info{};
-				di_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-				di_info.imageView = tex_img_view;
-				di_info.sampler = tex_sampler;
+			const rg::resource_id scene_target = post_enabled ? rg_hdr : rg_swap_chain;
 
-				/*
-				configuration of descriptors is updated using the vkUpdateDescriptorSets function, which takes an array of 
-				VkWriteDescriptorSet structs as parameter.
-				*/
-				std::array<VkWriteDescriptorSet,2> ds_writes{};
-				ds_writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-				/*
-				The first two fields specify the descriptor set to update and the binding. We gave our uniform buffer binding index 0. 
-				Remember that descriptors can be arrays, so we also need to specify the first index in the array that we want to update. 
-				We're not using an array, so the index is simply 0.
-				*/
-				ds_writes[0].dstSet = descriptor_sets[i];
-				ds_writes[0].dstBinding = 0;
-				ds_writes[0].dstArrayElement = 0;
-				/*
-				need to specify the type of descriptor again. It's possible to update multiple descriptors at once in an array, starting at 
-				index dstArrayElement. The descriptorCount field specifies how many array elements you want to update.
-				*/
-				ds_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-				ds_writes[0].descriptorCount = 1;
-				/*
-				The last field references an array with descriptorCount structs that actually configure the descriptors. It depends on the type 
-				of descriptor which one of the three you actually need to use. The pBufferInfo field is used for descriptors that refer to buffer 
-				data, pImageInfo is used for descriptors that refer to image data, and pTexelBufferView is used for descriptors that refer to 
-				buffer views. Our descriptor is based on buffers, so we're using pBufferInfo.
-				*/
-				ds_writes[0].pBufferInfo = &db_info;
-				ds_writes[0].pImageInfo = nullptr;
-				ds_writes[0].pTexelBufferView = nullptr;
-				/*
-				The updates are applied using vkUpdateDescriptorSets. It accepts two kinds of arrays as parameters: an array of VkWriteDescriptorSet 
-				and an array of VkCopyDescriptorSet. The latter can be used to copy descriptors to each other, as its name implies.
-				*/
+			// every geometry pass renders into the same attachments
+			auto write_targets = [scene_target](rg::pass_builder& pass)
+			{
+				pass.write(rg_depth, rg::usage::depth_attachment);
+
+				if (rg::invalid_resource != rg_color_msaa)
+				{
+					pass.write(rg_color_msaa, rg::usage::color_attachment)
+						.write(scene_target, rg::usage::resolve_attachment);
+				}
+				else
+				{
+					pass.write(scene_target, rg::usage::color_attachment);
+				}
+			};
 
-				// image & sampler stuff
-				ds_writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-				ds_writes[1].dstSet = descriptor_sets[i];
-				ds_writes[1].dstBinding = 1;
-				ds_writes[1].dstArrayElement = 0;
-				ds_writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-				ds_writes[1].descriptorCount = 1;
-				ds_writes[1].pImageInfo = &di_info;
+			if (particles_enabled)
+			{
+				// the frame slot's own, its last frame drew from them and has retired; the host resets the command
+				rg_particle_draws = frame_graph.import_buffer("particle draws", rg::state_for(rg::usage::vertex_storage_read));
+				rg_particle_args = frame_graph.import_buffer("particle args", rg::state_for(rg::usage::indirect_read));
 
-				vkUpdateDescriptorSets(dev, static_cast<uint32_t>(ds_writes.size()), ds_writes.data(), 0, nullptr);
+				// otherwise on the compute queue, and the submission waits for it at the vertex shader
+				if (!async_compute)
+				{
+					frame_graph.add_pass("particle sim", record_particle_sim)
+						.write(rg_particle_draws, rg::usage::compute_storage_write)
+						.write(rg_particle_args, rg::usage::compute_storage_read_write);
+				}
 			}
-		}
 
-		void create_cmd_buffers()
-		{
-			cmd_buffers.resize(sc_framebuffers.size());
+			// the particles go over the scene in the frame's last geometry pass
+			auto read_particles = [](rg::pass_builder& pass)
+			{
+				if (particles_enabled)
+				{
+					pass.read(rg_particle_draws, rg::usage::vertex_storage_read)
+						.read(rg_particle_args, rg::usage::indirect_read);
+				}
+			};
 
-			VkCommandBufferAllocateInfo alloc_info{};
-			alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-			alloc_info.commandPool = cmd_pool;
-			/*
-			The level parameter specifies if the allocated command buffers are primary or secondary command buffers.
+			if (!occlusion_enabled)
+			{
+				if (cluster_enabled && async_compute)
+				{
+					/*
+					The cull ran on the compute queue and the submission waited for it at the indirect and vertex input
+					stages, which is a full memory dependency: the forward pass finds them ready to read.
+					*/
+					rg_cluster_indices = frame_graph.import_buffer("cluster indices", rg::state_for(rg::usage::index_read));
+					rg_cluster_draws = frame_graph.import_buffer("cluster draws", rg::state_for(rg::usage::indirect_read));
+				}
+				else if (cluster_enabled)
+				{
+					// the frame slot's own, its last draws from them are what the cull waits on
+					rg_cluster_indices = frame_graph.import_buffer("cluster indices", rg::state_for(rg::usage::index_read));
+					rg_cluster_draws = frame_graph.import_buffer("cluster draws", rg::state_for(rg::usage::indirect_read));
 
-				- VK_COMMAND_BUFFER_LEVEL_PRIMARY: Can be submitted to a queue for execution, but cannot be called from other command buffers.
-				- VK_COMMAND_BUFFER_LEVEL_SECONDARY: Cannot be submitted directly, but can be called from primary command buffers.
-			*/
-			alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-			alloc_info.commandBufferCount = static_cast<unsigned>(cmd_buffers.size());
+					// zeroed by the host before every submit
+					rg_cluster_stats = frame_graph.import_buffer("cluster stats");
 
-			if (!OP_SUCCESS(vkAllocateCommandBuffers(dev,&alloc_info, cmd_buffers.data())))
-			{
-				throw std::runtime_error("Failed to allocate command buffers!");
-			}
+					frame_graph.add_pass("cluster cull", record_cluster_cull)
+						.write(rg_cluster_indices, rg::usage::compute_storage_write)
+						.write(rg_cluster_draws, rg::usage::compute_storage_write)
+						.write(rg_cluster_stats, rg::usage::compute_storage_read_write);
+				}
 
-			// command buffer recording
-			for (size_t i = 0; i < cmd_buffers.size(); i++)
-			{
-				VkCommandBufferBeginInfo begin_info{};
-				begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-				/*
-				The flags parameter specifies how we're going to use the command buffer. The following values are available:
+				auto forward = frame_graph.add_pass(settings.depth_prepass ? "prepass + forward" : "forward", record_forward_pass);
 
-					- VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT: The command buffer will be rerecorded right after executing it once.
-					- VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT: This is a secondary command buffer that will be entirely within a single render pass.
-					- VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT: The command buffer can be resubmitted while it is also already pending execution.
-				
-				None of these flags are applicable for us right now.
-				*/
-				begin_info.flags = 0;
+				if (cluster_enabled)
+				{
+					forward.read(rg_cluster_indices, rg::usage::index_read)
+						.read(rg_cluster_draws, rg::usage::indirect_read);
+				}
+
+				read_particles(forward);
+				write_targets(forward);
+
+				if (cluster_enabled && !async_compute)
+				{
+					frame_graph.set_final_usage(rg_cluster_stats, rg::usage::host_read);
+				}
+			}
+			else
+			{
 				/*
-				The pInheritanceInfo parameter is only relevant for secondary command buffers. It specifies which state to 
-				inherit from the calling primary command buffers.
+				Two phase occlusion culling: draw what was visible last frame, reduce its depth into a pyramid, test
+				everything against the pyramid and draw what was missed. The draw lists only ever live on the GPU.
 				*/
-				begin_info.pInheritanceInfo = nullptr;
+				rg_visibility = frame_graph.import_buffer("visibility", rg::state_for(rg::usage::compute_storage_read_write));
+				rg_early_draws = frame_graph.import_buffer("early draws", rg::state_for(rg::usage::indirect_read));
+				rg_late_draws = frame_graph.import_buffer("late draws", rg::state_for(rg::usage::indirect_read));
+
+				// zeroed by the host before every submit
+				rg_cull_stats = frame_graph.import_buffer("cull stats");
 
-				if (!OP_SUCCESS(vkBeginCommandBuffer(cmd_buffers[i], &begin_info)))
+				// a power of two no larger than the depth buffer, so every level below halves exactly
+				auto floor_pow2 = [](uint32_t v)
 				{
-					throw std::runtime_error("Command buffer recording failed!");
-				}
+					uint32_t p = 1;
 
-				std::array<VkClearValue, 2> clear_values{};
-				clear_values[0].color = { 0.f, 0.f, 0.f, 1.f };
-				clear_values[1].depthStencil = { 1.f, 0 };
+					while (p * 2 <= v)
+						p *= 2;
 
-				/* Note: If the command buffer was already recorded once, then a call to vkBeginCommandBuffer will implicitly reset it. 
-				 It's not possible to append commands to a buffer at a later time. */
+					return p;
+				};
 
-				VkRenderPassBeginInfo rpi{};
-				rpi.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-				/*
-				The first parameters are the render pass itself and the attachments to bind. We created a framebuffer for each swap chain 
-				image that specifies it as color attachment.
-				*/
-				rpi.renderPass = render_pass;
-				rpi.framebuffer = sc_framebuffers[i];
-				/*
-				* The next two parameters define the size of the render area. The render area defines where shader loads and stores will 
-				take place. The pixels outside this region will have undefined values. It should match the size of the attachments for 
-				best performance.
-				*/
-				rpi.renderArea.offset = { 0,0 };
-				rpi.renderArea.extent = sc_extent;
-				/*
-				The last two parameters define the clear values to use for VK_ATTACHMENT_LOAD_OP_CLEAR, which we used as load operation 
-				for the color attachment.
-				*/
-				
-				rpi.clearValueCount = static_cast<uint32_t>(clear_values.size());
-				rpi.pClearValues = clear_values.data();
+				pyramid_extent = { floor_pow2(sc_extent.width), floor_pow2(sc_extent.height) };
+				pyramid_levels = 1;
 
-				VkSubpassBeginInfo spi{};
-				spi.sType = VK_STRUCTURE_TYPE_SUBPASS_BEGIN_INFO;
-				spi.contents = VK_SUBPASS_CONTENTS_INLINE;
-				
-				/*
-				The render pass can now begin. All of the functions that record commands can be recognized by their vkCmd prefix. 
-				They all return void, so there will be no error handling until we've finished recording.
+				while ((std::max(pyramid_extent.width, pyramid_extent.height) >> pyramid_levels) > 0)
+					pyramid_levels++;
 
-				The final parameter controls how the drawing commands within the render pass will be provided. It can have one of two values:
+				rg::image_desc pyramid{};
+				pyramid.format = VK_FORMAT_R32_SFLOAT;
+				pyramid.extent = pyramid_extent;
+				pyramid.mip_levels = pyramid_levels;
+				pyramid.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+				pyramid.aspect = VK_IMAGE_ASPECT_COLOR_BIT;
 
-					- VK_SUBPASS_CONTENTS_INLINE: The render pass commands will be embedded in the primary command buffer itself and no 
-					secondary command buffers will be executed.
-					
-					- VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS: The render pass commands will be executed from secondary command buffers.
-				*/
-				vkCmdBeginRenderPass2(cmd_buffers[i], &rpi, &spi);
+				rg_pyramid = frame_graph.create_image("depth pyramid", pyramid);
+
+				frame_graph.add_pass("cull early", [](VkCommandBuffer cmd, uint32_t image_index)
+					{
+						record_cull_pass(cmd, image_index, false);
+					})
+					.read(rg_visibility, rg::usage::compute_storage_read)
+					.write(rg_early_draws, rg::usage::compute_storage_write)
+					.write(rg_cull_stats, rg::usage::compute_storage_read_write);
 
-				vkCmdBindPipeline(cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline);
+				auto early = frame_graph.add_pass("geometry early", [](VkCommandBuffer cmd, uint32_t image_index)
+					{
+						record_scene(cmd, image_index, render_pass, early_draw_buffer);
+					});
 
-				VkBuffer vtx_buffers[] = { vertex_buffer };
-				VkDeviceSize offsets[] = { 0 };
+				early.read(rg_early_draws, rg::usage::indirect_read);
+				write_targets(early);
 
-				vkCmdBindVertexBuffers(cmd_buffers[i], 0, 1, vtx_buffers, offsets);
+				frame_graph.add_pass("depth pyramid", record_depth_pyramid)
+					.read(rg_depth, rg::usage::compute_sampled)
+					.write(rg_pyramid, rg::usage::compute_storage_read_write);
 
-				vkCmdBindIndexBuffer(cmd_buffers[i], index_buffer, 0, VK_INDEX_TYPE_UINT16);
+				frame_graph.add_pass("cull late", [](VkCommandBuffer cmd, uint32_t image_index)
+					{
+						record_cull_pass(cmd, image_index, true);
+					})
+					.read(rg_pyramid, rg::usage::compute_sampled)
+					.write(rg_visibility, rg::usage::compute_storage_read_write)
+					.write(rg_late_draws, rg::usage::compute_storage_write)
+					.write(rg_cull_stats, rg::usage::compute_storage_read_write);
+
+				auto late = frame_graph.add_pass("geometry late", [](VkCommandBuffer cmd, uint32_t image_index)
+					{
+						record_scene(cmd, image_index, render_pass_late, late_draw_buffer);
+					});
 
-				/*
-				bind the right descriptor set for each swap chain image to the descriptors in the shader with vkCmdBindDescriptorSets. 
-				This needs to be done before the vkCmdDrawIndexed call:
+				late.read(rg_late_draws, rg::usage::indirect_read);
+				read_particles(late);
+				write_targets(late);
 
-				Unlike vertex and index buffers, descriptor sets are not unique to graphics pipelines. Therefore we need to specify if 
-				we want to bind descriptor sets to the graphics or compute pipeline. The next parameter is the layout that the descriptors 
-				are based on. The next three parameters specify the index of the first descriptor set, the number of sets to bind, and the 
-				array of sets to bind.
+				frame_graph.set_final_usage(rg_cull_stats, rg::usage::host_read);
+			}
 
-				The last two parameters specify an array of offsets that are used for dynamic descriptors.
-				*/
-				vkCmdBindDescriptorSets(cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, 
-					&descriptor_sets[i], 0, nullptr);
+			if (post_enabled)
+			{
+				add_post_passes(frame_graph, post_frame, rg_hdr, rg_swap_chain, sc_img_fmt, sc_extent);
+			}
 
-				//vkCmdDraw(cmd_buffers[i], static_cast<uint32_t>(vertices.size()), 1, 0, 0);
-				vkCmdDrawIndexed(cmd_buffers[i], static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+			frame_graph.set_final_usage(rg_swap_chain, rg::usage::present);
 
-				VkSubpassEndInfo spe{};
-				spe.sType = VK_STRUCTURE_TYPE_SUBPASS_END_INFO;
+			frame_graph.compile();
+		}
 
-				vkCmdEndRenderPass2(cmd_buffers[i], &spe);
+		// uploads signal it too, so it has to exist before the first buffer is filled
+		void create_timeline()
+		{
+			VkSemaphoreTypeCreateInfo type_info{};
+			type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+			type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+			type_info.initialValue = 0;
 
-				if (!OP_SUCCESS(vkEndCommandBuffer(cmd_buffers[i])))
-				{
-					throw std::runtime_error("Command buffer recording failed!");
-				}
+			VkSemaphoreCreateInfo sem_info{};
+			sem_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+			sem_info.pNext = &type_info;
+
+			if (!OP_SUCCESS(vkCreateSemaphore(dev, &sem_info, nullptr, &timeline)))
+			{
+				throw std::runtime_error("Timeline semaphore creation failed!");
+			}
+		}
+
+		uint64_t completed_timeline_value()
+		{
+			uint64_t value = 0;
+			vkGetSemaphoreCounterValue(dev, timeline, &value);
+
+			return value;
+		}
+
+		void wait_timeline(uint64_t value)
+		{
+			// zero was signalled at creation, nothing to wait for
+			if (0 == value)
+				return;
+
+			VkSemaphoreWaitInfo wait_info{};
+			wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+			wait_info.semaphoreCount = 1;
+			wait_info.pSemaphores = &timeline;
+			wait_info.pValues = &value;
+
+			vkWaitSemaphores(dev, &wait_info, std::numeric_limits<uint64_t>::max());
+		}
+
+		void defer_delete(std::function<void()> destroy)
+		{
+			deletion_queue.push_back({ timeline_value, std::move(destroy) });
+		}
+
+		void run_deletions(uint64_t completed)
+		{
+			while (!deletion_queue.empty() && deletion_queue.front().retire_after <= completed)
+			{
+				deletion_queue.front().destroy();
+				deletion_queue.pop_front();
 			}
 		}
 
@@ -2628,26 +7784,19 @@ namespace sandbox
 		{
 			image_semaphores.resize(max_frames_in_flight);
 			rp_semaphores.resize(max_frames_in_flight);
-			in_flight_fences.resize(max_frames_in_flight);
-			images_in_flight.resize(sc_images.size(), VK_NULL_HANDLE);
+			image_timeline.assign(sc_images.size(), 0);
 
 			VkSemaphoreCreateInfo sem_info{};
 			sem_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-			VkFenceCreateInfo fence_info{};
-			fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-			fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
 			for (size_t i = 0; i < max_frames_in_flight; i++)
 			{
 				if (!OP_SUCCESS(vkCreateSemaphore(dev, &sem_info, nullptr, &image_semaphores[i])) ||
-					!OP_SUCCESS(vkCreateSemaphore(dev, &sem_info, nullptr, &rp_semaphores[i])) ||
-					!OP_SUCCESS(vkCreateFence(dev, &fence_info, nullptr, &in_flight_fences[i])))
+					!OP_SUCCESS(vkCreateSemaphore(dev, &sem_info, nullptr, &rp_semaphores[i])))
 				{
 					throw std::runtime_error("Sync objects creation failed!");
 				}
 			}
-			
 		}
 		
 		void wait_for_device_completion()
@@ -2661,10 +7810,26 @@ namespace sandbox
 			{
 				vkDestroySemaphore(dev, image_semaphores[i], nullptr);
 				vkDestroySemaphore(dev, rp_semaphores[i], nullptr);
-				vkDestroyFence(dev, in_flight_fences[i], nullptr);
 			}
 
+			vkDestroySemaphore(dev, timeline, nullptr);
+
+			destroy_compute_resources();
+
 			KHR::clean_swap_chain();
+
+			// the device went idle before cleanup, everything queued is safe to go
+			run_deletions(std::numeric_limits<uint64_t>::max());
+
+			for (auto& frame : frame_descriptors)
+			{
+				frame.destroy();
+			}
+
+			destroy_occlusion_resources();
+			destroy_cluster_resources();
+			destroy_particle_resources();
+			destroy_post_resources();
 			
 			vkDestroySampler(dev, tex_sampler, nullptr);
 
@@ -2673,6 +7838,7 @@ namespace sandbox
 			vkDestroyImage(dev, texture_image, nullptr);
 			vkFreeMemory(dev, tex_img_mem, nullptr);
 
+			scene_template.destroy();
 			vkDestroyDescriptorSetLayout(dev, descriptor_set_layout, nullptr);
 
 			vkDestroyBuffer(dev, index_buffer, nullptr);
@@ -2692,59 +7858,145 @@ namespace sandbox
 			vkDestroySurfaceKHR(instance, surface, nullptr);
 
 			vkDestroyInstance(instance, nullptr);
+
+			assets.close();
 		}
 	}
 
 	void app::run()
 	{
+		// CPU only, runs without a window or a device
+		if (settings.sort_benchmark)
+		{
+			vulkan::sort::benchmark(std::cout);
+			return;
+		}
+
+		// a million unless asked for more or fewer
+		if (settings.particle_benchmark && 0 == settings.particle_count)
+		{
+			settings.particle_count = 1u << 20;
+		}
+
 		initialize();
+
+		vulkan::report_startup_stats();
+
+		// needs the device and the scene's resources, but no frames
+		if (settings.descriptor_benchmark)
+		{
+			vulkan::benchmark_descriptor_updates();
+			cleanup();
+			return;
+		}
+
+		if (settings.particle_benchmark)
+		{
+			vulkan::benchmark_particles();
+			cleanup();
+			return;
+		}
+
+		if (settings.post_benchmark)
+		{
+			vulkan::benchmark_post_processing();
+			cleanup();
+			return;
+		}
+
 		app_loop();
 		cleanup();
 	}
 
 	void app::initialize()
 	{
-		vulkan::KHR::start_time = std::chrono::high_resolution_clock::now();
+		vulkan::KHR::start_time = std::chrono::steady_clock::now();
 
 		glfw::glfw_initialization(RES_WIDTH, RES_HEIGHT);
+		vulkan::load_assets(ASSET_PACK);
+		vulkan::load_model(); // the render pass decides on cluster culling from what the pack holds
 		vulkan::create_instance();
 		vulkan::debug::setup_debug_messenger();
 		vulkan::KHR::create_surface();
 		vulkan::pick_physical_device();
 		vulkan::create_logical_device();
+		vulkan::create_timeline();
 		vulkan::KHR::create_swap_chain();
 		vulkan::create_image_views();
 		vulkan::create_render_pass();
+		vulkan::build_scene();
 		vulkan::create_descriptor_set_layout();
 		vulkan::create_graphics_pipeline();
+		vulkan::create_occlusion_pipelines();
+		vulkan::create_cluster_pipeline();
+		vulkan::create_particle_pipelines();
+		vulkan::create_particle_render_pipeline();
+		vulkan::create_post_pipelines();
 		vulkan::create_cmd_pool();
+		vulkan::create_compute_resources();
+		vulkan::create_color_resources();
+		vulkan::create_hdr_resources();
+		vulkan::create_capture_resources();
 		vulkan::create_depth_resources();
 		vulkan::create_framebuffers(); // must come after depth resources
+		vulkan::build_frame_graph();
 		vulkan::create_texture_image();
 		vulkan::create_tex_img_view();
 		vulkan::create_tex_sampler();
 		vulkan::create_vertex_buffer();
 		vulkan::create_index_buffer();
+		vulkan::create_occlusion_buffers();
+		vulkan::create_cluster_buffers();
+		vulkan::create_particle_buffers();
 		vulkan::create_uniform_buffers();
 		vulkan::create_descriptor_pool();
 		vulkan::create_descriptor_sets();
+		vulkan::create_occlusion_descriptors();
+		vulkan::create_cluster_descriptors();
+		vulkan::create_post_descriptors(vulkan::post_frame, vulkan::hdr_color_view);
+		vulkan::create_particle_descriptors();
 		vulkan::create_cmd_buffers();
 		vulkan::create_syncs();
+
+#ifdef SANDBOX_SHADER_DIR
+		vulkan::hot_reload::start(SANDBOX_SHADER_DIR);
+#else
+		vulkan::hot_reload::start("sandbox/shader");
+#endif
 	}
 
 	void app::app_loop()
 	{
 		while (!glfwWindowShouldClose(glfw::window))
 		{
+			vulkan::KHR::pace_frame();
 			glfwPollEvents();
 			vulkan::KHR::draw_frame();
 		}
 
 		vulkan::wait_for_device_completion();
+
+		vulkan::finish_capture();
+
+		vulkan::frame_graph.dump_timings(std::cout);
+		vulkan::report_msaa_stats();
+		vulkan::report_depth_stats();
+		vulkan::report_occlusion_stats();
+		vulkan::report_vertex_stats();
+		vulkan::report_lod_stats();
+		vulkan::report_cluster_stats();
+		vulkan::report_particle_stats();
+		vulkan::report_post_stats();
+		vulkan::report_async_compute_stats();
+		vulkan::report_pacing_stats();
+		vulkan::report_draw_stats();
+		vulkan::report_descriptor_stats();
+		vulkan::report_memory_stats();
 	}
 
 	void app::cleanup()
 	{
+		vulkan::hot_reload::stop();
 		vulkan::destroy_resources();
 		glfw::destroy_resources();
 	}
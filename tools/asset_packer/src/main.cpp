@@ -0,0 +1,572 @@
+#include "asset_pack.hpp"
+#include "mesh_optimizer.hpp"
+#include "mesh_simplifier.hpp"
+#include "meshlet_builder.hpp"
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <cstring>
+
+namespace fs = std::filesystem;
+
+namespace packer
+{
+	// must stay in sync with sandbox::vulkan::vertex, the runtime checks the stride
+	struct baked_vertex
+	{
+		float position[3];
+		float color[3];
+		float tex_coord[2];
+		float normal[3];
+
+		bool operator==(const baked_vertex& o) const
+		{
+			return 0 == memcmp(this, &o, sizeof(baked_vertex));
+		}
+	};
+
+	struct baked_vertex_hash
+	{
+		size_t operator()(const baked_vertex& v) const
+		{
+			return static_cast<size_t>(sandbox::asset::hash_name(
+				std::string_view(reinterpret_cast<const char*>(&v), sizeof(v))));
+		}
+	};
+
+	struct bake_options
+	{
+		bool	optimize{ true };		// vertex cache and fetch order
+		bool	overdraw{ false };		// cluster sort on top of the cache order
+		bool	lods{ true };			// simplified LOD chain
+		bool	meshlets{ true };		// clusters for GPU culling
+	};
+
+	struct baked_lod
+	{
+		std::vector<uint32_t>	indices;
+		float					error{ 0.f };
+		std::vector<mesh::meshlet> meshlets;	// ranges of indices
+	};
+
+	/*
+	Every level simplifies the one before it to half its triangles. The chain ends at max_mesh_lods, at a few
+	dozen triangles, or when the simplifier stops making progress because what is left is all seams and borders.
+	*/
+	std::vector<baked_lod> build_lods(const std::string& name, const std::vector<baked_vertex>& vertices,
+		std::vector<uint32_t> indices)
+	{
+		constexpr size_t min_triangles = 32;
+
+		std::vector<baked_lod> lods;
+		lods.push_back({ std::move(indices), 0.f, {} });
+
+		const auto start = std::chrono::steady_clock::now();
+
+		while (lods.size() < sandbox::asset::max_mesh_lods && lods.back().indices.size() / 3 >= 2 * min_triangles)
+		{
+			const auto& finer = lods.back();
+
+			baked_lod lod;
+			lod.error = finer.error;
+			lod.indices = mesh::simplify(finer.indices, vertices.data(), vertices.size(), sizeof(baked_vertex),
+				finer.indices.size() / 6 * 3, lod.error);
+
+			// a level that saves less than a quarter is not worth its index memory
+			if (lod.indices.size() > finer.indices.size() / 4 * 3)
+				break;
+
+			lods.push_back(std::move(lod));
+		}
+
+		const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		for (size_t i = 0; i < lods.size(); i++)
+		{
+			std::cout << '\t' << std::left << std::setw(24) << name << "lod " << std::setw(8) << i << std::right
+				<< std::setw(8) << lods[i].indices.size() / 3 << " triangles  error " << lods[i].error << '\n';
+		}
+
+		std::cout << '\t' << std::left << std::setw(24) << name << std::right << "simplified in " << std::fixed
+			<< std::setprecision(2) << ms << " ms\n" << std::defaultfloat;
+
+		return lods;
+	}
+
+	/*
+	Runs the optimization passes in place and prints the post-transform cache behaviour before and after each,
+	so the cost of the overdraw pass on cache efficiency is visible next to what the cache pass bought. Coarser
+	LODs get the cache order as well; overdraw matters most up close, where the full mesh is drawn.
+
+	Meshlets are built from the cache ordered triangles and regroup them, which costs a little cache efficiency
+	at the meshlet boundaries and keeps the overdraw order only roughly, since meshlets are seeded in that order.
+	Fetch order comes last, whatever the triangle order ended up being.
+	*/
+	void optimize_mesh(const std::string& name, std::vector<baked_vertex>& vertices, std::vector<baked_lod>& lods,
+		const bake_options& opts)
+	{
+		using clock = std::chrono::steady_clock;
+
+		auto& indices = lods.front().indices;
+
+		auto print = [&](const char* stage, const mesh::cache_stats& stats)
+		{
+			std::cout << '\t' << std::left << std::setw(24) << name << std::setw(12) << stage << std::right
+				<< std::fixed << std::setprecision(3) << "ACMR " << stats.acmr << "  ATVR " << stats.atvr
+				<< std::defaultfloat << '\n';
+		};
+
+		print("authored", mesh::analyze_vertex_cache(indices, vertices.size()));
+
+		const auto start = clock::now();
+
+		if (opts.optimize)
+		{
+			std::vector<uint32_t> clusters;
+			indices = mesh::optimize_vertex_cache(indices, vertices.size(), mesh::default_cache_size, &clusters);
+
+			print("cache", mesh::analyze_vertex_cache(indices, vertices.size()));
+
+			if (opts.overdraw)
+			{
+				mesh::optimize_overdraw(indices, clusters, vertices.data(), vertices.size(), sizeof(baked_vertex));
+
+				print("overdraw", mesh::analyze_vertex_cache(indices, vertices.size()));
+			}
+
+			for (size_t i = 1; i < lods.size(); i++)
+			{
+				lods[i].indices = mesh::optimize_vertex_cache(lods[i].indices, vertices.size());
+			}
+		}
+
+		const auto sorted = clock::now();
+
+		if (opts.meshlets)
+		{
+			for (auto& lod : lods)
+			{
+				lod.meshlets = mesh::build_meshlets(lod.indices, vertices.data(), vertices.size(), sizeof(baked_vertex));
+			}
+
+			print("meshlets", mesh::analyze_vertex_cache(indices, vertices.size()));
+
+			const auto& full = lods.front().meshlets;
+			size_t meshlet_vertices = 0, cullable = 0;
+
+			for (const auto& m : full)
+			{
+				meshlet_vertices += m.vertex_count;
+
+				if (m.cone_cutoff < 1.f)
+					cullable++;
+			}
+
+			std::cout << '\t' << std::left << std::setw(24) << name << std::right << full.size() << " meshlets, "
+				<< std::fixed << std::setprecision(1) << static_cast<double>(indices.size() / 3) / full.size()
+				<< " triangles and " << static_cast<double>(meshlet_vertices) / full.size() << " vertices on average, "
+				<< 100.0 * cullable / full.size() << "% with a usable cone\n" << std::defaultfloat;
+		}
+
+		const auto clustered = clock::now();
+
+		if (!opts.optimize)
+			return;
+
+		// only renumbers, the cache numbers do not change; the full mesh decides the order, coarser LODs use a subset
+		std::vector<uint32_t> all;
+
+		for (const auto& lod : lods)
+		{
+			all.insert(all.end(), lod.indices.begin(), lod.indices.end());
+		}
+
+		mesh::optimize_vertex_fetch(vertices, all);
+
+		for (size_t i = 0, first = 0; i < lods.size(); first += lods[i].indices.size(), i++)
+		{
+			std::copy(all.begin() + first, all.begin() + first + lods[i].indices.size(), lods[i].indices.begin());
+		}
+
+		const auto fetched = clock::now();
+
+		auto ms = [](clock::time_point a, clock::time_point b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+
+		std::cout << '\t' << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(2)
+			<< indices.size() / 3 << " triangles, cache and overdraw " << ms(start, sorted) << " ms, meshlets "
+			<< ms(sorted, clustered) << " ms, fetch " << ms(clustered, fetched) << " ms\n" << std::defaultfloat;
+	}
+
+	/*
+	A UV sphere with its triangles shuffled, the worst case for the cache and big enough to show the passes scale
+	linearly. Real exports are rarely this bad, but often not far from it after format conversions.
+	*/
+	void stress_mesh(uint32_t rings, uint32_t segments, std::vector<baked_vertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		const float pi = 3.14159265358979f;
+
+		vertices.clear();
+		indices.clear();
+
+		for (uint32_t r = 0; r <= rings; r++)
+		{
+			const float theta = pi * static_cast<float>(r) / static_cast<float>(rings);
+
+			for (uint32_t s = 0; s <= segments; s++)
+			{
+				const float phi = 2.f * pi * static_cast<float>(s) / static_cast<float>(segments);
+
+				baked_vertex v{};
+				v.normal[0] = std::sin(theta) * std::cos(phi);
+				v.normal[1] = std::sin(theta) * std::sin(phi);
+				v.normal[2] = std::cos(theta);
+
+				for (int k = 0; k < 3; k++)
+				{
+					v.position[k] = v.normal[k];
+					v.color[k] = 1.f;
+				}
+
+				v.tex_coord[0] = static_cast<float>(s) / static_cast<float>(segments);
+				v.tex_coord[1] = static_cast<float>(r) / static_cast<float>(rings);
+
+				vertices.push_back(v);
+			}
+		}
+
+		std::vector<std::array<uint32_t, 3>> triangles;
+
+		for (uint32_t r = 0; r < rings; r++)
+		{
+			for (uint32_t s = 0; s < segments; s++)
+			{
+				const uint32_t a = r * (segments + 1) + s;
+				const uint32_t b = a + segments + 1;
+
+				triangles.push_back({ a, b, a + 1 });
+				triangles.push_back({ a + 1, b, b + 1 });
+			}
+		}
+
+		// fixed seed, runs stay comparable
+		std::shuffle(triangles.begin(), triangles.end(), std::mt19937(1234));
+
+		for (const auto& t : triangles)
+		{
+			indices.insert(indices.end(), t.begin(), t.end());
+		}
+	}
+
+	std::vector<uint8_t> read_file(const fs::path& path)
+	{
+		std::ifstream source(path, std::ios::ate | std::ios::binary);
+
+		if (!source.is_open())
+		{
+			throw std::runtime_error("Failed to open " + path.string() + "!");
+		}
+
+		std::vector<uint8_t> buffer(static_cast<size_t>(source.tellg()));
+
+		source.seekg(0);
+		source.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+
+		return buffer;
+	}
+
+	void load_obj(const fs::path& path, std::vector<baked_vertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		tinyobj::attrib_t attrib;
+		std::vector<tinyobj::shape_t> shapes;
+		std::vector<tinyobj::material_t> materials;
+		std::string warn, err;
+
+		if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.string().c_str()))
+		{
+			throw std::runtime_error("Failed to load " + path.string() + ": " + warn + err);
+		}
+
+		vertices.clear();
+		indices.clear();
+
+		std::unordered_map<baked_vertex, uint32_t, baked_vertex_hash> unique;
+
+		for (const auto& shape : shapes)
+		{
+			for (const auto& index : shape.mesh.indices)
+			{
+				baked_vertex v{};
+
+				v.position[0] = attrib.vertices[3 * index.vertex_index + 0];
+				v.position[1] = attrib.vertices[3 * index.vertex_index + 1];
+				v.position[2] = attrib.vertices[3 * index.vertex_index + 2];
+
+				v.color[0] = v.color[1] = v.color[2] = 1.f;
+
+				if (index.texcoord_index >= 0)
+				{
+					// obj puts the origin of the texture at the bottom left, vulkan at the top left
+					v.tex_coord[0] = attrib.texcoords[2 * index.texcoord_index + 0];
+					v.tex_coord[1] = 1.f - attrib.texcoords[2 * index.texcoord_index + 1];
+				}
+
+				if (index.normal_index >= 0)
+				{
+					v.normal[0] = attrib.normals[3 * index.normal_index + 0];
+					v.normal[1] = attrib.normals[3 * index.normal_index + 1];
+					v.normal[2] = attrib.normals[3 * index.normal_index + 2];
+				}
+
+				auto found = unique.find(v);
+
+				if (unique.end() == found)
+				{
+					found = unique.emplace(v, static_cast<uint32_t>(vertices.size())).first;
+					vertices.push_back(v);
+				}
+
+				indices.push_back(found->second);
+			}
+		}
+	}
+
+	/*
+	Parsing .obj text and welding duplicate vertices is by far the most expensive part of loading a
+	model, so it happens here once instead of at every startup. The runtime gets a ready-to-upload
+	vertex and index stream, already ordered for the vertex cache.
+	*/
+	std::vector<uint8_t> bake_obj(const fs::path& path, const bake_options& opts)
+	{
+		std::vector<baked_vertex> vertices;
+		std::vector<uint32_t> indices;
+
+		load_obj(path, vertices, indices);
+
+		auto lods = opts.lods ? build_lods(path.generic_string(), vertices, std::move(indices)) :
+			std::vector<baked_lod>{ { std::move(indices), 0.f, {} } };
+
+		optimize_mesh(path.generic_string(), vertices, lods, opts);
+
+		indices.clear();
+
+		std::vector<sandbox::asset::mesh_meshlet> meshlets;
+
+		sandbox::asset::mesh_header header{};
+		header.lod_count = static_cast<uint32_t>(lods.size());
+
+		for (size_t i = 0; i < lods.size(); i++)
+		{
+			header.lods[i].first_index = static_cast<uint32_t>(indices.size());
+			header.lods[i].index_count = static_cast<uint32_t>(lods[i].indices.size());
+			header.lods[i].error = lods[i].error;
+			header.lods[i].first_meshlet = static_cast<uint32_t>(meshlets.size());
+			header.lods[i].meshlet_count = static_cast<uint32_t>(lods[i].meshlets.size());
+
+			for (const auto& m : lods[i].meshlets)
+			{
+				sandbox::asset::mesh_meshlet baked{};
+				memcpy(baked.center, m.center, sizeof(baked.center));
+				baked.radius = m.radius;
+				memcpy(baked.cone_axis, m.cone_axis, sizeof(baked.cone_axis));
+				baked.cone_cutoff = m.cone_cutoff;
+				baked.first_index = header.lods[i].first_index + m.first_index;
+				baked.index_count = m.index_count;
+
+				meshlets.push_back(baked);
+			}
+
+			indices.insert(indices.end(), lods[i].indices.begin(), lods[i].indices.end());
+		}
+
+		auto align = [](uint64_t size)
+		{
+			return (size + sandbox::asset::entry_alignment - 1) & ~(sandbox::asset::entry_alignment - 1);
+		};
+
+		header.vertex_count = static_cast<uint32_t>(vertices.size());
+		header.index_count = static_cast<uint32_t>(indices.size());
+		header.vertex_stride = sizeof(baked_vertex);
+		header.index_size = sizeof(uint32_t);
+		header.vertex_offset = align(sizeof(header));
+		header.index_offset = header.vertex_offset + align(vertices.size() * sizeof(baked_vertex));
+		header.meshlet_offset = header.index_offset + align(indices.size() * sizeof(uint32_t));
+		header.meshlet_count = static_cast<uint32_t>(meshlets.size());
+
+		std::vector<uint8_t> blob(static_cast<size_t>(header.meshlet_offset + meshlets.size() * sizeof(meshlets[0])));
+		memcpy(blob.data(), &header, sizeof(header));
+		memcpy(blob.data() + header.vertex_offset, vertices.data(), vertices.size() * sizeof(baked_vertex));
+		memcpy(blob.data() + header.index_offset, indices.data(), indices.size() * sizeof(uint32_t));
+
+		if (!meshlets.empty())
+		{
+			memcpy(blob.data() + header.meshlet_offset, meshlets.data(), meshlets.size() * sizeof(meshlets[0]));
+		}
+
+		std::cout << '\t' << path.generic_string() << ": " << header.vertex_count << " vertices, "
+			<< header.lods[0].index_count / 3 << " triangles, " << header.lod_count << " LODs, "
+			<< header.meshlet_count << " meshlets\n";
+
+		return blob;
+	}
+
+	void benchmark(const std::vector<fs::path>& inputs)
+	{
+		bake_options opts;
+		opts.overdraw = true;
+
+		std::vector<baked_vertex> vertices;
+		std::vector<uint32_t> indices;
+
+		auto run_obj = [&](const fs::path& p)
+		{
+			if (".obj" == p.extension())
+			{
+				load_obj(p, vertices, indices);
+
+				auto lods = build_lods(p.filename().string(), vertices, indices);
+				optimize_mesh(p.filename().string(), vertices, lods, opts);
+			}
+		};
+
+		for (const auto& in : inputs)
+		{
+			if (fs::is_directory(in))
+			{
+				for (const auto& e : fs::recursive_directory_iterator(in))
+				{
+					if (e.is_regular_file())
+						run_obj(e.path());
+				}
+			}
+			else
+			{
+				run_obj(in);
+			}
+		}
+
+		for (uint32_t rings : { 64u, 256u, 1024u })
+		{
+			stress_mesh(rings, 2 * rings, vertices, indices);
+
+			std::vector<baked_lod> lods = { { indices, 0.f, {} } };
+			optimize_mesh("sphere " + std::to_string(rings) + "x" + std::to_string(2 * rings), vertices, lods, opts);
+		}
+	}
+}
+
+auto main(int argc, char** argv) -> int
+{
+	std::string output = "assets.pak";
+	bool compress = false;
+	bool bench = false;
+	packer::bake_options bake;
+	std::vector<fs::path> inputs;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+
+		if ("-o" == arg && i + 1 < argc)
+		{
+			output = argv[++i];
+		}
+		else if ("--lz4" == arg)
+		{
+			compress = true;
+		}
+		else if ("--no-optimize" == arg)
+		{
+			bake.optimize = false;
+		}
+		else if ("--overdraw" == arg)
+		{
+			bake.overdraw = true;
+		}
+		else if ("--no-lod" == arg)
+		{
+			bake.lods = false;
+		}
+		else if ("--no-meshlets" == arg)
+		{
+			bake.meshlets = false;
+		}
+		else if ("--bench" == arg)
+		{
+			bench = true;
+		}
+		else
+		{
+			inputs.emplace_back(arg);
+		}
+	}
+
+	if (inputs.empty())
+	{
+		std::cerr << "usage: asset_packer [-o assets.pak] [--lz4] [--no-optimize] [--overdraw] [--no-lod] [--no-meshlets] [--bench] <file or directory>...\n"
+			"entries are named by their path relative to the working directory\n"
+			"--bench optimizes the .obj inputs and generated stress meshes without writing a pack\n";
+		return EXIT_FAILURE;
+	}
+
+	try
+	{
+		if (bench)
+		{
+			packer::benchmark(inputs);
+			return EXIT_SUCCESS;
+		}
+
+		sandbox::asset::pack_writer writer;
+
+		auto add_file = [&](const fs::path& p)
+		{
+			// names match the relative paths the sandbox used to open as loose files
+			std::string name = p.lexically_normal().generic_string();
+
+			if (".obj" == p.extension())
+			{
+				writer.add(name, packer::bake_obj(p, bake), compress);
+			}
+			else
+			{
+				writer.add(name, packer::read_file(p), compress);
+			}
+		};
+
+		for (const auto& in : inputs)
+		{
+			if (fs::is_directory(in))
+			{
+				for (const auto& e : fs::recursive_directory_iterator(in))
+				{
+					if (e.is_regular_file())
+						add_file(e.path());
+				}
+			}
+			else
+			{
+				add_file(in);
+			}
+		}
+
+		writer.write(output);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
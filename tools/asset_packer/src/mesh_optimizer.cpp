@@ -0,0 +1,357 @@
+#include "mesh_optimizer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+namespace packer
+{
+	namespace mesh
+	{
+		cache_stats analyze_vertex_cache(const std::vector<uint32_t>& indices, size_t vertex_count, uint32_t cache_size)
+		{
+			cache_stats stats{};
+
+			if (indices.empty() || 0 == vertex_count)
+				return stats;
+
+			/*
+			A FIFO cache holds the last cache_size misses, so a vertex is still cached when fewer than cache_size
+			misses happened since its own. Hits do not refresh the entry, unlike an LRU.
+			*/
+			std::vector<uint64_t> stamp(vertex_count, 0);
+			uint64_t time = cache_size;
+			uint64_t misses = 0;
+
+			for (uint32_t v : indices)
+			{
+				if (time - stamp[v] >= cache_size)
+				{
+					stamp[v] = time++;
+					misses++;
+				}
+			}
+
+			stats.acmr = static_cast<double>(misses) / static_cast<double>(indices.size() / 3);
+			stats.atvr = static_cast<double>(misses) / static_cast<double>(vertex_count);
+
+			return stats;
+		}
+
+		/*
+		Tipsify fans around one vertex at a time, emitting all of its remaining triangles, then moves on to the
+		neighbour that has the fewest triangles left and entered the cache earliest without having dropped out of it.
+		When no neighbour qualifies it backtracks through the recently used vertices, and only when those are all
+		finished does it jump to an unrelated part of the mesh. Those jumps start a new cluster.
+		*/
+		std::vector<uint32_t> optimize_vertex_cache(const std::vector<uint32_t>& indices, size_t vertex_count,
+			uint32_t cache_size, std::vector<uint32_t>* cluster_starts)
+		{
+			const size_t triangle_count = indices.size() / 3;
+
+			// triangles around every vertex, in one array indexed by offsets
+			std::vector<uint32_t> live(vertex_count, 0);
+
+			for (uint32_t v : indices)
+			{
+				live[v]++;
+			}
+
+			std::vector<uint32_t> offsets(vertex_count + 1, 0);
+
+			for (size_t v = 0; v < vertex_count; v++)
+			{
+				offsets[v + 1] = offsets[v] + live[v];
+			}
+
+			std::vector<uint32_t> adjacency(indices.size());
+			std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+
+			for (size_t t = 0; t < triangle_count; t++)
+			{
+				for (size_t k = 0; k < 3; k++)
+				{
+					adjacency[fill[indices[3 * t + k]]++] = static_cast<uint32_t>(t);
+				}
+			}
+
+			std::vector<uint32_t> stamp(vertex_count, 0);
+			std::vector<bool> emitted(triangle_count, false);
+			std::vector<uint32_t> dead_end;
+			std::vector<uint32_t> candidates;
+			std::vector<uint32_t> out;
+
+			dead_end.reserve(indices.size());
+			out.reserve(indices.size());
+
+			uint32_t time = cache_size + 1;
+			uint32_t cursor = 0;
+
+			if (cluster_starts)
+			{
+				cluster_starts->clear();
+			}
+
+			auto skip_dead_end = [&]() -> uint32_t
+			{
+				while (!dead_end.empty())
+				{
+					const uint32_t v = dead_end.back();
+					dead_end.pop_back();
+
+					if (live[v] > 0)
+						return v;
+				}
+
+				// nothing recently used is left, whatever comes next shares no vertices with the cache
+				while (cursor < vertex_count)
+				{
+					const uint32_t v = cursor++;
+
+					if (live[v] > 0)
+					{
+						if (cluster_starts)
+						{
+							cluster_starts->push_back(static_cast<uint32_t>(out.size() / 3));
+						}
+
+						return v;
+					}
+				}
+
+				return ~0u;
+			};
+
+			uint32_t fanning = skip_dead_end();
+
+			while (~0u != fanning)
+			{
+				candidates.clear();
+
+				for (uint32_t a = offsets[fanning]; a < offsets[fanning + 1]; a++)
+				{
+					const uint32_t t = adjacency[a];
+
+					if (emitted[t])
+						continue;
+
+					emitted[t] = true;
+
+					for (size_t k = 0; k < 3; k++)
+					{
+						const uint32_t v = indices[3 * t + k];
+
+						out.push_back(v);
+						dead_end.push_back(v);
+						candidates.push_back(v);
+
+						live[v]--;
+
+						if (time - stamp[v] > cache_size)
+						{
+							stamp[v] = time++;
+						}
+					}
+				}
+
+				// prefer the oldest candidate that will still be cached once its own fan has been emitted
+				uint32_t best = ~0u;
+				int64_t best_priority = -1;
+
+				for (uint32_t v : candidates)
+				{
+					if (0 == live[v])
+						continue;
+
+					int64_t priority = 0;
+
+					if (time - stamp[v] + 2 * live[v] <= cache_size)
+					{
+						priority = time - stamp[v];
+					}
+
+					if (priority > best_priority)
+					{
+						best_priority = priority;
+						best = v;
+					}
+				}
+
+				fanning = ~0u == best ? skip_dead_end() : best;
+			}
+
+			return out;
+		}
+
+		/*
+		Sander et al.'s view independent ordering. Clusters are split further wherever restarting with an empty
+		cache costs at most cache_penalty over the mesh's ACMR, then sorted so the clusters that face away from the
+		mesh centre, and so tend to occlude the rest from any viewpoint, are drawn first. The triangle order inside a
+		cluster is left as Tipsify made it.
+		*/
+		void optimize_overdraw(std::vector<uint32_t>& indices, const std::vector<uint32_t>& cluster_starts,
+			const void* vertices, size_t vertex_count, size_t vertex_stride)
+		{
+			constexpr double cache_penalty = 1.05;
+
+			const uint32_t triangle_count = static_cast<uint32_t>(indices.size() / 3);
+
+			if (0 == triangle_count || cluster_starts.empty())
+				return;
+
+			const double split_acmr = cache_penalty * analyze_vertex_cache(indices, vertex_count).acmr;
+
+			// soft boundaries inside the hard ones
+			std::vector<uint32_t> starts;
+			std::vector<uint64_t> stamp(vertex_count, 0);
+			uint64_t time = default_cache_size;
+
+			for (size_t c = 0; c < cluster_starts.size(); c++)
+			{
+				const uint32_t end = c + 1 < cluster_starts.size() ? cluster_starts[c + 1] : triangle_count;
+
+				uint32_t start = cluster_starts[c];
+				uint64_t misses = 0;
+
+				starts.push_back(start);
+
+				// an empty cache at every cluster start, which is what a sorted cluster will see
+				time += default_cache_size;
+
+				for (uint32_t t = start; t < end; t++)
+				{
+					for (size_t k = 0; k < 3; k++)
+					{
+						const uint32_t v = indices[3 * t + k];
+
+						if (time - stamp[v] >= default_cache_size)
+						{
+							stamp[v] = time++;
+							misses++;
+						}
+					}
+
+					const uint32_t emitted = t + 1 - start;
+
+					if (t + 1 < end && static_cast<double>(misses) / emitted <= split_acmr)
+					{
+						start = t + 1;
+						misses = 0;
+						time += default_cache_size;
+
+						starts.push_back(start);
+					}
+				}
+			}
+
+			auto position = [vertices, vertex_stride](uint32_t v)
+			{
+				float p[3];
+				memcpy(p, static_cast<const uint8_t*>(vertices) + v * vertex_stride, sizeof(p));
+
+				return std::array<double, 3>{ p[0], p[1], p[2] };
+			};
+
+			struct cluster
+			{
+				uint32_t				first;
+				uint32_t				count;
+				std::array<double, 3>	centroid{};
+				std::array<double, 3>	normal{};
+				double					area{ 0.0 };
+				double					sort_key{ 0.0 };
+			};
+
+			std::vector<cluster> clusters(starts.size());
+			std::array<double, 3> mesh_centroid{};
+			double mesh_area = 0.0;
+
+			for (size_t c = 0; c < starts.size(); c++)
+			{
+				auto& cl = clusters[c];
+				cl.first = starts[c];
+				cl.count = (c + 1 < starts.size() ? starts[c + 1] : triangle_count) - cl.first;
+
+				for (uint32_t t = cl.first; t < cl.first + cl.count; t++)
+				{
+					const auto a = position(indices[3 * t + 0]);
+					const auto b = position(indices[3 * t + 1]);
+					const auto d = position(indices[3 * t + 2]);
+
+					const std::array<double, 3> e0 = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+					const std::array<double, 3> e1 = { d[0] - a[0], d[1] - a[1], d[2] - a[2] };
+
+					// the cross product's length is twice the area, so summing it area weights the normal
+					const std::array<double, 3> n = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2],
+						e0[0] * e1[1] - e0[1] * e1[0] };
+
+					const double area = 0.5 * std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+					for (size_t k = 0; k < 3; k++)
+					{
+						cl.centroid[k] += area * (a[k] + b[k] + d[k]) / 3.0;
+						cl.normal[k] += n[k];
+					}
+
+					cl.area += area;
+				}
+
+				for (size_t k = 0; k < 3; k++)
+				{
+					mesh_centroid[k] += cl.centroid[k];
+				}
+
+				mesh_area += cl.area;
+			}
+
+			for (auto& cl : clusters)
+			{
+				if (cl.area <= 0.0 || mesh_area <= 0.0)
+					continue;
+
+				const double length = std::sqrt(cl.normal[0] * cl.normal[0] + cl.normal[1] * cl.normal[1] +
+					cl.normal[2] * cl.normal[2]);
+
+				if (0.0 == length)
+					continue;
+
+				for (size_t k = 0; k < 3; k++)
+				{
+					cl.sort_key += (cl.centroid[k] / cl.area - mesh_centroid[k] / mesh_area) * cl.normal[k] / length;
+				}
+			}
+
+			std::stable_sort(clusters.begin(), clusters.end(),
+				[](const cluster& a, const cluster& b) { return a.sort_key > b.sort_key; });
+
+			std::vector<uint32_t> sorted;
+			sorted.reserve(indices.size());
+
+			for (const auto& cl : clusters)
+			{
+				sorted.insert(sorted.end(), indices.begin() + 3 * size_t(cl.first), indices.begin() + 3 * size_t(cl.first + cl.count));
+			}
+
+			indices.swap(sorted);
+		}
+
+		std::vector<uint32_t> vertex_fetch_remap(std::vector<uint32_t>& indices, size_t vertex_count)
+		{
+			std::vector<uint32_t> remap(vertex_count, ~0u);
+			uint32_t next = 0;
+
+			for (auto& v : indices)
+			{
+				if (~0u == remap[v])
+				{
+					remap[v] = next++;
+				}
+
+				v = remap[v];
+			}
+
+			return remap;
+		}
+	}
+}
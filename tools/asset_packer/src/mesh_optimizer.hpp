@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace packer
+{
+	/*
+	Index buffer optimization for baked meshes. As authored, triangles come in whatever order the modelling
+	tool wrote them, which wastes the post-transform vertex cache and fetches vertices all over the buffer.
+	The passes run in this order:
+
+		optimize_vertex_cache	Tipsify (Sander, Nehab and Barczak 2007) reorders triangles so vertices are
+								reused while they are still in the cache. Linear in the triangle count.
+		optimize_overdraw		optionally sorts the clusters Tipsify produced so that outward facing parts
+								of the mesh are drawn first, trading a little cache efficiency for less overdraw.
+		optimize_vertex_fetch	renumbers vertices in order of first use, so fetches walk the vertex buffer
+								front to back.
+
+	Every pass keeps the triangle list valid on its own, they can be run or skipped independently.
+	*/
+	namespace mesh
+	{
+		// the cache size Tipsify targets and the analysis simulates, a conservative guess for current GPUs
+		constexpr uint32_t default_cache_size = 16;
+
+		struct cache_stats
+		{
+			double	acmr{ 0.0 };	// average cache miss ratio, transformed vertices per triangle, 0.5 is the ideal for a grid
+			double	atvr{ 0.0 };	// average transform to vertex ratio, 1.0 means every vertex is transformed once
+		};
+
+		// simulates a FIFO post-transform cache over the index buffer
+		cache_stats analyze_vertex_cache(const std::vector<uint32_t>& indices, size_t vertex_count,
+			uint32_t cache_size = default_cache_size);
+
+		// cluster_starts, when given, receives the first triangle of every cluster for optimize_overdraw
+		std::vector<uint32_t> optimize_vertex_cache(const std::vector<uint32_t>& indices, size_t vertex_count,
+			uint32_t cache_size = default_cache_size, std::vector<uint32_t>* cluster_starts = nullptr);
+
+		// positions are three floats at the start of every vertex_stride bytes
+		void optimize_overdraw(std::vector<uint32_t>& indices, const std::vector<uint32_t>& cluster_starts,
+			const void* vertices, size_t vertex_count, size_t vertex_stride);
+
+		// rewrites indices in order of first use and returns the new index of every old vertex, ~0u for unused ones
+		std::vector<uint32_t> vertex_fetch_remap(std::vector<uint32_t>& indices, size_t vertex_count);
+
+		template<typename V>
+		void optimize_vertex_fetch(std::vector<V>& vertices, std::vector<uint32_t>& indices)
+		{
+			const auto remap = vertex_fetch_remap(indices, vertices.size());
+
+			std::vector<V> reordered;
+			reordered.reserve(vertices.size());
+
+			for (size_t v = 0; v < vertices.size(); v++)
+			{
+				if (~0u == remap[v])
+					continue;
+
+				if (reordered.size() <= remap[v])
+					reordered.resize(remap[v] + 1);
+
+				reordered[remap[v]] = vertices[v];
+			}
+
+			vertices.swap(reordered);
+		}
+	}
+}
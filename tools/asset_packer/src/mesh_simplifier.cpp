@@ -0,0 +1,410 @@
+#include "mesh_simplifier.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+
+namespace packer
+{
+	namespace mesh
+	{
+		namespace
+		{
+			using vec3 = std::array<double, 3>;
+
+			vec3 sub(const vec3& a, const vec3& b) { return { a[0] - b[0], a[1] - b[1], a[2] - b[2] }; }
+
+			vec3 cross(const vec3& a, const vec3& b)
+			{
+				return { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+			}
+
+			double dot(const vec3& a, const vec3& b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+
+			// sum of squared distances to a set of planes, each weighted by the area of the triangle it came from
+			struct quadric
+			{
+				double a00{ 0 }, a01{ 0 }, a02{ 0 }, a03{ 0 };
+				double a11{ 0 }, a12{ 0 }, a13{ 0 };
+				double a22{ 0 }, a23{ 0 };
+				double a33{ 0 };
+				double weight{ 0 };
+
+				void add_plane(const vec3& n, double d, double w)
+				{
+					a00 += w * n[0] * n[0]; a01 += w * n[0] * n[1]; a02 += w * n[0] * n[2]; a03 += w * n[0] * d;
+					a11 += w * n[1] * n[1]; a12 += w * n[1] * n[2]; a13 += w * n[1] * d;
+					a22 += w * n[2] * n[2]; a23 += w * n[2] * d;
+					a33 += w * d * d;
+					weight += w;
+				}
+
+				quadric& operator+=(const quadric& o)
+				{
+					a00 += o.a00; a01 += o.a01; a02 += o.a02; a03 += o.a03;
+					a11 += o.a11; a12 += o.a12; a13 += o.a13;
+					a22 += o.a22; a23 += o.a23;
+					a33 += o.a33;
+					weight += o.weight;
+
+					return *this;
+				}
+
+				double evaluate(const vec3& p) const
+				{
+					const double x = p[0], y = p[1], z = p[2];
+
+					const double e = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x +
+						a11 * y * y + 2 * a12 * y * z + 2 * a13 * y +
+						a22 * z * z + 2 * a23 * z + a33;
+
+					return std::max(e, 0.0);
+				}
+			};
+
+			struct collapse
+			{
+				double		cost;
+				uint32_t	from;
+				uint32_t	to;
+				uint32_t	from_version;
+				uint32_t	to_version;
+
+				bool operator>(const collapse& o) const { return cost > o.cost; }
+			};
+		}
+
+		std::vector<uint32_t> simplify(const std::vector<uint32_t>& indices, const void* vertices, size_t vertex_count,
+			size_t vertex_stride, size_t target_index_count, float& error)
+		{
+			const size_t triangle_count = indices.size() / 3;
+
+			// weld by position, vertices that only differ in attributes are one point of the surface
+			std::vector<uint32_t> position_of(vertex_count, ~0u);
+			std::vector<vec3> positions;
+
+			{
+				struct key_hash
+				{
+					size_t operator()(const std::array<float, 3>& k) const
+					{
+						uint32_t b[3];
+						memcpy(b, k.data(), sizeof(b));
+
+						return (size_t(b[0]) * 73856093u) ^ (size_t(b[1]) * 19349663u) ^ (size_t(b[2]) * 83492791u);
+					}
+				};
+
+				std::unordered_map<std::array<float, 3>, uint32_t, key_hash> welded;
+
+				for (size_t v = 0; v < vertex_count; v++)
+				{
+					std::array<float, 3> p;
+					memcpy(p.data(), static_cast<const uint8_t*>(vertices) + v * vertex_stride, sizeof(p));
+
+					auto found = welded.emplace(p, static_cast<uint32_t>(positions.size()));
+
+					if (found.second)
+					{
+						positions.push_back({ p[0], p[1], p[2] });
+					}
+
+					position_of[v] = found.first->second;
+				}
+			}
+
+			const size_t position_count = positions.size();
+
+			std::vector<std::array<uint32_t, 3>> triangles(triangle_count);
+			std::vector<bool> alive(triangle_count, true);
+			std::vector<std::vector<uint32_t>> around(position_count);
+			std::vector<quadric> quadrics(position_count);
+
+			size_t live_indices = indices.size();
+
+			for (size_t t = 0; t < triangle_count; t++)
+			{
+				triangles[t] = { indices[3 * t + 0], indices[3 * t + 1], indices[3 * t + 2] };
+
+				const vec3& a = positions[position_of[triangles[t][0]]];
+				const vec3& b = positions[position_of[triangles[t][1]]];
+				const vec3& c = positions[position_of[triangles[t][2]]];
+
+				vec3 n = cross(sub(b, a), sub(c, a));
+				const double length = std::sqrt(dot(n, n));
+
+				for (uint32_t v : triangles[t])
+				{
+					around[position_of[v]].push_back(static_cast<uint32_t>(t));
+				}
+
+				if (0.0 == length)
+					continue;
+
+				n = { n[0] / length, n[1] / length, n[2] / length };
+
+				for (uint32_t v : triangles[t])
+				{
+					quadrics[position_of[v]].add_plane(n, -dot(n, a), 0.5 * length);
+				}
+			}
+
+			std::vector<bool> removed(position_count, false);
+			std::vector<uint32_t> version(position_count, 0);
+
+			std::priority_queue<collapse, std::vector<collapse>, std::greater<collapse>> heap;
+
+			auto cost = [&](uint32_t from, uint32_t to)
+			{
+				quadric q = quadrics[from];
+				q += quadrics[to];
+
+				return q.weight > 0.0 ? q.evaluate(positions[to]) / q.weight : 0.0;
+			};
+
+			auto push_edges = [&](uint32_t p)
+			{
+				for (uint32_t t : around[p])
+				{
+					if (!alive[t])
+						continue;
+
+					for (uint32_t v : triangles[t])
+					{
+						const uint32_t q = position_of[v];
+
+						if (q == p)
+							continue;
+
+						heap.push({ cost(p, q), p, q, version[p], version[q] });
+						heap.push({ cost(q, p), q, p, version[q], version[p] });
+					}
+				}
+			};
+
+			for (uint32_t p = 0; p < position_count; p++)
+			{
+				push_edges(p);
+			}
+
+			// scratch, reused by every collapse
+			std::unordered_map<uint32_t, uint32_t> edge_use;
+			std::unordered_map<uint32_t, uint32_t> wedge_map;
+			std::vector<uint32_t> neighbours_to;
+
+			auto corner = [&](uint32_t t, uint32_t p) -> int
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					if (position_of[triangles[t][k]] == p)
+						return k;
+				}
+
+				return -1;
+			};
+
+			auto valid = [&](const collapse& c)
+			{
+				const uint32_t u = c.from, v = c.to;
+
+				// how many live triangles use every edge out of u
+				edge_use.clear();
+
+				for (uint32_t t : around[u])
+				{
+					if (!alive[t])
+						continue;
+
+					for (uint32_t w : triangles[t])
+					{
+						if (position_of[w] != u)
+							edge_use[position_of[w]]++;
+					}
+				}
+
+				auto shared = edge_use.find(v);
+
+				if (edge_use.end() == shared || shared->second > 2)
+					return false;
+
+				// a border vertex may only slide along its border
+				const bool u_border = std::any_of(edge_use.begin(), edge_use.end(), [](const auto& e) { return 1 == e.second; });
+
+				if (u_border && 1 != shared->second)
+					return false;
+
+				// link condition, u and v may only share the neighbours across their common triangles
+				neighbours_to.clear();
+
+				for (uint32_t t : around[v])
+				{
+					if (!alive[t])
+						continue;
+
+					for (uint32_t w : triangles[t])
+					{
+						if (position_of[w] != v)
+							neighbours_to.push_back(position_of[w]);
+					}
+				}
+
+				std::sort(neighbours_to.begin(), neighbours_to.end());
+				neighbours_to.erase(std::unique(neighbours_to.begin(), neighbours_to.end()), neighbours_to.end());
+
+				uint32_t common = 0;
+
+				for (const auto& e : edge_use)
+				{
+					if (std::binary_search(neighbours_to.begin(), neighbours_to.end(), e.first))
+						common++;
+				}
+
+				if (common != shared->second)
+					return false;
+
+				// every vertex at u needs a partner at v on its own side of any seam
+				wedge_map.clear();
+
+				for (uint32_t t : around[u])
+				{
+					if (!alive[t])
+						continue;
+
+					const int cu = corner(t, u), cv = corner(t, v);
+
+					if (cv < 0)
+						continue;
+
+					auto mapped = wedge_map.emplace(triangles[t][cu], triangles[t][cv]);
+
+					if (!mapped.second && mapped.first->second != triangles[t][cv])
+						return false;
+				}
+
+				for (uint32_t t : around[u])
+				{
+					if (!alive[t])
+						continue;
+
+					const int cu = corner(t, u);
+
+					if (corner(t, v) < 0 && wedge_map.end() == wedge_map.find(triangles[t][cu]))
+						return false;
+				}
+
+				// no triangle that survives may turn over
+				for (uint32_t t : around[u])
+				{
+					if (!alive[t] || corner(t, v) >= 0)
+						continue;
+
+					vec3 p[3], q[3];
+
+					for (int k = 0; k < 3; k++)
+					{
+						const uint32_t pk = position_of[triangles[t][k]];
+
+						p[k] = positions[pk];
+						q[k] = pk == u ? positions[v] : positions[pk];
+					}
+
+					const vec3 before = cross(sub(p[1], p[0]), sub(p[2], p[0]));
+					const vec3 after = cross(sub(q[1], q[0]), sub(q[2], q[0]));
+
+					if (dot(before, after) <= 0.0)
+						return false;
+				}
+
+				return true;
+			};
+
+			double worst = static_cast<double>(error) * static_cast<double>(error);
+
+			while (live_indices > target_index_count && !heap.empty())
+			{
+				const collapse c = heap.top();
+				heap.pop();
+
+				if (removed[c.from] || removed[c.to] || version[c.from] != c.from_version || version[c.to] != c.to_version)
+					continue;
+
+				// rejected collapses come back with fresh costs once their neighbourhood changes
+				if (!valid(c))
+					continue;
+
+				for (uint32_t t : around[c.from])
+				{
+					if (!alive[t])
+						continue;
+
+					if (corner(t, c.to) >= 0)
+					{
+						alive[t] = false;
+						live_indices -= 3;
+						continue;
+					}
+
+					auto& w = triangles[t][corner(t, c.from)];
+					w = wedge_map[w];
+
+					around[c.to].push_back(t);
+				}
+
+				removed[c.from] = true;
+				quadrics[c.to] += quadrics[c.from];
+				version[c.to]++;
+
+				around[c.from].clear();
+
+				// drop the triangles that died so the neighbourhood walks stay short
+				auto& list = around[c.to];
+				list.erase(std::remove_if(list.begin(), list.end(), [&](uint32_t t) { return !alive[t]; }), list.end());
+
+				worst = std::max(worst, c.cost);
+
+				// v's quadric changed and its neighbours' links did, everything queued for them is stale
+				neighbours_to.clear();
+
+				for (uint32_t t : around[c.to])
+				{
+					for (uint32_t w : triangles[t])
+					{
+						neighbours_to.push_back(position_of[w]);
+					}
+				}
+
+				std::sort(neighbours_to.begin(), neighbours_to.end());
+				neighbours_to.erase(std::unique(neighbours_to.begin(), neighbours_to.end()), neighbours_to.end());
+
+				for (uint32_t p : neighbours_to)
+				{
+					version[p]++;
+				}
+
+				for (uint32_t p : neighbours_to)
+				{
+					push_edges(p);
+				}
+			}
+
+			error = static_cast<float>(std::sqrt(worst));
+
+			std::vector<uint32_t> out;
+			out.reserve(live_indices);
+
+			for (size_t t = 0; t < triangle_count; t++)
+			{
+				if (alive[t])
+				{
+					out.insert(out.end(), triangles[t].begin(), triangles[t].end());
+				}
+			}
+
+			return out;
+		}
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace packer
+{
+	namespace mesh
+	{
+		/*
+		Quadric error metric simplification (Garland and Heckbert 1997) restricted to half edge collapses, so every
+		LOD is an index list into the same vertex buffer as the full mesh. Collapses happen between positions;
+		the vertices that share a position on a UV seam move together, and a collapse that would tear a seam,
+		fold a triangle over, pull in a border or pinch the surface into a non manifold edge is rejected.
+
+		Stops at target_index_count or when nothing collapses any more. error comes in as the error of the input
+		and leaves as the largest RMS distance, in model units, any collapse so far moved the surface.
+		*/
+		std::vector<uint32_t> simplify(const std::vector<uint32_t>& indices, const void* vertices, size_t vertex_count,
+			size_t vertex_stride, size_t target_index_count, float& error);
+	}
+}
@@ -0,0 +1,345 @@
+#include "meshlet_builder.hpp"
+#include "mesh_optimizer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace packer
+{
+	namespace mesh
+	{
+		std::vector<meshlet> build_meshlets(std::vector<uint32_t>& indices, const void* vertices, size_t vertex_count,
+			size_t vertex_stride)
+		{
+			const size_t triangle_count = indices.size() / 3;
+
+			auto position = [vertices, vertex_stride](uint32_t v)
+			{
+				float p[3];
+				memcpy(p, static_cast<const uint8_t*>(vertices) + v * vertex_stride, sizeof(p));
+
+				return std::array<double, 3>{ p[0], p[1], p[2] };
+			};
+
+			// unit normals, zero for degenerate triangles so they never widen a cone
+			std::vector<std::array<double, 3>> normals(triangle_count);
+
+			for (size_t t = 0; t < triangle_count; t++)
+			{
+				const auto a = position(indices[3 * t + 0]);
+				const auto b = position(indices[3 * t + 1]);
+				const auto c = position(indices[3 * t + 2]);
+
+				const std::array<double, 3> e0 = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+				const std::array<double, 3> e1 = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+				const std::array<double, 3> n = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2],
+					e0[0] * e1[1] - e0[1] * e1[0] };
+
+				const double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+				if (length > 0.0)
+				{
+					normals[t] = { n[0] / length, n[1] / length, n[2] / length };
+				}
+			}
+
+			/*
+			Neighbours are found through positions rather than vertices, otherwise every UV seam would end a
+			meshlet early. The vertex limit still counts vertices, a seam costs what it costs.
+			*/
+			std::vector<uint32_t> position_of(vertex_count);
+			size_t position_count = 0;
+
+			{
+				struct key_hash
+				{
+					size_t operator()(const std::array<float, 3>& k) const
+					{
+						uint32_t b[3];
+						memcpy(b, k.data(), sizeof(b));
+
+						return (size_t(b[0]) * 73856093u) ^ (size_t(b[1]) * 19349663u) ^ (size_t(b[2]) * 83492791u);
+					}
+				};
+
+				std::unordered_map<std::array<float, 3>, uint32_t, key_hash> welded;
+
+				for (size_t v = 0; v < vertex_count; v++)
+				{
+					std::array<float, 3> p;
+					memcpy(p.data(), static_cast<const uint8_t*>(vertices) + v * vertex_stride, sizeof(p));
+
+					position_of[v] = welded.emplace(p, static_cast<uint32_t>(welded.size())).first->second;
+				}
+
+				position_count = welded.size();
+			}
+
+			// triangles around every position, in one array indexed by offsets
+			std::vector<uint32_t> offsets(position_count + 1, 0);
+
+			for (uint32_t v : indices)
+			{
+				offsets[position_of[v] + 1]++;
+			}
+
+			for (size_t p = 0; p < position_count; p++)
+			{
+				offsets[p + 1] += offsets[p];
+			}
+
+			std::vector<uint32_t> adjacency(indices.size());
+			std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+
+			for (size_t t = 0; t < triangle_count; t++)
+			{
+				for (size_t k = 0; k < 3; k++)
+				{
+					adjacency[fill[position_of[indices[3 * t + k]]]++] = static_cast<uint32_t>(t);
+				}
+			}
+
+			// stamped with the meshlet being built, so nothing has to be cleared between meshlets
+			std::vector<uint32_t> owner(vertex_count, ~0u);
+			std::vector<uint32_t> queued(triangle_count, ~0u);
+			std::vector<bool> emitted(triangle_count, false);
+
+			std::vector<uint32_t> local_vertices;
+			std::vector<uint32_t> local_triangles;
+			std::vector<uint32_t> candidates;
+
+			std::vector<uint32_t> out;
+			std::vector<meshlet> meshlets;
+
+			out.reserve(indices.size());
+
+			size_t cursor = 0;
+
+			while (true)
+			{
+				while (cursor < triangle_count && emitted[cursor])
+					cursor++;
+
+				if (cursor == triangle_count)
+					break;
+
+				const uint32_t id = static_cast<uint32_t>(meshlets.size());
+				std::array<double, 3> facing{};
+				std::array<double, 3> lo{}, hi{};
+
+				local_vertices.clear();
+				local_triangles.clear();
+				candidates.clear();
+
+				auto new_vertices = [&](uint32_t t)
+				{
+					uint32_t count = 0;
+
+					for (size_t k = 0; k < 3; k++)
+					{
+						if (id != owner[indices[3 * t + k]])
+							count++;
+					}
+
+					return count;
+				};
+
+				auto take = [&](uint32_t t)
+				{
+					emitted[t] = true;
+					local_triangles.push_back(t);
+
+					for (size_t k = 0; k < 3; k++)
+					{
+						facing[k] += normals[t][k];
+
+						const uint32_t v = indices[3 * t + k];
+
+						if (id == owner[v])
+							continue;
+
+						owner[v] = id;
+						local_vertices.push_back(v);
+
+						const auto pos = position(v);
+
+						for (size_t j = 0; j < 3; j++)
+						{
+							lo[j] = 1 == local_vertices.size() ? pos[j] : std::min(lo[j], pos[j]);
+							hi[j] = 1 == local_vertices.size() ? pos[j] : std::max(hi[j], pos[j]);
+						}
+
+						const uint32_t p = position_of[v];
+
+						for (uint32_t a = offsets[p]; a < offsets[p + 1]; a++)
+						{
+							const uint32_t n = adjacency[a];
+
+							if (!emitted[n] && id != queued[n])
+							{
+								queued[n] = id;
+								candidates.push_back(n);
+							}
+						}
+					}
+				};
+
+				take(static_cast<uint32_t>(cursor));
+
+				while (local_triangles.size() < max_meshlet_triangles)
+				{
+					const double length = std::sqrt(facing[0] * facing[0] + facing[1] * facing[1] + facing[2] * facing[2]);
+
+					uint32_t best = ~0u;
+					double best_cost = 0.0;
+					size_t kept = 0;
+
+					for (size_t c = 0; c < candidates.size(); c++)
+					{
+						const uint32_t t = candidates[c];
+
+						if (emitted[t])
+							continue;
+
+						candidates[kept++] = t;
+
+						const uint32_t added = new_vertices(t);
+
+						if (local_vertices.size() + added > max_meshlet_vertices)
+							continue;
+
+						// a shared vertex always wins, the facing only breaks ties
+						const double alignment = length > 0.0 ? (normals[t][0] * facing[0] + normals[t][1] * facing[1] +
+							normals[t][2] * facing[2]) / length : 1.0;
+						const double cost = added + 0.25 * (1.0 - alignment);
+
+						if (~0u == best || cost < best_cost)
+						{
+							best = t;
+							best_cost = cost;
+						}
+					}
+
+					candidates.resize(kept);
+
+					/*
+					Nothing adjacent fits, which on meshes made of many small parts happens long before either limit.
+					The next triangle in the input order is usually close by, take it if it is no further away than
+					the meshlet is large, otherwise the bounds would grow too loose to cull with.
+					*/
+					while (cursor < triangle_count && emitted[cursor])
+						cursor++;
+
+					if (~0u == best && cursor < triangle_count &&
+						local_vertices.size() + new_vertices(static_cast<uint32_t>(cursor)) <= max_meshlet_vertices)
+					{
+						double extent = 0.0, gap = 0.0;
+
+						for (size_t j = 0; j < 3; j++)
+						{
+							const double c = (position(indices[3 * cursor + 0])[j] + position(indices[3 * cursor + 1])[j] +
+								position(indices[3 * cursor + 2])[j]) / 3.0;
+
+							extent = std::max(extent, hi[j] - lo[j]);
+							gap = std::max(gap, std::max(lo[j] - c, c - hi[j]));
+						}
+
+						if (gap <= extent)
+						{
+							best = static_cast<uint32_t>(cursor);
+						}
+					}
+
+					if (~0u == best)
+						break;
+
+					take(best);
+				}
+
+				// the cache order inside the meshlet, on local indices so the pass only ever sees 64 vertices
+				std::vector<uint32_t> local;
+				local.reserve(3 * local_triangles.size());
+
+				for (uint32_t t : local_triangles)
+				{
+					for (size_t k = 0; k < 3; k++)
+					{
+						const uint32_t v = indices[3 * t + k];
+
+						local.push_back(static_cast<uint32_t>(std::find(local_vertices.begin(), local_vertices.end(), v) -
+							local_vertices.begin()));
+					}
+				}
+
+				local = optimize_vertex_cache(local, local_vertices.size());
+
+				meshlet m{};
+				m.first_index = static_cast<uint32_t>(out.size());
+				m.index_count = static_cast<uint32_t>(local.size());
+				m.vertex_count = static_cast<uint32_t>(local_vertices.size());
+
+				for (uint32_t v : local)
+				{
+					out.push_back(local_vertices[v]);
+				}
+
+				// a sphere around the box, like the runtime's object bounds
+				double radius = 0.0;
+
+				for (uint32_t v : local_vertices)
+				{
+					const auto p = position(v);
+					double d = 0.0;
+
+					for (size_t k = 0; k < 3; k++)
+					{
+						const double e = p[k] - 0.5 * (lo[k] + hi[k]);
+						d += e * e;
+					}
+
+					radius = std::max(radius, std::sqrt(d));
+				}
+
+				for (size_t k = 0; k < 3; k++)
+				{
+					m.center[k] = static_cast<float>(0.5 * (lo[k] + hi[k]));
+				}
+
+				m.radius = static_cast<float>(radius);
+
+				/*
+				Every normal lies within the cone around the axis. If it is narrower than a hemisphere, the whole
+				meshlet faces away from any eye that sees the cone's back side, with the bounding sphere standing in
+				for the triangle positions (Wihlidal 2016).
+				*/
+				const double length = std::sqrt(facing[0] * facing[0] + facing[1] * facing[1] + facing[2] * facing[2]);
+				double min_dot = length > 0.0 ? 1.0 : -1.0;
+
+				for (uint32_t t : local_triangles)
+				{
+					if (0.0 == normals[t][0] && 0.0 == normals[t][1] && 0.0 == normals[t][2])
+						continue;
+
+					min_dot = std::min(min_dot, (normals[t][0] * facing[0] + normals[t][1] * facing[1] +
+						normals[t][2] * facing[2]) / length);
+				}
+
+				for (size_t k = 0; k < 3; k++)
+				{
+					m.cone_axis[k] = length > 0.0 ? static_cast<float>(facing[k] / length) : 0.f;
+				}
+
+				m.cone_cutoff = min_dot > 0.0 ? static_cast<float>(std::sqrt(1.0 - min_dot * min_dot)) : 1.f;
+
+				meshlets.push_back(m);
+			}
+
+			indices.swap(out);
+
+			return meshlets;
+		}
+	}
+}
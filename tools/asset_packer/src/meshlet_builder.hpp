@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace packer
+{
+	namespace mesh
+	{
+		// the limits mesh shading hardware is built around, so the same clusters would feed a mesh shader
+		constexpr uint32_t max_meshlet_vertices = 64;
+		constexpr uint32_t max_meshlet_triangles = 124;
+
+		struct meshlet
+		{
+			uint32_t	first_index;		// into the index list the meshlets were built from
+			uint32_t	index_count;
+			uint32_t	vertex_count;
+			float		center[3];			// bounding sphere
+			float		radius;
+			float		cone_axis[3];		// average facing of the triangles
+			float		cone_cutoff;		// sine of the cone's half angle, 1 when the cluster faces too many ways to cull
+		};
+
+		/*
+		Greedy clustering. A meshlet starts at the first triangle not yet taken, in the order the list already
+		has, and grows by the neighbouring triangle that adds the fewest new vertices, ties going to the one that
+		faces most like the meshlet so far. That keeps the normal cones narrow enough to cull. A meshlet closes
+		at either limit or when nothing adjacent fits.
+
+		indices is rewritten so every meshlet is a contiguous range, with the triangles inside each reordered
+		for the vertex cache. Positions are three floats at the start of every vertex_stride bytes.
+		*/
+		std::vector<meshlet> build_meshlets(std::vector<uint32_t>& indices, const void* vertices, size_t vertex_count,
+			size_t vertex_stride);
+	}
+}
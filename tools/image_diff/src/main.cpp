@@ -0,0 +1,222 @@
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace diff
+{
+	// exit codes, so a CI step can tell a regression from a broken run
+	constexpr int images_match = 0;
+	constexpr int images_differ = 1;
+	constexpr int diff_failed = 2;
+
+	struct image
+	{
+		int						width{ 0 };
+		int						height{ 0 };
+		std::vector<uint8_t>	rgb;
+	};
+
+	struct compare_options
+	{
+		int		tolerance{ 2 };			// largest per channel difference that still counts as equal
+		double	max_percent{ 0.0 };		// share of pixels allowed to differ by more than that
+	};
+
+	struct result
+	{
+		size_t	pixels{ 0 };
+		size_t	differing{ 0 };
+		int		max_difference{ 0 };
+		double	mean_difference{ 0.0 };		// over all channels of all pixels
+		double	psnr{ 0.0 };				// infinite for identical images
+	};
+
+	// whatever the file holds is compared as RGB, the sandbox's captures have no alpha
+	image load(const std::string& path)
+	{
+		image img;
+		int channels = 0;
+
+		stbi_uc* pixels = stbi_load(path.c_str(), &img.width, &img.height, &channels, 3);
+
+		if (nullptr == pixels)
+		{
+			throw std::runtime_error("Failed to load " + path + ": " + stbi_failure_reason() + "!");
+		}
+
+		img.rgb.assign(pixels, pixels + static_cast<size_t>(img.width) * img.height * 3);
+
+		stbi_image_free(pixels);
+
+		return img;
+	}
+
+	/*
+	A pixel differs when any of its channels is further off than the tolerance. Driver and hardware changes shift
+	rounding in blending, filtering and FXAA by a step or two, which a small tolerance absorbs; a regression
+	moves far more than that, or moves a little over a large area, which the pixel share catches.
+	*/
+	result compare(const image& reference, const image& candidate, const compare_options& options, image* heat_map)
+	{
+		result r;
+		r.pixels = static_cast<size_t>(reference.width) * reference.height;
+
+		if (heat_map)
+		{
+			heat_map->width = reference.width;
+			heat_map->height = reference.height;
+			heat_map->rgb.resize(reference.rgb.size());
+		}
+
+		uint64_t sum = 0;
+		uint64_t sum_sq = 0;
+
+		for (size_t i = 0; i < r.pixels; i++)
+		{
+			const uint8_t* a = &reference.rgb[i * 3];
+			const uint8_t* b = &candidate.rgb[i * 3];
+
+			int pixel_max = 0;
+
+			for (int c = 0; c < 3; c++)
+			{
+				const int d = std::abs(static_cast<int>(a[c]) - static_cast<int>(b[c]));
+
+				pixel_max = std::max(pixel_max, d);
+				sum += d;
+				sum_sq += static_cast<uint64_t>(d) * d;
+			}
+
+			r.max_difference = std::max(r.max_difference, pixel_max);
+
+			const bool differs = pixel_max > options.tolerance;
+
+			if (differs)
+				r.differing++;
+
+			// differing pixels in red, scaled up so small errors show, the rest a dimmed grey of the reference
+			if (heat_map)
+			{
+				uint8_t* out = &heat_map->rgb[i * 3];
+
+				if (differs)
+				{
+					out[0] = static_cast<uint8_t>(std::min(255, 64 + pixel_max * 4));
+					out[1] = 0;
+					out[2] = 0;
+				}
+				else
+				{
+					const uint8_t grey = static_cast<uint8_t>((a[0] * 77 + a[1] * 150 + a[2] * 29) >> 10);
+
+					out[0] = grey;
+					out[1] = grey;
+					out[2] = grey;
+				}
+			}
+		}
+
+		const double samples = static_cast<double>(std::max<size_t>(r.pixels * 3, 1));
+
+		r.mean_difference = static_cast<double>(sum) / samples;
+
+		const double mse = static_cast<double>(sum_sq) / samples;
+		r.psnr = 0.0 == mse ? INFINITY : 10.0 * std::log10(255.0 * 255.0 / mse);
+
+		return r;
+	}
+
+	double differing_percent(const result& r)
+	{
+		return 100.0 * static_cast<double>(r.differing) / static_cast<double>(std::max<size_t>(r.pixels, 1));
+	}
+}
+
+auto main(int argc, char** argv) -> int
+{
+	diff::compare_options options;
+	std::string heat_map_path;
+	std::vector<std::string> inputs;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+
+		if ("--tolerance" == arg && i + 1 < argc)
+		{
+			options.tolerance = std::clamp(std::atoi(argv[++i]), 0, 255);
+		}
+		else if ("--max-percent" == arg && i + 1 < argc)
+		{
+			options.max_percent = std::clamp(std::atof(argv[++i]), 0.0, 100.0);
+		}
+		else if ("-o" == arg && i + 1 < argc)
+		{
+			heat_map_path = argv[++i];
+		}
+		else
+		{
+			inputs.push_back(arg);
+		}
+	}
+
+	if (2 != inputs.size())
+	{
+		std::cerr << "usage: image_diff [--tolerance N] [--max-percent P] [-o diff.png] <reference> <candidate>\n"
+			"a pixel differs when a channel is more than N (default 2) off, the images match while at most P percent\n"
+			"(default 0) of the pixels differ; exits with 0 when they match, 1 when they do not and 2 on errors\n";
+		return diff::diff_failed;
+	}
+
+	try
+	{
+		const diff::image reference = diff::load(inputs[0]);
+		const diff::image candidate = diff::load(inputs[1]);
+
+		if (reference.width != candidate.width || reference.height != candidate.height)
+		{
+			std::cout << "FAIL: " << inputs[1] << " is " << candidate.width << 'x' << candidate.height << ", "
+				<< inputs[0] << " is " << reference.width << 'x' << reference.height << '\n';
+			return diff::images_differ;
+		}
+
+		diff::image heat_map;
+		const diff::result r = diff::compare(reference, candidate, options, heat_map_path.empty() ? nullptr : &heat_map);
+
+		const double percent = diff::differing_percent(r);
+		const bool match = percent <= options.max_percent;
+
+		std::cout << (match ? "PASS: " : "FAIL: ") << r.differing << " of " << r.pixels << " pixels ("
+			<< std::fixed << std::setprecision(3) << percent << "%) differ by more than " << options.tolerance
+			<< ", " << options.max_percent << "% allowed; largest difference " << r.max_difference << ", mean "
+			<< r.mean_difference << ", PSNR " << std::setprecision(2) << r.psnr << " dB\n";
+
+		if (!heat_map_path.empty())
+		{
+			if (0 == stbi_write_png(heat_map_path.c_str(), heat_map.width, heat_map.height, 3, heat_map.rgb.data(),
+				heat_map.width * 3))
+			{
+				throw std::runtime_error("Failed to write " + heat_map_path + "!");
+			}
+		}
+
+		return match ? diff::images_match : diff::images_differ;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return diff::diff_failed;
+	}
+}